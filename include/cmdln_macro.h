@@ -124,7 +124,31 @@
 { "-pl_pbeam",                                                          \
       ARG_FLOAT64,                                                      \
       "1e-5",                                                           \
-      "Beam width applied to phone loop transitions for lookahead" }
+      "Beam width applied to phone loop transitions for lookahead" },   \
+{ "-pl_pair",                                                           \
+      ARG_BOOLEAN,                                                      \
+      "no",                                                             \
+      "Use phone-pair bounds over the whole window for lookahead" },    \
+{ "-vad",                                                               \
+      ARG_BOOLEAN,                                                      \
+      "no",                                                             \
+      "Detect the start and end of speech in the decoder" },            \
+{ "-vad_autoend",                                                       \
+      ARG_BOOLEAN,                                                      \
+      "no",                                                             \
+      "End the utterance automatically at the end of speech" },         \
+{ "-vad_prespeech",                                                     \
+      ARG_INT32,                                                        \
+      "10",                                                             \
+      "Frames of speech needed to detect the start of speech" },        \
+{ "-vad_postspeech",                                                    \
+      ARG_INT32,                                                        \
+      "50",                                                             \
+      "Frames of silence needed to detect the end of speech" },         \
+{ "-vad_threshold",                                                     \
+      ARG_FLOAT32,                                                      \
+      "2.0",                                                            \
+      "Energy (C0) above the noise floor needed for speech" }
 
 /** Options defining other parameters for tuning the search. */
 #define POCKETSPHINX_SEARCH_OPTIONS \
@@ -136,6 +160,10 @@
       ARG_BOOLEAN,                                                                              \
       "yes",                                                                                    \
       "Run forward lexicon-tree search (1st pass)" },                                           \
+{ "-fwdskip",                                                                                   \
+      ARG_INT32,                                                                                \
+      "1",                                                                                      \
+      "Advance the lexicon-tree search once every N frames, on pooled senone scores" },         \
 { "-fwdflat",                                                                                   \
       ARG_BOOLEAN,                                                                              \
       "yes",                                                                                    \
@@ -160,6 +188,10 @@
       ARG_INT32,                                                                                \
       "-1",                                                                                     \
       "Maximum number of active HMMs to maintain at each frame (or -1 for no pruning)" },       \
+{ "-rtf",                                                                                       \
+      ARG_FLOAT32,                                                                              \
+      "0",                                                                                      \
+      "Target real-time factor; beams are narrowed adaptively to keep up (or 0 to disable)" },  \
 { "-min_endfr",                                                                                 \
       ARG_INT32,                                                                                \
       "0",                                                                                      \
@@ -171,7 +203,31 @@
 { "-fwdflatsfwin",                                                                              \
       ARG_INT32,                                                                                \
       "25",                                                                    	                \
-      "Window of frames in lattice to search for successor words in fwdflat search " }
+      "Window of frames in lattice to search for successor words in fwdflat search " },         \
+{ "-fwdflatlag",                                                                                \
+      ARG_INT32,                                                                                \
+      "0",                                                                                      \
+      "Run fwdflat search during the utterance, at most this many frames behind fwdtree (or 0 to disable)" }, \
+{ "-fwdflatthread",                                                                             \
+      ARG_BOOLEAN,                                                                              \
+      "no",                                                                                     \
+      "Run the incremental fwdflat search (see -fwdflatlag) on a separate thread" },            \
+{ "-nbestmaxpath",                                                                              \
+      ARG_INT32,                                                                                \
+      "500",                                                                                    \
+      "Maximum number of partial paths kept in N-best search (or -1 for no limit)" },           \
+{ "-nbestmaxpop",                                                                               \
+      ARG_INT32,                                                                                \
+      "10000",                                                                                  \
+      "Maximum number of partial paths expanded in N-best search (or -1 for no limit)" },       \
+{ "-nbestuniq",                                                                                 \
+      ARG_BOOLEAN,                                                                              \
+      "no",                                                                                     \
+      "Suppress N-best hypotheses with the same word sequence as an earlier one" },             \
+{ "-aligncheckpoint",                                                                           \
+      ARG_INT32,                                                                                \
+      "0",                                                                                      \
+      "Keep state alignment backpointers only for this many frames at a time, recomputing the rest at the end of the utterance (0 to keep all)" }
 
 /** Command-line options for finite state grammars. */
 #define POCKETSPHINX_FSG_OPTIONS \
@@ -194,7 +250,15 @@
 { "-fsgusefiller",                                              \
         ARG_BOOLEAN,                                            \
         "yes",                                                  \
-        "Insert filler words at each state."}
+        "Insert filler words at each state."},                  \
+{ "-fsgopt",                                                    \
+        ARG_BOOLEAN,                                            \
+        "yes",                                                  \
+        "Remove null transitions from and minimize FSGs"},      \
+{ "-fsgcache",                                                  \
+        ARG_INT32,                                              \
+        "8192",                                                 \
+        "Memory (in KiB) for keeping compiled grammars to switch between"}
 
 /** Command-line options for statistical language models. */
 #define POCKETSPHINX_NGRAM_OPTIONS \
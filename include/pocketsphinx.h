@@ -273,7 +273,8 @@ fsg_set_t *ps_update_fsgset(ps_decoder_t *ps);
  * @param fdictfile Path to filler dictionary to load, or NULL to keep
  *                  the existing filler dictionary.
  * @param format Format of the dictionary file, or NULL to determine
- *               automatically (currently unused,should be NULL)
+ *               automatically (binary dictionaries are detected
+ *               from their header)
  */
 POCKETSPHINX_EXPORT
 int ps_load_dict(ps_decoder_t *ps, char const *dictfile,
@@ -286,7 +287,9 @@ int ps_load_dict(ps_decoder_t *ps, char const *dictfile,
  *
  * @param dictfile Path to file where dictionary will be written.
  * @param format Format of the dictionary file, or NULL for the
- *               default (text) format (currently unused, should be NULL)
+ *               default (text) format.  "bin" writes a binary
+ *               dictionary, including fillers, which can be
+ *               memory-mapped by ps_load_dict() or -dict.
  */
 POCKETSPHINX_EXPORT
 int ps_save_dict(ps_decoder_t *ps, char const *dictfile, char const *format);
@@ -427,6 +430,51 @@ int ps_process_cep(ps_decoder_t *ps,
 POCKETSPHINX_EXPORT
 int ps_get_n_frames(ps_decoder_t *ps);
 
+/**
+ * States of the endpointer.
+ */
+typedef enum ps_vad_state_e {
+    PS_VAD_SILENCE, /**< No speech has been detected yet. */
+    PS_VAD_SPEECH,  /**< Speech is in progress. */
+    PS_VAD_ENDED    /**< Speech has been followed by enough silence. */
+} ps_vad_state_t;
+
+/**
+ * Get the state of the endpointer in the current utterance.
+ *
+ * If the decoder was configured with <tt>-vad yes</tt>, each frame is
+ * classified as speech or not, according to whether a silence or
+ * noise phone is the best one in the phone loop search and whether
+ * its energy is far enough above the noise floor.  The main search
+ * only starts at the first frame of speech, so frame numbers in the
+ * results count from there (see ps_get_vad_offset()).  With <tt>-vad_autoend yes</tt>,
+ * ps_end_utt() is called as soon as the end of speech is detected,
+ * the rest of the data in that call is ignored, as is any further
+ * data until ps_start_utt() is called again.  Otherwise, speech can
+ * start again after it has ended.
+ *
+ * @param ps Decoder.
+ * @return Current state, which is always PS_VAD_SPEECH if the
+ *         endpointer is not enabled.
+ */
+POCKETSPHINX_EXPORT
+ps_vad_state_t ps_get_vad_state(ps_decoder_t *ps);
+
+/**
+ * Get the number of frames the endpointer dropped from the start of
+ * the current (or most recent) utterance.
+ *
+ * Frame numbers from ps_seg_frames(), lattices and alignments count
+ * from the first frame of speech, so this must be added to them to
+ * find the corresponding frame of the audio that was passed in.
+ *
+ * @param ps Decoder.
+ * @return Number of frames of silence dropped, which is always 0 if
+ *         the endpointer is not enabled.
+ */
+POCKETSPHINX_EXPORT
+int ps_get_vad_offset(ps_decoder_t *ps);
+
 /**
  * End utterance processing.
  *
@@ -436,6 +484,48 @@ int ps_get_n_frames(ps_decoder_t *ps);
 POCKETSPHINX_EXPORT
 int ps_end_utt(ps_decoder_t *ps);
 
+/**
+ * Save the state of the decoder to a file.
+ *
+ * Between utterances this is the cepstral mean normalization
+ * estimate, which is what carries over from one utterance to the
+ * next.  In the middle of an utterance it also includes the state of
+ * the acoustic model (buffered features and senone scores) and of the
+ * search: its active HMMs and the backpointer table of words found so
+ * far.  Its size therefore depends on how much of the search is
+ * active rather than on the length of the utterance, except that the
+ * second pass of <tt>-fwdflat</tt> needs all the features of the
+ * utterance.  Only the N-Gram tree search without
+ * <tt>-fwdflatlag</tt> can be saved in the middle of an utterance;
+ * finite state grammars and state alignment cannot.  Audio passed to
+ * ps_process_raw() which has not yet made up a full frame is not
+ * included, nor is any state of automatic gain control.
+ *
+ * @param ps Decoder.
+ * @param fh File to write the snapshot to.
+ * @return 0 for success, <0 on error.
+ */
+POCKETSPHINX_EXPORT
+int ps_snapshot(ps_decoder_t *ps, FILE *fh);
+
+/**
+ * Restore the state of the decoder from a file written by ps_snapshot().
+ *
+ * The decoder must have the same configuration, models, dictionary
+ * and language model as the one the snapshot was taken from.  Any
+ * utterance in progress is abandoned.  If the snapshot was taken in
+ * the middle of an utterance, decoding can then continue with the
+ * rest of its data, giving the same results as if it had not been
+ * interrupted.  Decoding with <tt>-rtf</tt> depends on timing, so it
+ * will not be reproduced exactly after that point.
+ *
+ * @param ps Decoder.
+ * @param fh File to read the snapshot from.
+ * @return 0 for success, <0 on error.
+ */
+POCKETSPHINX_EXPORT
+int ps_restore(ps_decoder_t *ps, FILE *fh);
+
 /**
  * Get hypothesis string and path score.
  *
@@ -86,6 +86,10 @@ struct ps_decoder_s;
 /**
  * Read a lattice from a file on disk.
  *
+ * Both the Sphinx-III text format and the binary format written by
+ * ps_lattice_write_bin() are accepted; the format is detected
+ * automatically.
+ *
  * @param ps Decoder to use for processing this lattice, or NULL.
  * @param file Path to lattice file.
  * @return Newly created lattice, or NULL for failure.
@@ -130,6 +134,18 @@ int ps_lattice_write(ps_lattice_t *dag, char const *filename);
 POCKETSPHINX_EXPORT
 int ps_lattice_write_htk(ps_lattice_t *dag, char const *filename);
 
+/**
+ * Write a lattice to disk in compact binary format.
+ *
+ * Binary lattices are much smaller and faster to read than the text
+ * formats.  They can be read back with ps_lattice_read(), which will
+ * memory-map them if the <tt>-mmap</tt> option is enabled.
+ *
+ * @return 0 for success, <0 on failure.
+ */
+POCKETSPHINX_EXPORT
+int ps_lattice_write_bin(ps_lattice_t *dag, char const *filename);
+
 /**
  * Get the log-math computation object for this lattice
  *
@@ -29,7 +29,19 @@ cdef extern from "stdio.h":
 
 cdef extern from "Python.h":
     FILE *PyFile_AsFile(object p)
+    void PyFile_IncUseCount(object p)
+    void PyFile_DecUseCount(object p)
     int PyString_AsStringAndSize(object p, char **buf, Py_ssize_t *len) except -1
+    # New and old style buffer interfaces, so that audio can be passed
+    # without copying from anything that exports its memory.
+    ctypedef struct Py_buffer:
+        void *buf
+        Py_ssize_t len
+    int PyBUF_SIMPLE
+    int PyObject_CheckBuffer(object p)
+    int PyObject_GetBuffer(object p, Py_buffer *view, int flags) except -1
+    void PyBuffer_Release(Py_buffer *view)
+    int PyObject_AsReadBuffer(object p, void **buf, Py_ssize_t *len) except -1
 
 # Don't rely on having PyGTK actually installed
 cdef extern from "bogus_pygobject.h":
@@ -51,10 +63,11 @@ cdef extern from "ps_lattice.h":
     ctypedef struct ps_latlink_iter_t
     ctypedef struct ps_decoder_t
 
-    ps_lattice_t *ps_lattice_read(ps_decoder_t *ps, char *file)
+    ps_lattice_t *ps_lattice_read(ps_decoder_t *ps, char *file) nogil
     ps_lattice_t *ps_lattice_retain(ps_lattice_t *dag)
     int ps_lattice_free(ps_lattice_t *dag)
-    int ps_lattice_write(ps_lattice_t *dag, char *filename)
+    int ps_lattice_write(ps_lattice_t *dag, char *filename) nogil
+    int ps_lattice_write_bin(ps_lattice_t *dag, char *filename) nogil
     logmath_t *ps_lattice_get_logmath(ps_lattice_t *dag)
     ps_latnode_iter_t *ps_latnode_iter(ps_lattice_t *dag)
     ps_latnode_iter_t *ps_latnode_iter_next(ps_latnode_iter_t *itor)
@@ -84,8 +97,8 @@ cdef extern from "ps_lattice.h":
                                            ps_latnode_t *end)
     ps_latlink_t *ps_lattice_reverse_next(ps_lattice_t *dag, ps_latnode_t *start)
     ps_latlink_t *ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
-                                      float lwf, float ascale)
-    int ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset, float ascale)
+                                      float lwf, float ascale) nogil
+    int ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset, float ascale) nogil
     int ps_lattice_n_frames(ps_lattice_t *dag)
 
 cdef extern from "pocketsphinx.h":
@@ -109,15 +122,15 @@ cdef extern from "pocketsphinx.h":
     int ps_save_dict(ps_decoder_t *ps, char *dictfile, char *format)
     int ps_add_word(ps_decoder_t *ps, char *word, char *phones, int update)
     int ps_decode_raw(ps_decoder_t *ps, FILE *rawfh,
-                      char *uttid, long maxsamps)
-    int ps_decode_senscr(ps_decoder_t *ps, FILE *senfh, char *uttid)
+                      char *uttid, long maxsamps) nogil
+    int ps_decode_senscr(ps_decoder_t *ps, FILE *senfh, char *uttid) nogil
     int ps_start_utt(ps_decoder_t *ps, char *uttid)
     int ps_process_raw(ps_decoder_t *ps, raw_data_ptr data, size_t n_samples,
-                       int no_search, int full_utt)
-    int ps_end_utt(ps_decoder_t *ps)
+                       int no_search, int full_utt) nogil
+    int ps_end_utt(ps_decoder_t *ps) nogil
     const_char_ptr ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score, const_char_ptr_ptr out_uttid)
     int32 ps_get_prob(ps_decoder_t *ps, const_char_ptr_ptr out_uttid)
-    ps_lattice_t *ps_get_lattice(ps_decoder_t *ps)
+    ps_lattice_t *ps_get_lattice(ps_decoder_t *ps) nogil
     ps_seg_t *ps_seg_iter(ps_decoder_t *ps, int32 *out_best_score)
     ps_seg_t *ps_seg_next(ps_seg_t *seg)
     char *ps_seg_word(ps_seg_t *seg)
@@ -239,7 +239,7 @@ cdef class Lattice:
 
     @param ps: PocketSphinx decoder.
     @type ps: Decoder
-    @param latfile: Filename of lattice file to read.
+    @param latfile: Filename of lattice file to read (text or binary).
     @type latfile: str
     @param boxed: Boxed pointer from GStreamer containing a lattice
     @type boxed: PyGBoxed
@@ -259,10 +259,12 @@ cdef class Lattice:
             self.set_boxed(boxed)
 
     cdef read_dag(Lattice self, Decoder ps, latfile):
+        cdef ps_decoder_t *cps = NULL
+        cdef char *cfile = latfile
         if ps:
-            self.dag = ps_lattice_read(ps.ps, latfile)
-        else:
-            self.dag = ps_lattice_read(NULL, latfile)
+            cps = ps.ps
+        with nogil:
+            self.dag = ps_lattice_read(cps, cfile)
         self.n_frames = ps_lattice_n_frames(self.dag)
         if self.dag == NULL:
             raise RuntimeError, "Failed to read lattice from %s" % latfile
@@ -308,8 +310,10 @@ cdef class Lattice:
         @rtype: LatLink
         """
         cdef ps_latlink_t *end
+        cdef ngram_model_t *lm = lmset.lm
         cdef LatLink link
-        end = ps_lattice_bestpath(self.dag, lmset.lm, lwf, ascale)
+        with nogil:
+            end = ps_lattice_bestpath(self.dag, lm, lwf, ascale)
         link = LatLink()
         link.set_link(self.dag, end)
         return link
@@ -331,9 +335,12 @@ cdef class Lattice:
         @rtype: float
         """
         cdef logmath_t *lmath
+        cdef ngram_model_t *lm = lmset.lm
+        cdef int post
         lmath = ps_lattice_get_logmath(self.dag)
-        return sb.logmath_log_to_ln(lmath,
-                                    ps_lattice_posterior(self.dag, lmset.lm, ascale))
+        with nogil:
+            post = ps_lattice_posterior(self.dag, lm, ascale)
+        return sb.logmath_log_to_ln(lmath, post)
 
     def nodes(self, start=0, end=-1):
         """
@@ -363,8 +370,28 @@ cdef class Lattice:
         @type outfile: str        
         """
         cdef int rv
+        cdef char *cfile = outfile
+
+        with nogil:
+            rv = ps_lattice_write(self.dag, cfile)
+        if rv < 0:
+            raise RuntimeError, "Failed to write lattice to %s" % outfile
+
+    def write_bin(self, outfile):
+        """
+        Write the lattice to an output file in compact binary format.
+
+        Binary lattice files can be read back by passing them as
+        C{latfile} to the constructor.
+
+        @param outfile: Name of file to write to.
+        @type outfile: str
+        """
+        cdef int rv
+        cdef char *cfile = outfile
 
-        rv = ps_lattice_write(self.dag, outfile)
+        with nogil:
+            rv = ps_lattice_write_bin(self.dag, cfile)
         if rv < 0:
             raise RuntimeError, "Failed to write lattice to %s" % outfile
 
@@ -446,6 +473,10 @@ cdef class Decoder:
     @type lm: str
     @param jsgf: Path to JSGF grammar file
     @type jsgf str
+
+    Decoding releases the Python global interpreter lock, so separate
+    Decoder objects can run in parallel in different threads.  A
+    single Decoder must not be used from more than one thread at once.
     """
     def __init__(self, **kwargs):
         cdef cmd_ln_t *config
@@ -504,6 +535,7 @@ cdef class Decoder:
         """
         cdef FILE *cfh
         cdef int nsamp
+        cdef long cmaxsamps = maxsamps
         cdef char *cuttid
 
         cfh = PyFile_AsFile(fh)
@@ -511,7 +543,12 @@ cdef class Decoder:
             cuttid = NULL
         else:
             cuttid = uttid
-        return ps_decode_raw(self.ps, cfh, cuttid, maxsamps)
+        # Keep other threads from closing the file while we read it
+        PyFile_IncUseCount(fh)
+        with nogil:
+            nsamp = ps_decode_raw(self.ps, cfh, cuttid, cmaxsamps)
+        PyFile_DecUseCount(fh)
+        return nsamp
 
     def decode_senscr(self, fh, uttid=None):
         """
@@ -523,6 +560,7 @@ cdef class Decoder:
         @type uttid: str
         """
         cdef FILE *cfh
+        cdef int nfr
         cdef char *cuttid
 
         cfh = PyFile_AsFile(fh)
@@ -530,7 +568,11 @@ cdef class Decoder:
             cuttid = NULL
         else:
             cuttid = uttid
-        return ps_decode_senscr(self.ps, cfh, cuttid)
+        PyFile_IncUseCount(fh)
+        with nogil:
+            nfr = ps_decode_senscr(self.ps, cfh, cuttid)
+        PyFile_DecUseCount(fh)
+        return nfr
 
     def start_utt(self, uttid=None):
         """
@@ -555,7 +597,10 @@ cdef class Decoder:
         @param data: Audio data to process.  This is packed binary
         data, which consists of single-channel, 16-bit PCM audio, at
         the sample rate specified when the decoder was initialized.
-        @type data: str
+        Any object supporting the buffer interface (str, bytearray,
+        memoryview, array.array, numpy arrays of int16) is accepted
+        and read in place without copying.
+        @type data: buffer
         @param no_search: Buffer the data without actually processing it (default is to process the
         data as it is received).
         @type no_search: bool
@@ -565,20 +610,38 @@ cdef class Decoder:
         the decoder.
         @type full_utt: bool
         """
+        cdef Py_buffer view
+        cdef void *buf
         cdef Py_ssize_t len
-        cdef char* strdata
-        cdef raw_data_ptr cdata
-        
-        PyString_AsStringAndSize(data, &strdata, &len)
-        cdata = strdata
-        if ps_process_raw(self.ps, cdata, len, no_search, full_utt) < 0:
+        cdef int cno_search = no_search
+        cdef int cfull_utt = full_utt
+        cdef int nfr, has_view
+
+        has_view = PyObject_CheckBuffer(data)
+        if has_view:
+            PyObject_GetBuffer(data, &view, PyBUF_SIMPLE)
+            buf = view.buf
+            len = view.len
+        else:
+            # Old-style buffers (array.array in Python 2, mostly)
+            PyObject_AsReadBuffer(data, &buf, &len)
+        len = len / 2
+        with nogil:
+            nfr = ps_process_raw(self.ps, <raw_data_ptr>buf, len,
+                                 cno_search, cfull_utt)
+        if has_view:
+            PyBuffer_Release(&view)
+        if nfr < 0:
             raise RuntimeError, "Failed to process %d samples of audio data" % len
 
     def ps_end_utt(self):
         """
         Finish processing an utterance.
         """
-        if ps_end_utt(self.ps) < 0:
+        cdef int rv
+        with nogil:
+            rv = ps_end_utt(self.ps)
+        if rv < 0:
             raise RuntimeError, "Failed to stop utterance processing"
 
     def get_hyp(self):
@@ -631,7 +694,8 @@ cdef class Decoder:
         cdef ps_lattice_t *dag
         cdef Lattice lat
 
-        dag = ps_get_lattice(self.ps)
+        with nogil:
+            dag = ps_get_lattice(self.ps)
         if dag == NULL:
             raise RuntimeError, "Failed to create word lattice"
         lat = Lattice()
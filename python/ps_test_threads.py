@@ -0,0 +1,39 @@
+#!/usr/bin/env python
+# -*- py-indent-offset: 4; indent-tabs-mode: nil; coding: utf-8 -*-
+
+# Decode the same utterance with one Decoder per thread, to check that
+# decoding runs in parallel with the interpreter lock released.
+
+import sys
+import time
+import threading
+import pocketsphinx as ps
+
+data = open("../test/data/goforward.raw", "rb").read()
+
+def worker(decoder, nutt):
+    buf = bytearray(data)
+    for i in xrange(nutt):
+        decoder.start_utt()
+        decoder.process_raw(memoryview(buf), False, True)
+        decoder.ps_end_utt()
+
+def run(nthreads, nutt):
+    decoders = [ps.Decoder() for i in xrange(nthreads)]
+    threads = [threading.Thread(target=worker, args=(d, nutt))
+               for d in decoders]
+    start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return time.time() - start
+
+nutt = 4
+base = run(1, nutt)
+print "1 thread: %.2f sec" % base
+for n in 2, 4:
+    if len(sys.argv) > 1 and n > int(sys.argv[1]):
+        break
+    elapsed = run(n, nutt)
+    print "%d threads: %.2f sec, speedup %.2f" % (n, elapsed, n * base / elapsed)
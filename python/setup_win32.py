@@ -5,6 +5,11 @@ except:
 
 import os
 
+# The pocketsphinx.c in the source tree is not kept up to date with
+# pocketsphinx.pyx, so regenerate it first with:
+#
+#   cython -I../../sphinxbase/python pocketsphinx.pyx
+
 sb_includes = ['../../sphinxbase/include', '../../sphinxbase/win32/include']
 sb_libdirs = ['../../sphinxbase/lib/debug']
 
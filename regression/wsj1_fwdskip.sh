@@ -0,0 +1,12 @@
+#!/bin/sh
+
+# Word error rate and speed of the tree search with -fwdskip 1 to 3.
+
+set -e
+
+decode=${1:-../src/programs/pocketsphinx_batch}
+
+for n in 1 2 3; do
+    echo "-fwdskip $n:"
+    ./wsj1_test5k_fast.sh fwdskip$n $decode -fwdskip $n
+done
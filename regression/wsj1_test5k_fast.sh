@@ -2,10 +2,13 @@
 
 expt=$1
 if [ x"$expt" = x ]; then
-    >&2 echo "Usage: $0 EXPTID [DECODER]"
+    >&2 echo "Usage: $0 EXPTID [DECODER [OPTIONS...]]"
     exit 1
 fi
 decode=${2:-../src/programs/pocketsphinx_batch}
+# Any further arguments are passed to the decoder.
+shift
+[ $# -gt 0 ] && shift
 
 # `dirname $decode`/../../libtool --mode=execute \
 #     valgrind --tool=massif \
@@ -23,6 +26,7 @@ $decode \
     -adcin yes -adchdr 1024 \
     -ctl wsj_test.fileids \
     -hyp $expt.hyp \
+    "$@" \
     > $expt.log 2>&1
 
 cat wsj_test.transcription | ./word_align.pl -i - $expt.hyp > $expt.align
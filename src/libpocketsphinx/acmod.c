@@ -60,6 +60,7 @@
 #include "s2_semi_mgau.h"
 #include "ptm_mgau.h"
 #include "ms_mgau.h"
+#include "snapshot.h"
 
 /* Feature and front-end parameters that may be in feat.params */
 static const arg_t feat_defn[] = {
@@ -73,6 +74,8 @@ static const arg_t feat_defn[] = {
 #endif
 
 static int32 acmod_process_mfcbuf(acmod_t *acmod);
+static int calc_feat_idx(acmod_t *acmod, int frame_idx);
+static void acmod_clear_senscr_hist(acmod_t *acmod);
 
 static int
 acmod_init_am(acmod_t *acmod)
@@ -286,8 +289,23 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb)
         ckd_calloc_2d(acmod->n_mfc_alloc, acmod->fcb->cepsize,
                       sizeof(**acmod->mfc_buf));
 
-    /* Feature buffer has to be at least as large as MFCC buffer. */
+    /* Feature buffer has to be at least as large as MFCC buffer, plus
+     * the lookahead window, the frames the endpointer looks back over
+     * to find the start of speech, and those the incremental fwdflat
+     * search has yet to score (with the lag raised as in
+     * ngram_search_init()). */
     acmod->n_feat_alloc = acmod->n_mfc_alloc + cmd_ln_int32_r(config, "-pl_window");
+    if (cmd_ln_boolean_r(config, "-vad"))
+        acmod->n_feat_alloc += cmd_ln_int32_r(config, "-vad_prespeech");
+    if (cmd_ln_boolean_r(config, "-fwdtree")
+        && cmd_ln_boolean_r(config, "-fwdflat")
+        && cmd_ln_int32_r(config, "-fwdflatlag") > 0) {
+        int32 lag = cmd_ln_int32_r(config, "-fwdflatsfwin")
+            + cmd_ln_int32_r(config, "-fwdflatefwid") + 1;
+        if (lag < cmd_ln_int32_r(config, "-fwdflatlag"))
+            lag = cmd_ln_int32_r(config, "-fwdflatlag");
+        acmod->n_feat_alloc += lag;
+    }
     acmod->feat_buf = feat_array_alloc(acmod->fcb, acmod->n_feat_alloc);
     acmod->framepos = ckd_calloc(acmod->n_feat_alloc, sizeof(*acmod->framepos));
 
@@ -297,8 +315,32 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb)
     acmod->senone_active_vec = bitvec_alloc(bin_mdef_n_sen(acmod->mdef));
     acmod->senone_active = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
                                                      sizeof(*acmod->senone_active));
+    acmod->ssid_active_vec = bitvec_alloc(bin_mdef_n_sseq(acmod->mdef));
+    acmod->ssid_active = ckd_calloc(bin_mdef_n_sseq(acmod->mdef),
+                                    sizeof(*acmod->ssid_active));
     acmod->log_zero = logmath_get_zero(acmod->lmath);
     acmod->compallsen = cmd_ln_boolean_r(config, "-compallsen");
+    acmod->log_energy = cmd_ln_boolean_r(config, "-vad");
+
+    /* Keep scores for the lookahead window so that the main search
+     * does not have to recompute them.  The endpointer's phone loop
+     * scores the same frame as the main search without one. */
+    if (cmd_ln_int32_r(config, "-pl_window") > 0
+        || cmd_ln_boolean_r(config, "-vad")) {
+        acmod->n_senscr_hist = cmd_ln_int32_r(config, "-pl_window") + 1;
+        acmod->senscr_hist = (int16 **)
+            ckd_calloc_2d(acmod->n_senscr_hist, bin_mdef_n_sen(acmod->mdef),
+                          sizeof(**acmod->senscr_hist));
+        acmod->senscr_hist_vec = (bitvec_t **)
+            ckd_calloc_2d(acmod->n_senscr_hist,
+                          bitvec_size(bin_mdef_n_sen(acmod->mdef)),
+                          sizeof(**acmod->senscr_hist_vec));
+        acmod->senscr_hist_frame = ckd_calloc(acmod->n_senscr_hist,
+                                              sizeof(*acmod->senscr_hist_frame));
+        acmod->senscr_hist_active = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
+                                               sizeof(*acmod->senscr_hist_active));
+        acmod_clear_senscr_hist(acmod);
+    }
     return acmod;
 
 error_out:
@@ -332,6 +374,15 @@ acmod_free(acmod_t *acmod)
     ckd_free(acmod->senone_scores);
     ckd_free(acmod->senone_active_vec);
     ckd_free(acmod->senone_active);
+    ckd_free(acmod->ssid_active_vec);
+    ckd_free(acmod->ssid_active);
+    if (acmod->senscr_hist)
+        ckd_free_2d((void **)acmod->senscr_hist);
+    if (acmod->senscr_hist_vec)
+        ckd_free_2d((void **)acmod->senscr_hist_vec);
+    ckd_free(acmod->senscr_hist_frame);
+    ckd_free(acmod->senscr_hist_active);
+    ckd_free(acmod->energy);
 
     if (acmod->mdef)
         bin_mdef_free(acmod->mdef);
@@ -352,6 +403,7 @@ acmod_update_mllr(acmod_t *acmod, ps_mllr_t *mllr)
         ps_mllr_free(acmod->mllr);
     acmod->mllr = mllr;
     ps_mgau_transform(acmod->mgau, mllr);
+    acmod_clear_senscr_hist(acmod);
 
     return mllr;
 }
@@ -364,7 +416,7 @@ acmod_write_senfh_header(acmod_t *acmod, FILE *logfh)
     sprintf(nsenstr, "%d", bin_mdef_n_sen(acmod->mdef));
     sprintf(logbasestr, "%f", logmath_get_base(acmod->lmath));
     return bio_writehdr(logfh,
-                        "version", "0.1",
+                        "version", "0.2",
                         "mdef_file", cmd_ln_str_r(acmod->config, "-mdef"),
                         "n_sen", nsenstr,
                         "logbase", logbasestr, NULL);
@@ -440,7 +492,12 @@ acmod_start_utt(acmod_t *acmod)
     acmod->output_frame = 0;
     acmod->senscr_frame = -1;
     acmod->n_senone_active = 0;
+    acmod->n_ssid_hmm = acmod->n_ssid_expand = 0;
     acmod->mgau->frame_idx = 0;
+    acmod->frame_offset = 0;
+    acmod->n_energy = 0;
+    acmod->energy_start = 0;
+    acmod_clear_senscr_hist(acmod);
     return 0;
 }
 
@@ -514,6 +571,48 @@ acmod_log_mfc(acmod_t *acmod,
     return 0;
 }
 
+/**
+ * Record the energy of each frame for the endpointer.
+ *
+ * Only frames from the current one onwards are kept, so this does not
+ * grow while waiting for speech.
+ */
+static void
+acmod_log_energy(acmod_t *acmod, mfcc_t **cep, int n_frames)
+{
+    int32 n_done;
+    int i;
+
+    if (!acmod->log_energy || n_frames <= 0)
+        return;
+
+    if (acmod->n_energy + n_frames > acmod->n_energy_alloc) {
+        /* Drop the frames already searched before growing. */
+        n_done = acmod->frame_offset + acmod->output_frame
+            - acmod->energy_start;
+        if (n_done > acmod->n_energy)
+            n_done = acmod->n_energy;
+        if (n_done > 0) {
+            memmove(acmod->energy, acmod->energy + n_done,
+                    (acmod->n_energy - n_done) * sizeof(*acmod->energy));
+            acmod->n_energy -= n_done;
+            acmod->energy_start += n_done;
+        }
+    }
+    if (acmod->n_energy + n_frames > acmod->n_energy_alloc) {
+        if (acmod->n_energy_alloc == 0)
+            acmod->n_energy_alloc = 256;
+        while (acmod->n_energy + n_frames > acmod->n_energy_alloc)
+            acmod->n_energy_alloc *= 2;
+        acmod->energy = ckd_realloc(acmod->energy,
+                                    acmod->n_energy_alloc
+                                    * sizeof(*acmod->energy));
+    }
+    for (i = 0; i < n_frames; ++i)
+        acmod->energy[acmod->n_energy + i] = MFCC2FLOAT(cep[i][0]);
+    acmod->n_energy += n_frames;
+}
+
 static int
 acmod_process_full_cep(acmod_t *acmod,
                        mfcc_t ***inout_cep,
@@ -539,6 +638,7 @@ acmod_process_full_cep(acmod_t *acmod,
         acmod->feat_outidx = 0;
     }
     /* Make dynamic features. */
+    acmod_log_energy(acmod, *inout_cep, *inout_n_frames);
     nfr = feat_s2mfc2feat_live(acmod->fcb, *inout_cep, inout_n_frames,
                                TRUE, TRUE, acmod->feat_buf);
     acmod->n_feat_frame = nfr;
@@ -747,6 +847,7 @@ acmod_process_cep(acmod_t *acmod,
     if (inptr + nfeat > acmod->n_feat_alloc) {
         int32 ncep1 = acmod->n_feat_alloc - inptr;
 
+        acmod_log_energy(acmod, *inout_cep, ncep1);
         /* Make sure we don't end the utterance here. */
         nfeat = feat_s2mfc2feat_live(acmod->fcb, *inout_cep,
                                      &ncep1,
@@ -766,6 +867,7 @@ acmod_process_cep(acmod_t *acmod,
         ncep -= ncep1;
     }
 
+    acmod_log_energy(acmod, *inout_cep, ncep);
     nfeat = feat_s2mfc2feat_live(acmod->fcb, *inout_cep,
                                  &ncep,
                                  (acmod->state == ACMOD_STARTED),
@@ -823,7 +925,11 @@ acmod_read_senfh_header(acmod_t *acmod)
 
     if (bio_readhdr(acmod->insenfh, &name, &val, &swap) < 0)
         goto error_out;
+    /* Version 0.1 files store active senones as 8-bit deltas. */
+    acmod->insen_deltas = TRUE;
     for (i = 0; name[i] != NULL; ++i) {
+        if (!strcmp(name[i], "version"))
+            acmod->insen_deltas = (strcmp(val[i], "0.1") == 0);
         if (!strcmp(name[i], "n_sen")) {
             if (atoi(val[i]) != bin_mdef_n_sen(acmod->mdef)) {
                 E_ERROR("Number of senones in senone file (%d) does not match mdef (%d)\n",
@@ -873,11 +979,15 @@ acmod_rewind(acmod_t *acmod)
     /* Frames consumed + frames available */
     acmod->n_feat_frame = acmod->output_frame + acmod->n_feat_frame;
 
-    /* Reset output pointers. */
-    acmod->feat_outidx = 0;
+    /* Reset output pointers to the first frame, which acmod_rebase()
+     * may have left anywhere in the buffer. */
+    acmod->feat_outidx = (acmod->feat_outidx + acmod->n_feat_alloc
+                          - acmod->output_frame) % acmod->n_feat_alloc;
     acmod->output_frame = 0;
     acmod->senscr_frame = -1;
+    acmod->n_ssid_hmm = acmod->n_ssid_expand = 0;
     acmod->mgau->frame_idx = 0;
+    acmod_clear_senscr_hist(acmod);
 
     return 0;
 }
@@ -895,12 +1005,312 @@ acmod_advance(acmod_t *acmod)
 }
 
 int
-acmod_write_scores(acmod_t *acmod, int n_active, uint8 const *active,
+acmod_rebase(acmod_t *acmod, int frame_idx)
+{
+    int feat_idx;
+
+    if (frame_idx == 0)
+        return 0;
+    if (frame_idx > acmod->output_frame
+        || (feat_idx = calc_feat_idx(acmod, frame_idx)) < 0)
+        return -1;
+
+    /* Frames before the new first one stay in a growable buffer until
+     * there are at least as many of them as frames to keep, so that
+     * dropping one frame at a time while waiting for speech does not
+     * move the rest every time (acmod_rewind() finds the first frame
+     * wherever it is). */
+    if (acmod->grow_feat) {
+        int i, j, n_frames;
+
+        n_frames = acmod->output_frame - frame_idx + acmod->n_feat_frame;
+        if (feat_idx >= n_frames && feat_idx + n_frames <= acmod->n_feat_alloc
+            && acmod->feat_outidx >= feat_idx) {
+            for (i = 0; i < n_frames; ++i) {
+                for (j = 0; j < feat_dimension1(acmod->fcb); ++j)
+                    memcpy(acmod->feat_buf[i][j],
+                           acmod->feat_buf[feat_idx + i][j],
+                           feat_dimension2(acmod->fcb, j)
+                           * sizeof(***acmod->feat_buf));
+                acmod->framepos[i] = acmod->framepos[feat_idx + i];
+            }
+            acmod->feat_outidx -= feat_idx;
+        }
+    }
+
+    acmod->output_frame -= frame_idx;
+    acmod->mgau->frame_idx -= frame_idx;
+    acmod->frame_offset += frame_idx;
+    acmod->senscr_frame = -1;
+    acmod_clear_senscr_hist(acmod);
+
+    return 0;
+}
+
+void
+acmod_truncate(acmod_t *acmod)
+{
+    acmod->n_feat_frame = 0;
+}
+
+static int
+acmod_write_feat(acmod_t *acmod, FILE *fh, mfcc_t **feat)
+{
+    int j;
+
+    for (j = 0; j < feat_dimension1(acmod->fcb); ++j)
+        if (snapshot_write(fh, feat[j], sizeof(mfcc_t),
+                           feat_dimension2(acmod->fcb, j)) < 0)
+            return -1;
+    return 0;
+}
+
+static int
+acmod_read_feat(acmod_t *acmod, FILE *fh, mfcc_t **feat)
+{
+    int j;
+
+    for (j = 0; j < feat_dimension1(acmod->fcb); ++j)
+        if (snapshot_read(fh, feat[j], sizeof(mfcc_t),
+                          feat_dimension2(acmod->fcb, j)) < 0)
+            return -1;
+    return 0;
+}
+
+int
+acmod_snapshot(acmod_t *acmod, FILE *fh)
+{
+    feat_t *fcb = acmod->fcb;
+    int32 n_sen = bin_mdef_n_sen(acmod->mdef);
+    int32 n_sseq = bin_mdef_n_sseq(acmod->mdef);
+    int32 cepsize = feat_cepsize(fcb);
+    int32 n_back, n_live, start, n, i;
+
+    /* Frames before the current one can be scored for as long as
+     * they have not been overwritten in the feature buffer. */
+    n_back = acmod->n_feat_alloc - acmod->n_feat_frame;
+    if (n_back > acmod->output_frame)
+        n_back = acmod->output_frame;
+    if (snapshot_write_int32(fh, acmod->state) < 0
+        || snapshot_write_int32(fh, acmod->grow_feat) < 0
+        || snapshot_write_int32(fh, acmod->output_frame) < 0
+        || snapshot_write_int32(fh, acmod->frame_offset) < 0
+        || snapshot_write_int32(fh, acmod->mgau->frame_idx) < 0
+        || snapshot_write_int32(fh, acmod->n_ssid_hmm) < 0
+        || snapshot_write_int32(fh, acmod->n_ssid_expand) < 0
+        || snapshot_write_int32(fh, n_back) < 0
+        || snapshot_write_int32(fh, acmod->n_feat_frame) < 0)
+        return -1;
+    for (i = -n_back; i < acmod->n_feat_frame; ++i) {
+        if (acmod_write_feat(acmod, fh,
+                             acmod->feat_buf[calc_feat_idx(acmod,
+                                                           acmod->output_frame
+                                                           + i)]) < 0)
+            return -1;
+    }
+
+    /* Cepstra waiting for dynamic feature computation. */
+    if (snapshot_write_int32(fh, acmod->n_mfc_frame) < 0)
+        return -1;
+    for (i = 0; i < acmod->n_mfc_frame; ++i) {
+        int j = (acmod->mfc_outidx + i) % acmod->n_mfc_alloc;
+        if (snapshot_write(fh, acmod->mfc_buf[j], sizeof(mfcc_t), cepsize) < 0)
+            return -1;
+    }
+
+    /* Cepstra held by dynamic feature computation: the window behind
+     * the next frame to be computed, and any after it. */
+    n_live = feat_window_size(fcb)
+        + (fcb->bufpos - fcb->curpos + LIVEBUFBLOCKSIZE) % LIVEBUFBLOCKSIZE;
+    if (snapshot_write_int32(fh, fcb->bufpos) < 0
+        || snapshot_write_int32(fh, fcb->curpos) < 0
+        || snapshot_write_int32(fh, n_live) < 0)
+        return -1;
+    start = fcb->curpos - feat_window_size(fcb) + LIVEBUFBLOCKSIZE;
+    for (i = 0; i < n_live; ++i) {
+        if (snapshot_write(fh, fcb->cepbuf[(start + i) % LIVEBUFBLOCKSIZE],
+                           sizeof(mfcc_t), cepsize) < 0)
+            return -1;
+    }
+
+    /* Energies for the endpointer, from the current frame on. */
+    start = acmod->frame_offset + acmod->output_frame;
+    if (start < acmod->energy_start)
+        start = acmod->energy_start;
+    n = acmod->energy_start + acmod->n_energy - start;
+    if (n < 0)
+        n = 0;
+    if (snapshot_write_int32(fh, start) < 0
+        || snapshot_write_int32(fh, n) < 0
+        || snapshot_write(fh, acmod->energy + start - acmod->energy_start,
+                          sizeof(*acmod->energy), n) < 0)
+        return -1;
+
+    /* Senone scores and activation. */
+    if (snapshot_write_int32(fh, n_sen) < 0
+        || snapshot_write_int32(fh, acmod->senscr_frame) < 0
+        || snapshot_write(fh, acmod->senone_scores,
+                          sizeof(*acmod->senone_scores), n_sen) < 0
+        || snapshot_write(fh, acmod->senone_active_vec,
+                          sizeof(bitvec_t), bitvec_size(n_sen)) < 0
+        || snapshot_write(fh, acmod->ssid_active_vec,
+                          sizeof(bitvec_t), bitvec_size(n_sseq)) < 0
+        || snapshot_write_int32(fh, acmod->n_senone_active) < 0
+        || snapshot_write(fh, acmod->senone_active,
+                          sizeof(*acmod->senone_active),
+                          acmod->n_senone_active) < 0
+        || snapshot_write_int32(fh, acmod->n_senscr_hist) < 0)
+        return -1;
+    for (i = 0; i < acmod->n_senscr_hist; ++i) {
+        if (snapshot_write_int32(fh, acmod->senscr_hist_frame[i]) < 0)
+            return -1;
+        if (acmod->senscr_hist_frame[i] < 0)
+            continue;
+        if (snapshot_write(fh, acmod->senscr_hist[i],
+                           sizeof(**acmod->senscr_hist), n_sen) < 0
+            || snapshot_write(fh, acmod->senscr_hist_vec[i],
+                              sizeof(bitvec_t), bitvec_size(n_sen)) < 0)
+            return -1;
+    }
+
+    /* Models which keep nothing from one frame to the next have no
+     * snapshot function. */
+    if (acmod->mgau->vt->snapshot == NULL)
+        return 0;
+    return ps_mgau_snapshot(acmod->mgau, fh);
+}
+
+int
+acmod_restore(acmod_t *acmod, FILE *fh)
+{
+    feat_t *fcb = acmod->fcb;
+    int32 n_sen = bin_mdef_n_sen(acmod->mdef);
+    int32 n_sseq = bin_mdef_n_sseq(acmod->mdef);
+    int32 cepsize = feat_cepsize(fcb);
+    int32 state, grow_feat, output_frame, frame_offset, frame_idx;
+    int32 n_back, n_feat, n_mfc, n_live, start, n, i;
+
+    if (snapshot_read_int32(fh, &state) < 0
+        || snapshot_read_int32(fh, &grow_feat) < 0
+        || snapshot_read_int32(fh, &output_frame) < 0
+        || snapshot_read_int32(fh, &frame_offset) < 0
+        || snapshot_read_int32(fh, &frame_idx) < 0
+        || snapshot_read_int32(fh, &acmod->n_ssid_hmm) < 0
+        || snapshot_read_int32(fh, &acmod->n_ssid_expand) < 0
+        || snapshot_read_int32(fh, &n_back) < 0
+        || snapshot_read_int32(fh, &n_feat) < 0)
+        return -1;
+    if (n_back < 0 || n_feat < 0 || n_back > output_frame
+        || n_back + n_feat > MAX_N_FRAMES) {
+        E_ERROR("Corrupt snapshot: %d frames of features\n", n_back + n_feat);
+        return -1;
+    }
+    acmod->state = state;
+    acmod->grow_feat = grow_feat;
+    acmod->output_frame = output_frame;
+    acmod->frame_offset = frame_offset;
+    acmod->mgau->frame_idx = frame_idx;
+
+    /* Put the features at the start of the buffer, so there is no
+     * wraparound until more of them are added. */
+    if (n_back + n_feat > acmod->n_feat_alloc)
+        acmod_grow_feat_buf(acmod, n_back + n_feat);
+    for (i = 0; i < n_back + n_feat; ++i)
+        if (acmod_read_feat(acmod, fh, acmod->feat_buf[i]) < 0)
+            return -1;
+    acmod->feat_outidx = n_back;
+    acmod->n_feat_frame = n_feat;
+
+    if (snapshot_read_int32(fh, &n_mfc) < 0)
+        return -1;
+    if (n_mfc < 0 || n_mfc > acmod->n_mfc_alloc) {
+        E_ERROR("Snapshot has %d pending frames, decoder only holds %d\n",
+                n_mfc, acmod->n_mfc_alloc);
+        return -1;
+    }
+    for (i = 0; i < n_mfc; ++i)
+        if (snapshot_read(fh, acmod->mfc_buf[i], sizeof(mfcc_t), cepsize) < 0)
+            return -1;
+    acmod->mfc_outidx = 0;
+    acmod->n_mfc_frame = n_mfc;
+
+    if (snapshot_read_int32(fh, &fcb->bufpos) < 0
+        || snapshot_read_int32(fh, &fcb->curpos) < 0
+        || snapshot_read_int32(fh, &n_live) < 0)
+        return -1;
+    if (fcb->bufpos < 0 || fcb->bufpos >= LIVEBUFBLOCKSIZE
+        || fcb->curpos < 0 || fcb->curpos >= LIVEBUFBLOCKSIZE
+        || n_live != feat_window_size(fcb)
+        + (fcb->bufpos - fcb->curpos + LIVEBUFBLOCKSIZE) % LIVEBUFBLOCKSIZE) {
+        E_ERROR("Corrupt snapshot: bad dynamic feature buffer\n");
+        return -1;
+    }
+    start = fcb->curpos - feat_window_size(fcb) + LIVEBUFBLOCKSIZE;
+    for (i = 0; i < n_live; ++i)
+        if (snapshot_read(fh, fcb->cepbuf[(start + i) % LIVEBUFBLOCKSIZE],
+                          sizeof(mfcc_t), cepsize) < 0)
+            return -1;
+
+    if (snapshot_read_int32(fh, &start) < 0
+        || snapshot_read_int32(fh, &n) < 0)
+        return -1;
+    if (n < 0) {
+        E_ERROR("Corrupt snapshot: %d frame energies\n", n);
+        return -1;
+    }
+    if (n > acmod->n_energy_alloc) {
+        acmod->n_energy_alloc = n;
+        acmod->energy = ckd_realloc(acmod->energy,
+                                    n * sizeof(*acmod->energy));
+    }
+    if (snapshot_read(fh, acmod->energy, sizeof(*acmod->energy), n) < 0)
+        return -1;
+    acmod->energy_start = start;
+    acmod->n_energy = n;
+
+    if (snapshot_check_int32(fh, n_sen, "number of senones") < 0
+        || snapshot_read_int32(fh, &acmod->senscr_frame) < 0
+        || snapshot_read(fh, acmod->senone_scores,
+                         sizeof(*acmod->senone_scores), n_sen) < 0
+        || snapshot_read(fh, acmod->senone_active_vec,
+                         sizeof(bitvec_t), bitvec_size(n_sen)) < 0
+        || snapshot_read(fh, acmod->ssid_active_vec,
+                         sizeof(bitvec_t), bitvec_size(n_sseq)) < 0
+        || snapshot_read_int32(fh, &n) < 0)
+        return -1;
+    if (n < 0 || n > n_sen) {
+        E_ERROR("Corrupt snapshot: %d active senones\n", n);
+        return -1;
+    }
+    acmod->n_senone_active = n;
+    if (snapshot_read(fh, acmod->senone_active,
+                      sizeof(*acmod->senone_active), n) < 0
+        || snapshot_check_int32(fh, acmod->n_senscr_hist, "-pl_window") < 0)
+        return -1;
+    for (i = 0; i < acmod->n_senscr_hist; ++i) {
+        if (snapshot_read_int32(fh, &acmod->senscr_hist_frame[i]) < 0)
+            return -1;
+        if (acmod->senscr_hist_frame[i] < 0)
+            continue;
+        if (snapshot_read(fh, acmod->senscr_hist[i],
+                          sizeof(**acmod->senscr_hist), n_sen) < 0
+            || snapshot_read(fh, acmod->senscr_hist_vec[i],
+                             sizeof(bitvec_t), bitvec_size(n_sen)) < 0)
+            return -1;
+    }
+
+    if (acmod->mgau->vt->restore == NULL)
+        return 0;
+    return ps_mgau_restore(acmod->mgau, fh);
+}
+
+int
+acmod_write_scores(acmod_t *acmod, int n_active, uint16 const *active,
                    int16 const *senscr, FILE *senfh)
 {
     int16 n_active2;
 
-    /* Uncompressed frame format:
+    /* Uncompressed frame format (version 0.2):
      *
      * (2 bytes) n_active: Number of active senones
      * If all senones active:
@@ -908,8 +1318,10 @@ acmod_write_scores(acmod_t *acmod, int n_active, uint8 const *active,
      *
      * Otherwise:
      * (2 bytes) n_active: Number of active senones
-     * (n_active bytes) deltas to active senones
+     * (n_active * 2 bytes) sorted IDs of active senones
      * (n_active * 2 bytes) scores of active senones
+     *
+     * Version 0.1 had 1-byte deltas between senone IDs instead.
      */
     n_active2 = n_active;
     if (fwrite(&n_active2, 2, 1, senfh) != 1)
@@ -919,12 +1331,11 @@ acmod_write_scores(acmod_t *acmod, int n_active, uint8 const *active,
             goto error_out;
     }
     else {
-        int i, n;
-        if (fwrite(active, 1, n_active, senfh) != n_active)
+        int i;
+        if (fwrite(active, 2, n_active, senfh) != n_active)
             goto error_out;
-        for (i = n = 0; i < n_active; ++i) {
-            n += active[i];
-            if (fwrite(senscr + n, 2, 1, senfh) != 1)
+        for (i = 0; i < n_active; ++i) {
+            if (fwrite(senscr + active[i], 2, 1, senfh) != 1)
                 goto error_out;
         }
     }
@@ -967,25 +1378,36 @@ acmod_read_scores_internal(acmod_t *acmod)
             return 0;
     }
     else {
-        int i, n;
-        if ((rv = fread(acmod->senone_active, 1,
-                        acmod->n_senone_active, senfh)) < 0)
-            goto error_out;
-        else if (rv != acmod->n_senone_active)
-            return 0;
-        for (i = 0, n = 0; i < acmod->n_senone_active; ++i) {
-            int j, sen = n + acmod->senone_active[i];
-            for (j = n + 1; j < sen; ++j)
-                acmod->senone_scores[j] = SENSCR_DUMMY;
+        int i, n_sen = bin_mdef_n_sen(acmod->mdef);
+        if (acmod->insen_deltas) {
+            int c, sen;
+            for (i = sen = 0; i < acmod->n_senone_active; ++i) {
+                if ((c = fgetc(senfh)) == EOF)
+                    return 0;
+                sen += c;
+                acmod->senone_active[i] = sen;
+            }
+        }
+        else {
+            if ((rv = fread(acmod->senone_active, 2,
+                            acmod->n_senone_active, senfh)) < 0)
+                goto error_out;
+            else if (rv != acmod->n_senone_active)
+                return 0;
+        }
+        for (i = 0; i < n_sen; ++i)
+            acmod->senone_scores[i] = SENSCR_DUMMY;
+        for (i = 0; i < acmod->n_senone_active; ++i) {
+            int sen = acmod->senone_active[i];
+            if (sen >= n_sen) {
+                E_ERROR("Senone ID %d in senone file out of range\n", sen);
+                return -1;
+            }
             if ((rv = fread(acmod->senone_scores + sen, 2, 1, senfh)) < 0)
                 goto error_out;
             else if (rv == 0)
                 return 0;
-            n = sen;
         }
-        ++n;
-        while (n < bin_mdef_n_sen(acmod->mdef))
-            acmod->senone_scores[n++] = SENSCR_DUMMY;
     }
     return 1;
 error_out:
@@ -1084,6 +1506,110 @@ acmod_get_frame(acmod_t *acmod, int *inout_frame_idx)
     return acmod->feat_buf[feat_idx];
 }
 
+int
+acmod_frame_energy(acmod_t *acmod, int frame_idx, float32 *out_energy)
+{
+    int32 idx = frame_idx + acmod->frame_offset - acmod->energy_start;
+
+    /* Energies are counted from the start of the utterance (before
+     * acmod_rebase()), one per frame of dynamic features. */
+    if (idx < 0 || idx >= acmod->n_energy)
+        return -1;
+    *out_energy = acmod->energy[idx];
+    return 0;
+}
+
+static void
+acmod_clear_senscr_hist(acmod_t *acmod)
+{
+    int i;
+
+    for (i = 0; i < acmod->n_senscr_hist; ++i)
+        acmod->senscr_hist_frame[i] = -1;
+}
+
+/**
+ * Score a frame using the senone score history, evaluating only
+ * those active senones which were not already computed for it.
+ */
+static void
+acmod_score_hist(acmod_t *acmod, int frame_idx, int feat_idx)
+{
+    int n_sen = bin_mdef_n_sen(acmod->mdef);
+    int hist_idx = frame_idx % acmod->n_senscr_hist;
+    int16 *hist_scores = acmod->senscr_hist[hist_idx];
+    bitvec_t *hist_vec = acmod->senscr_hist_vec[hist_idx];
+    uint16 *active = acmod->senscr_hist_active;
+    int i, n, sen, ref, n_new;
+
+    if (acmod->senscr_hist_frame[hist_idx] != frame_idx) {
+        acmod->senscr_hist_frame[hist_idx] = frame_idx;
+        bitvec_clear_all(hist_vec, n_sen);
+        if (acmod->compallsen) {
+            ps_mgau_frame_eval(acmod->mgau, acmod->senone_scores,
+                               acmod->senone_active, 0,
+                               acmod->feat_buf[feat_idx],
+                               frame_idx, TRUE);
+            memcpy(hist_scores, acmod->senone_scores,
+                   n_sen * sizeof(*hist_scores));
+        }
+    }
+    if (acmod->compallsen) {
+        acmod->n_senone_active = n_sen;
+        memcpy(acmod->senone_scores, hist_scores,
+               n_sen * sizeof(*hist_scores));
+        return;
+    }
+
+    /* Build a list of active senones that have not been computed
+     * yet.  Scores may be normalized differently in each call to
+     * ps_mgau_frame_eval(), so one that has already been computed is
+     * included too, as a reference. */
+    acmod_flags2list(acmod);
+    ref = -1;
+    n = n_new = 0;
+    for (i = 0; i < acmod->n_senone_active; ++i) {
+        sen = acmod->senone_active[i];
+        if (bitvec_is_set(hist_vec, sen)) {
+            if (ref != -1)
+                continue;
+            ref = sen;
+        }
+        else
+            ++n_new;
+        active[n++] = sen;
+    }
+
+    if (n_new > 0) {
+        int32 offset = 0;
+
+        ps_mgau_frame_eval(acmod->mgau, acmod->senone_scores, active, n,
+                           acmod->feat_buf[feat_idx], frame_idx, FALSE);
+        if (ref != -1)
+            offset = acmod->senone_scores[ref] - hist_scores[ref];
+        for (i = 0; i < n; ++i) {
+            int32 scr;
+
+            sen = active[i];
+            if (sen == ref)
+                continue;
+            scr = acmod->senone_scores[sen] - offset;
+            if (scr > 32767)
+                scr = 32767;
+            if (scr < -32768)
+                scr = -32768;
+            hist_scores[sen] = scr;
+            bitvec_set(hist_vec, sen);
+        }
+    }
+
+    /* Now copy out scores for everything that was asked for. */
+    for (i = 0; i < acmod->n_senone_active; ++i) {
+        sen = acmod->senone_active[i];
+        acmod->senone_scores[sen] = hist_scores[sen];
+    }
+}
+
 int16 const *
 acmod_score(acmod_t *acmod, int *inout_frame_idx)
 {
@@ -1111,6 +1637,10 @@ acmod_score(acmod_t *acmod, int *inout_frame_idx)
         if (acmod_read_scores_internal(acmod) < 0)
             return NULL;
     }
+    else if (acmod->senscr_hist) {
+        /* Reuse any scores computed earlier for this frame. */
+        acmod_score_hist(acmod, frame_idx, feat_idx);
+    }
     else {
         /* Build active senone list. */
         acmod_flags2list(acmod);
@@ -1157,13 +1687,11 @@ acmod_best_score(acmod_t *acmod, int *out_best_senid)
         }
     }
     else {
-        int16 *senscr;
-        senscr = acmod->senone_scores;
         for (i = 0; i < acmod->n_senone_active; ++i) {
-            senscr += acmod->senone_active[i];
-            if (*senscr < best) {
-                best = *senscr;
-                *out_best_senid = i;
+            int sen = acmod->senone_active[i];
+            if (acmod->senone_scores[sen] < best) {
+                best = acmod->senone_scores[sen];
+                *out_best_senid = sen;
             }
         }
     }
@@ -1177,15 +1705,13 @@ acmod_clear_active(acmod_t *acmod)
     if (acmod->compallsen)
         return;
     bitvec_clear_all(acmod->senone_active_vec, bin_mdef_n_sen(acmod->mdef));
+    bitvec_clear_all(acmod->ssid_active_vec, bin_mdef_n_sseq(acmod->mdef));
     acmod->n_senone_active = 0;
 }
 
 #define MPX_BITVEC_SET(a,h,i)                                   \
     if (hmm_mpx_ssid(h,i) != BAD_SSID)                          \
         bitvec_set((a)->senone_active_vec, hmm_mpx_senid(h,i))
-#define NONMPX_BITVEC_SET(a,h,i)                                        \
-    bitvec_set((a)->senone_active_vec,                                  \
-               hmm_nonmpx_senid(h,i))
 
 void
 acmod_activate_hmm(acmod_t *acmod, hmm_t *hmm)
@@ -1195,6 +1721,8 @@ acmod_activate_hmm(acmod_t *acmod, hmm_t *hmm)
     if (acmod->compallsen)
         return;
     if (hmm_is_mpx(hmm)) {
+        /* Each state may come from a different senone sequence, so
+         * these are still done one senone at a time. */
         switch (hmm_n_emit_state(hmm)) {
         case 5:
             MPX_BITVEC_SET(acmod, hmm, 4);
@@ -1211,73 +1739,105 @@ acmod_activate_hmm(acmod_t *acmod, hmm_t *hmm)
         }
     }
     else {
-        switch (hmm_n_emit_state(hmm)) {
-        case 5:
-            NONMPX_BITVEC_SET(acmod, hmm, 4);
-            NONMPX_BITVEC_SET(acmod, hmm, 3);
-        case 3:
-            NONMPX_BITVEC_SET(acmod, hmm, 2);
-            NONMPX_BITVEC_SET(acmod, hmm, 1);
-            NONMPX_BITVEC_SET(acmod, hmm, 0);
-            break;
-        default:
-            for (i = 0; i < hmm_n_emit_state(hmm); ++i) {
-                NONMPX_BITVEC_SET(acmod, hmm, i);
-            }
+        bitvec_set(acmod->ssid_active_vec, hmm_nonmpx_ssid(hmm));
+        ++acmod->n_ssid_hmm;
+    }
+}
+
+/**
+ * Expand the senone sequences marked in ssid_active_vec to their
+ * senones, once each.
+ */
+static void
+acmod_expand_ssids(acmod_t *acmod)
+{
+    bin_mdef_t *mdef = acmod->mdef;
+    int32 i, j, n;
+
+    n = acmod_bitvec_list(acmod->ssid_active_vec, bin_mdef_n_sseq(mdef),
+                          acmod->ssid_active);
+    for (i = 0; i < n; ++i) {
+        int32 ssid = acmod->ssid_active[i];
+        int32 n_emit = bin_mdef_n_emit_state(mdef)
+            ? bin_mdef_n_emit_state(mdef) : mdef->sseq_len[ssid];
+        for (j = 0; j < n_emit; ++j)
+            bitvec_set(acmod->senone_active_vec,
+                       bin_mdef_sseq2sen(mdef, ssid, j));
+    }
+    /* They are all in senone_active_vec now. */
+    if (n > 0)
+        bitvec_clear_all(acmod->ssid_active_vec, bin_mdef_n_sseq(mdef));
+    acmod->n_ssid_expand += n;
+}
+
+/**
+ * Find the index of the lowest set bit in a non-zero word.
+ */
+static int
+bitvec_word_ctz(bitvec_t w)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzl((unsigned long)w);
+#else
+    int b = 0;
+    while (!(w & 1)) {
+        w >>= 1;
+        ++b;
+    }
+    return b;
+#endif
+}
+
+int32
+acmod_bitvec_list(bitvec_t const *vec, int32 n_bits, uint16 *out_list)
+{
+    int32 w, n, total_words, extra_bits;
+
+    total_words = n_bits / BITVEC_BITS;
+    extra_bits = n_bits % BITVEC_BITS;
+    for (w = n = 0; w <= total_words; ++w) {
+        bitvec_t bits;
+
+        if (w == total_words) {
+            if (extra_bits == 0)
+                break;
+            bits = vec[w] & ((1UL << extra_bits) - 1);
+        }
+        else
+            bits = vec[w];
+        /* Peel off set bits one at a time, lowest first. */
+        while (bits) {
+            out_list[n++] = w * BITVEC_BITS + bitvec_word_ctz(bits);
+            bits &= bits - 1;
         }
     }
+    return n;
 }
 
 int32
 acmod_flags2list(acmod_t *acmod)
 {
-    int32 w, l, n, b, total_dists, total_words, extra_bits;
-    bitvec_t *flagptr;
+    int32 total_dists;
 
     total_dists = bin_mdef_n_sen(acmod->mdef);
     if (acmod->compallsen) {
         acmod->n_senone_active = total_dists;
         return total_dists;
     }
-    total_words = total_dists / BITVEC_BITS;
-    extra_bits = total_dists % BITVEC_BITS;
-    w = n = l = 0;
-    for (flagptr = acmod->senone_active_vec; w < total_words; ++w, ++flagptr) {
-        if (*flagptr == 0)
-            continue;
-        for (b = 0; b < BITVEC_BITS; ++b) {
-            if (*flagptr & (1UL << b)) {
-                int32 sen = w * BITVEC_BITS + b;
-                int32 delta = sen - l;
-                /* Handle excessive deltas "lossily" by adding a few
-                   extra senones to bridge the gap. */
-                while (delta > 255) {
-                    acmod->senone_active[n++] = 255;
-                    delta -= 255;
-                }
-                acmod->senone_active[n++] = delta;
-                l = sen;
-            }
-        }
-    }
-
-    for (b = 0; b < extra_bits; ++b) {
-        if (*flagptr & (1UL << b)) {
-            int32 sen = w * BITVEC_BITS + b;
-            int32 delta = sen - l;
-            /* Handle excessive deltas "lossily" by adding a few
-               extra senones to bridge the gap. */
-            while (delta > 255) {
-                acmod->senone_active[n++] = 255;
-                delta -= 255;
-            }
-            acmod->senone_active[n++] = delta;
-            l = sen;
-        }
-    }
-
-    acmod->n_senone_active = n;
+    acmod_expand_ssids(acmod);
+    acmod->n_senone_active = acmod_bitvec_list(acmod->senone_active_vec,
+                                               total_dists,
+                                               acmod->senone_active);
     E_DEBUG(1, ("acmod_flags2list: %d active in frame %d\n",
                 acmod->n_senone_active, acmod->output_frame));
-    return n;
+    return acmod->n_senone_active;
+}
+
+void
+acmod_log_ssid_stats(acmod_t *acmod)
+{
+    E_INFO("%8d HMMs activated for %d senone sequences (%.1f each)\n",
+           acmod->n_ssid_hmm, acmod->n_ssid_expand,
+           acmod->n_ssid_expand
+           ? (double)acmod->n_ssid_hmm / acmod->n_ssid_expand : 0.0);
 }
@@ -100,7 +100,7 @@ typedef struct ps_mgaufuncs_s {
 
     int (*frame_eval)(ps_mgau_t *mgau,
                       int16 *senscr,
-                      uint8 *senone_active,
+                      uint16 *senone_active,
                       int32 n_senone_active,
                       mfcc_t ** feat,
                       int32 frame,
@@ -108,6 +108,12 @@ typedef struct ps_mgaufuncs_s {
     int (*transform)(ps_mgau_t *mgau,
                      ps_mllr_t *mllr);
     void (*free)(ps_mgau_t *mgau);
+    /**
+     * Save or restore any state carried over from one frame to the
+     * next, for acmod_snapshot().  May be NULL if there is none.
+     */
+    int (*snapshot)(ps_mgau_t *mgau, FILE *fh);
+    int (*restore)(ps_mgau_t *mgau, FILE *fh);
 } ps_mgaufuncs_t;    
 
 struct ps_mgau_s {
@@ -123,6 +129,10 @@ struct ps_mgau_s {
     (*ps_mgau_base(mg)->vt->transform)(mg, mllr)
 #define ps_mgau_free(mg)                                  \
     (*ps_mgau_base(mg)->vt->free)(mg)
+#define ps_mgau_snapshot(mg, fh)                          \
+    (*ps_mgau_base(mg)->vt->snapshot)(mg, fh)
+#define ps_mgau_restore(mg, fh)                           \
+    (*ps_mgau_base(mg)->vt->restore)(mg, fh)
 
 /**
  * Acoustic model structure.
@@ -164,11 +174,22 @@ struct acmod_s {
     /* Senone scoring: */
     int16 *senone_scores;      /**< GMM scores for current frame. */
     bitvec_t *senone_active_vec; /**< Active GMMs in current frame. */
-    uint8 *senone_active;      /**< Array of deltas to active GMMs. */
+    uint16 *senone_active;     /**< Sorted array of active GMMs. */
     int senscr_frame;          /**< Frame index for senone_scores. */
     int n_senone_active;       /**< Number of active GMMs. */
+    bitvec_t *ssid_active_vec; /**< Active senone sequences in current frame. */
+    uint16 *ssid_active;       /**< Temporary list of active senone sequences. */
+    int32 n_ssid_hmm;          /**< HMMs activated by senone sequence (per utt). */
+    int32 n_ssid_expand;       /**< Unique senone sequences expanded (per utt). */
     int log_zero;              /**< Zero log-probability value. */
 
+    /* Senone score history, for lagged searches (-pl_window > 0): */
+    int16 **senscr_hist;       /**< Scores already computed for recent frames. */
+    bitvec_t **senscr_hist_vec; /**< Senones already computed for recent frames. */
+    int *senscr_hist_frame;    /**< Frame index for each entry (-1 if none). */
+    int n_senscr_hist;         /**< Number of frames of history (pl_window + 1). */
+    uint16 *senscr_hist_active; /**< Sorted array of GMMs to compute. */
+
     /* Utterance processing: */
     mfcc_t **mfc_buf;   /**< Temporary buffer of acoustic features. */
     mfcc_t ***feat_buf; /**< Temporary buffer of dynamic features. */
@@ -177,12 +198,21 @@ struct acmod_s {
     FILE *senfh;        /**< File for writing senone score data. */
     FILE *insenfh;	/**< Input senone score file. */
     long *framepos;     /**< File positions of recent frames in senone file. */
+    int32 frame_offset; /**< Frames dropped from the start by acmod_rebase(). */
+
+    /* Frame energies for the endpointer: */
+    float32 *energy;    /**< C0 of frames not yet searched, before CMN. */
+    int32 energy_start; /**< Frame (from the start of the utterance) of energy[0]. */
+    int32 n_energy;     /**< Number of frames in energy. */
+    int32 n_energy_alloc; /**< Number of frames allocated in energy. */
 
     /* A whole bunch of flags and counters: */
     uint8 state;        /**< State of utterance processing. */
     uint8 compallsen;   /**< Compute all senones? */
     uint8 grow_feat;    /**< Whether to grow feat_buf. */
+    uint8 log_energy;   /**< Whether to record frame energies. */
     uint8 insen_swap;   /**< Whether to swap input senone score. */
+    uint8 insen_deltas; /**< Whether input senone file has old-style deltas. */
 
     frame_idx_t output_frame; /**< Index of next frame of dynamic features. */
     frame_idx_t n_mfc_alloc;  /**< Number of frames allocated in mfc_buf */
@@ -292,6 +322,53 @@ int acmod_rewind(acmod_t *acmod);
  */
 int acmod_advance(acmod_t *acmod);
 
+/**
+ * Make a frame the first frame of the current utterance.
+ *
+ * Frames before it are discarded, and frame indices (including the
+ * one returned by acmod_rewind()) count from it afterwards.  This is
+ * used to drop silence at the start of an utterance.
+ *
+ * @param frame_idx Frame to start from, which must still be in the
+ *                  feature buffer and not after the current frame.
+ * @return 0 for success, <0 if frame_idx is not available.
+ */
+int acmod_rebase(acmod_t *acmod, int frame_idx);
+
+/**
+ * Discard any frames which have not yet been output.
+ *
+ * This is used to end an utterance before the end of its data.
+ */
+void acmod_truncate(acmod_t *acmod);
+
+/**
+ * Save the state of an utterance in progress.
+ *
+ * This writes the frames of dynamic features which have not been
+ * searched yet (and in a growable feature buffer, those before them
+ * too, which acmod_rewind() may return to), the cepstra queued in
+ * front of them, the senone scores kept for lagged searches, and
+ * the state of the acoustic model itself.  The CMN estimate is not
+ * included.  Nor are live AGC and any audio samples the front end is
+ * holding that do not make up a whole frame yet, so a snapshot is
+ * best taken between blocks of cepstra, or at least of audio.
+ *
+ * @return 0 for success, <0 on error.
+ */
+int acmod_snapshot(acmod_t *acmod, FILE *fh);
+
+/**
+ * Restore the state of an utterance written by acmod_snapshot().
+ *
+ * The utterance must have just been started with acmod_start_utt(),
+ * and the acoustic model must be configured the same way as the one
+ * the snapshot was taken from.
+ *
+ * @return 0 for success, <0 on error.
+ */
+int acmod_restore(acmod_t *acmod, FILE *fh);
+
 /**
  * Set memory allocation policy for utterance processing.
  *
@@ -383,6 +460,19 @@ int acmod_read_scores(acmod_t *acmod);
  */
 mfcc_t **acmod_get_frame(acmod_t *acmod, int *inout_frame_idx);
 
+/**
+ * Get the energy (C0) of a frame of the current utterance.
+ *
+ * This is only available with -vad, for frames which were computed
+ * from cepstra or audio (not feature or senone score input), from the
+ * current frame onwards.
+ *
+ * @param frame_idx Frame index.
+ * @param out_energy Output: C0 of the frame, before normalization.
+ * @return 0 for success, <0 if it is not available.
+ */
+int acmod_frame_energy(acmod_t *acmod, int frame_idx, float32 *out_energy);
+
 /**
  * Score one frame of data.
  *
@@ -407,7 +497,7 @@ int acmod_write_senfh_header(acmod_t *acmod, FILE *logfh);
 /**
  * Write a frame of senone scores to a dump file.
  */
-int acmod_write_scores(acmod_t *acmod, int n_active, uint8 const *active,
+int acmod_write_scores(acmod_t *acmod, int n_active, uint16 const *active,
                        int16 const *senscr, FILE *senfh);
 
 
@@ -423,6 +513,10 @@ void acmod_clear_active(acmod_t *acmod);
 
 /**
  * Activate senones associated with an HMM.
+ *
+ * For non-multiplex HMMs this only marks the senone sequence, which
+ * is expanded to its senones once per frame in acmod_flags2list(), no
+ * matter how many HMMs share it.
  */
 void acmod_activate_hmm(acmod_t *acmod, hmm_t *hmm);
 
@@ -432,8 +526,26 @@ void acmod_activate_hmm(acmod_t *acmod, hmm_t *hmm);
 #define acmod_activate_sen(acmod, sen) bitvec_set((acmod)->senone_active_vec, sen)
 
 /**
- * Build active list from 
+ * Build active list from senone_active_vec (and ssid_active_vec).
  */
 int32 acmod_flags2list(acmod_t *acmod);
 
+/**
+ * Log how many HMMs were activated in this utterance, and for how
+ * many unique senone sequences.
+ */
+void acmod_log_ssid_stats(acmod_t *acmod);
+
+/**
+ * Build a sorted list of the set bits in a bit vector.
+ *
+ * This scans a word at a time, skipping empty words and finding set
+ * bits directly, so it is cheap for sparse vectors.
+ *
+ * @param n_bits Number of valid bits in vec (bits beyond are ignored).
+ * @param out_list Output list, with room for up to n_bits entries.
+ * @return Number of entries written to out_list.
+ */
+int32 acmod_bitvec_list(bitvec_t const *vec, int32 n_bits, uint16 *out_list);
+
 #endif /* __ACMOD_H__ */
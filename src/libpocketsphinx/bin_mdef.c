@@ -62,6 +62,8 @@
 #include "mdef.h"
 #include "bin_mdef.h"
 
+static void bin_mdef_build_cd_index(bin_mdef_t *m);
+
 bin_mdef_t *
 bin_mdef_read_text(cmd_ln_t *config, const char *filename)
 {
@@ -258,6 +260,7 @@ bin_mdef_read_text(cmd_ln_t *config, const char *filename)
     mdef_free(mdef);
 
     bmdef->alloc_mode = BIN_MDEF_FROM_TEXT;
+    bin_mdef_build_cd_index(bmdef);
     return bmdef;
 }
 
@@ -293,6 +296,8 @@ bin_mdef_free(bin_mdef_t * m)
         mmio_file_unmap(m->filemap);
     ckd_free(m->cd2cisen);
     ckd_free(m->sen2cimap);
+    ckd_free(m->cd_keys);
+    ckd_free(m->cd_pids);
     ckd_free(m->ciname);
     ckd_free(m->sseq);
     ckd_free(m);
@@ -510,6 +515,8 @@ bin_mdef_read(cmd_ln_t *config, const char *filename)
     /* Set the silence phone. */
     m->sil = bin_mdef_ciphone_id(m, S3_SILENCE_CIPHONE);
 
+    bin_mdef_build_cd_index(m);
+
     E_INFO
         ("%d CI-phone, %d CD-phone, %d emitstate/phone, %d CI-sen, %d Sen, %d Sen-Seq\n",
          m->n_ciphone, m->n_phone - m->n_ciphone, m->n_emit_state,
@@ -741,32 +748,116 @@ bin_mdef_ciphone_str(bin_mdef_t * m, int32 ci)
     return m->ciname[ci];
 }
 
-int
-bin_mdef_phone_id(bin_mdef_t * m, int32 ci, int32 lc, int32 rc, int32 wpos)
+/*
+ * CD phones are looked up in an open-addressed hash table keyed on
+ * their packed contexts, which is built from the CD tree at load
+ * time.  Empty slots have a key of zero, which is never used as
+ * contexts are packed with the word position in the high bits.
+ */
+#define CD_KEY(wpos,ci,lc,rc) \
+    ((((uint32)(wpos) + 1) << 24) | ((uint32)(ci) << 16) \
+     | ((uint32)(lc) << 8) | (uint32)(rc))
+
+static uint32
+cd_hash(uint32 key)
 {
-    cd_tree_t *cd_tree;
-    int level, max;
-    int16 ctx[4];
+    key = ((key >> 16) ^ key) * 0x45d9f3b;
+    key = ((key >> 16) ^ key) * 0x45d9f3b;
+    return (key >> 16) ^ key;
+}
 
-    assert(m);
+static void
+cd_index_insert(bin_mdef_t *m, uint32 key, int32 pid)
+{
+    uint32 h = cd_hash(key) & m->cd_mask;
 
-    /* In the future, we might back off when context is not available,
-     * but for now we'll just return the CI phone. */
-    if (lc < 0 || rc < 0)
-        return ci;
+    while (m->cd_keys[h] != 0) {
+        if (m->cd_keys[h] == key)
+            return;
+        h = (h + 1) & m->cd_mask;
+    }
+    m->cd_keys[h] = key;
+    m->cd_pids[h] = pid;
+}
 
-    assert((ci >= 0) && (ci < m->n_ciphone));
-    assert((lc >= 0) && (lc < m->n_ciphone));
-    assert((rc >= 0) && (rc < m->n_ciphone));
-    assert((wpos >= 0) && (wpos < N_WORD_POSN));
+static void
+bin_mdef_build_cd_index(bin_mdef_t *m)
+{
+    int32 n_leaves, size, w, i, j, k;
+
+    m->cd_keys = NULL;
+    m->cd_pids = NULL;
+    m->cd_mask = 0;
+    /* Contexts have to fit in eight bits each. */
+    if (m->n_ciphone > 256 || m->n_cd_tree == 0)
+        return;
+
+    /* Count the triphones, and make sure the tree has no leaves
+     * above the right context level that would match anything but
+     * an empty subtree (otherwise just walk the tree). */
+    n_leaves = 0;
+    for (w = 0; w < N_WORD_POSN; ++w) {
+        cd_tree_t *wn = m->cd_tree + w;
+
+        if (wn->n_down == 0) {
+            if (wn->c.pid >= 0)
+                return;
+            continue;
+        }
+        for (i = 0; i < wn->n_down; ++i) {
+            cd_tree_t *cn = m->cd_tree + wn->c.down + i;
 
-    /* Create a context list, mapping fillers to silence. */
-    ctx[0] = wpos;
-    ctx[1] = ci;
-    ctx[2] = (m->sil >= 0
-              && m->phone[lc].info.ci.filler) ? m->sil : lc;
-    ctx[3] = (m->sil >= 0
-              && m->phone[rc].info.ci.filler) ? m->sil : rc;
+            if (cn->n_down == 0) {
+                if (cn->c.pid >= 0)
+                    return;
+                continue;
+            }
+            for (j = 0; j < cn->n_down; ++j) {
+                cd_tree_t *ln = m->cd_tree + cn->c.down + j;
+
+                if (ln->n_down == 0) {
+                    if (ln->c.pid >= 0)
+                        return;
+                    continue;
+                }
+                n_leaves += ln->n_down;
+            }
+        }
+    }
+
+    /* Keep the load factor at or below one half. */
+    for (size = 2; size < 2 * n_leaves; size <<= 1)
+        ;
+    m->cd_mask = size - 1;
+    m->cd_keys = ckd_calloc(size, sizeof(*m->cd_keys));
+    m->cd_pids = ckd_calloc(size, sizeof(*m->cd_pids));
+    for (w = 0; w < N_WORD_POSN; ++w) {
+        cd_tree_t *wn = m->cd_tree + w;
+
+        for (i = 0; i < wn->n_down; ++i) {
+            cd_tree_t *cn = m->cd_tree + wn->c.down + i;
+
+            for (j = 0; j < cn->n_down; ++j) {
+                cd_tree_t *ln = m->cd_tree + cn->c.down + j;
+
+                for (k = 0; k < ln->n_down; ++k) {
+                    cd_tree_t *rn = m->cd_tree + ln->c.down + k;
+                    /* First match wins, as in the tree walk. */
+                    cd_index_insert(m, CD_KEY(wn->ctx, cn->ctx,
+                                              ln->ctx, rn->ctx),
+                                    rn->c.pid);
+                }
+            }
+        }
+    }
+    E_INFO("CD phone index: %d entries in %d slots\n", n_leaves, size);
+}
+
+static int
+cd_tree_phone_id(bin_mdef_t * m, int16 const *ctx)
+{
+    cd_tree_t *cd_tree;
+    int level, max;
 
     /* Walk down the cd_tree. */
     cd_tree = m->cd_tree;
@@ -775,28 +866,12 @@ bin_mdef_phone_id(bin_mdef_t * m, int32 ci, int32 lc, int32 rc, int32 wpos)
     while (level < 4) {
         int i;
 
-#if 0
-        E_INFO("Looking for context %d=%s in %d at %d\n",
-               ctx[level], m->ciname[ctx[level]],
-               max, cd_tree - m->cd_tree);
-#endif
         for (i = 0; i < max; ++i) {
-#if 0
-            E_INFO("Look at context %d=%s at %d\n",
-                   cd_tree[i].ctx,
-                   m->ciname[cd_tree[i].ctx], cd_tree + i - m->cd_tree);
-#endif
             if (cd_tree[i].ctx == ctx[level])
                 break;
         }
         if (i == max)
             return -1;
-#if 0
-        E_INFO("Found context %d=%s at %d, n_down=%d, down=%d\n",
-               ctx[level], m->ciname[ctx[level]],
-               cd_tree + i - m->cd_tree,
-               cd_tree[i].n_down, cd_tree[i].c.down);
-#endif
         /* Leaf node, stop here. */
         if (cd_tree[i].n_down == 0)
             return cd_tree[i].c.pid;
@@ -810,6 +885,44 @@ bin_mdef_phone_id(bin_mdef_t * m, int32 ci, int32 lc, int32 rc, int32 wpos)
     return -1;
 }
 
+int
+bin_mdef_phone_id(bin_mdef_t * m, int32 ci, int32 lc, int32 rc, int32 wpos)
+{
+    int16 ctx[4];
+    uint32 key, h;
+
+    assert(m);
+
+    /* In the future, we might back off when context is not available,
+     * but for now we'll just return the CI phone. */
+    if (lc < 0 || rc < 0)
+        return ci;
+
+    assert((ci >= 0) && (ci < m->n_ciphone));
+    assert((lc >= 0) && (lc < m->n_ciphone));
+    assert((rc >= 0) && (rc < m->n_ciphone));
+    assert((wpos >= 0) && (wpos < N_WORD_POSN));
+
+    /* Create a context list, mapping fillers to silence. */
+    ctx[0] = wpos;
+    ctx[1] = ci;
+    ctx[2] = (m->sil >= 0
+              && m->phone[lc].info.ci.filler) ? m->sil : lc;
+    ctx[3] = (m->sil >= 0
+              && m->phone[rc].info.ci.filler) ? m->sil : rc;
+
+    if (m->cd_keys == NULL)
+        return cd_tree_phone_id(m, ctx);
+
+    key = CD_KEY(ctx[0], ctx[1], ctx[2], ctx[3]);
+    for (h = cd_hash(key) & m->cd_mask; m->cd_keys[h] != 0;
+         h = (h + 1) & m->cd_mask) {
+        if (m->cd_keys[h] == key)
+            return m->cd_pids[h];
+    }
+    return -1;
+}
+
 int
 bin_mdef_phone_id_nearest(bin_mdef_t * m, int32 b, int32 l, int32 r, int32 pos)
 {
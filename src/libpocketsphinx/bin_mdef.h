@@ -137,9 +137,12 @@ struct bin_mdef_s {
 	uint16 **sseq;       /**< Unique senone sequences (2D array built at load time) */
 	uint8 *sseq_len;     /**< Number of states in each sseq (NULL for homogeneous) */
 
-	/* These two are not stored on disk, but are generated at load time. */
+	/* These are not stored on disk, but are generated at load time. */
 	int16 *cd2cisen;	/**< Parent CI-senone id for each senone */
 	int16 *sen2cimap;	/**< Parent CI-phone for each senone (CI or CD) */
+	uint32 *cd_keys;	/**< Hash of packed (wpos, ci, lc, rc) for each CD phone */
+	int32 *cd_pids;		/**< Phone ID for each entry in cd_keys */
+	uint32 cd_mask;		/**< Size of cd_keys minus one (a power of two) */
 
 	/** Allocation mode for this object. */
 	enum { BIN_MDEF_FROM_TEXT, BIN_MDEF_IN_MEMORY, BIN_MDEF_ON_DISK } alloc_mode;
@@ -41,6 +41,8 @@
 /* SphinxBase headers. */
 #include <sphinxbase/pio.h>
 #include <sphinxbase/strfuncs.h>
+#include <sphinxbase/byteorder.h>
+#include <sphinxbase/case.h>
 
 /* Local headers. */
 #include "dict.h"
@@ -65,6 +67,44 @@ dict_ciphone_id(dict_t * d, const char *str)
 }
 
 
+/*
+ * Hash function for the binary dictionary index.  This has to be
+ * stable across platforms since the index is stored on disk.
+ */
+static uint32
+dict_hash(char const *str, int nocase)
+{
+    uint32 h = 2166136261U;
+
+    for (; *str; ++str) {
+        unsigned char c = *str;
+        if (nocase)
+            c = UPPER_CASE(c);
+        h = (h ^ c) * 16777619U;
+    }
+    return h;
+}
+
+static s3wid_t
+dict_bin_lookup(dict_t *d, char const *word)
+{
+    int32 mask, h, w;
+
+    if (d->bin_index == NULL)
+        return BAD_S3WID;
+    mask = d->n_bin_slot - 1;
+    for (h = dict_hash(word, d->nocase) & mask;
+         (w = d->bin_index[h]) >= 0; h = (h + 1) & mask) {
+        if (d->nocase) {
+            if (strcmp_nocase(d->word[w].word, word) == 0)
+                return w;
+        }
+        else if (strcmp(d->word[w].word, word) == 0)
+            return w;
+    }
+    return BAD_S3WID;
+}
+
 const char *
 dict_ciphone_str(dict_t * d, s3wid_t wid, int32 pos)
 {
@@ -95,6 +135,9 @@ dict_add_word(dict_t * d, char const *word, s3cipid_t const * p, int32 np)
     }
 
     wordp = d->word + d->n_word;
+    /* Words from a binary dictionary are not in the hash table. */
+    if (dict_bin_lookup(d, word) != BAD_S3WID)
+        return BAD_S3WID;
     wordp->word = (char *) ckd_salloc(word);    /* Freed in dict_free */
 
     /* Associate word string with d->n_word in hash table */
@@ -123,7 +166,7 @@ dict_add_word(dict_t * d, char const *word, s3cipid_t const * p, int32 np)
 	int32 w;
 
         /* Truncated to a baseword string; find its ID */
-        if (hash_table_lookup_int32(d->ht, wword, &w) < 0) {
+        if ((w = dict_wordid(d, wword)) == BAD_S3WID) {
             E_ERROR("Missing base word for: %s\n", word);
             ckd_free(wword);
             ckd_free(wordp->word);
@@ -216,12 +259,299 @@ dict_read(FILE * fp, dict_t * d)
     return 0;
 }
 
+static const char format_desc[] =
+    "BEGIN FILE FORMAT DESCRIPTION\n"
+    "int32 n_word;       /**< Number of words (including fillers) */\n"
+    "int32 filler_start; /**< First filler word ID */\n"
+    "int32 filler_end;   /**< Last filler word ID */\n"
+    "int32 nocase;       /**< Index is case-insensitive */\n"
+    "int32 n_ciphone;    /**< Number of CI phone names below */\n"
+    "int32 n_slot;       /**< Size of hash index (a power of two) */\n"
+    "int32 n_pron;       /**< Total number of phones in pronunciations */\n"
+    "int32 str_size;     /**< Size of string pool */\n"
+    "char ciphones[][];  /**< CI phone strings (null-terminated) */\n"
+    "char padding[];     /**< Padding to a 4-bytes boundary */\n"
+    "struct { int32 word, pron, pronlen, alt, basewid } words[];\n"
+    "int32 index[];      /**< Word ID for each hash slot, or -1 */\n"
+    "int16 prons[];      /**< CI phone IDs */\n"
+    "char strings[];     /**< Word strings (null-terminated) */\n"
+    "END FILE FORMAT DESCRIPTION\n";
+
+static int
+dict_write_bin(dict_t *d, char const *filename)
+{
+    FILE *fh;
+    int32 *index;
+    int32 val, i, n_ciphone, n_slot, n_pron, str_size;
+
+    if ((fh = fopen(filename, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open '%s'", filename);
+        return -1;
+    }
+
+    /* Build the index with a load factor of at most one half. */
+    for (n_slot = 2; n_slot < 2 * d->n_word; n_slot <<= 1)
+        ;
+    index = ckd_malloc(n_slot * sizeof(*index));
+    for (i = 0; i < n_slot; ++i)
+        index[i] = -1;
+    n_pron = str_size = 0;
+    for (i = 0; i < d->n_word; ++i) {
+        int32 h = dict_hash(d->word[i].word, d->nocase) & (n_slot - 1);
+        while (index[h] >= 0)
+            h = (h + 1) & (n_slot - 1);
+        index[h] = i;
+        n_pron += d->word[i].pronlen;
+        str_size += strlen(d->word[i].word) + 1;
+    }
+    n_ciphone = d->mdef ? bin_mdef_n_ciphone(d->mdef) : 0;
+
+    /* Byteorder marker, version and format descriptor. */
+    val = BIN_DICT_NATIVE_ENDIAN;
+    fwrite(&val, 4, 1, fh);
+    val = BIN_DICT_FORMAT_VERSION;
+    fwrite(&val, 4, 1, fh);
+    val = ((sizeof(format_desc) + 3) & ~3);
+    fwrite(&val, 4, 1, fh);
+    fwrite(format_desc, 1, sizeof(format_desc), fh);
+    i = 0;
+    fwrite(&i, 1, val - sizeof(format_desc), fh);
+
+    /* Header. */
+    fwrite(&d->n_word, 4, 1, fh);
+    fwrite(&d->filler_start, 4, 1, fh);
+    fwrite(&d->filler_end, 4, 1, fh);
+    val = d->nocase;
+    fwrite(&val, 4, 1, fh);
+    fwrite(&n_ciphone, 4, 1, fh);
+    fwrite(&n_slot, 4, 1, fh);
+    fwrite(&n_pron, 4, 1, fh);
+    fwrite(&str_size, 4, 1, fh);
+
+    /* Phone names, so that it can be checked against the mdef. */
+    for (i = 0; i < n_ciphone; ++i) {
+        char const *name = bin_mdef_ciphone_str(d->mdef, i);
+        fwrite(name, 1, strlen(name) + 1, fh);
+    }
+    val = (ftell(fh) + 3) & ~3;
+    i = 0;
+    fwrite(&i, 1, val - ftell(fh), fh);
+
+    /* Word entries, with offsets into the pronunciation and string
+     * arrays. */
+    n_pron = str_size = 0;
+    for (i = 0; i < d->n_word; ++i) {
+        int32 ent[5];
+
+        ent[0] = str_size;
+        ent[1] = n_pron;
+        ent[2] = d->word[i].pronlen;
+        ent[3] = d->word[i].alt;
+        ent[4] = d->word[i].basewid;
+        fwrite(ent, 4, 5, fh);
+        n_pron += d->word[i].pronlen;
+        str_size += strlen(d->word[i].word) + 1;
+    }
+    fwrite(index, 4, n_slot, fh);
+    ckd_free(index);
+    for (i = 0; i < d->n_word; ++i)
+        fwrite(d->word[i].ciphone, sizeof(s3cipid_t), d->word[i].pronlen, fh);
+    for (i = 0; i < d->n_word; ++i)
+        fwrite(d->word[i].word, 1, strlen(d->word[i].word) + 1, fh);
+
+    if (fclose(fh) != 0) {
+        E_ERROR_SYSTEM("Failed to write '%s'", filename);
+        return -1;
+    }
+    return 0;
+}
+
+static dict_t *
+dict_read_bin(cmd_ln_t *config, bin_mdef_t *mdef, char const *filename)
+{
+    FILE *fh;
+    dict_t *d;
+    char *data, *strings, *ciname;
+    int32 *ent, *index;
+    s3cipid_t *pron;
+    int32 hdr[8], val, i, swap, do_mmap;
+    long pos, end;
+
+    E_INFO("Reading binary dictionary: %s\n", filename);
+    if ((fh = fopen(filename, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open dictionary file '%s' for reading",
+                       filename);
+        return NULL;
+    }
+    if (fread(&val, 4, 1, fh) != 1)
+        goto error_out;
+    swap = (val == BIN_DICT_OTHER_ENDIAN);
+    if (fread(&val, 4, 1, fh) != 1)
+        goto error_out;
+    if (swap)
+        SWAP_INT32(&val);
+    if (val > BIN_DICT_FORMAT_VERSION) {
+        E_ERROR("File format version %d for %s is newer than library\n",
+                val, filename);
+        fclose(fh);
+        return NULL;
+    }
+    if (fread(&val, 4, 1, fh) != 1)
+        goto error_out;
+    if (swap)
+        SWAP_INT32(&val);
+    /* Skip format descriptor. */
+    fseek(fh, val, SEEK_CUR);
+    if (fread(hdr, 4, 8, fh) != 8)
+        goto error_out;
+    if (swap)
+        for (i = 0; i < 8; ++i)
+            SWAP_INT32(&hdr[i]);
+
+    d = ckd_calloc(1, sizeof(*d));
+    d->refcnt = 1;
+
+    /* Decide whether to read in the whole file or mmap it. */
+    do_mmap = (config && cmd_ln_exists_r(config, "-mmap"))
+        ? cmd_ln_boolean_r(config, "-mmap") : TRUE;
+    if (swap) {
+        E_INFO("Must byte-swap %s, will not memory-map it\n", filename);
+        do_mmap = FALSE;
+    }
+    if (do_mmap) {
+        d->filemap = mmio_file_read(filename);
+        if (d->filemap == NULL)
+            do_mmap = FALSE;
+    }
+    pos = ftell(fh);
+    if (do_mmap)
+        data = (char *)mmio_file_ptr(d->filemap) + pos;
+    else {
+        fseek(fh, 0, SEEK_END);
+        end = ftell(fh);
+        fseek(fh, pos, SEEK_SET);
+        d->bin_data = data = ckd_malloc(end - pos);
+        if (fread(data, 1, end - pos, fh) != end - pos) {
+            ckd_free(d->bin_data);
+            ckd_free(d);
+            goto error_out;
+        }
+    }
+    fclose(fh);
+
+    d->n_bin_word = d->n_word = hdr[0];
+    d->filler_start = hdr[1];
+    d->filler_end = hdr[2];
+    d->nocase = hdr[3];
+    d->n_bin_slot = hdr[5];
+    if (config && cmd_ln_exists_r(config, "-dictcase")
+        && cmd_ln_boolean_r(config, "-dictcase") != d->nocase)
+        E_WARN("%s was compiled with -dictcase %s, using that\n",
+               filename, d->nocase ? "yes" : "no");
+
+    /* Find the sections. */
+    ciname = data;
+    for (i = 0; i < hdr[4]; ++i)
+        data += strlen(data) + 1;
+    data = ciname + ((data - ciname + 3) & ~3);
+    ent = (int32 *)data;
+    index = ent + 5 * hdr[0];
+    pron = (s3cipid_t *)(index + hdr[5]);
+    strings = (char *)(pron + hdr[6]);
+    if (swap) {
+        for (i = 0; i < 5 * hdr[0] + hdr[5]; ++i)
+            SWAP_INT32(&ent[i]);
+        for (i = 0; i < hdr[6]; ++i)
+            SWAP_INT16(&pron[i]);
+    }
+    d->bin_index = index;
+
+    /* Map the phones to this model's IDs, copying them only if they
+     * differ from the ones the dictionary was compiled with. */
+    if (mdef && hdr[4] > 0) {
+        s3cipid_t *map = ckd_calloc(hdr[4], sizeof(*map));
+        int identity = (hdr[4] == bin_mdef_n_ciphone(mdef));
+
+        for (i = 0; i < hdr[4]; ++i) {
+            map[i] = bin_mdef_ciphone_id(mdef, ciname);
+            if (NOT_S3CIPID(map[i])) {
+                E_ERROR("Phone '%s' in %s is missing in the acoustic model\n",
+                        ciname, filename);
+                ckd_free(map);
+                d->n_bin_word = d->n_word = 0;
+                dict_free(d);
+                return NULL;
+            }
+            if (map[i] != i)
+                identity = FALSE;
+            ciname += strlen(ciname) + 1;
+        }
+        if (!identity) {
+            E_INFO("Remapping phones in %s to the acoustic model\n", filename);
+            d->bin_pron = ckd_malloc(hdr[6] * sizeof(*d->bin_pron));
+            for (i = 0; i < hdr[6]; ++i)
+                d->bin_pron[i] = map[pron[i]];
+            pron = d->bin_pron;
+        }
+        ckd_free(map);
+    }
+
+    /* Only the word array itself is allocated, with room to grow. */
+    d->max_words = d->n_word + S3DICT_INC_SZ;
+    d->word = ckd_calloc(d->max_words, sizeof(*d->word));
+    for (i = 0; i < d->n_word; ++i, ent += 5) {
+        d->word[i].word = strings + ent[0];
+        d->word[i].ciphone = ent[2] ? pron + ent[1] : NULL;
+        d->word[i].pronlen = ent[2];
+        d->word[i].alt = ent[3];
+        d->word[i].basewid = ent[4];
+    }
+    /* Words added at runtime go in the hash table. */
+    d->ht = hash_table_new(S3DICT_INC_SZ, d->nocase);
+    if (mdef)
+        d->mdef = bin_mdef_retain(mdef);
+    E_INFO("%d words read (%s)\n", d->n_word,
+           d->filemap ? "memory-mapped" : "in memory");
+
+    d->startwid = dict_wordid(d, S3_START_WORD);
+    d->finishwid = dict_wordid(d, S3_FINISH_WORD);
+    d->silwid = dict_wordid(d, S3_SILENCE_WORD);
+    if (NOT_S3WID(d->startwid) || NOT_S3WID(d->finishwid)
+        || NOT_S3WID(d->silwid) || !dict_filler_word(d, d->silwid)) {
+        E_ERROR("Binary dictionary %s lacks special words\n", filename);
+        dict_free(d);
+        return NULL;
+    }
+    return d;
+
+error_out:
+    E_ERROR_SYSTEM("Failed to read binary dictionary from %s", filename);
+    fclose(fh);
+    return NULL;
+}
+
+static int
+dict_is_bin(char const *filename)
+{
+    FILE *fh;
+    int32 val;
+
+    if ((fh = fopen(filename, "rb")) == NULL)
+        return FALSE;
+    if (fread(&val, 4, 1, fh) != 1)
+        val = 0;
+    fclose(fh);
+    return (val == BIN_DICT_NATIVE_ENDIAN || val == BIN_DICT_OTHER_ENDIAN);
+}
+
 int
 dict_write(dict_t *dict, char const *filename, char const *format)
 {
     FILE *fh;
     int i;
 
+    if (format && 0 == strcmp(format, "bin"))
+        return dict_write_bin(dict, filename);
     if ((fh = fopen(filename, "w")) == NULL) {
         E_ERROR_SYSTEM("Failed to open '%s'", filename);
         return -1;
@@ -262,6 +592,13 @@ dict_init(cmd_ln_t *config, bin_mdef_t * mdef)
         fillerfile = cmd_ln_str_r(config, "-fdict");
     }
 
+    /* Binary dictionaries are self-contained. */
+    if (dictfile && dict_is_bin(dictfile)) {
+        if (fillerfile)
+            E_INFO("Ignoring -fdict, fillers are included in %s\n", dictfile);
+        return dict_read_bin(config, mdef, dictfile);
+    }
+
     /*
      * First obtain #words in dictionary (for hash table allocation).
      * Reason: The PC NT system doesn't like to grow memory gradually.  Better to allocate
@@ -386,6 +723,8 @@ dict_wordid(dict_t *d, const char *word)
     assert(d);
     assert(word);
 
+    if ((w = dict_bin_lookup(d, word)) != BAD_S3WID)
+        return w;
     if (hash_table_lookup_int32(d->ht, word, &w) < 0)
         return (BAD_S3WID);
     return w;
@@ -458,8 +797,9 @@ dict_free(dict_t * d)
     if (--d->refcnt > 0)
         return d->refcnt;
 
-    /* First Step, free all memory allocated for each word */
-    for (i = 0; i < d->n_word; i++) {
+    /* First Step, free all memory allocated for each word (those
+     * from a binary dictionary point into its data) */
+    for (i = d->n_bin_word; i < d->n_word; i++) {
         word = (dictword_t *) & (d->word[i]);
         if (word->word)
             ckd_free((void *) word->word);
@@ -471,6 +811,10 @@ dict_free(dict_t * d)
         ckd_free((void *) d->word);
     if (d->ht)
         hash_table_free(d->ht);
+    if (d->filemap)
+        mmio_file_unmap(d->filemap);
+    ckd_free(d->bin_data);
+    ckd_free(d->bin_pron);
     if (d->mdef)
         bin_mdef_free(d->mdef);
     ckd_free((void *) d);
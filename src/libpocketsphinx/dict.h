@@ -44,6 +44,7 @@
 
 /* SphinxBase headers. */
 #include <sphinxbase/hash_table.h>
+#include <sphinxbase/mmio.h>
 
 /* Local headers. */
 #include "s3types.h"
@@ -52,6 +53,11 @@
 
 #define S3DICT_INC_SZ 4096
 
+#define BIN_DICT_FORMAT_VERSION 1
+/* Little-endian machines will write "BDIC" to disk, big-endian ones "CIDB". */
+#define BIN_DICT_NATIVE_ENDIAN 0x43494442 /* 'BDIC' in little-endian order */
+#define BIN_DICT_OTHER_ENDIAN 0x42444943  /* 'BDIC' in big-endian order */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -89,6 +95,14 @@ typedef struct {
     s3wid_t finishwid;	/**< FOR INTERNAL-USE ONLY */
     s3wid_t silwid;	/**< FOR INTERNAL-USE ONLY */
     int nocase;
+
+    /* Binary dictionaries (see dict_write()): */
+    mmio_file_t *filemap;	/**< Memory map of binary dictionary (if any) */
+    void *bin_data;		/**< Binary dictionary contents, if not memory-mapped */
+    s3cipid_t *bin_pron;	/**< Pronunciations, if remapped to mdef phone IDs */
+    int32 const *bin_index;	/**< Open-addressed hash index of binary dictionary words */
+    int32 n_bin_slot;		/**< Size of bin_index (a power of two) */
+    int32 n_bin_word;		/**< Number of words from binary dictionary */
 } dict_t;
 
 
@@ -101,6 +115,11 @@ typedef struct {
  *
  * Otherwise an empty case-sensitive dictionary will be created.
  *
+ * If -dict is a binary dictionary written by dict_write(), it is
+ * memory-mapped (subject to -mmap) and already contains the filler
+ * words, so -fdict is ignored.  Words added with dict_add_word() are
+ * kept on top of it.
+ *
  * Return ptr to dict_t if successful, NULL otherwise.
  */
 dict_t *dict_init(cmd_ln_t *config, /**< Configuration (-dict, -fdict, -dictcase) or NULL */
@@ -109,6 +128,10 @@ dict_t *dict_init(cmd_ln_t *config, /**< Configuration (-dict, -fdict, -dictcase
 
 /**
  * Write dictionary to a file.
+ *
+ * @param format NULL or "text" to write the real words as a text
+ *               dictionary, or "bin" to write the whole dictionary,
+ *               including fillers, in binary form.
  */
 int dict_write(dict_t *dict, char const *filename, char const *format);
 
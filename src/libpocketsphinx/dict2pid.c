@@ -77,123 +77,181 @@ compress_table(s3ssid_t * uncomp_tab, s3ssid_t * com_tab,
 }
 
 
+/*
+ * Return the row of ssids in *slot, allocating it (filled with
+ * BAD_S3SSID) if it is still the shared bad row.
+ */
+static s3ssid_t *
+dict2pid_row(dict2pid_t *d2p, s3ssid_t **slot)
+{
+    int32 n_ci = bin_mdef_n_ciphone(d2p->mdef);
+    int32 i;
+
+    if (*slot == d2p->bad_row) {
+        *slot = ckd_malloc(n_ci * sizeof(**slot));
+        for (i = 0; i < n_ci; ++i)
+            (*slot)[i] = BAD_S3SSID;
+        d2p->alloc += n_ci * sizeof(**slot);
+    }
+    return *slot;
+}
+
+/*
+ * Allocate a table of row pointers which all point to the bad row.
+ */
+static s3ssid_t ***
+dict2pid_sparse_3d(dict2pid_t *d2p)
+{
+    int32 n_ci = bin_mdef_n_ciphone(d2p->mdef);
+    s3ssid_t ***tab;
+    int32 b, i;
+
+    tab = (s3ssid_t ***) ckd_calloc_2d(n_ci, n_ci, sizeof(s3ssid_t *));
+    for (b = 0; b < n_ci; ++b)
+        for (i = 0; i < n_ci; ++i)
+            tab[b][i] = d2p->bad_row;
+    d2p->alloc += n_ci * (n_ci + 1) * sizeof(s3ssid_t *);
+    return tab;
+}
+
+static void
+free_sparse_3d(dict2pid_t *d2p, s3ssid_t ***tab)
+{
+    int32 n_ci = bin_mdef_n_ciphone(d2p->mdef);
+    int32 b, i;
+
+    for (b = 0; b < n_ci; ++b)
+        for (i = 0; i < n_ci; ++i)
+            if (tab[b][i] != d2p->bad_row)
+                ckd_free(tab[b][i]);
+    ckd_free_2d((void **) tab);
+}
+
+/*
+ * Compress one row of right-context ssids into an xwdssid_t.
+ */
+static void
+compress_xwdssid(dict2pid_t *d2p, xwdssid_t *xwd, s3ssid_t *rmap,
+                 s3ssid_t *tmpssid, s3cipid_t *tmpcimap)
+{
+    int32 n_ci = bin_mdef_n_ciphone(d2p->mdef);
+    int32 r;
+
+    compress_table(rmap, tmpssid, tmpcimap, n_ci);
+    for (r = 0; r < n_ci && tmpssid[r] != BAD_S3SSID; r++)
+        ;
+    if (tmpssid[0] != BAD_S3SSID) {
+        xwd->ssid = ckd_calloc(r, sizeof(s3ssid_t));
+        memcpy(xwd->ssid, tmpssid, r * sizeof(s3ssid_t));
+        xwd->cimap = ckd_calloc(n_ci, sizeof(s3cipid_t));
+        memcpy(xwd->cimap, tmpcimap, n_ci * sizeof(s3cipid_t));
+        xwd->n_ssid = r;
+        d2p->alloc += r * sizeof(s3ssid_t) + n_ci * sizeof(s3cipid_t);
+    }
+    else {
+        xwd->ssid = NULL;
+        xwd->cimap = NULL;
+        xwd->n_ssid = 0;
+    }
+}
+
+/*
+ * Return the row of xwdssid_t in tree[b], allocating it if it is
+ * still the shared empty row.
+ */
+static xwdssid_t *
+dict2pid_xwd_row(dict2pid_t *d2p, xwdssid_t **tree, int32 b)
+{
+    int32 n_ci = bin_mdef_n_ciphone(d2p->mdef);
+
+    if (tree[b] == d2p->empty_xwd) {
+        tree[b] = ckd_calloc(n_ci, sizeof(xwdssid_t));
+        d2p->alloc += n_ci * sizeof(xwdssid_t);
+    }
+    return tree[b];
+}
+
+static xwdssid_t **
+alloc_xwd_tree(dict2pid_t *d2p)
+{
+    int32 n_ci = bin_mdef_n_ciphone(d2p->mdef);
+    xwdssid_t **tree;
+    int32 b;
+
+    tree = ckd_calloc(n_ci, sizeof(*tree));
+    for (b = 0; b < n_ci; ++b)
+        tree[b] = d2p->empty_xwd;
+    d2p->alloc += n_ci * sizeof(*tree);
+    return tree;
+}
+
 static void
 compress_right_context_tree(dict2pid_t * d2p,
                             s3ssid_t ***rdiph_rc)
 {
     int32 n_ci;
-    int32 b, l, r;
-    s3ssid_t *rmap;
+    int32 b, l;
     s3ssid_t *tmpssid;
     s3cipid_t *tmpcimap;
     bin_mdef_t *mdef = d2p->mdef;
-    size_t alloc;
 
     n_ci = mdef->n_ciphone;
 
     tmpssid = ckd_calloc(n_ci, sizeof(s3ssid_t));
     tmpcimap = ckd_calloc(n_ci, sizeof(s3cipid_t));
 
-    d2p->rssid =
-        (xwdssid_t **) ckd_calloc(mdef->n_ciphone, sizeof(xwdssid_t *));
-    alloc = mdef->n_ciphone * sizeof(xwdssid_t *);
-
+    d2p->rssid = alloc_xwd_tree(d2p);
     for (b = 0; b < n_ci; b++) {
-        d2p->rssid[b] =
-            (xwdssid_t *) ckd_calloc(mdef->n_ciphone, sizeof(xwdssid_t));
-        alloc += mdef->n_ciphone * sizeof(xwdssid_t);
-
         for (l = 0; l < n_ci; l++) {
-            rmap = rdiph_rc[b][l];
-            compress_table(rmap, tmpssid, tmpcimap, mdef->n_ciphone);
-
-            for (r = 0; r < mdef->n_ciphone && tmpssid[r] != BAD_S3SSID;
-                 r++);
-
-            if (tmpssid[0] != BAD_S3SSID) {
-                d2p->rssid[b][l].ssid = ckd_calloc(r, sizeof(s3ssid_t));
-                memcpy(d2p->rssid[b][l].ssid, tmpssid,
-                       r * sizeof(s3ssid_t));
-                d2p->rssid[b][l].cimap =
-                    ckd_calloc(mdef->n_ciphone, sizeof(s3cipid_t));
-                memcpy(d2p->rssid[b][l].cimap, tmpcimap,
-                       (mdef->n_ciphone) * sizeof(s3cipid_t));
-                d2p->rssid[b][l].n_ssid = r;
-            }
-            else {
-                d2p->rssid[b][l].ssid = NULL;
-                d2p->rssid[b][l].cimap = NULL;
-                d2p->rssid[b][l].n_ssid = 0;
-            }
+            if (rdiph_rc[b][l] == d2p->bad_row)
+                continue;
+            compress_xwdssid(d2p, &dict2pid_xwd_row(d2p, d2p->rssid, b)[l],
+                             rdiph_rc[b][l], tmpssid, tmpcimap);
+            ++d2p->n_rdiph;
         }
     }
 
-    E_INFO("Allocated %d bytes (%d KiB) for word-final triphones\n",
-           (int)alloc, (int)alloc / 1024);
     ckd_free(tmpssid);
     ckd_free(tmpcimap);
 }
 
 static void
-compress_left_right_context_tree(dict2pid_t * d2p)
+compress_left_right_context(dict2pid_t * d2p, int32 b)
 {
     int32 n_ci;
-    int32 b, l, r;
-    s3ssid_t *rmap;
+    int32 l;
     s3ssid_t *tmpssid;
     s3cipid_t *tmpcimap;
-    bin_mdef_t *mdef = d2p->mdef;
-    size_t alloc;
-
-    n_ci = mdef->n_ciphone;
+    xwdssid_t *row;
 
+    n_ci = bin_mdef_n_ciphone(d2p->mdef);
     tmpssid = ckd_calloc(n_ci, sizeof(s3ssid_t));
     tmpcimap = ckd_calloc(n_ci, sizeof(s3cipid_t));
 
-    assert(d2p->lrdiph_rc);
-
-    d2p->lrssid =
-        (xwdssid_t **) ckd_calloc(mdef->n_ciphone, sizeof(xwdssid_t *));
-    alloc = mdef->n_ciphone * sizeof(xwdssid_t *);
-
-    for (b = 0; b < n_ci; b++) {
-
-        d2p->lrssid[b] =
-            (xwdssid_t *) ckd_calloc(mdef->n_ciphone, sizeof(xwdssid_t));
-        alloc += mdef->n_ciphone * sizeof(xwdssid_t);
-
-        for (l = 0; l < n_ci; l++) {
-            rmap = d2p->lrdiph_rc[b][l];
-
-            compress_table(rmap, tmpssid, tmpcimap, mdef->n_ciphone);
-
-            for (r = 0; r < mdef->n_ciphone && tmpssid[r] != BAD_S3SSID;
-                 r++);
-
-            if (tmpssid[0] != BAD_S3SSID) {
-                d2p->lrssid[b][l].ssid = ckd_calloc(r, sizeof(s3ssid_t));
-                memcpy(d2p->lrssid[b][l].ssid, tmpssid,
-                       r * sizeof(s3ssid_t));
-                d2p->lrssid[b][l].cimap =
-                    ckd_calloc(mdef->n_ciphone, sizeof(s3cipid_t));
-                memcpy(d2p->lrssid[b][l].cimap, tmpcimap,
-                       (mdef->n_ciphone) * sizeof(s3cipid_t));
-                d2p->lrssid[b][l].n_ssid = r;
-            }
-            else {
-                d2p->lrssid[b][l].ssid = NULL;
-                d2p->lrssid[b][l].cimap = NULL;
-                d2p->lrssid[b][l].n_ssid = 0;
-            }
-        }
+    row = dict2pid_xwd_row(d2p, d2p->lrssid, b);
+    for (l = 0; l < n_ci; l++) {
+        ckd_free(row[l].ssid);
+        ckd_free(row[l].cimap);
+        compress_xwdssid(d2p, &row[l], d2p->lrdiph_rc[b][l],
+                         tmpssid, tmpcimap);
     }
 
-    /* Try to compress lrdiph_rc into lrdiph_rc_compressed */
     ckd_free(tmpssid);
     ckd_free(tmpcimap);
+}
+
+static void
+compress_left_right_context_tree(dict2pid_t * d2p)
+{
+    int32 b;
+
+    assert(d2p->lrdiph_rc);
 
-    E_INFO("Allocated %d bytes (%d KiB) for single-phone word triphones\n",
-           (int)alloc, (int)alloc / 1024);
+    d2p->lrssid = alloc_xwd_tree(d2p);
+    for (b = 0; b < bin_mdef_n_ciphone(d2p->mdef); b++) {
+        if (d2p->lrdiph_rc[b] != d2p->bad_table)
+            compress_left_right_context(d2p, b);
+    }
 }
 
 /**
@@ -250,10 +308,12 @@ dict2pid_get_rcmap(dict2pid_t * d2p, s3wid_t w)
 }
 
 static void
-free_compress_map(xwdssid_t ** tree, int32 n_ci)
+free_compress_map(dict2pid_t *d2p, xwdssid_t ** tree, int32 n_ci)
 {
     int32 b, l;
     for (b = 0; b < n_ci; b++) {
+        if (tree[b] == d2p->empty_xwd)
+            continue;
         for (l = 0; l < n_ci; l++) {
             ckd_free(tree[b][l].ssid);
             ckd_free(tree[b][l].cimap);
@@ -267,8 +327,20 @@ static void
 populate_lrdiph(dict2pid_t *d2p, s3ssid_t ***rdiph_rc, s3cipid_t b)
 {
     bin_mdef_t *mdef = d2p->mdef;
-    s3cipid_t l, r;
-
+    s3cipid_t l, r, sil = bin_mdef_silphone(mdef);
+    s3ssid_t *ldiph_sil, *rdiph_sil;
+
+    if (d2p->lrdiph_rc[b] == d2p->bad_table) {
+        d2p->lrdiph_rc[b] = (s3ssid_t **)
+            ckd_calloc_2d(bin_mdef_n_ciphone(mdef), bin_mdef_n_ciphone(mdef),
+                          sizeof(s3ssid_t));
+        d2p->alloc += bin_mdef_n_ciphone(mdef) * (sizeof(s3ssid_t *)
+                                                  + bin_mdef_n_ciphone(mdef)
+                                                  * sizeof(s3ssid_t));
+        ++d2p->n_single;
+    }
+    ldiph_sil = dict2pid_row(d2p, &d2p->ldiph_lc[b][sil]);
+    rdiph_sil = rdiph_rc ? dict2pid_row(d2p, &rdiph_rc[b][sil]) : NULL;
     for (l = 0; l < bin_mdef_n_ciphone(mdef); l++) {
         for (r = 0; r < bin_mdef_n_ciphone(mdef); r++) {
             s3pid_t p;
@@ -278,12 +350,10 @@ populate_lrdiph(dict2pid_t *d2p, s3ssid_t ***rdiph_rc, s3cipid_t b)
                                           WORD_POSN_SINGLE);
             d2p->lrdiph_rc[b][l][r]
                 = bin_mdef_pid2ssid(mdef, p);
-            if (r == bin_mdef_silphone(mdef))
-                d2p->ldiph_lc[b][r][l]
-                    = bin_mdef_pid2ssid(mdef, p);
-            if (rdiph_rc && l == bin_mdef_silphone(mdef))
-                rdiph_rc[b][l][r]
-                    = bin_mdef_pid2ssid(mdef, p);
+            if (r == sil)
+                ldiph_sil[l] = bin_mdef_pid2ssid(mdef, p);
+            if (rdiph_sil && l == sil)
+                rdiph_sil[r] = bin_mdef_pid2ssid(mdef, p);
             assert(IS_S3SSID(bin_mdef_pid2ssid(mdef, p)));
             E_DEBUG(2,("%s(%s,%s) => %d / %d\n",
                        bin_mdef_ciphone_str(mdef, b),
@@ -294,6 +364,39 @@ populate_lrdiph(dict2pid_t *d2p, s3ssid_t ***rdiph_rc, s3cipid_t b)
     }
 }
 
+/*
+ * Fill in all left contexts for word-initial diphone b(?,r).
+ */
+static void
+populate_ldiph(dict2pid_t *d2p, s3cipid_t b, s3cipid_t r)
+{
+    bin_mdef_t *mdef = d2p->mdef;
+    s3ssid_t *row;
+    s3cipid_t l;
+
+    row = dict2pid_row(d2p, &d2p->ldiph_lc[b][r]);
+    for (l = 0; l < bin_mdef_n_ciphone(mdef); l++) {
+        int p = bin_mdef_phone_id_nearest(mdef, b, l, r, WORD_POSN_BEGIN);
+        row[l] = bin_mdef_pid2ssid(mdef, p);
+    }
+    ++d2p->n_ldiph;
+}
+
+/*
+ * Fill in all right contexts for word-final diphone b(l,?).
+ */
+static void
+populate_rdiph(dict2pid_t *d2p, s3ssid_t *rmap, s3cipid_t b, s3cipid_t l)
+{
+    bin_mdef_t *mdef = d2p->mdef;
+    s3cipid_t r;
+
+    for (r = 0; r < bin_mdef_n_ciphone(mdef); r++) {
+        int p = bin_mdef_phone_id_nearest(mdef, b, l, r, WORD_POSN_END);
+        rmap[r] = bin_mdef_pid2ssid(mdef, p);
+    }
+}
+
 int
 dict2pid_add_word(dict2pid_t *d2p,
                   int32 wid)
@@ -302,7 +405,7 @@ dict2pid_add_word(dict2pid_t *d2p,
     dict_t *d = d2p->dict;
 
     if (dict_pronlen(d, wid) > 1) {
-        s3cipid_t l;
+        s3cipid_t b, l;
         /* Make sure we have left and right context diphones for this
          * word. */
         if (d2p->ldiph_lc[dict_first_phone(d, wid)][dict_second_phone(d, wid)][0]
@@ -310,44 +413,29 @@ dict2pid_add_word(dict2pid_t *d2p,
             E_DEBUG(2, ("Filling in left-context diphones for %s(?,%s)\n",
                    bin_mdef_ciphone_str(mdef, dict_first_phone(d, wid)),
                    bin_mdef_ciphone_str(mdef, dict_second_phone(d, wid))));
-            for (l = 0; l < bin_mdef_n_ciphone(mdef); l++) {
-                int p
-                    = bin_mdef_phone_id_nearest(mdef,
-                                                dict_first_phone(d, wid), l,
-                                                dict_second_phone(d, wid),
-                                                WORD_POSN_BEGIN);
-                d2p->ldiph_lc[dict_first_phone(d, wid)][dict_second_phone(d, wid)][l]
-                    = bin_mdef_pid2ssid(mdef, p);
-            }
+            populate_ldiph(d2p, dict_first_phone(d, wid),
+                           dict_second_phone(d, wid));
         }
-        if (d2p->rssid[dict_last_phone(d, wid)][dict_second_last_phone(d, wid)].n_ssid
-            == 0) {
+        b = dict_last_phone(d, wid);
+        l = dict_second_last_phone(d, wid);
+        if (d2p->rssid[b][l].n_ssid == 0) {
             s3ssid_t *rmap;
             s3ssid_t *tmpssid;
             s3cipid_t *tmpcimap;
-            s3cipid_t r;
 
             E_DEBUG(2, ("Filling in right-context diphones for %s(%s,?)\n",
-                   bin_mdef_ciphone_str(mdef, dict_last_phone(d, wid)),
-                   bin_mdef_ciphone_str(mdef, dict_second_last_phone(d, wid))));
+                   bin_mdef_ciphone_str(mdef, b),
+                   bin_mdef_ciphone_str(mdef, l)));
             rmap = ckd_calloc(bin_mdef_n_ciphone(mdef), sizeof(*rmap));
-            for (r = 0; r < bin_mdef_n_ciphone(mdef); r++) {
-                int p
-                    = bin_mdef_phone_id_nearest(mdef,
-                                                dict_last_phone(d, wid),
-                                                dict_second_last_phone(d, wid), r,
-                                                WORD_POSN_END);
-                rmap[r] = bin_mdef_pid2ssid(mdef, p);
-            }
             tmpssid = ckd_calloc(bin_mdef_n_ciphone(mdef), sizeof(*tmpssid));
             tmpcimap = ckd_calloc(bin_mdef_n_ciphone(mdef), sizeof(*tmpcimap));
-            compress_table(rmap, tmpssid, tmpcimap, bin_mdef_n_ciphone(mdef));
-            for (r = 0; r < mdef->n_ciphone && tmpssid[r] != BAD_S3SSID; r++)
-                ;
-            d2p->rssid[dict_last_phone(d, wid)][dict_second_last_phone(d, wid)].ssid = tmpssid;
-            d2p->rssid[dict_last_phone(d, wid)][dict_second_last_phone(d, wid)].cimap = tmpcimap;
-            d2p->rssid[dict_last_phone(d, wid)][dict_second_last_phone(d, wid)].n_ssid = r;
+            populate_rdiph(d2p, rmap, b, l);
+            compress_xwdssid(d2p, &dict2pid_xwd_row(d2p, d2p->rssid, b)[l],
+                             rmap, tmpssid, tmpcimap);
+            ++d2p->n_rdiph;
             ckd_free(rmap);
+            ckd_free(tmpssid);
+            ckd_free(tmpcimap);
         }
     }
     else {
@@ -357,6 +445,7 @@ dict2pid_add_word(dict2pid_t *d2p,
                bin_mdef_ciphone_str(mdef, dict_first_phone(d, wid)));
         if (d2p->lrdiph_rc[dict_first_phone(d, wid)][0][0] == BAD_S3SSID) {
             populate_lrdiph(d2p, NULL, dict_first_phone(d, wid));
+            compress_left_right_context(d2p, dict_first_phone(d, wid));
         }
     }
 
@@ -391,7 +480,7 @@ dict2pid_build(bin_mdef_t * mdef, dict_t * dict)
     s3ssid_t ***rdiph_rc;
     bitvec_t *ldiph, *rdiph, *single;
     int32 pronlen;
-    int32 b, l, r, w, p;
+    int32 b, l, r, w;
 
     E_INFO("Building PID tables for dictionary\n");
     assert(mdef);
@@ -401,33 +490,27 @@ dict2pid_build(bin_mdef_t * mdef, dict_t * dict)
     dict2pid->refcount = 1;
     dict2pid->mdef = bin_mdef_retain(mdef);
     dict2pid->dict = dict_retain(dict);
-    E_INFO("Allocating %d^3 * %d bytes (%d KiB) for word-initial triphones\n",
-           mdef->n_ciphone, sizeof(s3ssid_t),
-           mdef->n_ciphone * mdef->n_ciphone * mdef->n_ciphone * sizeof(s3ssid_t) / 1024);
-    dict2pid->ldiph_lc =
-        (s3ssid_t ***) ckd_calloc_3d(mdef->n_ciphone, mdef->n_ciphone,
-                                     mdef->n_ciphone, sizeof(s3ssid_t));
+    ptmr_init(&dict2pid->build_time);
+    ptmr_start(&dict2pid->build_time);
+
+    /* Shared placeholders for everything not in the dictionary. */
+    dict2pid->bad_row = ckd_malloc(mdef->n_ciphone * sizeof(s3ssid_t));
+    for (l = 0; l < mdef->n_ciphone; ++l)
+        dict2pid->bad_row[l] = BAD_S3SSID;
+    dict2pid->bad_table = ckd_calloc(mdef->n_ciphone, sizeof(s3ssid_t *));
+    for (l = 0; l < mdef->n_ciphone; ++l)
+        dict2pid->bad_table[l] = dict2pid->bad_row;
+    dict2pid->empty_xwd = ckd_calloc(mdef->n_ciphone, sizeof(xwdssid_t));
+    dict2pid->alloc = mdef->n_ciphone * (sizeof(s3ssid_t) + sizeof(s3ssid_t *)
+                                         + sizeof(xwdssid_t));
+
+    dict2pid->ldiph_lc = dict2pid_sparse_3d(dict2pid);
     /* Only used internally to generate rssid */
-    rdiph_rc =
-        (s3ssid_t ***) ckd_calloc_3d(mdef->n_ciphone, mdef->n_ciphone,
-                                     mdef->n_ciphone, sizeof(s3ssid_t));
-
-    dict2pid->lrdiph_rc = (s3ssid_t ***) ckd_calloc_3d(mdef->n_ciphone,
-                                                       mdef->n_ciphone,
-                                                       mdef->n_ciphone,
-                                                       sizeof
-                                                       (s3ssid_t));
-    /* Actually could use memset for this, if BAD_S3SSID is guaranteed
-     * to be 65535... */
-    for (b = 0; b < mdef->n_ciphone; ++b) {
-        for (r = 0; r < mdef->n_ciphone; ++r) {
-            for (l = 0; l < mdef->n_ciphone; ++l) {
-                dict2pid->ldiph_lc[b][r][l] = BAD_S3SSID;
-                dict2pid->lrdiph_rc[b][l][r] = BAD_S3SSID;
-                rdiph_rc[b][l][r] = BAD_S3SSID;
-            }
-        }
-    }
+    rdiph_rc = dict2pid_sparse_3d(dict2pid);
+    dict2pid->lrdiph_rc = ckd_calloc(mdef->n_ciphone, sizeof(s3ssid_t **));
+    for (b = 0; b < mdef->n_ciphone; ++b)
+        dict2pid->lrdiph_rc[b] = dict2pid->bad_table;
+    dict2pid->alloc += mdef->n_ciphone * sizeof(s3ssid_t **);
 
     /* Track which diphones / ciphones have been seen. */
     ldiph = bitvec_alloc(mdef->n_ciphone * mdef->n_ciphone);
@@ -446,12 +529,7 @@ dict2pid_build(bin_mdef_t * mdef, dict_t * dict)
                 bitvec_set(ldiph, b * mdef->n_ciphone + r);
 
                 /* Record all possible ssids for b(?,r) */
-                for (l = 0; l < bin_mdef_n_ciphone(mdef); l++) {
-                    p = bin_mdef_phone_id_nearest(mdef, (s3cipid_t) b,
-                                              (s3cipid_t) l, (s3cipid_t) r,
-                                              WORD_POSN_BEGIN);
-                    dict2pid->ldiph_lc[b][r][l] = bin_mdef_pid2ssid(mdef, p);
-                }
+                populate_ldiph(dict2pid, b, r);
             }
 
 
@@ -462,12 +540,8 @@ dict2pid_build(bin_mdef_t * mdef, dict_t * dict)
                 /* Mark this diphone as done */
                 bitvec_set(rdiph, b * mdef->n_ciphone + l);
 
-                for (r = 0; r < bin_mdef_n_ciphone(mdef); r++) {
-                    p = bin_mdef_phone_id_nearest(mdef, (s3cipid_t) b,
-                                              (s3cipid_t) l, (s3cipid_t) r,
-                                              WORD_POSN_END);
-                    rdiph_rc[b][l][r] = bin_mdef_pid2ssid(mdef, p);
-                }
+                populate_rdiph(dict2pid,
+                               dict2pid_row(dict2pid, &rdiph_rc[b][l]), b, l);
             }
         }
         else if (pronlen == 1) {
@@ -490,8 +564,11 @@ dict2pid_build(bin_mdef_t * mdef, dict_t * dict)
     compress_right_context_tree(dict2pid, rdiph_rc);
     compress_left_right_context_tree(dict2pid);
 
-    ckd_free_3d(rdiph_rc);
+    /* rdiph_rc is freed, so don't count it. */
+    free_sparse_3d(dict2pid, rdiph_rc);
+    dict2pid->alloc -= mdef->n_ciphone * (mdef->n_ciphone + 1) * sizeof(s3ssid_t *);
 
+    ptmr_stop(&dict2pid->build_time);
     dict2pid_report(dict2pid);
     return dict2pid;
 }
@@ -512,16 +589,25 @@ dict2pid_free(dict2pid_t * d2p)
         return d2p->refcount;
 
     if (d2p->ldiph_lc)
-        ckd_free_3d((void ***) d2p->ldiph_lc);
-
-    if (d2p->lrdiph_rc)
-        ckd_free_3d((void ***) d2p->lrdiph_rc);
+        free_sparse_3d(d2p, d2p->ldiph_lc);
+
+    if (d2p->lrdiph_rc) {
+        int32 b;
+        for (b = 0; b < bin_mdef_n_ciphone(d2p->mdef); ++b)
+            if (d2p->lrdiph_rc[b] != d2p->bad_table)
+                ckd_free_2d((void **) d2p->lrdiph_rc[b]);
+        ckd_free(d2p->lrdiph_rc);
+    }
 
     if (d2p->rssid)
-        free_compress_map(d2p->rssid, bin_mdef_n_ciphone(d2p->mdef));
+        free_compress_map(d2p, d2p->rssid, bin_mdef_n_ciphone(d2p->mdef));
 
     if (d2p->lrssid)
-        free_compress_map(d2p->lrssid, bin_mdef_n_ciphone(d2p->mdef));
+        free_compress_map(d2p, d2p->lrssid, bin_mdef_n_ciphone(d2p->mdef));
+
+    ckd_free(d2p->bad_row);
+    ckd_free(d2p->bad_table);
+    ckd_free(d2p->empty_xwd);
 
     bin_mdef_free(d2p->mdef);
     dict_free(d2p->dict);
@@ -532,6 +618,16 @@ dict2pid_free(dict2pid_t * d2p)
 void
 dict2pid_report(dict2pid_t * d2p)
 {
+    int32 n_ci = bin_mdef_n_ciphone(d2p->mdef);
+
+    E_INFO("%d word-initial, %d word-final diphones, %d single-phone bases"
+           " out of %d CI phones\n",
+           d2p->n_ldiph, d2p->n_rdiph, d2p->n_single, n_ci);
+    E_INFO("Allocated %d KiB for cross-word triphones (%d KiB if dense)\n",
+           (int)(d2p->alloc / 1024),
+           (int)(2 * n_ci * n_ci * n_ci * sizeof(s3ssid_t) / 1024));
+    E_INFO("Built in %.3f sec CPU, %.3f sec elapsed\n",
+           d2p->build_time.t_cpu, d2p->build_time.t_elapsed);
 }
 
 void
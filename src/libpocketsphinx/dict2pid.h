@@ -105,6 +105,7 @@
 /* SphinxBase headers. */
 #include <sphinxbase/logmath.h>
 #include <sphinxbase/bitvec.h>
+#include <sphinxbase/profile.h>
 
 /* Local headers. */
 #include "s3types.h"
@@ -152,10 +153,13 @@ typedef struct {
                                    internal ssids on the fly. */
     dict_t *dict;               /**< Dictionary this table refers to. */
 
+    /*
+     * The cross-word tables below are sparse: rows for phone
+     * combinations that do not occur in the dictionary all point to
+     * bad_row (or bad_table, or empty_xwd), so lookups never need to
+     * check for them, and only rows that are used take up memory.
+     */
     /*Notice the order of the arguments */
-    /* FIXME: This is crying out for compression - in Mandarin we have
-     * 180 context independent phones, which makes this an 11MB
-     * array. */
     s3ssid_t ***ldiph_lc;	/**< For multi-phone words, [base][rc][lc] -> ssid; filled out for
 				   word-initial base x rc combinations in current vocabulary */
 
@@ -173,6 +177,15 @@ typedef struct {
                                     First dimension: base phone,
                                     Second dimension: left context. 
                                  */
+
+    s3ssid_t *bad_row;          /**< Shared row of BAD_S3SSID for unused diphones */
+    s3ssid_t **bad_table;       /**< Shared table of bad_row for unused single phones */
+    xwdssid_t *empty_xwd;       /**< Shared row of empty entries for unused base phones */
+    size_t alloc;               /**< Bytes allocated for cross-word tables */
+    int32 n_ldiph;              /**< Number of word-initial diphones in ldiph_lc */
+    int32 n_rdiph;              /**< Number of word-final diphones in rssid */
+    int32 n_single;             /**< Number of single-phone bases in lrdiph_rc */
+    ptmr_t build_time;          /**< Time taken by dict2pid_build() */
 } dict2pid_t;
 
 /** Access macros; not designed for arbitrary use */
@@ -49,6 +49,7 @@
 
 /* Local headers. */
 #include "fsg_lextree.h"
+#include "fsg_optimize.h"
 
 #define __FSG_DBG__		0
 
@@ -82,6 +83,14 @@ static void fsg_psubtree_free(fsg_pnode_t *alloc_head);
  */
 static void fsg_psubtree_dump(fsg_lextree_t *tree, fsg_pnode_t *root, FILE *fp);
 
+static fsg_pnode_t *psubtree_add_trans(fsg_lextree_t *lextree,
+                                       fsg_pnode_t * root,
+                                       fsg_glist_linklist_t **curglist,
+                                       fsg_link_t * fsglink,
+                                       int16 *lclist, int16 *rclist,
+                                       fsg_pnode_t ** alloc_head);
+void fsg_glist_linklist_free(fsg_glist_linklist_t *glist);
+
 /**
  * Compute the left and right context CIphone sets for each state.
  */
@@ -154,33 +163,30 @@ fsg_lextree_lc_rc(fsg_lextree_t *lextree)
     }
 
     /*
-     * Propagate lc and rc lists past null transitions.  (Since FSG contains
-     * null transitions closure, no need to worry about a chain of successive
-     * null transitions.  Right??)
+     * Propagate lc and rc lists past null transitions, using the null
+     * closure so that chains of them are taken care of.
      *
      * This can't be joined with the previous loop because we first calculate 
      * contexts and only then we can propagate them.
      */
     for (s = 0; s < fsg->n_state; s++) {
-        fsg_arciter_t *itor;
-        for (itor = fsg_model_arcs(fsg, s); itor; itor = fsg_arciter_next(itor)) {
-            fsg_link_t *l = fsg_arciter_get(itor);
-            if (fsg_link_wid(l) < 0) {
+        fsg_link_t *l = fsg_lextree_null(lextree, s);
+        int32 n_null = fsg_lextree_n_null(lextree, s);
 
-                /*
-                 * lclist(d) |= lclist(s), because all the words ending up at s, can
-                 * now also end at d, becoming the left context for words leaving d.
-                 */
-                for (i = 0; i < n_ci; i++)
-                    lextree->lc[fsg_link_to_state(l)][i] |= lextree->lc[fsg_link_from_state(l)][i];
-                /*
-                 * Similarly, rclist(s) |= rclist(d), because all the words leaving d
-                 * can equivalently leave s, becoming the right context for words
-                 * ending up at s.
-                 */
-                for (i = 0; i < n_ci; i++)
-                    lextree->rc[fsg_link_from_state(l)][i] |= lextree->rc[fsg_link_to_state(l)][i];
-            }
+        for (j = 0; j < n_null; ++j, ++l) {
+            /*
+             * lclist(d) |= lclist(s), because all the words ending up at s, can
+             * now also end at d, becoming the left context for words leaving d.
+             */
+            for (i = 0; i < n_ci; i++)
+                lextree->lc[fsg_link_to_state(l)][i] |= lextree->lc[fsg_link_from_state(l)][i];
+            /*
+             * Similarly, rclist(s) |= rclist(d), because all the words leaving d
+             * can equivalently leave s, becoming the right context for words
+             * ending up at s.
+             */
+            for (i = 0; i < n_ci; i++)
+                lextree->rc[fsg_link_from_state(l)][i] |= lextree->rc[fsg_link_to_state(l)][i];
         }
     }
 
@@ -214,7 +220,7 @@ fsg_lextree_init(fsg_model_t * fsg, dict_t *dict, dict2pid_t *d2p,
                  bin_mdef_t *mdef, hmm_context_t *ctx,
                  int32 wip, int32 pip)
 {
-    int32 s, n_leaves;
+    int32 s, n_leaves, n_null;
     fsg_lextree_t *lextree;
     fsg_pnode_t *pn;
 
@@ -231,7 +237,10 @@ fsg_lextree_init(fsg_model_t * fsg, dict_t *dict, dict2pid_t *d2p,
     lextree->wip = wip;
     lextree->pip = pip;
 
-    /* Compute lc and rc for fsg. */
+    /* Compute null transition closure, then lc and rc for fsg. */
+    n_null = fsg_null_closure(fsg, &lextree->null_start,
+                              &lextree->null_links);
+    E_INFO("%d null transitions in closure\n", n_null);
     fsg_lextree_lc_rc(lextree);
 
     /* Create lextree for each state, i.e. an HMM network that
@@ -294,11 +303,128 @@ fsg_lextree_free(fsg_lextree_t * lextree)
 
     ckd_free_2d(lextree->lc);
     ckd_free_2d(lextree->rc);
+    ckd_free(lextree->null_start);
+    ckd_free(lextree->null_links);
     ckd_free(lextree->root);
     ckd_free(lextree->alloc_head);
     ckd_free(lextree);
 }
 
+/*
+ * Check whether ci is in a -1-terminated list of context phones.
+ */
+static int
+ctxt_list_has(int16 const *list, int32 ci)
+{
+    for (; *list >= 0; ++list)
+        if (*list == ci)
+            return TRUE;
+    return FALSE;
+}
+
+/*
+ * Check whether a word with first phone first_ci and last phone
+ * last_ci can go from state s to state d without changing the
+ * context lists, including those propagated over null transitions
+ * by fsg_lextree_lc_rc().
+ */
+static int
+fsg_lextree_ctxt_covers(fsg_lextree_t *lextree, int32 s, int32 d,
+                        int32 first_ci, int32 last_ci)
+{
+    fsg_link_t *l;
+    int32 n_null, t, j;
+
+    if (!ctxt_list_has(lextree->rc[s], first_ci)
+        || !ctxt_list_has(lextree->lc[d], last_ci))
+        return FALSE;
+    /* Words ending in d can also end in any state after it... */
+    l = fsg_lextree_null(lextree, d);
+    n_null = fsg_lextree_n_null(lextree, d);
+    for (j = 0; j < n_null; ++j, ++l)
+        if (!ctxt_list_has(lextree->lc[fsg_link_to_state(l)], last_ci))
+            return FALSE;
+    /* ...and words leaving s can also leave any state before it. */
+    for (t = 0; t < fsg_model_n_state(lextree->fsg); ++t) {
+        l = fsg_lextree_null(lextree, t);
+        n_null = fsg_lextree_n_null(lextree, t);
+        for (j = 0; j < n_null; ++j, ++l)
+            if (fsg_link_to_state(l) == s
+                && !ctxt_list_has(lextree->rc[t], first_ci))
+                return FALSE;
+    }
+    return TRUE;
+}
+
+int
+fsg_lextree_add_word(fsg_lextree_t *lextree, int32 wid)
+{
+    fsg_model_t *fsg = lextree->fsg;
+    fsg_arciter_t *itor;
+    int32 dictwid, first_ci, last_ci, s;
+
+    /* Fillers use silence as context, and are not worth the trouble. */
+    if (fsg_model_is_filler(fsg, wid))
+        return -1;
+    dictwid = dict_wordid(lextree->dict, fsg_model_word_str(fsg, wid));
+    if (dictwid == BAD_S3WID)
+        return -1;
+    first_ci = dict_first_phone(lextree->dict, dictwid);
+    last_ci = dict_last_phone(lextree->dict, dictwid);
+
+    /* Make sure every transition fits before touching anything. */
+    for (s = 0; s < fsg_model_n_state(fsg); s++) {
+        for (itor = fsg_model_arcs(fsg, s); itor; itor = fsg_arciter_next(itor)) {
+            fsg_link_t *l = fsg_arciter_get(itor);
+
+            if (fsg_link_wid(l) != wid)
+                continue;
+            if (!fsg_lextree_ctxt_covers(lextree, s, fsg_link_to_state(l),
+                                         first_ci, last_ci)) {
+                fsg_arciter_free(itor);
+                return -1;
+            }
+        }
+    }
+
+    /* Add them as new root nodes, without sharing any prefix with the
+     * words already there. */
+    for (s = 0; s < fsg_model_n_state(fsg); s++) {
+        for (itor = fsg_model_arcs(fsg, s); itor; itor = fsg_arciter_next(itor)) {
+            fsg_link_t *l = fsg_arciter_get(itor);
+            fsg_glist_linklist_t *glist = NULL;
+            fsg_pnode_t *old_head, *pn;
+
+            if (fsg_link_wid(l) != wid)
+                continue;
+            old_head = lextree->alloc_head[s];
+            lextree->root[s] =
+                psubtree_add_trans(lextree, lextree->root[s], &glist, l,
+                                   lextree->lc[s],
+                                   lextree->rc[fsg_link_to_state(l)],
+                                   &lextree->alloc_head[s]);
+            fsg_glist_linklist_free(glist);
+            for (pn = lextree->alloc_head[s]; pn != old_head; pn = pn->alloc_next)
+                lextree->n_pnode++;
+        }
+    }
+    return 0;
+}
+
+size_t
+fsg_lextree_size(fsg_lextree_t *lextree)
+{
+    size_t n_state = fsg_model_n_state(lextree->fsg);
+    size_t n_ci = bin_mdef_n_ciphone(lextree->mdef);
+
+    return sizeof(*lextree)
+        + lextree->n_pnode * sizeof(fsg_pnode_t)
+        + 2 * n_state * sizeof(fsg_pnode_t *)      /* root, alloc_head */
+        + 2 * n_state * (n_ci + 1) * sizeof(int16) /* lc, rc */
+        + (n_state + 1) * sizeof(int32)
+        + lextree->null_start[n_state] * sizeof(fsg_link_t);
+}
+
 /******************************
  * psubtree stuff starts here *
  ******************************/
@@ -246,6 +246,11 @@ typedef struct fsg_lextree_s {
 			   via fsg_pnode_t.sibling (root[s]->sibling) */
     fsg_pnode_t **alloc_head;	/* alloc_head[s] = head of linear list of all
 				   pnodes allocated for state s */
+    int32 *null_start;  /**< Index of the first null closure link for
+                           each state, plus one past the last one. */
+    fsg_link_t *null_links; /**< Best scoring null transition path from
+                               each state to each state reachable from it
+                               that way, as a single link. */
     int32 n_pnode;	/* #HMM nodes in search structure */
     int32 wip;
     int32 pip;
@@ -254,6 +259,8 @@ typedef struct fsg_lextree_s {
 /* Access macros */
 #define fsg_lextree_root(lt,s)	((lt)->root[s])
 #define fsg_lextree_n_pnode(lt)	((lt)->n_pnode)
+#define fsg_lextree_n_null(lt,s)	((lt)->null_start[(s)+1] - (lt)->null_start[s])
+#define fsg_lextree_null(lt,s)	((lt)->null_links + (lt)->null_start[s])
 
 /**
  * Create, initialize, and return a new phonetic lextree for the given FSG.
@@ -268,6 +275,22 @@ fsg_lextree_t *fsg_lextree_init(fsg_model_t *fsg, dict_t *dict,
  */
 void fsg_lextree_free(fsg_lextree_t *fsg);
 
+/**
+ * Add the transitions for a word newly added to the FSG to its
+ * lextree, without rebuilding it.
+ *
+ * @param wid FSG (not dictionary) word ID.
+ * @return 0 on success, or <0 if the word's first or last phone is
+ * not already among the phonetic contexts of the states it connects,
+ * in which case the lextree must be rebuilt.
+ */
+int fsg_lextree_add_word(fsg_lextree_t *lextree, int32 wid);
+
+/**
+ * Approximate number of bytes allocated for a lextree.
+ */
+size_t fsg_lextree_size(fsg_lextree_t *lextree);
+
 /**
  * Print an FSG lextree to a file for debugging.
  */
@@ -0,0 +1,736 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2010 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+
+/**
+ * @file fsg_optimize.c Null transition removal, determinization and
+ * minimization of finite-state grammars.
+ *
+ * All of this is done in the tropical semiring, i.e. alternative paths
+ * are combined by taking the best score, which is what the Viterbi
+ * search would do with them anyway.  The grammar is first copied into
+ * a simple arc-list automaton (opt_fsa_t) in which every state has a
+ * final weight, so the single final state of fsg_model_t only needs
+ * to be restored at the end.
+ */
+
+/* System headers. */
+#include <stdlib.h>
+#include <string.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/hash_table.h>
+#include <sphinxbase/err.h>
+
+/* Local headers. */
+#include "hmm.h"
+#include "fsg_optimize.h"
+
+/**
+ * Arc in an intermediate automaton.
+ */
+typedef struct opt_arc_s {
+    int32 wid;   /**< Word ID, or -1 for a null transition. */
+    int32 logp;  /**< Transition score. */
+    int32 to;    /**< Destination state. */
+} opt_arc_t;
+
+/**
+ * Intermediate automaton with arc lists and final weights per state.
+ */
+typedef struct opt_fsa_s {
+    int32 n_state;
+    int32 n_state_alloc;
+    int32 start;
+    int32 *final;        /**< Final weight of each state, or WORST_SCORE. */
+    int32 *n_arc;        /**< Number of arcs out of each state. */
+    int32 *n_arc_alloc;  /**< Number of arcs allocated for each state. */
+    opt_arc_t **arcs;    /**< Arcs out of each state. */
+} opt_fsa_t;
+
+/**
+ * Subset of states with residual weights, i.e. a state in the
+ * determinized automaton.
+ */
+typedef struct opt_subset_s {
+    int32 n;             /**< Number of (state, residual) pairs. */
+    int32 *pairs;        /**< Pairs, sorted by state. */
+} opt_subset_t;
+
+static opt_fsa_t *
+fsa_init(int32 n_state)
+{
+    opt_fsa_t *fsa;
+    int32 i;
+
+    fsa = ckd_calloc(1, sizeof(*fsa));
+    fsa->n_state = fsa->n_state_alloc = n_state;
+    if (fsa->n_state_alloc == 0)
+        fsa->n_state_alloc = 16;
+    fsa->final = ckd_calloc(fsa->n_state_alloc, sizeof(*fsa->final));
+    fsa->n_arc = ckd_calloc(fsa->n_state_alloc, sizeof(*fsa->n_arc));
+    fsa->n_arc_alloc = ckd_calloc(fsa->n_state_alloc, sizeof(*fsa->n_arc_alloc));
+    fsa->arcs = ckd_calloc(fsa->n_state_alloc, sizeof(*fsa->arcs));
+    for (i = 0; i < fsa->n_state_alloc; ++i)
+        fsa->final[i] = WORST_SCORE;
+    return fsa;
+}
+
+static void
+fsa_free(opt_fsa_t *fsa)
+{
+    int32 i;
+
+    if (fsa == NULL)
+        return;
+    for (i = 0; i < fsa->n_state_alloc; ++i)
+        ckd_free(fsa->arcs[i]);
+    ckd_free(fsa->arcs);
+    ckd_free(fsa->n_arc_alloc);
+    ckd_free(fsa->n_arc);
+    ckd_free(fsa->final);
+    ckd_free(fsa);
+}
+
+static int32
+fsa_add_state(opt_fsa_t *fsa)
+{
+    if (fsa->n_state == fsa->n_state_alloc) {
+        int32 i, n = fsa->n_state_alloc * 2;
+
+        fsa->final = ckd_realloc(fsa->final, n * sizeof(*fsa->final));
+        fsa->n_arc = ckd_realloc(fsa->n_arc, n * sizeof(*fsa->n_arc));
+        fsa->n_arc_alloc = ckd_realloc(fsa->n_arc_alloc,
+                                       n * sizeof(*fsa->n_arc_alloc));
+        fsa->arcs = ckd_realloc(fsa->arcs, n * sizeof(*fsa->arcs));
+        for (i = fsa->n_state_alloc; i < n; ++i) {
+            fsa->final[i] = WORST_SCORE;
+            fsa->n_arc[i] = fsa->n_arc_alloc[i] = 0;
+            fsa->arcs[i] = NULL;
+        }
+        fsa->n_state_alloc = n;
+    }
+    return fsa->n_state++;
+}
+
+static void
+fsa_add_arc(opt_fsa_t *fsa, int32 from, int32 wid, int32 logp, int32 to)
+{
+    opt_arc_t *arc;
+
+    if (fsa->n_arc[from] == fsa->n_arc_alloc[from]) {
+        fsa->n_arc_alloc[from] = fsa->n_arc_alloc[from] ? fsa->n_arc_alloc[from] * 2 : 4;
+        fsa->arcs[from] = ckd_realloc(fsa->arcs[from], fsa->n_arc_alloc[from]
+                                      * sizeof(*fsa->arcs[from]));
+    }
+    arc = fsa->arcs[from] + fsa->n_arc[from]++;
+    arc->wid = wid;
+    arc->logp = logp;
+    arc->to = to;
+}
+
+static void
+fsg_count_arcs(fsg_model_t *fsg, int32 *out_n_arc, int32 *out_n_null)
+{
+    int32 s;
+
+    *out_n_arc = *out_n_null = 0;
+    for (s = 0; s < fsg_model_n_state(fsg); ++s) {
+        fsg_arciter_t *itor;
+
+        for (itor = fsg_model_arcs(fsg, s); itor;
+             itor = fsg_arciter_next(itor)) {
+            ++*out_n_arc;
+            if (fsg_link_wid(fsg_arciter_get(itor)) < 0)
+                ++*out_n_null;
+        }
+    }
+}
+
+/**
+ * Copy an FSG into an automaton without null transitions.  Each state
+ * gets the word arcs of every state in its null closure, with the best
+ * null path score added, and a final weight if the final state is in
+ * its closure.
+ */
+static opt_fsa_t *
+remove_nulls(fsg_model_t *fsg)
+{
+    opt_fsa_t *words, *fsa;
+    fsg_link_t *null_links;
+    int32 *null_start;
+    int32 n_state, s, i, j;
+
+    n_state = fsg_model_n_state(fsg);
+    words = fsa_init(n_state);
+    for (s = 0; s < n_state; ++s) {
+        fsg_arciter_t *itor;
+
+        for (itor = fsg_model_arcs(fsg, s); itor;
+             itor = fsg_arciter_next(itor)) {
+            fsg_link_t *l = fsg_arciter_get(itor);
+
+            if (fsg_link_wid(l) >= 0)
+                fsa_add_arc(words, s, fsg_link_wid(l), fsg_link_logs2prob(l),
+                            fsg_link_to_state(l));
+        }
+    }
+
+    fsa = fsa_init(n_state);
+    fsa->start = fsg_model_start_state(fsg);
+    fsg_null_closure(fsg, &null_start, &null_links);
+    for (s = 0; s < n_state; ++s) {
+        /* The state itself, then the rest of its closure. */
+        for (i = null_start[s] - 1; i < null_start[s + 1]; ++i) {
+            int32 t, score;
+
+            if (i < null_start[s]) {
+                t = s;
+                score = 0;
+            }
+            else {
+                t = fsg_link_to_state(null_links + i);
+                score = fsg_link_logs2prob(null_links + i);
+            }
+            for (j = 0; j < words->n_arc[t]; ++j) {
+                opt_arc_t *arc = words->arcs[t] + j;
+                fsa_add_arc(fsa, s, arc->wid,
+                            score + arc->logp, arc->to);
+            }
+            if (t == fsg_model_final_state(fsg))
+                fsa->final[s] = score;
+        }
+    }
+
+    ckd_free(null_start);
+    ckd_free(null_links);
+    fsa_free(words);
+    return fsa;
+}
+
+/**
+ * Remove states which are not reachable from the start state or from
+ * which no final state can be reached.
+ *
+ * @return The trimmed automaton, or NULL if it accepts nothing.
+ */
+static opt_fsa_t *
+trim(opt_fsa_t *fsa)
+{
+    opt_fsa_t *out;
+    uint8 *fwd, *bwd;
+    int32 *map, *stack;
+    int32 s, i, n_stack, changed;
+
+    fwd = ckd_calloc(fsa->n_state, sizeof(*fwd));
+    bwd = ckd_calloc(fsa->n_state, sizeof(*bwd));
+    map = ckd_calloc(fsa->n_state, sizeof(*map));
+    stack = ckd_calloc(fsa->n_state, sizeof(*stack));
+
+    /* Forward reachability. */
+    fwd[fsa->start] = TRUE;
+    stack[0] = fsa->start;
+    n_stack = 1;
+    while (n_stack > 0) {
+        s = stack[--n_stack];
+        for (i = 0; i < fsa->n_arc[s]; ++i) {
+            int32 t = fsa->arcs[s][i].to;
+            if (!fwd[t]) {
+                fwd[t] = TRUE;
+                stack[n_stack++] = t;
+            }
+        }
+    }
+    /* Backward reachability, by iterating to a fixed point since we
+     * have no reverse arcs. */
+    for (s = 0; s < fsa->n_state; ++s)
+        bwd[s] = (fsa->final[s] != WORST_SCORE);
+    do {
+        changed = FALSE;
+        for (s = 0; s < fsa->n_state; ++s) {
+            if (bwd[s] || !fwd[s])
+                continue;
+            for (i = 0; i < fsa->n_arc[s]; ++i) {
+                if (bwd[fsa->arcs[s][i].to]) {
+                    bwd[s] = changed = TRUE;
+                    break;
+                }
+            }
+        }
+    } while (changed);
+
+    out = NULL;
+    if (bwd[fsa->start]) {
+        int32 n = 0;
+
+        for (s = 0; s < fsa->n_state; ++s)
+            map[s] = (fwd[s] && bwd[s]) ? n++ : -1;
+        out = fsa_init(n);
+        out->start = map[fsa->start];
+        for (s = 0; s < fsa->n_state; ++s) {
+            if (map[s] < 0)
+                continue;
+            out->final[map[s]] = fsa->final[s];
+            for (i = 0; i < fsa->n_arc[s]; ++i) {
+                opt_arc_t *arc = fsa->arcs[s] + i;
+                if (map[arc->to] >= 0)
+                    fsa_add_arc(out, map[s], arc->wid, arc->logp, map[arc->to]);
+            }
+        }
+    }
+
+    ckd_free(stack);
+    ckd_free(map);
+    ckd_free(bwd);
+    ckd_free(fwd);
+    return out;
+}
+
+static int
+cmp_arc_wid_to(const void *a, const void *b)
+{
+    opt_arc_t const *aa = a, *bb = b;
+
+    if (aa->wid != bb->wid)
+        return aa->wid < bb->wid ? -1 : 1;
+    if (aa->to != bb->to)
+        return aa->to < bb->to ? -1 : 1;
+    /* Best score first. */
+    if (aa->logp != bb->logp)
+        return aa->logp > bb->logp ? -1 : 1;
+    return 0;
+}
+
+static int32
+subset_state(hash_table_t *subsets, opt_subset_t **subset_list,
+             int32 *n_subset_alloc, opt_fsa_t *dfa,
+             int32 *pairs, int32 n)
+{
+    void *val;
+    opt_subset_t *subset;
+    int32 d;
+
+    if (hash_table_lookup_bkey(subsets, (char const *)pairs,
+                               n * 2 * sizeof(*pairs), &val) == 0) {
+        ckd_free(pairs);
+        return (int32)(long)val;
+    }
+    d = fsa_add_state(dfa);
+    if (d == *n_subset_alloc) {
+        *n_subset_alloc *= 2;
+        *subset_list = ckd_realloc(*subset_list,
+                                   *n_subset_alloc * sizeof(**subset_list));
+    }
+    subset = *subset_list + d;
+    subset->n = n;
+    subset->pairs = pairs;
+    hash_table_enter_bkey(subsets, (char const *)pairs,
+                          n * 2 * sizeof(*pairs), (void *)(long)d);
+    return d;
+}
+
+/**
+ * Determinize a null-free automaton.  Each new state is a set of old
+ * ones, each with the score it is behind the best of them by, which is
+ * carried forward onto later arcs.
+ *
+ * @return The deterministic automaton, or NULL if it would have more
+ *         than max_state states (which can happen with weights, and
+ *         is in any case not worth it).
+ */
+static opt_fsa_t *
+determinize(opt_fsa_t *nfa, int32 max_state)
+{
+    hash_table_t *subsets;
+    opt_subset_t *subset_list;
+    opt_arc_t *cand;
+    opt_fsa_t *dfa;
+    int32 n_subset_alloc, n_cand_alloc, d, i, *pairs;
+
+    dfa = fsa_init(0);
+    n_subset_alloc = dfa->n_state_alloc;
+    subset_list = ckd_calloc(n_subset_alloc, sizeof(*subset_list));
+    subsets = hash_table_new(nfa->n_state, HASH_CASE_YES);
+    n_cand_alloc = 64;
+    cand = ckd_calloc(n_cand_alloc, sizeof(*cand));
+
+    pairs = ckd_calloc(2, sizeof(*pairs));
+    pairs[0] = nfa->start;
+    pairs[1] = 0;
+    dfa->start = subset_state(subsets, &subset_list, &n_subset_alloc,
+                              dfa, pairs, 1);
+
+    for (d = 0; d < dfa->n_state; ++d) {
+        opt_subset_t *subset = subset_list + d;
+        int32 n_cand, final;
+
+        if (dfa->n_state > max_state)
+            break;
+
+        /* Gather all arcs leaving the subset, and its final weight. */
+        n_cand = 0;
+        final = WORST_SCORE;
+        for (i = 0; i < subset->n; ++i) {
+            int32 q = subset->pairs[i * 2];
+            int32 resid = subset->pairs[i * 2 + 1];
+            int32 j;
+
+            if (nfa->final[q] != WORST_SCORE
+                && resid + nfa->final[q] > final)
+                final = resid + nfa->final[q];
+            if (n_cand + nfa->n_arc[q] > n_cand_alloc) {
+                while (n_cand + nfa->n_arc[q] > n_cand_alloc)
+                    n_cand_alloc *= 2;
+                cand = ckd_realloc(cand, n_cand_alloc * sizeof(*cand));
+            }
+            for (j = 0; j < nfa->n_arc[q]; ++j) {
+                cand[n_cand] = nfa->arcs[q][j];
+                cand[n_cand].logp += resid;
+                ++n_cand;
+            }
+        }
+        dfa->final[d] = final;
+        qsort(cand, n_cand, sizeof(*cand), cmp_arc_wid_to);
+
+        /* One arc per word, to the subset of its destinations. */
+        for (i = 0; i < n_cand;) {
+            int32 j, k, n, best, next;
+
+            best = WORST_SCORE;
+            for (j = i; j < n_cand && cand[j].wid == cand[i].wid; ++j)
+                if (cand[j].logp > best)
+                    best = cand[j].logp;
+            pairs = ckd_calloc((j - i) * 2, sizeof(*pairs));
+            for (n = 0, k = i; k < j; ++k) {
+                /* Sorted by best score first within each destination. */
+                if (k > i && cand[k].to == cand[k - 1].to)
+                    continue;
+                pairs[n * 2] = cand[k].to;
+                pairs[n * 2 + 1] = cand[k].logp - best;
+                ++n;
+            }
+            next = subset_state(subsets, &subset_list, &n_subset_alloc,
+                                dfa, pairs, n);
+            fsa_add_arc(dfa, d, cand[i].wid, best, next);
+            i = j;
+        }
+    }
+
+    for (d = 0; d < dfa->n_state; ++d)
+        ckd_free(subset_list[d].pairs);
+    if (dfa->n_state > max_state) {
+        fsa_free(dfa);
+        dfa = NULL;
+    }
+    ckd_free(subset_list);
+    hash_table_free(subsets);
+    ckd_free(cand);
+    return dfa;
+}
+
+static int
+cmp_sig_arc(const void *a, const void *b)
+{
+    int32 const *aa = a, *bb = b;
+    int i;
+
+    for (i = 0; i < 3; ++i)
+        if (aa[i] != bb[i])
+            return aa[i] < bb[i] ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Find the classes of equivalent states by partition refinement: two
+ * states are equivalent if they have the same final weight and arcs
+ * with the same words and scores to equivalent states.  This gives the
+ * minimal automaton for a deterministic input, and merges at least
+ * some states for a non-deterministic one.
+ *
+ * @return Number of classes.
+ */
+static int32
+merge_states(opt_fsa_t *fsa, int32 *cls)
+{
+    int32 **sigs, *new_cls;
+    int32 n_cls, s;
+
+    sigs = ckd_calloc(fsa->n_state, sizeof(*sigs));
+    new_cls = ckd_calloc(fsa->n_state, sizeof(*new_cls));
+    memset(cls, 0, fsa->n_state * sizeof(*cls));
+    n_cls = 1;
+    while (TRUE) {
+        hash_table_t *h;
+        int32 n_new = 0;
+
+        h = hash_table_new(fsa->n_state, HASH_CASE_YES);
+        for (s = 0; s < fsa->n_state; ++s) {
+            int32 *sig, i, n;
+
+            /* Signature: class, final weight, then sorted, unique
+             * (word, score, destination class) triples. */
+            sig = sigs[s] = ckd_calloc(2 + 3 * fsa->n_arc[s], sizeof(*sig));
+            sig[0] = cls[s];
+            sig[1] = fsa->final[s];
+            for (i = 0; i < fsa->n_arc[s]; ++i) {
+                sig[2 + 3 * i] = fsa->arcs[s][i].wid;
+                sig[2 + 3 * i + 1] = fsa->arcs[s][i].logp;
+                sig[2 + 3 * i + 2] = cls[fsa->arcs[s][i].to];
+            }
+            qsort(sig + 2, fsa->n_arc[s], 3 * sizeof(*sig), cmp_sig_arc);
+            for (n = i = 0; i < fsa->n_arc[s]; ++i) {
+                if (n > 0 && cmp_sig_arc(sig + 2 + 3 * (n - 1),
+                                         sig + 2 + 3 * i) == 0)
+                    continue;
+                memmove(sig + 2 + 3 * n, sig + 2 + 3 * i, 3 * sizeof(*sig));
+                ++n;
+            }
+            new_cls[s] = hash_table_enter_bkey_int32(h, (char const *)sig,
+                                                     (2 + 3 * n) * sizeof(*sig),
+                                                     n_new);
+            if (new_cls[s] == n_new)
+                ++n_new;
+        }
+        hash_table_free(h);
+        for (s = 0; s < fsa->n_state; ++s) {
+            ckd_free(sigs[s]);
+            sigs[s] = NULL;
+        }
+        memcpy(cls, new_cls, fsa->n_state * sizeof(*cls));
+        /* Each pass refines the last one, so stop when it doesn't. */
+        if (n_new == n_cls)
+            break;
+        n_cls = n_new;
+    }
+    ckd_free(new_cls);
+    ckd_free(sigs);
+    return n_cls;
+}
+
+int32
+fsg_null_closure(fsg_model_t *fsg, int32 **out_start, fsg_link_t **out_links)
+{
+    int32 *closure, *queue, *touched, *null_start;
+    uint8 *queued, *seen;
+    fsg_link_t *null_links;
+    int32 n_state, n_alloc, n_link, s, i;
+
+    n_state = fsg_model_n_state(fsg);
+    closure = ckd_calloc(n_state, sizeof(*closure));
+    queue = ckd_calloc(n_state, sizeof(*queue));
+    touched = ckd_calloc(n_state, sizeof(*touched));
+    queued = ckd_calloc(n_state, sizeof(*queued));
+    seen = ckd_calloc(n_state, sizeof(*seen));
+    null_start = ckd_calloc(n_state + 1, sizeof(*null_start));
+    n_alloc = n_state ? n_state : 1;
+    null_links = ckd_calloc(n_alloc, sizeof(*null_links));
+    n_link = 0;
+
+    for (s = 0; s < n_state; ++s) {
+        int32 head, n_queued, n_touched;
+
+        /* Best null path score from s to every state reachable by
+         * null transitions (which all have scores <= 0). */
+        null_start[s] = n_link;
+        closure[s] = 0;
+        queue[0] = touched[0] = s;
+        queued[s] = seen[s] = TRUE;
+        head = 0;
+        n_queued = n_touched = 1;
+        while (n_queued > 0) {
+            fsg_arciter_t *itor;
+            int32 t = queue[head];
+
+            head = (head + 1) % n_state;
+            --n_queued;
+            queued[t] = FALSE;
+            for (itor = fsg_model_arcs(fsg, t); itor;
+                 itor = fsg_arciter_next(itor)) {
+                fsg_link_t *l = fsg_arciter_get(itor);
+                int32 d = fsg_link_to_state(l);
+                int32 score = closure[t] + fsg_link_logs2prob(l);
+
+                if (fsg_link_wid(l) != -1)
+                    continue;
+                if (!seen[d]) {
+                    seen[d] = TRUE;
+                    touched[n_touched++] = d;
+                }
+                else if (score <= closure[d])
+                    continue;
+                closure[d] = score;
+                if (!queued[d]) {
+                    queued[d] = TRUE;
+                    queue[(head + n_queued++) % n_state] = d;
+                }
+            }
+        }
+
+        seen[s] = FALSE;
+        for (i = 1; i < n_touched; ++i) {
+            int32 d = touched[i];
+            fsg_link_t *l;
+
+            seen[d] = FALSE;
+            if (d == s)
+                continue;
+            if (n_link == n_alloc) {
+                n_alloc *= 2;
+                null_links = ckd_realloc(null_links,
+                                         n_alloc * sizeof(*null_links));
+            }
+            l = null_links + n_link++;
+            l->from_state = s;
+            l->to_state = d;
+            l->logs2prob = closure[d];
+            l->wid = -1;
+        }
+    }
+    null_start[n_state] = n_link;
+
+    ckd_free(seen);
+    ckd_free(queued);
+    ckd_free(touched);
+    ckd_free(queue);
+    ckd_free(closure);
+    *out_start = null_start;
+    *out_links = null_links;
+    return n_link;
+}
+
+int
+fsg_optimize(fsg_model_t *fsg)
+{
+    opt_fsa_t *nfa, *fsa, *dfa;
+    fsg_model_t *opt;
+    int32 *cls, *rep;
+    int32 n_arc, n_null, n_arc_opt, n_null_opt;
+    int32 n_cls, n_final, n_state, final_state, s, i;
+
+    fsg_count_arcs(fsg, &n_arc, &n_null);
+    nfa = remove_nulls(fsg);
+    fsa = trim(nfa);
+    fsa_free(nfa);
+    if (fsa == NULL) {
+        E_WARN("FSG '%s' accepts no word sequences\n", fsg_model_name(fsg));
+        return -1;
+    }
+    /* If determinization blows up, just merge states in the null-free
+     * automaton instead. */
+    if ((dfa = determinize(fsa, 4 * fsa->n_state + 64)) != NULL) {
+        fsa_free(fsa);
+        fsa = dfa;
+    }
+    else
+        E_INFO("Not determinizing FSG '%s'\n", fsg_model_name(fsg));
+
+    cls = ckd_calloc(fsa->n_state, sizeof(*cls));
+    n_cls = merge_states(fsa, cls);
+    rep = ckd_calloc(n_cls, sizeof(*rep));
+    for (i = 0; i < n_cls; ++i)
+        rep[i] = -1;
+    n_final = 0;
+    final_state = -1;
+    for (s = 0; s < fsa->n_state; ++s) {
+        if (rep[cls[s]] != -1)
+            continue;
+        rep[cls[s]] = s;
+        if (fsa->final[s] != WORST_SCORE) {
+            ++n_final;
+            final_state = cls[s];
+        }
+    }
+
+    /* A single final state with nothing to add to the score can be the
+     * final state, otherwise they all get a null transition to a new
+     * one. */
+    n_state = n_cls;
+    if (n_final > 1 || fsa->final[rep[final_state]] != 0)
+        final_state = n_state++;
+    opt = fsg_model_init(fsg_model_name(fsg), fsg->lmath,
+                         fsg_model_lw(fsg), n_state);
+    opt->start_state = cls[fsa->start];
+    opt->final_state = final_state;
+    for (i = 0; i < n_cls; ++i) {
+        int32 j;
+
+        s = rep[i];
+        for (j = 0; j < fsa->n_arc[s]; ++j) {
+            opt_arc_t *arc = fsa->arcs[s] + j;
+            fsg_model_trans_add(opt, i, cls[arc->to], arc->logp, arc->wid);
+        }
+        if (fsa->final[s] != WORST_SCORE && i != final_state)
+            fsg_model_null_trans_add(opt, i, final_state, fsa->final[s]);
+    }
+    ckd_free(rep);
+    ckd_free(cls);
+    fsa_free(fsa);
+
+    fsg_count_arcs(opt, &n_arc_opt, &n_null_opt);
+    if (fsg_model_n_state(opt) + n_arc_opt
+        >= fsg_model_n_state(fsg) + n_arc) {
+        E_INFO("FSG '%s' is already optimal: %d states, %d arcs (%d null)\n",
+               fsg_model_name(fsg), fsg_model_n_state(fsg), n_arc, n_null);
+        fsg_model_free(opt);
+        return 1;
+    }
+    E_INFO("Optimized FSG '%s': %d states, %d arcs (%d null) "
+           "-> %d states, %d arcs (%d null)\n",
+           fsg_model_name(fsg), fsg_model_n_state(fsg), n_arc, n_null,
+           fsg_model_n_state(opt), n_arc_opt, n_null_opt);
+
+    /* Swap the transitions into the original FSG, which keeps its
+     * name, vocabulary and filler/alternate word flags, and free the
+     * old ones along with the temporary FSG. */
+    {
+        fsg_model_t tmp = *fsg;
+
+        fsg->n_state = opt->n_state;
+        fsg->start_state = opt->start_state;
+        fsg->final_state = opt->final_state;
+        fsg->trans = opt->trans;
+        fsg->link_alloc = opt->link_alloc;
+        opt->n_state = tmp.n_state;
+        opt->start_state = tmp.start_state;
+        opt->final_state = tmp.final_state;
+        opt->trans = tmp.trans;
+        opt->link_alloc = tmp.link_alloc;
+    }
+    fsg_model_free(opt);
+
+    return 0;
+}
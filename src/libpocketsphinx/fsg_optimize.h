@@ -0,0 +1,83 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2010 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+
+/**
+ * @file fsg_optimize.h Null transition removal, determinization and
+ * minimization of finite-state grammars.
+ */
+
+#ifndef __FSG_OPTIMIZE_H__
+#define __FSG_OPTIMIZE_H__
+
+/* SphinxBase headers. */
+#include <sphinxbase/fsg_model.h>
+
+/**
+ * Rewrite the transitions of an FSG into an equivalent, smaller one.
+ *
+ * Null transitions are folded into the word transitions that follow
+ * them, the result is determinized on word labels (keeping the best
+ * scoring of any alternative paths, so the Viterbi score of every word
+ * sequence is unchanged) and equivalent states are merged.  Null
+ * transitions only remain into the final state, where the grammar has
+ * more than one way of ending.
+ *
+ * The vocabulary of the FSG is not touched, so word IDs stay the same,
+ * but state numbers change.  This must therefore be done before any
+ * search structures are built from it.
+ *
+ * @return 0 if the FSG was rewritten, 1 if it was left alone because
+ *         this would not make it any smaller, <0 on error.
+ */
+int fsg_optimize(fsg_model_t *fsg);
+
+/**
+ * Find the best scoring null transition path from each state of an
+ * FSG to every other state reachable from it by null transitions.
+ *
+ * The result is one row of links per state, all in one array:
+ * (*out_links)[(*out_start)[s]] up to (*out_links)[(*out_start)[s+1]]
+ * are the links out of state s, with the path score as their
+ * probability and a word ID of -1.  Both arrays must be freed with
+ * ckd_free().
+ *
+ * @return Total number of links.
+ */
+int32 fsg_null_closure(fsg_model_t *fsg, int32 **out_start,
+                       fsg_link_t **out_links);
+
+#endif /* __FSG_OPTIMIZE_H__ */
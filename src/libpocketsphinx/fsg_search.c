@@ -65,6 +65,7 @@
 #include "fsg_search_internal.h"
 #include "fsg_history.h"
 #include "fsg_lextree.h"
+#include "fsg_optimize.h"
 
 /* Turn this on for detailed debugging dump */
 #define __FSG_DBG__		0
@@ -73,6 +74,7 @@
 static ps_seg_t *fsg_search_seg_iter(ps_search_t *search, int32 *out_score);
 static ps_lattice_t *fsg_search_lattice(ps_search_t *search);
 static int fsg_search_prob(ps_search_t *search);
+static int fsg_search_scale_beams(ps_search_t *search, float32 scale);
 
 static ps_searchfuncs_t fsg_funcs = {
     /* name: */   "fsg",
@@ -80,11 +82,15 @@ static ps_searchfuncs_t fsg_funcs = {
     /* step: */   fsg_search_step,
     /* finish: */ fsg_search_finish,
     /* reinit: */ fsg_search_reinit,
+    /* add_word: */ fsg_search_add_word,
     /* free: */   fsg_search_free,
     /* lattice: */  fsg_search_lattice,
     /* hyp: */      fsg_search_hyp,
     /* prob: */     fsg_search_prob,
     /* seg_iter: */ fsg_search_seg_iter,
+    /* scale_beams: */ fsg_search_scale_beams,
+    /* snapshot: */ NULL,
+    /* restore: */  NULL,
 };
 
 ps_search_t *
@@ -111,11 +117,14 @@ fsg_search_init(cmd_ln_t *config,
     fsgs->history = fsg_history_init(NULL, dict);
     fsgs->frame = -1;
 
-    /* Initialize FSG table. */
+    /* Initialize FSG table and the cache of their lextrees. */
     fsgs->fsgs = hash_table_new(5, HASH_CASE_YES);
+    fsgs->lextrees = hash_table_new(5, HASH_CASE_YES);
+    fsgs->lextree_budget = (size_t)cmd_ln_int32_r(config, "-fsgcache") * 1024;
 
     /* Get search pruning parameters */
     fsgs->beam_factor = 1.0f;
+    fsgs->beam_scale = 1.0f;
     fsgs->beam = fsgs->beam_orig
         = (int32) logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-beam"))
         >> SENSCR_SHIFT;
@@ -230,7 +239,10 @@ fsg_search_free(ps_search_t *search)
     ps_search_deinit(search);
     if (fsgs->jsgf)
         jsgf_grammar_free(fsgs->jsgf);
-    fsg_lextree_free(fsgs->lextree);
+    if (fsgs->lextrees) {
+        fsg_search_flush_lextrees(fsgs);
+        hash_table_free(fsgs->lextrees);
+    }
     if (fsgs->history) {
         fsg_history_reset(fsgs->history);
         fsg_history_set_fsg(fsgs->history, NULL, NULL);
@@ -248,14 +260,116 @@ fsg_search_free(ps_search_t *search)
     ckd_free(fsgs);
 }
 
+static void
+lru_unlink(fsg_search_t *fsgs, fsg_lextree_cache_t *ent)
+{
+    if (ent->prev)
+        ent->prev->next = ent->next;
+    else
+        fsgs->lru_head = ent->next;
+    if (ent->next)
+        ent->next->prev = ent->prev;
+    else
+        fsgs->lru_tail = ent->prev;
+    ent->prev = ent->next = NULL;
+}
+
+static void
+lru_push(fsg_search_t *fsgs, fsg_lextree_cache_t *ent)
+{
+    ent->prev = NULL;
+    ent->next = fsgs->lru_head;
+    if (fsgs->lru_head)
+        fsgs->lru_head->prev = ent;
+    else
+        fsgs->lru_tail = ent;
+    fsgs->lru_head = ent;
+}
+
+static void
+fsg_search_drop_lextree(fsg_search_t *fsgs, fsg_lextree_cache_t *ent)
+{
+    lru_unlink(fsgs, ent);
+    hash_table_delete_bkey(fsgs->lextrees,
+                           (char const *)&ent->fsg, sizeof(ent->fsg));
+    if (fsgs->lextree == ent->lextree)
+        fsgs->lextree = NULL;
+    fsg_lextree_free(ent->lextree);
+    fsgs->lextree_mem -= ent->size;
+    ckd_free(ent);
+}
+
+static fsg_lextree_cache_t *
+fsg_search_find_lextree(fsg_search_t *fsgs, fsg_model_t *fsg)
+{
+    void *val;
+
+    if (hash_table_lookup_bkey(fsgs->lextrees, (char const *)&fsg,
+                               sizeof(fsg), &val) < 0)
+        return NULL;
+    return (fsg_lextree_cache_t *)val;
+}
+
+void
+fsg_search_flush_lextrees(fsg_search_t *fsgs)
+{
+    while (fsgs->lru_head)
+        fsg_search_drop_lextree(fsgs, fsgs->lru_head);
+    fsgs->lextree = NULL;
+}
+
+/**
+ * Get the lextree for an FSG, building it if it is not in the cache,
+ * and evict the least recently used ones if over budget.
+ *
+ * Lextrees are built here, in the caller's thread, when a grammar is
+ * first selected.  Building them ahead of time on a helper thread, as
+ * -fwdflatthread does for fwdflat, would race with ps_add_word(),
+ * which changes the dictionary and dict2pid they are built from.
+ */
+static fsg_lextree_t *
+fsg_search_get_lextree(fsg_search_t *fsgs, fsg_model_t *fsg)
+{
+    fsg_lextree_cache_t *ent;
+
+    if ((ent = fsg_search_find_lextree(fsgs, fsg)) != NULL) {
+        lru_unlink(fsgs, ent);
+        lru_push(fsgs, ent);
+        return ent->lextree;
+    }
+
+    ent = ckd_calloc(1, sizeof(*ent));
+    ent->fsg = fsg;
+    ent->lextree = fsg_lextree_init(fsg, ps_search_dict(fsgs),
+                                    ps_search_dict2pid(fsgs),
+                                    ps_search_acmod(fsgs)->mdef,
+                                    fsgs->hmmctx, fsgs->wip, fsgs->pip);
+    ent->size = fsg_lextree_size(ent->lextree);
+    hash_table_enter_bkey(fsgs->lextrees, (char const *)&ent->fsg,
+                          sizeof(ent->fsg), ent);
+    lru_push(fsgs, ent);
+    fsgs->lextree_mem += ent->size;
+
+    while (fsgs->lextree_mem > fsgs->lextree_budget
+           && fsgs->lru_tail != ent) {
+        E_INFO("Dropping lextree for FSG '%s' (%d KiB)\n",
+               fsg_model_name(fsgs->lru_tail->fsg),
+               (int)(fsgs->lru_tail->size / 1024));
+        fsg_search_drop_lextree(fsgs, fsgs->lru_tail);
+    }
+    return ent->lextree;
+}
+
 int
 fsg_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
 {
     fsg_search_t *fsgs = (fsg_search_t *)search;
 
-    /* Free the old lextree */
-    if (fsgs->lextree)
-        fsg_lextree_free(fsgs->lextree);
+    /* Lextrees stay valid as long as words are only appended to the
+     * dictionary; a new one means building them all again. */
+    if (dict != ps_search_dict(search) || d2p != ps_search_dict2pid(search))
+        fsg_search_flush_lextrees(fsgs);
+    fsgs->lextree = NULL;
 
     /* Free old dict2pid, dict */
     ps_search_base_reinit(search, dict, d2p);
@@ -267,10 +381,8 @@ fsg_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     /* Update the number of words (not used by this module though). */
     search->n_words = dict_size(dict);
 
-    /* Allocate new lextree for the given FSG */
-    fsgs->lextree = fsg_lextree_init(fsgs->fsg, dict, d2p,
-                                     ps_search_acmod(fsgs)->mdef,
-                                     fsgs->hmmctx, fsgs->wip, fsgs->pip);
+    /* Find or allocate the lextree for the given FSG */
+    fsgs->lextree = fsg_search_get_lextree(fsgs, fsgs->fsg);
 
     /* Inform the history module of the new fsg */
     fsg_history_set_fsg(fsgs->history, fsgs->fsg, dict);
@@ -279,6 +391,59 @@ fsg_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
 }
 
 
+int
+fsg_search_add_word(ps_search_t *search, int32 wid)
+{
+    fsg_search_t *fsgs = (fsg_search_t *)search;
+    dict_t *dict = ps_search_dict(search);
+    char const *baseword, *altword;
+    hash_iter_t *itor;
+
+    if (wid != dict_size(dict) - 1)
+        return -1;
+    search->n_words = dict_size(dict);
+
+    /*
+     * Grammars are checked against the dictionary when they are
+     * added, so a new word can only occur in them as an alternate
+     * pronunciation of a word that is already there.
+     */
+    if (dict_basewid(dict, wid) == wid
+        || !cmd_ln_boolean_r(ps_search_config(fsgs), "-fsgusealtpron"))
+        return 0;
+    baseword = dict_basestr(dict, wid);
+    altword = dict_wordstr(dict, wid);
+    for (itor = hash_table_iter(fsgs->fsgs);
+         itor; itor = hash_table_iter_next(itor)) {
+        fsg_model_t *fsg = (fsg_model_t *) hash_entry_val(itor->ent);
+        fsg_lextree_cache_t *ent;
+
+        if (fsg_model_word_id(fsg, baseword) < 0)
+            continue;
+        if (fsg_model_add_alt(fsg, baseword, altword) <= 0)
+            continue;
+        /* Extend its lextree in place if it has one, or throw it
+         * away if the new contexts mean it has to be rebuilt. */
+        if ((ent = fsg_search_find_lextree(fsgs, fsg)) == NULL)
+            continue;
+        fsgs->lextree_mem -= ent->size;
+        if (fsg_lextree_add_word(ent->lextree,
+                                 fsg_model_word_id(fsg, altword)) < 0) {
+            E_INFO("Rebuilding lextree for FSG '%s' to add %s\n",
+                   fsg_model_name(fsg), altword);
+            fsgs->lextree_mem += ent->size;
+            fsg_search_drop_lextree(fsgs, ent);
+            continue;
+        }
+        ent->size = fsg_lextree_size(ent->lextree);
+        fsgs->lextree_mem += ent->size;
+    }
+    if (fsgs->fsg && fsgs->lextree == NULL)
+        fsgs->lextree = fsg_search_get_lextree(fsgs, fsgs->fsg);
+    return 0;
+}
+
+
 static int
 fsg_search_add_silences(fsg_search_t *fsgs, fsg_model_t *fsg)
 {
@@ -380,12 +545,24 @@ fsg_set_get_fsg(fsg_search_t *fsgs, const char *name)
 fsg_model_t *
 fsg_set_add(fsg_search_t *fsgs, char const *name, fsg_model_t *fsg)
 {
+    void *val;
+
     if (name == NULL)
         name = fsg_model_name(fsg);
 
+    /* Don't touch the FSG if the name is already taken. */
+    if (hash_table_lookup(fsgs->fsgs, name, &val) == 0)
+        return (fsg_model_t *)val;
+
     if (!fsg_search_check_dict(fsgs, fsg))
 	return NULL;
 
+    /* Remove null transitions and redundant states before adding
+     * silences to each of them. */
+    if (cmd_ln_boolean_r(ps_search_config(fsgs), "-fsgopt")
+        && fsg_search_find_lextree(fsgs, fsg) == NULL)
+        fsg_optimize(fsg);
+
     /* Add silence transitions and alternate words. */
     if (cmd_ln_boolean_r(ps_search_config(fsgs), "-fsgusefiller")
         && !fsg_model_has_sil(fsg))
@@ -401,6 +578,7 @@ fsg_set_add(fsg_search_t *fsgs, char const *name, fsg_model_t *fsg)
 fsg_model_t *
 fsg_set_remove_byname(fsg_search_t *fsgs, char const *key)
 {
+    fsg_lextree_cache_t *ent;
     fsg_model_t *oldfsg;
     void *val;
 
@@ -411,12 +589,12 @@ fsg_set_remove_byname(fsg_search_t *fsgs, char const *key)
     }
     oldfsg = val;
 
-    /* Remove it from the FSG table. */
+    /* Remove it from the FSG table and drop its lextree. */
     hash_table_delete(fsgs->fsgs, key);
+    if ((ent = fsg_search_find_lextree(fsgs, oldfsg)) != NULL)
+        fsg_search_drop_lextree(fsgs, ent);
     /* If this was the currently active FSG, also delete other stuff */
     if (fsgs->fsg == oldfsg) {
-        fsg_lextree_free(fsgs->lextree);
-        fsgs->lextree = NULL;
         fsg_history_set_fsg(fsgs->history, NULL, NULL);
         fsgs->fsg = NULL;
     }
@@ -507,6 +685,30 @@ fsg_search_sen_active(fsg_search_t *fsgs)
 }
 
 
+/*
+ * Compute effective beams from the configured ones, the absolute
+ * pruning factor and the real-time governor's scale.
+ */
+static void
+fsg_search_set_beams(fsg_search_t *fsgs)
+{
+    float32 f = fsgs->beam_factor * fsgs->beam_scale;
+
+    fsgs->beam = (int32) (fsgs->beam_orig * f);
+    fsgs->pbeam = (int32) (fsgs->pbeam_orig * f);
+    fsgs->wbeam = (int32) (fsgs->wbeam_orig * f);
+}
+
+static int
+fsg_search_scale_beams(ps_search_t *search, float32 scale)
+{
+    fsg_search_t *fsgs = (fsg_search_t *)search;
+
+    fsgs->beam_scale = scale;
+    fsg_search_set_beams(fsgs);
+    return 0;
+}
+
 /*
  * Evaluate all the active HMMs.
  * (Executed once per frame.)
@@ -564,19 +766,12 @@ fsg_search_hmm_eval(fsg_search_t *fsgs)
          */
         if (fsgs->beam_factor > 0.1) {        /* Hack!!  Hardwired constant 0.1 */
             fsgs->beam_factor *= 0.9f;        /* Hack!!  Hardwired constant 0.9 */
-            fsgs->beam =
-                (int32) (fsgs->beam_orig * fsgs->beam_factor);
-            fsgs->pbeam =
-                (int32) (fsgs->pbeam_orig * fsgs->beam_factor);
-            fsgs->wbeam =
-                (int32) (fsgs->wbeam_orig * fsgs->beam_factor);
+            fsg_search_set_beams(fsgs);
         }
     }
-    else {
+    else if (fsgs->beam_factor != 1.0f) {
         fsgs->beam_factor = 1.0f;
-        fsgs->beam = fsgs->beam_orig;
-        fsgs->pbeam = fsgs->pbeam_orig;
-        fsgs->wbeam = fsgs->wbeam_orig;
+        fsg_search_set_beams(fsgs);
     }
 
     if (n > fsg_lextree_n_pnode(fsgs->lextree))
@@ -741,7 +936,7 @@ fsg_search_null_prop(fsg_search_t *fsgs)
     int32 bpidx, n_entries, thresh, newscore;
     fsg_hist_entry_t *hist_entry;
     fsg_link_t *l;
-    int32 s;
+    int32 s, i, n_null;
     fsg_model_t *fsg;
 
     fsg = fsgs->fsg;
@@ -750,7 +945,6 @@ fsg_search_null_prop(fsg_search_t *fsgs)
     n_entries = fsg_history_n_entries(fsgs->history);
 
     for (bpidx = fsgs->bpidx_start; bpidx < n_entries; bpidx++) {
-        fsg_arciter_t *itor;
         hist_entry = fsg_history_entry_get(fsgs->history, bpidx);
 
         l = fsg_hist_entry_fsglink(hist_entry);
@@ -759,18 +953,14 @@ fsg_search_null_prop(fsg_search_t *fsgs)
         s = l ? fsg_link_to_state(l) : fsg_model_start_state(fsg);
 
         /*
-         * Check null transitions from d to all other states.  (Only need to
-         * propagate one step, since FSG contains transitive closure of null
-         * transitions.)
+         * Propagate to all states reachable from s by null
+         * transitions.  The lextree has the best path to each of them
+         * as a single link, so only one step is needed.
          */
-        /* Add all links from from_state to dst */
-        for (itor = fsg_model_arcs(fsg, s); itor;
-             itor = fsg_arciter_next(itor)) {
-            fsg_link_t *l = fsg_arciter_get(itor);
-
+        n_null = fsg_lextree_n_null(fsgs->lextree, s);
+        l = fsg_lextree_null(fsgs->lextree, s);
+        for (i = 0; i < n_null; ++i, ++l) {
             /* FIXME: Need to deal with tag transitions somehow. */
-            if (fsg_link_wid(l) != -1)
-                continue;
             newscore =
                 fsg_hist_entry_score(hist_entry) +
                 (fsg_link_logs2prob(l) >> SENSCR_SHIFT);
@@ -958,9 +1148,7 @@ fsg_search_start(ps_search_t *search)
 
     /* Reset dynamic adjustment factor for beams */
     fsgs->beam_factor = 1.0f;
-    fsgs->beam = fsgs->beam_orig;
-    fsgs->pbeam = fsgs->pbeam_orig;
-    fsgs->wbeam = fsgs->wbeam_orig;
+    fsg_search_set_beams(fsgs);
 
     silcipid = bin_mdef_ciphone_id(ps_search_acmod(fsgs)->mdef, "SIL");
 
@@ -1029,6 +1217,7 @@ fsg_search_finish(ps_search_t *search)
     fsgs->final = TRUE;
 
     n_hist = fsg_history_n_entries(fsgs->history);
+    acmod_log_ssid_stats(ps_search_acmod(fsgs));
     E_INFO
         ("%d frames, %d HMMs (%d/fr), %d senones (%d/fr), %d history entries (%d/fr)\n\n",
          fsgs->frame, fsgs->n_hmm_eval,
@@ -1610,7 +1799,8 @@ fsg_search_lattice(ps_search_t *search)
         fsg_hist_entry_t *fh = fsg_history_entry_get(fsgs->history, i);
         fsg_arciter_t *itor;
         ps_latnode_t *src, *dest;
-        int32 ascr;
+        fsg_link_t *null;
+        int32 ascr, s, j, n_null;
         int sf;
 
         /* Skip null transitions. */
@@ -1630,38 +1820,25 @@ fsg_search_lattice(ps_search_t *search)
         src = find_node(dag, fsg, sf, fh->fsglink->wid, fsg_link_to_state(fh->fsglink));
         sf = fh->frame + 1;
 
-        for (itor = fsg_model_arcs(fsg, fsg_link_to_state(fh->fsglink));
-             itor; itor = fsg_arciter_next(itor)) {
-            fsg_link_t *link = fsg_arciter_get(itor);
-            
-            /* FIXME: Need to figure out what to do about tag transitions. */
-            if (link->wid >= 0) {
-                /*
-                 * For each non-epsilon link following this one, look for a
-                 * matching node in the lattice and link to it.
-                 */
+        /*
+         * Link to words following this one, directly or through null
+         * transitions, using the null closure from the lextree.
+         */
+        s = fsg_link_to_state(fh->fsglink);
+        n_null = fsg_lextree_n_null(fsgs->lextree, s);
+        null = fsg_lextree_null(fsgs->lextree, s);
+        for (j = -1; j < n_null; ++j) {
+            int32 t = (j < 0) ? s : fsg_link_to_state(null + j);
+
+            for (itor = fsg_model_arcs(fsg, t);
+                 itor; itor = fsg_arciter_next(itor)) {
+                fsg_link_t *link = fsg_arciter_get(itor);
+
+                /* FIXME: Need to figure out what to do about tag transitions. */
+                if (link->wid == -1)
+                    continue;
                 if ((dest = find_node(dag, fsg, sf, link->wid, fsg_link_to_state(link))) != NULL)
-            	    ps_lattice_link(dag, src, dest, ascr, fh->frame);
-            }
-            else {
-                /*
-                 * Transitive closure on nulls has already been done, so we
-                 * just need to look one link forward from them.
-                 */
-                fsg_arciter_t *itor2;
-                
-                /* Add all non-null links out of j. */
-                for (itor2 = fsg_model_arcs(fsg, fsg_link_to_state(link));
-                     itor2; itor2 = fsg_arciter_next(itor2)) {
-                    fsg_link_t *link = fsg_arciter_get(itor2);
-
-                    if (link->wid == -1)
-                        continue;
-                    
-                    if ((dest = find_node(dag, fsg, sf, link->wid, fsg_link_to_state(link))) != NULL) {
-                        ps_lattice_link(dag, src, dest, ascr, fh->frame);
-                    }
-                }
+                    ps_lattice_link(dag, src, dest, ascr, fh->frame);
             }
         }
     }
@@ -62,6 +62,18 @@ typedef struct fsg_seg_s {
     int16 cur;      /**< Current position in hist. */
 } fsg_seg_t;
 
+/**
+ * Compiled lextree for one FSG in the set, kept around so that
+ * switching back to the FSG does not require building it again.
+ */
+typedef struct fsg_lextree_cache_s {
+    fsg_model_t *fsg;           /**< FSG (also the key in the cache table). */
+    struct fsg_lextree_s *lextree; /**< Lextree built for it. */
+    size_t size;                /**< Bytes allocated for lextree. */
+    struct fsg_lextree_cache_s *prev; /**< Next more recently used. */
+    struct fsg_lextree_cache_s *next; /**< Next less recently used. */
+} fsg_lextree_cache_t;
+
 /**
  * Implementation of FSG search (and "FSG set") structure.
  */
@@ -77,6 +89,12 @@ typedef struct fsg_search_s {
     jsgf_t *jsgf;               /**< Active JSGF grammar file. */
     struct fsg_lextree_s *lextree;/**< Lextree structure for the currently
 				   active FSG */
+    hash_table_t *lextrees;     /**< Compiled lextrees, keyed by FSG pointer. */
+    fsg_lextree_cache_t *lru_head; /**< Most recently used lextree. */
+    fsg_lextree_cache_t *lru_tail; /**< Least recently used lextree. */
+    size_t lextree_mem;         /**< Bytes used by all cached lextrees. */
+    size_t lextree_budget;      /**< Bytes allowed for cached lextrees
+                                   (the current one is always kept). */
     struct fsg_history_s *history;/**< For storing the Viterbi search history */
   
     glist_t pnode_active;	/**< Those active in this frame */
@@ -88,6 +106,7 @@ typedef struct fsg_search_s {
     float32 beam_factor;	/**< Dynamic/adaptive factor (<=1) applied to above
                                      beams to determine actual effective beams.
                                      For implementing absolute pruning. */
+    float32 beam_scale;		/**< Scale applied by the real-time governor. */
     int32 beam, pbeam, wbeam;	/**< Effective beams after applying beam_factor */
     int32 lw, pip, wip;         /**< Language weights */
   
@@ -127,6 +146,16 @@ void fsg_search_free(ps_search_t *search);
  */
 int fsg_search_reinit(ps_search_t *fsgs, dict_t *dict, dict2pid_t *d2p);
 
+/**
+ * Free all cached lextrees, including the current one.
+ */
+void fsg_search_flush_lextrees(fsg_search_t *fsgs);
+
+/**
+ * Account for a word newly added to the dictionary.
+ */
+int fsg_search_add_word(ps_search_t *search, int32 wid);
+
 /**
  * Prepare the FSG search structure for beginning decoding of the next
  * utterance.
@@ -70,12 +70,15 @@
 
 /* Local headers. */
 #include "ms_mgau.h"
+#include "tied_mgau_common.h"
 
 static ps_mgaufuncs_t ms_mgau_funcs = {
     "ms",
     ms_cont_mgau_frame_eval, /* frame_eval */
     ms_mgau_mllr_transform,  /* transform */
-    ms_mgau_free             /* free */
+    ms_mgau_free,            /* free */
+    NULL,                    /* snapshot */
+    NULL                     /* restore */
 };
 
 ps_mgau_t *
@@ -122,6 +125,12 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
                              lmath, mdef);
 
     s->aw = cmd_ln_int32_r(config, "-aw");
+    /* Ensure that it is only 8 bits wide so that fast_logmath_add() works. */
+    if (logmath_get_width(s->lmath) != 1) {
+        E_ERROR("Log base %f is too small to represent add table in 8 bits\n",
+                logmath_get_base(s->lmath));
+        goto error_out;
+    }
 
     /* Verify senone parameters against gauden parameters */
     if (s->n_feat != g->n_feat)
@@ -149,7 +158,8 @@ ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef)
     msg->dist = (gauden_dist_t ***)
         ckd_calloc_3d(g->n_mgau, g->n_feat, msg->topn,
                       sizeof(gauden_dist_t));
-    msg->mgau_active = ckd_calloc(g->n_mgau, sizeof(int8));
+    msg->mgau_active = bitvec_alloc(g->n_mgau);
+    msg->mgau_list = ckd_calloc(g->n_mgau, sizeof(*msg->mgau_list));
 
     mg = (ps_mgau_t *)msg;
     mg->vt = &ms_mgau_funcs;
@@ -173,7 +183,8 @@ ms_mgau_free(ps_mgau_t * mg)
     if (msg->dist)
         ckd_free_3d((void *) msg->dist);
     if (msg->mgau_active)
-        ckd_free(msg->mgau_active);
+        bitvec_free(msg->mgau_active);
+    ckd_free(msg->mgau_list);
     
     ckd_free(msg);
 }
@@ -186,17 +197,53 @@ ms_mgau_mllr_transform(ps_mgau_t *s,
     return gauden_mllr_transform(msg->g, mllr, msg->config);
 }
 
+/*
+ * Normalize the top-N densities for each feature stream by the best
+ * one over all active codebooks, then scale, negate and clamp them so
+ * that senone_eval() can combine them with mixture weights using
+ * fast_logmath_add().  The normalizer has to be shared across
+ * codebooks or the senone scores would not be comparable.
+ */
+static void
+ms_mgau_norm_dist(ms_mgau_model_t *msg)
+{
+    gauden_t *g = ms_mgau_gauden(msg);
+    int32 i, f, t;
+
+    for (f = 0; f < g->n_feat; f++) {
+        int32 norm = (int32) 0x80000000;
+
+        for (i = 0; i < msg->n_mgau_active; i++) {
+            int32 top = ((int32)msg->dist[msg->mgau_list[i]][f][0].dist
+                         + ((1 << SENSCR_SHIFT) - 1)) >> SENSCR_SHIFT;
+            if (norm < top)
+                norm = top;
+        }
+        for (i = 0; i < msg->n_mgau_active; i++) {
+            gauden_dist_t *fdist = msg->dist[msg->mgau_list[i]][f];
+            for (t = 0; t < msg->topn; t++) {
+                int32 fden = ((int32)fdist[t].dist
+                              + ((1 << SENSCR_SHIFT) - 1)) >> SENSCR_SHIFT;
+                if (fden < norm - MAX_NEG_ASCR)
+                    fdist[t].dist = MAX_NEG_ASCR;
+                else
+                    fdist[t].dist = norm - fden;
+            }
+        }
+    }
+}
+
 int32
 ms_cont_mgau_frame_eval(ps_mgau_t * mg,
 			int16 *senscr,
-			uint8 *senone_active,
+			uint16 *senone_active,
 			int32 n_senone_active,
                         mfcc_t ** feat,
 			int32 frame,
 			int32 compallsen)
 {
     ms_mgau_model_t *msg = (ms_mgau_model_t *)mg;
-    int32 gid;
+    int32 i, s;
     int32 topn;
     int32 best;
     gauden_t *g;
@@ -206,73 +253,49 @@ ms_cont_mgau_frame_eval(ps_mgau_t * mg,
     g = ms_mgau_gauden(msg);
     sen = ms_mgau_senone(msg);
 
+    /* Flag all active mixture-gaussian codebooks */
     if (compallsen) {
-	int32 s;
-
-	for (gid = 0; gid < g->n_mgau; gid++)
-	    gauden_dist(g, gid, topn, feat, msg->dist[gid]);
-
-	best = (int32) 0x7fffffff;
-	for (s = 0; s < sen->n_sen; s++) {
-	    senscr[s] = senone_eval(sen, s, msg->dist[sen->mgau[s]], topn);
-	    if (best > senscr[s]) {
-		best = senscr[s];
-	    }
-	}
-
-	/* Normalize senone scores */
-	for (s = 0; s < sen->n_sen; s++) {
-	    int32 bs = senscr[s] - best;
-	    if (bs > 32767)
-		bs = 32767;
-	    if (bs < -32768)
-		bs = -32768;
-	    senscr[s] = bs;
-	}
+        bitvec_set_all(msg->mgau_active, g->n_mgau);
+        n_senone_active = sen->n_sen;
     }
     else {
-	int32 i, n;
-	/* Flag all active mixture-gaussian codebooks */
-	for (gid = 0; gid < g->n_mgau; gid++)
-	    msg->mgau_active[gid] = 0;
-
-	n = 0;
-	for (i = 0; i < n_senone_active; i++) {
-	    /* senone_active consists of deltas. */
-	    int32 s = senone_active[i] + n;
-	    msg->mgau_active[sen->mgau[s]] = 1;
-	    n = s;
-	}
+        bitvec_clear_all(msg->mgau_active, g->n_mgau);
+        for (i = 0; i < n_senone_active; i++)
+            bitvec_set(msg->mgau_active, sen->mgau[senone_active[i]]);
+    }
+    msg->n_mgau_active = acmod_bitvec_list(msg->mgau_active, g->n_mgau,
+                                           msg->mgau_list);
 
-	/* Compute topn gaussian density values (for active codebooks) */
-	for (gid = 0; gid < g->n_mgau; gid++) {
-	    if (msg->mgau_active[gid])
-		gauden_dist(g, gid, topn, feat, msg->dist[gid]);
-	}
+    /* Compute topn gaussian density values (for active codebooks) */
+    for (i = 0; i < msg->n_mgau_active; i++)
+        gauden_dist(g, msg->mgau_list[i], topn, feat,
+                    msg->dist[msg->mgau_list[i]]);
+    ms_mgau_norm_dist(msg);
 
-	best = (int32) 0x7fffffff;
-	n = 0;
-	for (i = 0; i < n_senone_active; i++) {
-	    int32 s = senone_active[i] + n;
-	    senscr[s] = senone_eval(sen, s, msg->dist[sen->mgau[s]], topn);
-	    if (best > senscr[s]) {
-		best = senscr[s];
-	    }
-	    n = s;
-	}
+    if (sen->n_gauden == 1) {
+        best = senone_eval_all(sen, msg->dist[0], topn, senscr,
+                               senone_active, n_senone_active, compallsen);
+    }
+    else {
+        best = (int32) 0x7fffffff;
+        for (i = 0; i < n_senone_active; i++) {
+            s = compallsen ? i : senone_active[i];
+            senscr[s] = senone_eval(sen, s, msg->dist[sen->mgau[s]], topn);
+            if (best > senscr[s])
+                best = senscr[s];
+        }
+    }
 
-	/* Normalize senone scores */
-	n = 0;
-	for (i = 0; i < n_senone_active; i++) {
-	    int32 s = senone_active[i] + n;
-	    int32 bs = senscr[s] - best;
-	    if (bs > 32767)
-		bs = 32767;
-	    if (bs < -32768)
-		bs = -32768;
-	    senscr[s] = bs;
-	    n = s;
-	}
+    /* Normalize senone scores */
+    for (i = 0; i < n_senone_active; i++) {
+        int32 bs;
+        s = compallsen ? i : senone_active[i];
+        bs = senscr[s] - best;
+        if (bs > 32767)
+            bs = 32767;
+        if (bs < -32768)
+            bs = -32768;
+        senscr[s] = bs;
     }
 
     return 0;
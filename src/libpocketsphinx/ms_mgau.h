@@ -119,7 +119,9 @@ typedef struct {
 
     /**< Intermediate used in computation */
     gauden_dist_t ***dist;  
-    uint8 *mgau_active;
+    bitvec_t *mgau_active;  /**< Active codebooks in current frame */
+    uint16 *mgau_list;      /**< Sorted list of active codebooks */
+    int32 n_mgau_active;    /**< Number of active codebooks */
     cmd_ln_t *config;
 } ms_mgau_model_t;  
 
@@ -131,7 +133,7 @@ ps_mgau_t* ms_mgau_init(acmod_t *acmod, logmath_t *lmath, bin_mdef_t *mdef);
 void ms_mgau_free(ps_mgau_t *g);
 int32 ms_cont_mgau_frame_eval(ps_mgau_t * msg,
                               int16 *senscr,
-                              uint8 *senone_active,
+                              uint16 *senone_active,
                               int32 n_senone_active,
                               mfcc_t ** feat,
                               int32 frame,
@@ -45,6 +45,7 @@
 
 /* Local headers. */
 #include "ms_senone.h"
+#include "tied_mgau_common.h"
 
 
 #define MIXW_PARAM_VERSION	"1.0"
@@ -247,17 +248,19 @@ senone_mixw_read(senone_t * s, char const *file_name, logmath_t *lmath)
             vector_floor(pdf, s->n_cw, s->mixwfloor);
             vector_sum_norm(pdf, s->n_cw);
 
-            /* Convert to logs3, truncate to 8 bits, and store in s->pdf */
+            /* Convert to logs3, truncate to 8 bits, and store in
+             * s->pdf.  Clamp to MAX_NEG_MIXW so that fast_logmath_add()
+             * can be used in senone_eval(). */
             for (c = 0; c < s->n_cw; c++) {
                 p = -(logmath_log(lmath, pdf[c]));
                 p += (1 << (SENSCR_SHIFT - 1)) - 1; /* Rounding before truncation */
+                p = (p < (MAX_NEG_MIXW << SENSCR_SHIFT))
+                    ? (p >> SENSCR_SHIFT) : MAX_NEG_MIXW;
 
                 if (s->n_gauden > 1)
-                    s->pdf[i][f][c] =
-                        (p < (255 << SENSCR_SHIFT)) ? (p >> SENSCR_SHIFT) : 255;
+                    s->pdf[i][f][c] = p;
                 else
-                    s->pdf[f][c][i] =
-                        (p < (255 << SENSCR_SHIFT)) ? (p >> SENSCR_SHIFT) : 255;
+                    s->pdf[f][c][i] = p;
             }
         }
     }
@@ -368,6 +371,8 @@ senone_free(senone_t * s)
  * Compute senone score for one senone.
  * NOTE:  Remember that senone PDF tables contain SCALED, NEGATED logs3 values.
  * NOTE:  Remember also that PDF data may be transposed or not depending on s->n_gauden.
+ * NOTE:  Densities in dist have been normalized, scaled and negated
+ *        (see ms_cont_mgau_frame_eval()), so every term fits in 8 bits.
  */
 int32
 senone_eval(senone_t * s, int id, gauden_dist_t ** dist, int32 n_top)
@@ -385,29 +390,26 @@ senone_eval(senone_t * s, int id, gauden_dist_t ** dist, int32 n_top)
     scr = 0;
 
     for (f = 0; f < s->n_feat; f++) {
-        int top;
         fdist = dist[f];
 
         /* Top codeword for feature f */
-	top = fden = ((int32)fdist[0].dist + ((1<<SENSCR_SHIFT) - 1)) >> SENSCR_SHIFT;
+        fden = (int32)fdist[0].dist;
         fscr = (s->n_gauden > 1)
-	    ? (fden + -s->pdf[id][f][fdist[0].id])  /* untransposed */
-	    : (fden + -s->pdf[f][fdist[0].id][id]); /* transposed */
+	    ? (fden + s->pdf[id][f][fdist[0].id])  /* untransposed */
+	    : (fden + s->pdf[f][fdist[0].id][id]); /* transposed */
         E_DEBUG(1, ("fden[%d][%d] l+= %d + %d = %d\n",
-                    id, f, -(fscr - fden), -(fden-top), -(fscr-top)));
+                    id, f, fscr - fden, fden, fscr));
         /* Remaining of n_top codewords for feature f */
         for (t = 1; t < n_top; t++) {
-	    fden = ((int32)fdist[t].dist + ((1<<SENSCR_SHIFT) - 1)) >> SENSCR_SHIFT;
+            fden = (int32)fdist[t].dist;
             fwscr = (s->n_gauden > 1) ?
-                (fden + -s->pdf[id][f][fdist[t].id]) :
-                (fden + -s->pdf[f][fdist[t].id][id]);
-            fscr = logmath_add(s->lmath, fscr, fwscr);
+                (fden + s->pdf[id][f][fdist[t].id]) :
+                (fden + s->pdf[f][fdist[t].id][id]);
+            fscr = fast_logmath_add(s->lmath, fscr, fwscr);
             E_DEBUG(1, ("fden[%d][%d] l+= %d + %d = %d\n",
-                        id, f, -(fwscr - fden), -(fden-top), -(fscr-top)));
+                        id, f, fwscr - fden, fden, fscr));
         }
-	/* Senone scores are also scaled, negated logs3 values.  Hence
-	 * we have to negate the stuff we calculated above. */
-        scr -= fscr;
+        scr += fscr;
     }
     /* Downscale scores. */
     scr /= s->aw;
@@ -419,3 +421,87 @@ senone_eval(senone_t * s, int id, gauden_dist_t ** dist, int32 n_top)
       scr = -32768;
     return scr;
 }
+
+/*
+ * Accumulate one codeword's contribution to the feature scores of the
+ * active senones, reading a single row of the transposed PDF.
+ */
+static void
+senone_eval_cw(senone_t *s, senprob_t *pdf, int32 fden, int first,
+               uint16 *senone_active, int32 n_senone_active,
+               int32 compallsen)
+{
+    int32 *featscr = s->featscr;
+    int32 i;
+
+    if (compallsen) {
+        if (first) {
+            for (i = 0; i < s->n_sen; i++)
+                featscr[i] = fden + pdf[i];
+        }
+        else {
+            for (i = 0; i < s->n_sen; i++)
+                featscr[i] = fast_logmath_add(s->lmath, featscr[i],
+                                              fden + pdf[i]);
+        }
+    }
+    else {
+        if (first) {
+            for (i = 0; i < n_senone_active; i++) {
+                int32 sen = senone_active[i];
+                featscr[sen] = fden + pdf[sen];
+            }
+        }
+        else {
+            for (i = 0; i < n_senone_active; i++) {
+                int32 sen = senone_active[i];
+                featscr[sen] = fast_logmath_add(s->lmath, featscr[sen],
+                                                fden + pdf[sen]);
+            }
+        }
+    }
+}
+
+int32
+senone_eval_all(senone_t *s, gauden_dist_t **dist, int32 n_top,
+                int16 *senscr, uint16 *senone_active,
+                int32 n_senone_active, int32 compallsen)
+{
+    int32 f, t, i, best;
+
+    assert(s->n_gauden == 1);
+    assert((n_top > 0) && (n_top <= s->n_cw));
+
+    if (s->featscr == NULL)
+        s->featscr = ckd_calloc(s->n_sen, sizeof(*s->featscr));
+    if (compallsen)
+        n_senone_active = s->n_sen;
+
+    for (f = 0; f < s->n_feat; f++) {
+        /* Go through the top N codewords once each, touching each
+         * mixture weight row sequentially. */
+        for (t = 0; t < n_top; t++)
+            senone_eval_cw(s, s->pdf[f][dist[f][t].id],
+                           (int32)dist[f][t].dist, (t == 0),
+                           senone_active, n_senone_active, compallsen);
+
+        /* Sum over features (each fits easily in 16 bits). */
+        for (i = 0; i < n_senone_active; i++) {
+            int32 sen = compallsen ? i : senone_active[i];
+            if (f == 0)
+                senscr[sen] = s->featscr[sen];
+            else
+                senscr[sen] += s->featscr[sen];
+        }
+    }
+
+    /* Downscale scores and find the best one. */
+    best = (int32) 0x7fffffff;
+    for (i = 0; i < n_senone_active; i++) {
+        int32 sen = compallsen ? i : senone_active[i];
+        senscr[sen] /= s->aw;
+        if (best > senscr[sen])
+            best = senscr[sen];
+    }
+    return best;
+}
@@ -185,6 +185,8 @@ void senone_free(senone_t *s); /**< In: The senone_t to free */
 
 /**
  * Evaluate the score for the given senone wrt to the given top N gaussian codewords.
+ * The densities must already be normalized, scaled and negated so
+ * that they fit in 8 bits, as done by ms_cont_mgau_frame_eval().
  * @return senone score (in logs3 domain).
  */
 int32 senone_eval (senone_t *s, int id,		/**< In: senone for which score desired */
@@ -195,6 +197,24 @@ int32 senone_eval (senone_t *s, int id,		/**< In: senone for which score desired
 		   int n_top		/**< In: Length of dist[f], for each f */
     );
 
+/**
+ * Evaluate the scores for all active senones at once, when they share
+ * a single codebook (n_gauden == 1) and the PDF is thus transposed.
+ * This goes codeword-major, so that each of the top N codewords reads
+ * one contiguous row of mixture weights.
+ * @return best (lowest) senone score (in logs3 domain).
+ */
+int32 senone_eval_all(senone_t *s,
+                      gauden_dist_t **dist, /**< In: top N codewords and
+                                               densities for all features,
+                                               as for senone_eval() */
+                      int32 n_top,          /**< In: Length of dist[f] */
+                      int16 *senscr,        /**< Out: senone scores */
+                      uint16 *senone_active,/**< In: sorted list of active senones */
+                      int32 n_senone_active,/**< In: number of active senones */
+                      int32 compallsen      /**< In: evaluate all senones */
+    );
+
 #if 0
 { /* Stop indent from complaining */
 #endif
@@ -54,14 +54,20 @@
 #include "ngram_search.h"
 #include "ngram_search_fwdtree.h"
 #include "ngram_search_fwdflat.h"
+#include "snapshot.h"
 
 static int ngram_search_start(ps_search_t *search);
 static int ngram_search_step(ps_search_t *search, int frame_idx);
 static int ngram_search_finish(ps_search_t *search);
 static int ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p);
+static int ngram_search_add_word(ps_search_t *search, int32 wid);
 static char const *ngram_search_hyp(ps_search_t *search, int32 *out_score, int32 *out_is_final);
 static int32 ngram_search_prob(ps_search_t *search);
 static ps_seg_t *ngram_search_seg_iter(ps_search_t *search, int32 *out_score);
+static int ngram_search_scale_beams(ps_search_t *search, float32 scale);
+static int ngram_search_snapshot(ps_search_t *search, FILE *fh);
+static int ngram_search_restore(ps_search_t *search, FILE *fh);
+static void ngram_search_flat_wait(ngram_search_t *ngs);
 
 static ps_searchfuncs_t ngram_funcs = {
     /* name: */   "ngram",
@@ -69,11 +75,15 @@ static ps_searchfuncs_t ngram_funcs = {
     /* step: */   ngram_search_step,
     /* finish: */ ngram_search_finish,
     /* reinit: */ ngram_search_reinit,
+    /* add_word: */ ngram_search_add_word,
     /* free: */   ngram_search_free,
     /* lattice: */  ngram_search_lattice,
     /* hyp: */      ngram_search_hyp,
     /* prob: */     ngram_search_prob,
     /* seg_iter: */ ngram_search_seg_iter,
+    /* scale_beams: */ ngram_search_scale_beams,
+    /* snapshot: */ ngram_search_snapshot,
+    /* restore: */  ngram_search_restore,
 };
 
 static void
@@ -102,17 +112,27 @@ ngram_search_calc_beams(ngram_search_t *ngs)
     acmod = ps_search_acmod(ngs);
 
     /* Log beam widths. */
-    ngs->beam = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-beam"))>>SENSCR_SHIFT;
-    ngs->wbeam = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-wbeam"))>>SENSCR_SHIFT;
-    ngs->pbeam = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-pbeam"))>>SENSCR_SHIFT;
-    ngs->lpbeam = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-lpbeam"))>>SENSCR_SHIFT;
-    ngs->lponlybeam = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-lponlybeam"))>>SENSCR_SHIFT;
-    ngs->fwdflatbeam = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-fwdflatbeam"))>>SENSCR_SHIFT;
-    ngs->fwdflatwbeam = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-fwdflatwbeam"))>>SENSCR_SHIFT;
+    ngs->beam_orig = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-beam"))>>SENSCR_SHIFT;
+    ngs->wbeam_orig = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-wbeam"))>>SENSCR_SHIFT;
+    ngs->pbeam_orig = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-pbeam"))>>SENSCR_SHIFT;
+    ngs->lpbeam_orig = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-lpbeam"))>>SENSCR_SHIFT;
+    ngs->lponlybeam_orig = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-lponlybeam"))>>SENSCR_SHIFT;
+    ngs->fwdflatbeam_orig = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-fwdflatbeam"))>>SENSCR_SHIFT;
+    ngs->fwdflatwbeam_orig = logmath_log(acmod->lmath, cmd_ln_float64_r(config, "-fwdflatwbeam"))>>SENSCR_SHIFT;
+    ngs->beam = ngs->beam_orig;
+    ngs->wbeam = ngs->wbeam_orig;
+    ngs->pbeam = ngs->pbeam_orig;
+    ngs->lpbeam = ngs->lpbeam_orig;
+    ngs->lponlybeam = ngs->lponlybeam_orig;
+    ngs->fwdflatbeam = ngs->fwdflatbeam_orig;
+    ngs->fwdflatwbeam = ngs->fwdflatwbeam_orig;
 
     /* Absolute pruning parameters. */
     ngs->maxwpf = cmd_ln_int32_r(config, "-maxwpf");
     ngs->maxhmmpf = cmd_ln_int32_r(config, "-maxhmmpf");
+    ngs->fwdskip = cmd_ln_int32_r(config, "-fwdskip");
+    if (ngs->fwdskip < 1)
+        ngs->fwdskip = 1;
 
     /* Various penalties which may or may not be useful. */
     ngs->wip = logmath_log(acmod->lmath, cmd_ln_float32_r(config, "-wip")) >>SENSCR_SHIFT;
@@ -135,14 +155,125 @@ ngram_search_calc_beams(ngram_search_t *ngs)
     ngs->ascale = 1.0 / cmd_ln_float32_r(config, "-ascale");
 }
 
-ps_search_t *
-ngram_search_init(cmd_ln_t *config,
-		  acmod_t *acmod,
-		  dict_t *dict,
-                  dict2pid_t *d2p)
+static int
+ngram_search_scale_beams(ps_search_t *search, float32 scale)
+{
+    ngram_search_t *ngs = (ngram_search_t *)search;
+
+    ngs->beam = (int32)(ngs->beam_orig * scale);
+    ngs->pbeam = (int32)(ngs->pbeam_orig * scale);
+    ngs->wbeam = (int32)(ngs->wbeam_orig * scale);
+    ngs->lpbeam = (int32)(ngs->lpbeam_orig * scale);
+    ngs->lponlybeam = (int32)(ngs->lponlybeam_orig * scale);
+    ngs->fwdflatbeam = (int32)(ngs->fwdflatbeam_orig * scale);
+    ngs->fwdflatwbeam = (int32)(ngs->fwdflatwbeam_orig * scale);
+    if (ngs->flat) {
+        if (ngs->flat_thread)
+            ngram_search_flat_wait(ngs);
+        ngram_search_scale_beams(ps_search_base(ngs->flat), scale);
+    }
+    return 0;
+}
+
+static int
+ngram_search_snapshot(ps_search_t *search, FILE *fh)
+{
+    ngram_search_t *ngs = (ngram_search_t *)search;
+
+    /* The flat lexicon search keeps a list of word candidates for
+     * every frame, which is not worth saving. */
+    if (!ngs->fwdtree || ngs->flat) {
+        E_ERROR("Only the tree search without -fwdflatlag can be saved mid-utterance\n");
+        return -1;
+    }
+    if (snapshot_write_int32(fh, ps_search_n_words(ngs)) < 0
+        || snapshot_write_int32(fh, ngs->n_frame) < 0
+        || snapshot_write_int32(fh, ngs->best_score) < 0
+        || snapshot_write_int32(fh, ngs->last_phone_best_score) < 0
+        || snapshot_write_int32(fh, ngs->renormalized) < 0
+        || snapshot_write_int32(fh, ngs->bpidx) < 0
+        || snapshot_write(fh, ngs->bp_table, sizeof(*ngs->bp_table),
+                          ngs->bpidx) < 0
+        || snapshot_write_int32(fh, ngs->bss_head) < 0
+        || snapshot_write(fh, ngs->bscore_stack, sizeof(*ngs->bscore_stack),
+                          ngs->bss_head) < 0
+        || snapshot_write(fh, ngs->bp_table_idx, sizeof(*ngs->bp_table_idx),
+                          ngs->n_frame) < 0
+        || snapshot_write(fh, &ngs->st, sizeof(ngs->st), 1) < 0)
+        return -1;
+    return ngram_fwdtree_snapshot(ngs, fh);
+}
+
+static int
+ngram_search_restore(ps_search_t *search, FILE *fh)
+{
+    ngram_search_t *ngs = (ngram_search_t *)search;
+    int32 n_ciphone = bin_mdef_n_ciphone(ps_search_acmod(ngs)->mdef);
+    int32 n_frame;
+
+    if (!ngs->fwdtree || ngs->flat) {
+        E_ERROR("Only the tree search without -fwdflatlag can be restored mid-utterance\n");
+        return -1;
+    }
+    if (snapshot_check_int32(fh, ps_search_n_words(ngs), "number of words") < 0
+        || snapshot_read_int32(fh, &n_frame) < 0
+        || snapshot_read_int32(fh, &ngs->best_score) < 0
+        || snapshot_read_int32(fh, &ngs->last_phone_best_score) < 0
+        || snapshot_read_int32(fh, &ngs->renormalized) < 0
+        || snapshot_read_int32(fh, &ngs->bpidx) < 0)
+        return -1;
+    if (n_frame < 0 || ngs->bpidx < 0) {
+        E_ERROR("Corrupt snapshot: %d frames, %d backpointers\n",
+                n_frame, ngs->bpidx);
+        return -1;
+    }
+
+    /* Grow the tables the same way the search does. */
+    if (ngs->bpidx > ngs->bp_table_size) {
+        while (ngs->bpidx > ngs->bp_table_size)
+            ngs->bp_table_size *= 2;
+        ngs->bp_table = ckd_realloc(ngs->bp_table,
+                                    ngs->bp_table_size
+                                    * sizeof(*ngs->bp_table));
+    }
+    if (snapshot_read(fh, ngs->bp_table, sizeof(*ngs->bp_table),
+                      ngs->bpidx) < 0
+        || snapshot_read_int32(fh, &ngs->bss_head) < 0)
+        return -1;
+    if (ngs->bss_head < 0) {
+        E_ERROR("Corrupt snapshot: score stack size %d\n", ngs->bss_head);
+        return -1;
+    }
+    if (ngs->bss_head >= ngs->bscore_stack_size - n_ciphone) {
+        while (ngs->bss_head >= ngs->bscore_stack_size - n_ciphone)
+            ngs->bscore_stack_size *= 2;
+        ngs->bscore_stack = ckd_realloc(ngs->bscore_stack,
+                                        ngs->bscore_stack_size
+                                        * sizeof(*ngs->bscore_stack));
+    }
+    if (snapshot_read(fh, ngs->bscore_stack, sizeof(*ngs->bscore_stack),
+                      ngs->bss_head) < 0)
+        return -1;
+    while (n_frame >= ngs->n_frame_alloc)
+        ngram_search_mark_bptable(ngs, ngs->n_frame_alloc);
+    if (snapshot_read(fh, ngs->bp_table_idx, sizeof(*ngs->bp_table_idx),
+                      n_frame) < 0
+        || snapshot_read(fh, &ngs->st, sizeof(ngs->st), 1) < 0)
+        return -1;
+    ngs->n_frame = n_frame;
+    return ngram_fwdtree_restore(ngs, fh);
+}
+
+/**
+ * Allocate a search and the tables it needs, without a language model.
+ */
+static ngram_search_t *
+ngram_search_alloc(cmd_ln_t *config,
+                   acmod_t *acmod,
+                   dict_t *dict,
+                   dict2pid_t *d2p)
 {
     ngram_search_t *ngs;
-    const char *path;
 
     ngs = ckd_calloc(1, sizeof(*ngs));
     ps_search_init(&ngs->base, &ngram_funcs, config, acmod, dict, d2p);
@@ -186,6 +317,181 @@ ngram_search_init(cmd_ln_t *config,
     ngs->active_word_list = ckd_calloc_2d(2, dict_size(dict),
                                           sizeof(**ngs->active_word_list));
 
+    return ngs;
+}
+
+/**
+ * Create the flat lexicon search which runs a fixed number of frames
+ * behind the tree search, sharing its language model.
+ */
+static ngram_search_t *
+ngram_search_flat_init(ngram_search_t *ngs)
+{
+    ngram_search_t *flat;
+
+    flat = ngram_search_alloc(ps_search_config(ngs), ps_search_acmod(ngs),
+                              ps_search_dict(ngs), ps_search_dict2pid(ngs));
+    if (flat == NULL)
+        return NULL;
+    flat->lmset = ngram_model_retain(ngs->lmset);
+    flat->tree = ngs;
+    /* Pick up any scaling applied to the tree search's beams. */
+    flat->beam = ngs->beam;
+    flat->fwdflatbeam = ngs->fwdflatbeam;
+    flat->fwdflatwbeam = ngs->fwdflatwbeam;
+
+    ngram_fwdflat_init(flat);
+    flat->fwdflat = TRUE;
+    flat->fwdflat_perf.name = "fwdflat";
+    ptmr_init(&flat->fwdflat_perf);
+
+    return flat;
+}
+
+/**
+ * Main loop of the thread running the incremental fwdflat search.
+ */
+static int
+ngram_search_flat_main(sbthread_t *th)
+{
+    ngram_search_t *ngs = sbthread_arg(th);
+
+    while (sbevent_wait(ngs->flat_go, -1, -1) >= 0) {
+        int frame_idx, exit;
+
+        sbmtx_lock(ngs->lm_mtx);
+        frame_idx = ngs->flat_job;
+        exit = ngs->flat_exit;
+        sbmtx_unlock(ngs->lm_mtx);
+        if (exit)
+            break;
+
+        ngram_fwdflat_search_frame(ngs->flat, frame_idx, ngs->flat_senscr);
+
+        sbmtx_lock(ngs->lm_mtx);
+        ngs->flat_job = -1;
+        sbmtx_unlock(ngs->lm_mtx);
+        sbevent_signal(ngs->flat_idle);
+    }
+    return 0;
+}
+
+/**
+ * Wait for the fwdflat thread to finish the frame it is searching.
+ */
+static void
+ngram_search_flat_wait(ngram_search_t *ngs)
+{
+    for (;;) {
+        int busy;
+
+        sbmtx_lock(ngs->lm_mtx);
+        busy = (ngs->flat_job != -1);
+        sbmtx_unlock(ngs->lm_mtx);
+        if (!busy)
+            return;
+        sbevent_wait(ngs->flat_idle, -1, -1);
+    }
+}
+
+/**
+ * Start the thread running the incremental fwdflat search.
+ */
+static void
+ngram_search_flat_start_thread(ngram_search_t *ngs)
+{
+    ngs->lm_mtx = sbmtx_init();
+    ngs->flat_go = sbevent_init();
+    ngs->flat_idle = sbevent_init();
+    ngs->flat_senscr = ckd_calloc(bin_mdef_n_sen(ps_search_acmod(ngs)->mdef),
+                                  sizeof(*ngs->flat_senscr));
+    ngs->flat_job = -1;
+    ngs->flat_exit = FALSE;
+    if (ngs->lm_mtx && ngs->flat_go && ngs->flat_idle)
+        ngs->flat_thread = sbthread_start(ps_search_config(ngs),
+                                          ngram_search_flat_main, ngs);
+    if (ngs->flat_thread == NULL) {
+        E_WARN("Failed to start fwdflat thread, running it in the decoder thread\n");
+        sbmtx_free(ngs->lm_mtx);
+        ngs->lm_mtx = NULL;
+        return;
+    }
+    ngs->flat->lm_mtx = ngs->lm_mtx;
+}
+
+/**
+ * Stop the fwdflat thread, if any, and free the incremental fwdflat
+ * search.
+ */
+static void
+ngram_search_flat_free(ngram_search_t *ngs)
+{
+    if (ngs->flat_thread) {
+        ngram_search_flat_wait(ngs);
+        sbmtx_lock(ngs->lm_mtx);
+        ngs->flat_exit = TRUE;
+        sbmtx_unlock(ngs->lm_mtx);
+        sbevent_signal(ngs->flat_go);
+        sbthread_wait(ngs->flat_thread);
+        sbthread_free(ngs->flat_thread);
+        ngs->flat_thread = NULL;
+    }
+    if (ngs->flat_go)
+        sbevent_free(ngs->flat_go);
+    if (ngs->flat_idle)
+        sbevent_free(ngs->flat_idle);
+    if (ngs->lm_mtx)
+        sbmtx_free(ngs->lm_mtx);
+    ngs->flat_go = ngs->flat_idle = NULL;
+    ngs->lm_mtx = NULL;
+    ckd_free(ngs->flat_senscr);
+    ngs->flat_senscr = NULL;
+
+    if (ngs->flat)
+        ngram_search_free(ps_search_base(ngs->flat));
+    ngs->flat = NULL;
+}
+
+/**
+ * Search one frame of the incremental fwdflat search.  With a
+ * thread, its senone scores are computed here and the rest is handed
+ * over, after waiting for the previous frame to be done.
+ *
+ * @return 0, or -1 if the frame could not be scored.
+ */
+static int
+ngram_search_flat_frame(ngram_search_t *ngs, int frame_idx)
+{
+    int16 const *senscr;
+
+    if (ngs->flat_thread == NULL)
+        return (ngram_fwdflat_search(ngs->flat, frame_idx) < 0) ? -1 : 0;
+
+    ngram_search_flat_wait(ngs);
+    if ((senscr = ngram_fwdflat_score_frame(ngs->flat, frame_idx)) == NULL)
+        return -1;
+    memcpy(ngs->flat_senscr, senscr,
+           bin_mdef_n_sen(ps_search_acmod(ngs)->mdef)
+           * sizeof(*ngs->flat_senscr));
+    sbmtx_lock(ngs->lm_mtx);
+    ngs->flat_job = frame_idx;
+    sbmtx_unlock(ngs->lm_mtx);
+    sbevent_signal(ngs->flat_go);
+    return 0;
+}
+
+ps_search_t *
+ngram_search_init(cmd_ln_t *config,
+		  acmod_t *acmod,
+		  dict_t *dict,
+                  dict2pid_t *d2p)
+{
+    ngram_search_t *ngs;
+    const char *path;
+
+    if ((ngs = ngram_search_alloc(config, acmod, dict, d2p)) == NULL)
+        return NULL;
+
     /* Load language model(s) */
     if ((path = cmd_ln_str_r(config, "-lmctl"))) {
         ngs->lmset = ngram_model_set_read(config, path, acmod->lmath);
@@ -244,6 +550,19 @@ ngram_search_init(cmd_ln_t *config,
         ptmr_init(&ngs->bestpath_perf);
     }
 
+    /* Run fwdflat incrementally, behind fwdtree, if requested.  It
+     * can only search words whose exits fwdtree has finished
+     * recording, which takes a few frames. */
+    if (ngs->fwdtree && ngs->fwdflat
+        && (ngs->fwdflat_lag = cmd_ln_int32_r(config, "-fwdflatlag")) > 0) {
+        int32 min_lag = ngs->max_sf_win + ngs->min_ef_width + 1;
+        if (ngs->fwdflat_lag < min_lag) {
+            E_INFO("Increasing -fwdflatlag from %d to %d\n",
+                   ngs->fwdflat_lag, min_lag);
+            ngs->fwdflat_lag = min_lag;
+        }
+    }
+
     return (ps_search_t *)ngs;
 
 error_out:
@@ -251,6 +570,26 @@ error_out:
     return NULL;
 }
 
+/**
+ * Reallocate the temporary per-word arrays for the current number of
+ * words.  Their contents only live for one utterance.
+ */
+static void
+ngram_search_realloc_words(ngram_search_t *ngs)
+{
+    int32 n_words = ps_search_n_words(ngs);
+
+    ckd_free(ngs->word_lat_idx);
+    ckd_free(ngs->word_active);
+    ckd_free(ngs->last_ltrans);
+    ckd_free_2d(ngs->active_word_list);
+    ngs->word_lat_idx = ckd_calloc(n_words, sizeof(*ngs->word_lat_idx));
+    ngs->word_active = bitvec_alloc(n_words);
+    ngs->last_ltrans = ckd_calloc(n_words, sizeof(*ngs->last_ltrans));
+    ngs->active_word_list
+        = ckd_calloc_2d(2, n_words, sizeof(**ngs->active_word_list));
+}
+
 static int
 ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
 {
@@ -258,21 +597,14 @@ ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     int old_n_words;
     int rv = 0;
 
+    /* The incremental fwdflat search is recreated on demand. */
+    ngram_search_flat_free(ngs);
+
     /* Update the number of words. */
     old_n_words = search->n_words;
     if (old_n_words != dict_size(dict)) {
         search->n_words = dict_size(dict);
-        /* Reallocate these temporary arrays. */
-        ckd_free(ngs->word_lat_idx);
-        ckd_free(ngs->word_active);
-        ckd_free(ngs->last_ltrans);
-        ckd_free_2d(ngs->active_word_list);
-        ngs->word_lat_idx = ckd_calloc(search->n_words, sizeof(*ngs->word_lat_idx));
-        ngs->word_active = bitvec_alloc(search->n_words);
-        ngs->last_ltrans = ckd_calloc(search->n_words, sizeof(*ngs->last_ltrans));
-        ngs->active_word_list
-            = ckd_calloc_2d(2, search->n_words,
-                            sizeof(**ngs->active_word_list));
+        ngram_search_realloc_words(ngs);
     }
 
     /* Free old dict2pid, dict */
@@ -300,11 +632,50 @@ ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     return rv;
 }
 
+static int
+ngram_search_add_word(ps_search_t *search, int32 wid)
+{
+    ngram_search_t *ngs = (ngram_search_t *)search;
+    dict_t *dict = ps_search_dict(search);
+
+    /* Only a single word appended to the dictionary we already have
+     * can be added in place. */
+    if (wid != search->n_words || dict_size(dict) != wid + 1)
+        return -1;
+    if (ngs->lmset == NULL) {
+        search->n_words = dict_size(dict);
+        ngram_search_realloc_words(ngs);
+        return 0;
+    }
+    /* The tree search keeps its single-phone words in an array
+     * ordered by LM membership, so rebuild for those. */
+    if (ngs->fwdtree && dict_is_single_phone(dict, wid))
+        return -1;
+
+    /* The incremental fwdflat search is recreated on demand. */
+    ngram_search_flat_free(ngs);
+
+    search->n_words = dict_size(dict);
+    ngram_search_realloc_words(ngs);
+
+    /* The LM set assigns new words the next free ID, which is usually
+     * the same as the dictionary one, so the mapping can be kept. */
+    if (ngram_wid(ngs->lmset, dict_wordstr(dict, wid)) != wid)
+        ngram_search_update_widmap(ngs);
+
+    if (ngs->fwdtree)
+        ngram_fwdtree_add_word(ngs, wid);
+    if (ngs->fwdflat)
+        ngram_fwdflat_add_word(ngs, wid);
+    return 0;
+}
+
 void
 ngram_search_free(ps_search_t *search)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
+    ngram_search_flat_free(ngs);
     ps_search_deinit(search);
     if (ngs->fwdtree)
         ngram_fwdtree_deinit(ngs);
@@ -344,6 +715,8 @@ int
 ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx)
 {
     if (frame_idx >= ngs->n_frame_alloc) {
+        /* The fwdflat thread reads the tree search's word list. */
+        ngram_search_lm_lock(ngs);
         ngs->n_frame_alloc *= 2;
         ngs->bp_table_idx = ckd_realloc(ngs->bp_table_idx - 1,
                                         (ngs->n_frame_alloc + 1)
@@ -352,13 +725,51 @@ ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx)
             ngs->frm_wordlist = ckd_realloc(ngs->frm_wordlist,
                                             ngs->n_frame_alloc
                                             * sizeof(*ngs->frm_wordlist));
+            memset(ngs->frm_wordlist + ngs->n_frame_alloc / 2, 0,
+                   ngs->n_frame_alloc / 2 * sizeof(*ngs->frm_wordlist));
         }
         ++ngs->bp_table_idx; /* Make bptableidx[-1] valid */
+        ngram_search_lm_unlock(ngs);
     }
     ngs->bp_table_idx[frame_idx] = ngs->bpidx;
     return ngs->bpidx;
 }
 
+void
+ngram_search_hist_start(ngram_search_t *ngs, int32 ref, int32 beam)
+{
+    int32 bw = -beam / (NGRAM_HIST_NBIN / 2);
+
+    memset(ngs->hmm_hist, 0, sizeof(ngs->hmm_hist));
+    ngs->hist_ref = ref;
+    /* Round the bin width up to a power of two, so binning is a shift. */
+    for (ngs->hist_shift = 0; (1 << ngs->hist_shift) < bw; ++ngs->hist_shift)
+        ;
+}
+
+int32
+ngram_search_hist_beam(ngram_search_t *ngs, int32 max_hmm, int32 beam)
+{
+    int32 i, n, dbeam;
+
+    for (i = n = 0; i < NGRAM_HIST_NBIN; ++i) {
+        n += ngs->hmm_hist[i];
+        if (n > max_hmm)
+            break;
+    }
+    if (i == NGRAM_HIST_NBIN)
+        return beam;
+
+    /* Keep everything in the bins above this one, but always at
+     * least one bin's width below the best score. */
+    dbeam = ngs->hist_ref - (i << ngs->hist_shift) - ngs->best_score;
+    if (dbeam > -(1 << ngs->hist_shift))
+        dbeam = -(1 << ngs->hist_shift);
+    if (dbeam < beam)
+        dbeam = beam;
+    return dbeam;
+}
+
 static void
 set_real_wid(ngram_search_t *ngs, int32 bp)
 {
@@ -731,11 +1142,13 @@ ngram_compute_seg_score(ngram_search_t *ngs, bptbl_t *be, float32 lwf,
     }
     else {
         int32 n_used;
+        ngram_search_lm_lock(ngs);
         *out_lscr = ngram_tg_score(ngs->lmset,
                                    be->real_wid,
                                    pbe->real_wid,
                                    pbe->prev_real_wid,
                                    &n_used)>>SENSCR_SHIFT;
+        ngram_search_lm_unlock(ngs);
         *out_lscr = *out_lscr * lwf;
     }
     *out_ascr = be->score - start_score - *out_lscr;
@@ -754,6 +1167,22 @@ ngram_search_start(ps_search_t *search)
         ngram_fwdflat_start(ngs);
     else
         return -1;
+
+    if (ngs->fwdflat_lag > 0) {
+        if (ngs->flat == NULL) {
+            if ((ngs->flat = ngram_search_flat_init(ngs)) == NULL)
+                return -1;
+            if (cmd_ln_boolean_r(ps_search_config(ngs), "-fwdflatthread"))
+                ngram_search_flat_start_thread(ngs);
+        }
+        /* An unfinished utterance may have left a frame in flight. */
+        if (ngs->flat_thread)
+            ngram_search_flat_wait(ngs);
+        ngram_fwdflat_start(ngs->flat);
+        ngs->flat_frame = 0;
+        ngs->final_sf = 0;
+        ngs->flat->n_tree_frame = 0;
+    }
     return 0;
 }
 
@@ -762,8 +1191,29 @@ ngram_search_step(ps_search_t *search, int frame_idx)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
-    if (ngs->fwdtree)
-        return ngram_fwdtree_search(ngs, frame_idx);
+    if (ngs->fwdtree) {
+        int nfr;
+
+        nfr = ngram_fwdtree_search(ngs, frame_idx);
+        if (nfr <= 0 || ngs->flat == NULL)
+            return nfr;
+
+        /* Pass the words fwdtree found to fwdflat.  Run it over the
+         * frames whose successor words are all known, the same as
+         * they would be after the utterance, and at least up to the
+         * configured lag behind, since older features are dropped. */
+        ngram_search_lm_lock(ngs);
+        ngram_fwdflat_update_wordlist(ngs, frame_idx);
+        ngs->flat->n_tree_frame = ngs->n_frame;
+        ngram_search_lm_unlock(ngs);
+        ngs->final_sf = ngram_fwdtree_final_sf(ngs, frame_idx);
+        while (ngs->flat_frame <= frame_idx
+               && (ngs->flat_frame + ngs->max_sf_win <= ngs->final_sf
+                   || ngs->flat_frame <= frame_idx - ngs->fwdflat_lag))
+            if (ngram_search_flat_frame(ngs, ngs->flat_frame++) < 0)
+                return -1;
+        return nfr;
+    }
     else if (ngs->fwdflat)
         return ngram_fwdflat_search(ngs, frame_idx);
     else
@@ -801,13 +1251,62 @@ dump_bptable(ngram_search_t *ngs)
     }
 }
 
+/**
+ * Take over the backpointer table of the incremental fwdflat search,
+ * so that lattices and hypotheses come from its results.
+ */
+static void
+ngram_search_swap_bptable(ngram_search_t *ngs, ngram_search_t *flat)
+{
+#define SWAP(field, type) do {                  \
+        type tmp = ngs->field;                  \
+        ngs->field = flat->field;               \
+        flat->field = tmp;                      \
+    } while (0)
+    SWAP(bp_table, bptbl_t *);
+    SWAP(bp_table_size, int32);
+    SWAP(bpidx, int32);
+    SWAP(bscore_stack, int32 *);
+    SWAP(bscore_stack_size, int32);
+    SWAP(bss_head, int32);
+    SWAP(bp_table_idx, int32 *);
+    SWAP(n_frame_alloc, int32);
+    SWAP(frm_wordlist, ps_latnode_t **);
+#undef SWAP
+}
+
 static int
 ngram_search_finish(ps_search_t *search)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
     ngs->n_tot_frame += ngs->n_frame;
-    if (ngs->fwdtree) {
+    if (ngs->fwdtree && ngs->flat) {
+        ngram_search_t *flat = ngs->flat;
+
+        ngram_fwdtree_finish(ngs);
+        /* Catch up with the frames fwdtree has already searched,
+         * including any word exits it found while finishing. */
+        ngram_search_lm_lock(ngs);
+        if (ngs->n_frame > 0)
+            ngram_fwdflat_update_wordlist(ngs, ngs->n_frame - 1);
+        flat->n_tree_frame = ngs->n_frame;
+        ngram_search_lm_unlock(ngs);
+        while (ngs->flat_frame < ngs->n_frame) {
+            if (ngram_search_flat_frame(ngs, ngs->flat_frame++) < 0) {
+                if (ngs->flat_thread)
+                    ngram_search_flat_wait(ngs);
+                ngram_fwdflat_finish(flat);
+                return -1;
+            }
+        }
+        if (ngs->flat_thread)
+            ngram_search_flat_wait(ngs);
+        ngram_fwdflat_finish(flat);
+        flat->n_tot_frame += flat->n_frame;
+        ngram_search_swap_bptable(ngs, flat);
+    }
+    else if (ngs->fwdtree) {
         ngram_fwdtree_finish(ngs);
         /* dump_bptable(ngs); */
 
@@ -937,11 +1436,13 @@ ngram_search_bp2itor(ps_seg_t *seg, int bp)
             seg->lscr = ngs->fillpen;
         }
         else {
+            ngram_search_lm_lock(ngs);
             seg->lscr = ngram_tg_score(ngs->lmset,
                                        be->real_wid,
                                        pbe->real_wid,
                                        pbe->prev_real_wid,
                                        &seg->lback)>>SENSCR_SHIFT;
+            ngram_search_lm_unlock(ngs);
             seg->lscr = (int32)(seg->lscr * seg->lwf);
         }
         seg->ascr = be->score - start_score - seg->lscr;
@@ -1199,8 +1700,10 @@ find_end_node(ngram_search_t *ngs, ps_lattice_t *dag, float32 lwf)
             bestbp = bp;
             break;
         }
+        ngram_search_lm_lock(ngs);
         l_scr = ngram_tg_score(ngs->lmset, ps_search_finish_wid(ngs),
                                wid, prev_wid, &n_used) >>SENSCR_SHIFT;
+        ngram_search_lm_unlock(ngs);
         l_scr = l_scr * lwf;
         if (ngs->bp_table[bp].score + l_scr BETTER_THAN bestscore) {
             bestscore = ngs->bp_table[bp].score + l_scr;
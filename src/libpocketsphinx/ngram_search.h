@@ -47,6 +47,7 @@
 #include <sphinxbase/logmath.h>
 #include <sphinxbase/ngram_model.h>
 #include <sphinxbase/listelem_alloc.h>
+#include <sphinxbase/sbthread.h>
 #include <sphinxbase/err.h>
 
 /* Local headers. */
@@ -174,6 +175,12 @@ typedef struct bestbp_rc_s {
 
 #define NO_BP		-1
 
+/**
+ * Number of bins in the HMM score histogram used for absolute pruning.
+ * They cover twice the beam width below the previous frame's best score.
+ */
+#define NGRAM_HIST_NBIN 512
+
 /**
  * Various statistics for profiling.
  */
@@ -322,6 +329,36 @@ struct ngram_search_s {
     int32 max_sf_win;
     float32 fwdflat_fwdtree_lw_ratio;
 
+    /*
+     * Incremental flat lexicon search (-fwdflatlag).  The tree search
+     * owns a second search object which runs fwdflat behind it, as
+     * soon as the part of the word list it needs is complete, or at
+     * most a fixed number of frames behind, taking its word list from
+     * the tree's backpointer table as it grows.
+     */
+    struct ngram_search_s *flat; /**< Lagging fwdflat search, or NULL. */
+    struct ngram_search_s *tree; /**< In flat, the tree search feeding it. */
+    int32 fwdflat_lag;   /**< Most frames by which flat lags the tree search. */
+    int32 flat_frame;    /**< Next frame for flat to search. */
+    int32 final_sf;      /**< In tree, words starting before this frame have no more exits. */
+    int32 n_tree_frame;  /**< In flat, frames of tree word exits available. */
+    int32 n_fwdflat_wordlist;     /**< Number of words in fwdflat_wordlist. */
+    bitvec_t *fwdflat_word_flag;  /**< Words already in fwdflat_wordlist. */
+
+    /*
+     * Thread running the incremental flat search (-fwdflatthread).
+     * The tree search scores each frame for it and hands it over;
+     * language model lookups, which update caches in the model, and
+     * the shared word list are serialized with lm_mtx.
+     */
+    sbthread_t *flat_thread; /**< Thread running flat, or NULL. */
+    sbmtx_t *lm_mtx;         /**< Shared with flat, owned by the tree search. */
+    sbevent_t *flat_go;      /**< Signalled when flat_job is set. */
+    sbevent_t *flat_idle;    /**< Signalled when flat_job is done. */
+    int16 *flat_senscr;      /**< Senone scores for flat_job. */
+    int32 flat_job;          /**< Frame being searched by flat, or -1. */
+    int32 flat_exit;         /**< Tells the thread to exit. */
+
     int32 best_score; /**< Best Viterbi path score. */
     int32 last_phone_best_score; /**< Best Viterbi path score for last phone. */
     int32 renormalized;
@@ -347,6 +384,15 @@ struct ngram_search_s {
     int32 lponlybeam;
     int32 fwdflatbeam;
     int32 fwdflatwbeam;
+    /* Beam widths from the configuration, before the real-time
+     * governor scales them. */
+    int32 beam_orig;
+    int32 pbeam_orig;
+    int32 wbeam_orig;
+    int32 lpbeam_orig;
+    int32 lponlybeam_orig;
+    int32 fwdflatbeam_orig;
+    int32 fwdflatwbeam_orig;
     int32 fillpen;
     int32 silpen;
     int32 wip;
@@ -354,6 +400,18 @@ struct ngram_search_s {
     int32 pip;
     int32 maxwpf;
     int32 maxhmmpf;
+
+    /* Histogram of HMM scores for absolute pruning (-maxhmmpf). */
+    int32 hmm_hist[NGRAM_HIST_NBIN];
+    int32 hist_ref;    /**< Score at the top of the first bin. */
+    int32 hist_shift;  /**< Log2 of the bin width. */
+
+    /* Frame skipping in the tree search. */
+    int32 fwdskip;     /**< Search advances once every this many frames. */
+    int32 n_pooled;    /**< Number of frames pooled since the last advance. */
+    int32 *pool_acc;   /**< Accumulated senone scores for pooled frames. */
+    int16 *pool_senscr; /**< Pooled senone scores passed to the search. */
+    uint8 ***pool_tp;   /**< Transition scores for fwdskip frames at once. */
 };
 typedef struct ngram_search_s ngram_search_t;
 
@@ -377,6 +435,41 @@ void ngram_search_free(ps_search_t *ngs);
  */
 int ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx);
 
+/**
+ * Start a new histogram of HMM scores for absolute pruning.
+ *
+ * @param ref Score no HMM in this frame can exceed, i.e. the best
+ *            score in the previous frame (after any renormalization).
+ * @param beam Beam width which the histogram should span.
+ */
+void ngram_search_hist_start(ngram_search_t *ngs, int32 ref, int32 beam);
+
+/**
+ * Add an evaluated HMM's score to the histogram.
+ */
+#define ngram_search_hist_add(ngs, score) do {                          \
+        int32 b_ = ((ngs)->hist_ref - (score)) >> (ngs)->hist_shift;   \
+        if (b_ < 0) b_ = 0;                                             \
+        else if (b_ >= NGRAM_HIST_NBIN) b_ = NGRAM_HIST_NBIN - 1;       \
+        ++(ngs)->hmm_hist[b_];                                          \
+    } while (0)
+
+/**
+ * Find the beam width, relative to ngs->best_score, which keeps at
+ * most max_hmm of the HMMs added to the histogram.
+ *
+ * @return the narrower of that and beam.
+ */
+int32 ngram_search_hist_beam(ngram_search_t *ngs, int32 max_hmm, int32 beam);
+
+/**
+ * Serialize language model access with the fwdflat thread, if any.
+ */
+#define ngram_search_lm_lock(ngs) \
+    ((ngs)->lm_mtx ? sbmtx_lock((ngs)->lm_mtx) : 0)
+#define ngram_search_lm_unlock(ngs) \
+    ((ngs)->lm_mtx ? sbmtx_unlock((ngs)->lm_mtx) : 0)
+
 /**
  * Enter a word in the backpointer table.
  */
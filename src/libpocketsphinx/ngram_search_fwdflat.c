@@ -156,10 +156,15 @@ ngram_fwdflat_init(ngram_search_t *ngs)
     E_INFO("fwdflat: min_ef_width = %d, max_sf_win = %d\n",
            ngs->min_ef_width, ngs->max_sf_win);
 
-    /* No tree-search; pre-build the expansion list, including all LM words. */
+    /* No tree-search; pre-build the expansion list, including all LM
+     * words, unless the word list is fed incrementally by a tree
+     * search running ahead of this one. */
     if (!ngs->fwdtree) {
-        /* Build full expansion list from LM words. */
-        ngram_fwdflat_expand_all(ngs);
+        if (ngs->tree)
+            ngs->fwdflat_word_flag = bitvec_alloc(n_words);
+        else
+            /* Build full expansion list from LM words. */
+            ngram_fwdflat_expand_all(ngs);
         /* Allocate single phone words. */
         ngram_fwdflat_allocate_1ph(ngs);
     }
@@ -184,6 +189,7 @@ ngram_fwdflat_deinit(ngram_search_t *ngs)
     }
     ckd_free(ngs->fwdflat_wordlist);
     bitvec_free(ngs->expand_word_flag);
+    bitvec_free(ngs->fwdflat_word_flag);
     ckd_free(ngs->expand_word_list);
     ckd_free(ngs->frm_wordlist);
 }
@@ -220,55 +226,143 @@ ngram_fwdflat_reinit(ngram_search_t *ngs)
     return 0;
 }
 
+int
+ngram_fwdflat_add_word(ngram_search_t *ngs, int32 wid)
+{
+    dict_t *dict = ps_search_dict(ngs);
+    int32 n_words = ps_search_n_words(ngs);
+    int i;
+
+    /* Grow the word lists, which are otherwise built as needed. */
+    ngs->fwdflat_wordlist = ckd_realloc(ngs->fwdflat_wordlist,
+                                        (n_words + 1) * sizeof(*ngs->fwdflat_wordlist));
+    ngs->expand_word_list = ckd_realloc(ngs->expand_word_list,
+                                        (n_words + 1) * sizeof(*ngs->expand_word_list));
+    ngs->expand_word_flag = bitvec_realloc(ngs->expand_word_flag,
+                                           n_words - 1, n_words);
+    if (ngs->fwdflat_word_flag)
+        ngs->fwdflat_word_flag = bitvec_realloc(ngs->fwdflat_word_flag,
+                                                n_words - 1, n_words);
+    if (ngs->fwdtree)
+        return 0;
+
+    /* No tree search; we own word_chan and the single-phone words. */
+    ngs->word_chan = ckd_realloc(ngs->word_chan,
+                                 n_words * sizeof(*ngs->word_chan));
+    ngs->word_chan[wid] = NULL;
+    if (dict_is_single_phone(dict, wid)) {
+        root_chan_t *rhmm;
+
+        ngs->rhmm_1ph = ckd_realloc(ngs->rhmm_1ph,
+                                    (ngs->n_1ph_words + 1) * sizeof(*ngs->rhmm_1ph));
+        ngs->single_phone_wid = ckd_realloc(ngs->single_phone_wid,
+                                            (ngs->n_1ph_words + 1)
+                                            * sizeof(*ngs->single_phone_wid));
+        rhmm = &ngs->rhmm_1ph[ngs->n_1ph_words];
+        memset(rhmm, 0, sizeof(*rhmm));
+        rhmm->ciphone = dict_first_phone(dict, wid);
+        rhmm->ci2phone = bin_mdef_silphone(ps_search_acmod(ngs)->mdef);
+        hmm_init(ngs->hmmctx, &rhmm->hmm, TRUE,
+                 bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, rhmm->ciphone),
+                 bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, rhmm->ciphone));
+        ngs->single_phone_wid[ngs->n_1ph_words++] = wid;
+        /* The array may have moved. */
+        for (i = 0; i < ngs->n_1ph_words; ++i)
+            ngs->word_chan[ngs->single_phone_wid[i]]
+                = (chan_t *) &ngs->rhmm_1ph[i];
+    }
+
+    /* Append it to the static expansion list if the LM knows it. */
+    if (ngram_model_set_known_wid(ngs->lmset, dict_basewid(dict, wid))) {
+        ngs->fwdflat_wordlist[ngs->n_expand_words] = wid;
+        ngs->expand_word_list[ngs->n_expand_words] = wid;
+        bitvec_set(ngs->expand_word_flag, wid);
+        ngs->n_expand_words++;
+        ngs->expand_word_list[ngs->n_expand_words] = -1;
+        ngs->fwdflat_wordlist[ngs->n_expand_words] = -1;
+    }
+    return 0;
+}
+
+/**
+ * Record the exit frame of a backpointer in the word list for its
+ * start frame.
+ */
+static void
+add_wordlist_node(ngram_search_t *ngs, bptbl_t *bp)
+{
+    int32 sf, ef, wid;
+    ps_latnode_t *node;
+
+    sf = (bp->bp < 0) ? 0 : ngs->bp_table[bp->bp].frame + 1;
+    ef = bp->frame;
+    wid = bp->wid;
+
+    /* Anything that can be transitioned to in the LM can go in
+     * the word list. */
+    if (!ngram_model_set_known_wid(ngs->lmset,
+                                   dict_basewid(ps_search_dict(ngs), wid)))
+        return;
+
+    /* Look for it in the wordlist. */
+    for (node = ngs->frm_wordlist[sf]; node && (node->wid != wid);
+         node = node->next);
+
+    /* Update last end frame. */
+    if (node)
+        node->lef = ef;
+    else {
+        /* New node; link to head of list */
+        node = listelem_malloc(ngs->latnode_alloc);
+        node->wid = wid;
+        node->fef = node->lef = ef;
+
+        node->next = ngs->frm_wordlist[sf];
+        ngs->frm_wordlist[sf] = node;
+    }
+}
+
+void
+ngram_fwdflat_update_wordlist(ngram_search_t *ngs, int frame_idx)
+{
+    int32 i;
+
+    for (i = ngs->bp_table_idx[frame_idx]; i < ngs->bpidx; ++i)
+        add_wordlist_node(ngs, ngs->bp_table + i);
+}
+
 /**
  * Find all active words in backpointer table and sort by frame.
  */
 static void
 build_fwdflat_wordlist(ngram_search_t *ngs)
 {
-    int32 i, f, sf, ef, wid, nwd;
-    dict_t *dict;
+    int32 i, f, nwd;
     bptbl_t *bp;
     ps_latnode_t *node, *prevnode, *nextnode;
 
+    /* Incremental search, start with an empty word list and clear
+     * the tree search's per-frame lists, which it fills in as it
+     * goes. */
+    if (ngs->tree) {
+        memset(ngs->tree->frm_wordlist, 0,
+               ngs->tree->n_frame_alloc * sizeof(*ngs->tree->frm_wordlist));
+        bitvec_clear_all(ngs->fwdflat_word_flag, ps_search_n_words(ngs));
+        ngs->n_fwdflat_wordlist = 0;
+        ngs->fwdflat_wordlist[0] = -1;
+        return;
+    }
+
     /* No tree-search, use statically allocated wordlist. */
     if (!ngs->fwdtree)
         return;
 
-    dict = ps_search_dict(ngs);
-
     memset(ngs->frm_wordlist, 0, ngs->n_frame_alloc * sizeof(*ngs->frm_wordlist));
 
     /* Scan the backpointer table for all active words and record
      * their exit frames. */
-    for (i = 0, bp = ngs->bp_table; i < ngs->bpidx; i++, bp++) {
-        sf = (bp->bp < 0) ? 0 : ngs->bp_table[bp->bp].frame + 1;
-        ef = bp->frame;
-        wid = bp->wid;
-
-        /* Anything that can be transitioned to in the LM can go in
-         * the word list. */
-        if (!ngram_model_set_known_wid(ngs->lmset,
-                                       dict_basewid(ps_search_dict(ngs), wid)))
-            continue;
-
-        /* Look for it in the wordlist. */
-        for (node = ngs->frm_wordlist[sf]; node && (node->wid != wid);
-             node = node->next);
-
-        /* Update last end frame. */
-        if (node)
-            node->lef = ef;
-        else {
-            /* New node; link to head of list */
-            node = listelem_malloc(ngs->latnode_alloc);
-            node->wid = wid;
-            node->fef = node->lef = ef;
-
-            node->next = ngs->frm_wordlist[sf];
-            ngs->frm_wordlist[sf] = node;
-        }
-    }
+    for (i = 0, bp = ngs->bp_table; i < ngs->bpidx; i++, bp++)
+        add_wordlist_node(ngs, bp);
 
     /* Eliminate "unlikely" words, for which there are too few end points */
     for (f = 0; f < ngs->n_frame; f++) {
@@ -306,12 +400,12 @@ build_fwdflat_wordlist(ngram_search_t *ngs)
 }
 
 /**
- * Build HMM network for one utterance of fwdflat search.
+ * Build the word HMMs for one multi-phone word.
  */
 static void
-build_fwdflat_chan(ngram_search_t *ngs)
+build_fwdflat_word_chan(ngram_search_t *ngs, int32 wid)
 {
-    int32 i, wid, p;
+    int32 p;
     root_chan_t *rhmm;
     chan_t *hmm, *prevhmm;
     dict_t *dict;
@@ -320,57 +414,82 @@ build_fwdflat_chan(ngram_search_t *ngs)
     dict = ps_search_dict(ngs);
     d2p = ps_search_dict2pid(ngs);
 
-    /* Build word HMMs for each word in the lattice. */
-    for (i = 0; ngs->fwdflat_wordlist[i] >= 0; i++) {
-        wid = ngs->fwdflat_wordlist[i];
+    assert(ngs->word_chan[wid] == NULL);
+
+    /* Multiplex root HMM for first phone (one root per word, flat
+     * lexicon).  diphone is irrelevant here, for the time being,
+     * at least. */
+    rhmm = listelem_malloc(ngs->root_chan_alloc);
+    rhmm->ci2phone = dict_second_phone(dict, wid);
+    rhmm->ciphone = dict_first_phone(dict, wid);
+    rhmm->next = NULL;
+    hmm_init(ngs->hmmctx, &rhmm->hmm, TRUE,
+             bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, rhmm->ciphone),
+             bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, rhmm->ciphone));
+
+    /* HMMs for word-internal phones */
+    prevhmm = NULL;
+    for (p = 1; p < dict_pronlen(dict, wid) - 1; p++) {
+        hmm = listelem_malloc(ngs->chan_alloc);
+        hmm->ciphone = dict_pron(dict, wid, p);
+        hmm->info.rc_id = (p == dict_pronlen(dict, wid) - 1) ? 0 : -1;
+        hmm->next = NULL;
+        hmm_init(ngs->hmmctx, &hmm->hmm, FALSE,
+                 dict2pid_internal(d2p,wid,p), 
+                 bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, hmm->ciphone));
 
-        /* Single-phone words are permanently allocated */
-        if (dict_is_single_phone(dict, wid))
-            continue;
+        if (prevhmm)
+            prevhmm->next = hmm;
+        else
+            rhmm->next = hmm;
 
-        assert(ngs->word_chan[wid] == NULL);
+        prevhmm = hmm;
+    }
 
-        /* Multiplex root HMM for first phone (one root per word, flat
-         * lexicon).  diphone is irrelevant here, for the time being,
-         * at least. */
-        rhmm = listelem_malloc(ngs->root_chan_alloc);
-        rhmm->ci2phone = dict_second_phone(dict, wid);
-        rhmm->ciphone = dict_first_phone(dict, wid);
-        rhmm->next = NULL;
-        hmm_init(ngs->hmmctx, &rhmm->hmm, TRUE,
-                 bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, rhmm->ciphone),
-                 bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, rhmm->ciphone));
+    /* Right-context phones */
+    ngram_search_alloc_all_rc(ngs, wid);
 
-        /* HMMs for word-internal phones */
-        prevhmm = NULL;
-        for (p = 1; p < dict_pronlen(dict, wid) - 1; p++) {
-            hmm = listelem_malloc(ngs->chan_alloc);
-            hmm->ciphone = dict_pron(dict, wid, p);
-            hmm->info.rc_id = (p == dict_pronlen(dict, wid) - 1) ? 0 : -1;
-            hmm->next = NULL;
-            hmm_init(ngs->hmmctx, &hmm->hmm, FALSE,
-                     dict2pid_internal(d2p,wid,p), 
-		     bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, hmm->ciphone));
-
-            if (prevhmm)
-                prevhmm->next = hmm;
-            else
-                rhmm->next = hmm;
+    /* Link in just allocated right-context phones */
+    if (prevhmm)
+        prevhmm->next = ngs->word_chan[wid];
+    else
+        rhmm->next = ngs->word_chan[wid];
+    ngs->word_chan[wid] = (chan_t *) rhmm;
+}
 
-            prevhmm = hmm;
-        }
+/**
+ * Build HMM network for one utterance of fwdflat search.
+ */
+static void
+build_fwdflat_chan(ngram_search_t *ngs)
+{
+    int32 i, wid;
 
-        /* Right-context phones */
-        ngram_search_alloc_all_rc(ngs, wid);
+    /* Build word HMMs for each word in the lattice. */
+    for (i = 0; ngs->fwdflat_wordlist[i] >= 0; i++) {
+        wid = ngs->fwdflat_wordlist[i];
 
-        /* Link in just allocated right-context phones */
-        if (prevhmm)
-            prevhmm->next = ngs->word_chan[wid];
-        else
-            rhmm->next = ngs->word_chan[wid];
-        ngs->word_chan[wid] = (chan_t *) rhmm;
+        /* Single-phone words are permanently allocated */
+        if (dict_is_single_phone(ps_search_dict(ngs), wid))
+            continue;
+        build_fwdflat_word_chan(ngs, wid);
     }
+}
 
+/**
+ * Add a word to the incremental search's word list, building its
+ * HMMs if need be.
+ */
+static void
+add_fwdflat_word(ngram_search_t *ngs, int32 wid)
+{
+    if (bitvec_is_set(ngs->fwdflat_word_flag, wid))
+        return;
+    bitvec_set(ngs->fwdflat_word_flag, wid);
+    ngs->fwdflat_wordlist[ngs->n_fwdflat_wordlist++] = wid;
+    ngs->fwdflat_wordlist[ngs->n_fwdflat_wordlist] = -1;
+    if (!dict_is_single_phone(ps_search_dict(ngs), wid))
+        build_fwdflat_word_chan(ngs, wid);
 }
 
 void
@@ -467,6 +586,8 @@ fwdflat_eval_chan(ngram_search_t *ngs, int frame_idx)
             int32 score = chan_v_eval(rhmm);
             if ((score BETTER_THAN bestscore) && (w != ps_search_finish_wid(ngs)))
                 bestscore = score;
+            if (ngs->maxhmmpf != -1)
+                ngram_search_hist_add(ngs, score);
             ngs->st.n_fwdflat_chan++;
         }
 
@@ -475,6 +596,8 @@ fwdflat_eval_chan(ngram_search_t *ngs, int frame_idx)
                 int32 score = chan_v_eval(hmm);
                 if (score BETTER_THAN bestscore)
                     bestscore = score;
+                if (ngs->maxhmmpf != -1)
+                    ngram_search_hist_add(ngs, score);
                 ngs->st.n_fwdflat_chan++;
             }
         }
@@ -497,7 +620,7 @@ fwdflat_prune_chan(ngram_search_t *ngs, int frame_idx)
     awl = ngs->active_word_list[cf & 0x1];
     bitvec_clear_all(ngs->word_active, ps_search_n_words(ngs));
 
-    thresh = ngs->best_score + ngs->fwdflatbeam;
+    thresh = ngs->best_score + ngs->dynamic_beam;
     wordthresh = ngs->best_score + ngs->fwdflatwbeam;
     pip = ngs->pip;
     E_DEBUG(3,("frame %d thresh %d wordthresh %d\n", frame_idx, thresh, wordthresh));
@@ -609,29 +732,57 @@ fwdflat_prune_chan(ngram_search_t *ngs, int frame_idx)
     }
 }
 
+/**
+ * Check whether a word found so far by the tree search can be
+ * searched by the incremental flat search.  This applies the same
+ * filtering as build_fwdflat_wordlist() to a word list which is still
+ * growing.  The result is the same as after the utterance for words
+ * starting before the tree search's final_sf.
+ */
+static int
+fwdflat_node_usable(ngram_search_t *ngs, ps_latnode_t *node)
+{
+    if (node->lef - node->fef < ngs->min_ef_width)
+        return FALSE;
+    if (node->wid == ps_search_finish_wid(ngs)
+        && node->lef < ngs->n_tree_frame - 1)
+        return FALSE;
+    return TRUE;
+}
+
 static void
 get_expand_wordlist(ngram_search_t *ngs, int32 frm, int32 win)
 {
-    int32 f, sf, ef;
+    ngram_search_t *src;
+    int32 f, sf, ef, n_frame;
     ps_latnode_t *node;
 
-    if (!ngs->fwdtree) {
+    if (!ngs->fwdtree && !ngs->tree) {
         ngs->st.n_fwdflat_word_transition += ngs->n_expand_words;
         return;
     }
 
+    /* The incremental search reads the tree search's word list, as
+     * far as it has been filled in. */
+    src = ngs->tree ? ngs->tree : ngs;
+    n_frame = ngs->tree ? ngs->n_tree_frame : ngs->n_frame;
     sf = frm - win;
     if (sf < 0)
         sf = 0;
     ef = frm + win;
-    if (ef > ngs->n_frame)
-        ef = ngs->n_frame;
+    if (ef > n_frame)
+        ef = n_frame;
 
     bitvec_clear_all(ngs->expand_word_flag, ps_search_n_words(ngs));
     ngs->n_expand_words = 0;
 
     for (f = sf; f < ef; f++) {
-        for (node = ngs->frm_wordlist[f]; node; node = node->next) {
+        for (node = src->frm_wordlist[f]; node; node = node->next) {
+            if (ngs->tree) {
+                if (!fwdflat_node_usable(ngs, node))
+                    continue;
+                add_fwdflat_word(ngs, node->wid);
+            }
             if (!bitvec_is_set(ngs->expand_word_flag, node->wid)) {
                 ngs->expand_word_list[ngs->n_expand_words++] = node->wid;
                 bitvec_set(ngs->expand_word_flag, node->wid);
@@ -657,7 +808,7 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
 
     cf = frame_idx;
     nf = cf + 1;
-    thresh = ngs->best_score + ngs->fwdflatbeam;
+    thresh = ngs->best_score + ngs->dynamic_beam;
     pip = ngs->pip;
     best_silrc_score = WORST_SCORE;
     lwf = ngs->fwdflat_fwdtree_lw_ratio;
@@ -807,12 +958,10 @@ fwdflat_renormalize_scores(ngram_search_t *ngs, int frame_idx, int32 norm)
     ngs->renormalized = TRUE;
 }
 
-int
-ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx)
+int16 const *
+ngram_fwdflat_score_frame(ngram_search_t *ngs, int frame_idx)
 {
     int16 const *senscr;
-    int32 nf, i, j;
-    int32 *nawl;
 
     /* Activate our HMMs for the current frame if need be. */
     if (!ps_search_acmod(ngs)->compallsen)
@@ -822,6 +971,16 @@ ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx)
     senscr = acmod_score(ps_search_acmod(ngs), &frame_idx);
     ngs->st.n_senone_active_utt += ps_search_acmod(ngs)->n_senone_active;
 
+    return senscr;
+}
+
+int
+ngram_fwdflat_search_frame(ngram_search_t *ngs, int frame_idx,
+                           int16 const *senscr)
+{
+    int32 nf, i, j, ref;
+    int32 *nawl;
+
     /* Mark backpointer table for current frame. */
     ngram_search_mark_bptable(ngs, frame_idx);
 
@@ -830,21 +989,32 @@ ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx)
     if (ngs->best_score == WORST_SCORE || ngs->best_score WORSE_THAN WORST_SCORE)
         return 0;
     /* Renormalize if necessary */
+    ref = ngs->best_score;
     if (ngs->best_score + (2 * ngs->beam) WORSE_THAN WORST_SCORE) {
         E_INFO("Renormalizing Scores at frame %d, best score %d\n",
                frame_idx, ngs->best_score);
         fwdflat_renormalize_scores(ngs, frame_idx, ngs->best_score);
+        ref = 0;
     }
 
     ngs->best_score = WORST_SCORE;
     hmm_context_set_senscore(ngs->hmmctx, senscr);
 
     /* Evaluate HMMs */
+    if (ngs->maxhmmpf != -1)
+        ngram_search_hist_start(ngs, ref, ngs->fwdflatbeam);
     fwdflat_eval_chan(ngs, frame_idx);
+    /* Set the dynamic beam based on maxhmmpf. */
+    ngs->dynamic_beam = ngs->fwdflatbeam;
+    if (ngs->maxhmmpf != -1)
+        ngs->dynamic_beam = ngram_search_hist_beam(ngs, ngs->maxhmmpf,
+                                                   ngs->fwdflatbeam);
     /* Prune HMMs and do phone transitions. */
     fwdflat_prune_chan(ngs, frame_idx);
     /* Do word transitions. */
+    ngram_search_lm_lock(ngs);
     fwdflat_word_transition(ngs, frame_idx);
+    ngram_search_lm_unlock(ngs);
 
     /* Create next active word list */
     nf = frame_idx + 1;
@@ -869,23 +1039,37 @@ ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx)
     return 1;
 }
 
+int
+ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx)
+{
+    int16 const *senscr;
+
+    if ((senscr = ngram_fwdflat_score_frame(ngs, frame_idx)) == NULL)
+        return -1;
+    return ngram_fwdflat_search_frame(ngs, frame_idx, senscr);
+}
+
 /**
  * Destroy wordlist from the current utterance.
  */
 static void
 destroy_fwdflat_wordlist(ngram_search_t *ngs)
 {
+    ngram_search_t *src;
     ps_latnode_t *node, *tnode;
     int32 f;
 
-    if (!ngs->fwdtree)
+    if (!ngs->fwdtree && !ngs->tree)
         return;
 
-    for (f = 0; f < ngs->n_frame; f++) {
-        for (node = ngs->frm_wordlist[f]; node; node = tnode) {
+    /* The incremental search's word list belongs to the tree search. */
+    src = ngs->tree ? ngs->tree : ngs;
+    for (f = 0; f < src->n_frame; f++) {
+        for (node = src->frm_wordlist[f]; node; node = tnode) {
             tnode = node->next;
-            listelem_free(ngs->latnode_alloc, node);
+            listelem_free(src->latnode_alloc, node);
         }
+        src->frm_wordlist[f] = NULL;
     }
 }
 
@@ -941,6 +1125,7 @@ ngram_fwdflat_finish(ngram_search_t *ngs)
                ngs->bpidx, (ngs->bpidx + (cf >> 1)) / (cf + 1));
         E_INFO("%8d senones evaluated (%d/fr)\n", ngs->st.n_senone_active_utt,
                (ngs->st.n_senone_active_utt + (cf >> 1)) / (cf + 1));
+        acmod_log_ssid_stats(ps_search_acmod(ngs));
         E_INFO("%8d channels searched (%d/fr)\n",
                ngs->st.n_fwdflat_chan, ngs->st.n_fwdflat_chan / (cf + 1));
         E_INFO("%8d words searched (%d/fr)\n",
@@ -62,6 +62,11 @@ void ngram_fwdflat_deinit(ngram_search_t *ngs);
  */
 int ngram_fwdflat_reinit(ngram_search_t *ngs);
 
+/**
+ * Add a newly appended dictionary word without a full rebuild.
+ */
+int ngram_fwdflat_add_word(ngram_search_t *ngs, int32 wid);
+
 /**
  * Start fwdflat decoding for an utterance.
  */
@@ -69,13 +74,39 @@ void ngram_fwdflat_start(ngram_search_t *ngs);
 
 /**
  * Search one frame forward in an utterance.
+ *
+ * @return Number of frames searched (either 0 or 1), or -1 if the
+ *         frame could not be scored.
  */
 int ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx);
 
+/**
+ * Compute senone scores for one frame of fwdflat search.
+ *
+ * This is the only part of ngram_fwdflat_search() which uses the
+ * acoustic model.
+ *
+ * @return Senone scores, valid until the acoustic model is next used.
+ */
+int16 const *ngram_fwdflat_score_frame(ngram_search_t *ngs, int frame_idx);
+
+/**
+ * Search one frame forward using senone scores from
+ * ngram_fwdflat_score_frame().
+ */
+int ngram_fwdflat_search_frame(ngram_search_t *ngs, int frame_idx,
+                               int16 const *senscr);
+
 /**
  * Finish fwdflat decoding for an utterance.
  */
 void ngram_fwdflat_finish(ngram_search_t *ngs);
 
+/**
+ * Add the tree search's word exits in a frame to its per-frame word
+ * list, for use by an incremental fwdflat search.
+ */
+void ngram_fwdflat_update_wordlist(ngram_search_t *ngs, int frame_idx);
+
 
 #endif /* __NGRAM_SEARCH_FWDFLAT_H__ */
@@ -51,6 +51,7 @@
 /* Local headers. */
 #include "ngram_search_fwdtree.h"
 #include "phone_loop_search.h"
+#include "snapshot.h"
 
 /* Turn this on to dump channels for debugging */
 #define __CHAN_DUMP__		0
@@ -60,6 +61,9 @@
 #define chan_v_eval(chan) hmm_vit_eval(&(chan)->hmm)
 #endif
 
+/* Root channels added at a time for words added after the tree is built. */
+#define ROOT_CHAN_INC 16
+
 /*
  * Allocate that part of the search channel tree structure that is independent of the
  * LM in use.
@@ -161,6 +165,146 @@ init_nonroot_chan(ngram_search_t *ngs, chan_t * hmm, int32 ph, int32 ci, int32 t
     hmm_init(ngs->hmmctx, &hmm->hmm, FALSE, ph, tmatid);
 }
 
+/*
+ * Add the pronunciation of multi-phone word w to the channel tree,
+ * sharing a root channel and as many internal channels as possible
+ * with the words already in it.
+ */
+static void
+add_tree_word(ngram_search_t *ngs, int32 w)
+{
+    chan_t *hmm;
+    root_chan_t *rhmm;
+    int32 i, j, p, ph, tmatid;
+    int ciphone, ci2phone;
+    dict_t *dict = ps_search_dict(ngs);
+    dict2pid_t *d2p = ps_search_dict2pid(ngs);
+
+    /* Find a root channel matching the initial diphone, or
+     * allocate one if not found. */
+    ciphone = dict_first_phone(dict, w);
+    ci2phone = dict_second_phone(dict, w);
+    for (i = 0; i < ngs->n_root_chan; ++i) {
+        if (ngs->root_chan[i].ciphone == ciphone
+            && ngs->root_chan[i].ci2phone == ci2phone)
+            break;
+    }
+    if (i == ngs->n_root_chan) {
+        /* Only words added after the tree was built can overflow it. */
+        if (ngs->n_root_chan == ngs->n_root_chan_alloc) {
+            ngs->root_chan = ckd_realloc(ngs->root_chan,
+                                         (ngs->n_root_chan_alloc + ROOT_CHAN_INC)
+                                         * sizeof(*ngs->root_chan));
+            for (i = ngs->n_root_chan_alloc;
+                 i < ngs->n_root_chan_alloc + ROOT_CHAN_INC; ++i) {
+                memset(&ngs->root_chan[i], 0, sizeof(ngs->root_chan[i]));
+                hmm_init(ngs->hmmctx, &ngs->root_chan[i].hmm, TRUE, -1, -1);
+                ngs->root_chan[i].penult_phn_wid = -1;
+            }
+            ngs->n_root_chan_alloc += ROOT_CHAN_INC;
+        }
+        rhmm = &(ngs->root_chan[ngs->n_root_chan]);
+        rhmm->hmm.tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, ciphone);
+        /* Begin with CI phone?  Not sure this makes a difference... */
+        hmm_mpx_ssid(&rhmm->hmm, 0) =
+            bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, ciphone);
+        rhmm->ciphone = ciphone;
+        rhmm->ci2phone = ci2phone;
+        ngs->n_root_chan++;
+    }
+    else
+        rhmm = &(ngs->root_chan[i]);
+
+    E_DEBUG(3,("word %s rhmm %d\n", dict_wordstr(dict, w), rhmm - ngs->root_chan));
+    /* Now, rhmm = root channel for w.  Go on to remaining phones */
+    if (dict_pronlen(dict, w) == 2) {
+        /* Next phone is the last; not kept in tree; add w to penult_phn_wid set */
+        if ((j = rhmm->penult_phn_wid) < 0)
+            rhmm->penult_phn_wid = w;
+        else {
+            for (; ngs->homophone_set[j] >= 0; j = ngs->homophone_set[j]);
+            ngs->homophone_set[j] = w;
+        }
+    }
+    else {
+        /* Add remaining phones, except the last, to tree */
+        ph = dict2pid_internal(d2p, w, 1);
+        tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, 1));
+        hmm = rhmm->next;
+        if (hmm == NULL) {
+            rhmm->next = hmm = listelem_malloc(ngs->chan_alloc);
+            init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, 1), tmatid);
+            ngs->n_nonroot_chan++;
+        }
+        else {
+            chan_t *prev_hmm = NULL;
+
+            for (; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph); hmm = hmm->alt)
+                prev_hmm = hmm;
+            if (!hmm) {     /* thanks, rkm! */
+                prev_hmm->alt = hmm = listelem_malloc(ngs->chan_alloc);
+                init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, 1), tmatid);
+                ngs->n_nonroot_chan++;
+            }
+        }
+        E_DEBUG(3,("phone %s = %d\n",
+                   bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
+                                        dict_second_phone(dict, w)), ph));
+        for (p = 2; p < dict_pronlen(dict, w) - 1; p++) {
+            ph = dict2pid_internal(d2p, w, p);
+            tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, p));
+            if (!hmm->next) {
+                hmm->next = listelem_malloc(ngs->chan_alloc);
+                hmm = hmm->next;
+                init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, p), tmatid);
+                ngs->n_nonroot_chan++;
+            }
+            else {
+                chan_t *prev_hmm = NULL;
+
+                for (hmm = hmm->next; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph);
+                     hmm = hmm->alt)
+                    prev_hmm = hmm;
+                if (!hmm) { /* thanks, rkm! */
+                    prev_hmm->alt = hmm = listelem_malloc(ngs->chan_alloc);
+                    init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, p), tmatid);
+                    ngs->n_nonroot_chan++;
+                }
+            }
+            E_DEBUG(3,("phone %s = %d\n",
+                       bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
+                                            dict_pron(dict, w, p)), ph));
+        }
+
+        /* All but last phone of w in tree; add w to hmm->info.penult_phn_wid set */
+        if ((j = hmm->info.penult_phn_wid) < 0)
+            hmm->info.penult_phn_wid = w;
+        else {
+            for (; ngs->homophone_set[j] >= 0; j = ngs->homophone_set[j]);
+            ngs->homophone_set[j] = w;
+        }
+    }
+}
+
+/*
+ * Make sure the active channel lists can hold every non-root channel.
+ */
+static void
+grow_active_chan_list(ngram_search_t *ngs)
+{
+    if (ngs->n_nonroot_chan >= ngs->max_nonroot_chan) {
+        /* Give some room for channels for new words added dynamically at run time */
+        ngs->max_nonroot_chan = ngs->n_nonroot_chan + 128;
+        E_INFO("after: max nonroot chan increased to %d\n", ngs->max_nonroot_chan);
+
+        /* Free old active channel list array if any and allocate new one */
+        if (ngs->active_chan_list)
+            ckd_free_2d(ngs->active_chan_list);
+        ngs->active_chan_list = ckd_calloc_2d(2, ngs->max_nonroot_chan,
+                                              sizeof(**ngs->active_chan_list));
+    }
+}
+
 /*
  * Allocate and initialize search channel-tree structure.
  * At this point, all the root-channels have been allocated and partly initialized
@@ -174,12 +318,8 @@ init_nonroot_chan(ngram_search_t *ngs, chan_t * hmm, int32 ph, int32 ci, int32 t
 static void
 create_search_tree(ngram_search_t *ngs)
 {
-    chan_t *hmm;
-    root_chan_t *rhmm;
-    int32 w, i, j, p, ph, tmatid;
-    int32 n_words;
+    int32 w, n_words;
     dict_t *dict = ps_search_dict(ngs);
-    dict2pid_t *d2p = ps_search_dict2pid(ngs);
 
     n_words = ps_search_n_words(ngs);
 
@@ -196,8 +336,6 @@ create_search_tree(ngram_search_t *ngs)
     ngs->n_nonroot_chan = 0;
 
     for (w = 0; w < n_words; w++) {
-        int ciphone, ci2phone;
-
         /* Ignore dictionary words not in LM */
         if (!ngram_model_set_known_wid(ngs->lmset, dict_basewid(dict, w)))
             continue;
@@ -210,97 +348,7 @@ create_search_tree(ngram_search_t *ngs)
             continue;
         }
 
-        /* Find a root channel matching the initial diphone, or
-         * allocate one if not found. */
-        ciphone = dict_first_phone(dict, w);
-        ci2phone = dict_second_phone(dict, w);
-        for (i = 0; i < ngs->n_root_chan; ++i) {
-            if (ngs->root_chan[i].ciphone == ciphone
-                && ngs->root_chan[i].ci2phone == ci2phone)
-                break;
-        }
-        if (i == ngs->n_root_chan) {
-            rhmm = &(ngs->root_chan[ngs->n_root_chan]);
-            rhmm->hmm.tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, ciphone);
-            /* Begin with CI phone?  Not sure this makes a difference... */
-            hmm_mpx_ssid(&rhmm->hmm, 0) =
-                bin_mdef_pid2ssid(ps_search_acmod(ngs)->mdef, ciphone);
-            rhmm->ciphone = ciphone;
-            rhmm->ci2phone = ci2phone;
-            ngs->n_root_chan++;
-        }
-        else
-            rhmm = &(ngs->root_chan[i]);
-
-        E_DEBUG(3,("word %s rhmm %d\n", dict_wordstr(dict, w), rhmm - ngs->root_chan));
-        /* Now, rhmm = root channel for w.  Go on to remaining phones */
-        if (dict_pronlen(dict, w) == 2) {
-            /* Next phone is the last; not kept in tree; add w to penult_phn_wid set */
-            if ((j = rhmm->penult_phn_wid) < 0)
-                rhmm->penult_phn_wid = w;
-            else {
-                for (; ngs->homophone_set[j] >= 0; j = ngs->homophone_set[j]);
-                ngs->homophone_set[j] = w;
-            }
-        }
-        else {
-            /* Add remaining phones, except the last, to tree */
-            ph = dict2pid_internal(d2p, w, 1);
-            tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, 1));
-            hmm = rhmm->next;
-            if (hmm == NULL) {
-                rhmm->next = hmm = listelem_malloc(ngs->chan_alloc);
-                init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, 1), tmatid);
-                ngs->n_nonroot_chan++;
-            }
-            else {
-                chan_t *prev_hmm = NULL;
-
-                for (; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph); hmm = hmm->alt)
-                    prev_hmm = hmm;
-                if (!hmm) {     /* thanks, rkm! */
-                    prev_hmm->alt = hmm = listelem_malloc(ngs->chan_alloc);
-                    init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, 1), tmatid);
-                    ngs->n_nonroot_chan++;
-                }
-            }
-            E_DEBUG(3,("phone %s = %d\n",
-                       bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
-                                            dict_second_phone(dict, w)), ph));
-            for (p = 2; p < dict_pronlen(dict, w) - 1; p++) {
-                ph = dict2pid_internal(d2p, w, p);
-                tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, dict_pron(dict, w, p));
-                if (!hmm->next) {
-                    hmm->next = listelem_malloc(ngs->chan_alloc);
-                    hmm = hmm->next;
-                    init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, p), tmatid);
-                    ngs->n_nonroot_chan++;
-                }
-                else {
-                    chan_t *prev_hmm = NULL;
-
-                    for (hmm = hmm->next; hmm && (hmm_nonmpx_ssid(&hmm->hmm) != ph);
-                         hmm = hmm->alt)
-                        prev_hmm = hmm;
-                    if (!hmm) { /* thanks, rkm! */
-                        prev_hmm->alt = hmm = listelem_malloc(ngs->chan_alloc);
-                        init_nonroot_chan(ngs, hmm, ph, dict_pron(dict, w, p), tmatid);
-                        ngs->n_nonroot_chan++;
-                    }
-                }
-                E_DEBUG(3,("phone %s = %d\n",
-                           bin_mdef_ciphone_str(ps_search_acmod(ngs)->mdef,
-                                                dict_pron(dict, w, p)), ph));
-            }
-
-            /* All but last phone of w in tree; add w to hmm->info.penult_phn_wid set */
-            if ((j = hmm->info.penult_phn_wid) < 0)
-                hmm->info.penult_phn_wid = w;
-            else {
-                for (; ngs->homophone_set[j] >= 0; j = ngs->homophone_set[j]);
-                ngs->homophone_set[j] = w;
-            }
-        }
+        add_tree_word(ngs, w);
     }
 
     ngs->n_1ph_words = ngs->n_1ph_LMwords;
@@ -320,17 +368,7 @@ create_search_tree(ngram_search_t *ngs)
         ngs->single_phone_wid[ngs->n_1ph_words++] = w;
     }
 
-    if (ngs->n_nonroot_chan >= ngs->max_nonroot_chan) {
-        /* Give some room for channels for new words added dynamically at run time */
-        ngs->max_nonroot_chan = ngs->n_nonroot_chan + 128;
-        E_INFO("after: max nonroot chan increased to %d\n", ngs->max_nonroot_chan);
-
-        /* Free old active channel list array if any and allocate new one */
-        if (ngs->active_chan_list)
-            ckd_free_2d(ngs->active_chan_list);
-        ngs->active_chan_list = ckd_calloc_2d(2, ngs->max_nonroot_chan,
-                                              sizeof(**ngs->active_chan_list));
-    }
+    grow_active_chan_list(ngs);
 
     if (!ngs->n_root_chan)
 	E_ERROR("No word from the language model has pronunciation in the dictionary\n");
@@ -380,6 +418,79 @@ reinit_search_tree(ngram_search_t *ngs)
     ngs->n_nonroot_chan = 0;
 }
 
+static void
+free_pool(ngram_search_t *ngs)
+{
+    /* Don't leave the HMMs pointing at the scaled matrices. */
+    ngs->hmmctx->tp = ps_search_acmod(ngs)->tmat->tp;
+    ckd_free(ngs->pool_acc);
+    ngs->pool_acc = NULL;
+    ckd_free(ngs->pool_senscr);
+    ngs->pool_senscr = NULL;
+    if (ngs->pool_tp)
+        ckd_free_3d(ngs->pool_tp);
+    ngs->pool_tp = NULL;
+}
+
+/*
+ * Fill pool_tp with the transition matrices for one step of the
+ * frame-skipping search, which stands for n_step real frames.  Each
+ * entry is the cost of the best path of n_step transitions between
+ * the two states, so that staying in a state costs n_step self-loops,
+ * but moving on only costs one transition plus the self-loops around
+ * it.  The exit state absorbs paths which leave the HMM early.
+ */
+static void
+fill_pool_tp(ngram_search_t *ngs, int32 n_step)
+{
+    tmat_t *tmat = ps_search_acmod(ngs)->tmat;
+    int32 n_st = tmat->n_state;
+    int32 t, i, j, k, n;
+    int32 cur[HMM_MAX_NSTATE + 1][HMM_MAX_NSTATE + 1];
+    int32 next[HMM_MAX_NSTATE + 1][HMM_MAX_NSTATE + 1];
+
+    for (t = 0; t < tmat->n_tmat; ++t) {
+        /* One step, with the exit state absorbing. */
+        for (i = 0; i <= n_st; ++i)
+            for (j = 0; j <= n_st; ++j)
+                cur[i][j] = (i < n_st) ? tmat->tp[t][i][j]
+                    : (j == n_st) ? 0 : 255;
+        for (n = 1; n < n_step; ++n) {
+            for (i = 0; i < n_st; ++i) {
+                for (j = 0; j <= n_st; ++j) {
+                    next[i][j] = cur[i][n_st] + ((j == n_st) ? 0 : 255);
+                    for (k = 0; k < n_st; ++k) {
+                        int32 c = cur[i][k] + tmat->tp[t][k][j];
+                        if (c < next[i][j])
+                            next[i][j] = c;
+                    }
+                }
+            }
+            memcpy(cur, next, sizeof(cur));
+        }
+        for (i = 0; i < n_st; ++i)
+            for (j = 0; j <= n_st; ++j)
+                ngs->pool_tp[t][i][j] = (cur[i][j] > 255) ? 255 : cur[i][j];
+    }
+}
+
+static void
+alloc_pool(ngram_search_t *ngs)
+{
+    int32 n_sen = bin_mdef_n_sen(ps_search_acmod(ngs)->mdef);
+    tmat_t *tmat = ps_search_acmod(ngs)->tmat;
+
+    free_pool(ngs);
+    if (ngs->fwdskip <= 1)
+        return;
+    ngs->pool_acc = ckd_calloc(n_sen, sizeof(*ngs->pool_acc));
+    ngs->pool_senscr = ckd_calloc(n_sen, sizeof(*ngs->pool_senscr));
+    ngs->pool_tp = (uint8 ***)ckd_calloc_3d(tmat->n_tmat, tmat->n_state,
+                                            tmat->n_state + 1,
+                                            sizeof(***ngs->pool_tp));
+    E_INFO("Tree search advances every %d frames\n", ngs->fwdskip);
+}
+
 void
 ngram_fwdtree_init(ngram_search_t *ngs)
 {
@@ -388,6 +499,7 @@ ngram_fwdtree_init(ngram_search_t *ngs)
                                 sizeof(*ngs->bestbp_rc));
     ngs->lastphn_cand = ckd_calloc(ps_search_n_words(ngs),
                                    sizeof(*ngs->lastphn_cand));
+    alloc_pool(ngs);
     init_search_tree(ngs);
     create_search_tree(ngs);
 }
@@ -448,6 +560,7 @@ ngram_fwdtree_deinit(ngram_search_t *ngs)
     ngs->bestbp_rc = NULL;
     ckd_free(ngs->lastphn_cand);
     ngs->lastphn_cand = NULL;
+    free_pool(ngs);
 }
 
 int
@@ -464,12 +577,37 @@ ngram_fwdtree_reinit(ngram_search_t *ngs)
     ckd_free(ngs->word_chan);
     ngs->word_chan = ckd_calloc(ps_search_n_words(ngs),
                                 sizeof(*ngs->word_chan));
+    alloc_pool(ngs);
     /* Rebuild the search tree. */
     init_search_tree(ngs);
     create_search_tree(ngs);
     return 0;
 }
 
+int
+ngram_fwdtree_add_word(ngram_search_t *ngs, int32 wid)
+{
+    int32 n_words = ps_search_n_words(ngs);
+
+    /* Per-word arrays: the homophone chains and word_chan are kept,
+     * the rest only matter within an utterance. */
+    ngs->homophone_set = ckd_realloc(ngs->homophone_set,
+                                     n_words * sizeof(*ngs->homophone_set));
+    ngs->homophone_set[wid] = -1;
+    ngs->word_chan = ckd_realloc(ngs->word_chan,
+                                 n_words * sizeof(*ngs->word_chan));
+    ngs->word_chan[wid] = NULL;
+    ckd_free(ngs->lastphn_cand);
+    ngs->lastphn_cand = ckd_calloc(n_words, sizeof(*ngs->lastphn_cand));
+
+    if (!ngram_model_set_known_wid(ngs->lmset,
+                                   dict_basewid(ps_search_dict(ngs), wid)))
+        return 0;
+    add_tree_word(ngs, wid);
+    grow_active_chan_list(ngs);
+    return 0;
+}
+
 void
 ngram_fwdtree_start(ngram_search_t *ngs)
 {
@@ -499,6 +637,12 @@ ngram_fwdtree_start(ngram_search_t *ngs)
     /* Reset scores. */
     ngs->best_score = 0;
     ngs->renormalized = 0;
+    ngs->n_pooled = 0;
+    /* Each step of the frame-skipping search spans fwdskip frames. */
+    if (ngs->pool_tp) {
+        fill_pool_tp(ngs, ngs->fwdskip);
+        ngs->hmmctx->tp = ngs->pool_tp;
+    }
 
     /* Reset other stuff. */
     for (i = 0; i < n_words; i++)
@@ -618,6 +762,8 @@ eval_root_chan(ngram_search_t *ngs, int frame_idx)
             int32 score = chan_v_eval(rhmm);
             if (score BETTER_THAN bestscore)
                 bestscore = score;
+            if (ngs->maxhmmpf != -1)
+                ngram_search_hist_add(ngs, score);
             ++ngs->st.n_root_chan_eval;
         }
     }
@@ -640,6 +786,8 @@ eval_nonroot_chan(ngram_search_t *ngs, int frame_idx)
         assert(hmm_frame(&hmm->hmm) == frame_idx);
         if (score BETTER_THAN bestscore)
             bestscore = score;
+        if (ngs->maxhmmpf != -1)
+            ngram_search_hist_add(ngs, score);
     }
 
     return bestscore;
@@ -671,6 +819,8 @@ eval_word_chan(ngram_search_t *ngs, int frame_idx)
 
             if (score BETTER_THAN bestscore)
                 bestscore = score;
+            if (ngs->maxhmmpf != -1)
+                ngram_search_hist_add(ngs, score);
 
             k++;
         }
@@ -690,6 +840,8 @@ eval_word_chan(ngram_search_t *ngs, int frame_idx)
         /* printf("eval 1ph word chan %d score %d\n", w, score); */
         if (score BETTER_THAN bestscore && w != ps_search_finish_wid(ngs))
             bestscore = score;
+        if (ngs->maxhmmpf != -1)
+            ngram_search_hist_add(ngs, score);
 
         j++;
     }
@@ -718,6 +870,54 @@ evaluate_channels(ngram_search_t *ngs, int16 const *senone_scores, int frame_idx
     return ngs->best_score;
 }
 
+/*
+ * Lookahead score for entering a non-root channel.  With -pl_pair,
+ * this is the phone-pair bound over the successors of this node in
+ * the tree.
+ */
+static int32
+chan_lookahead(ngram_search_t *ngs, phone_loop_search_t *pls, chan_t *hmm)
+{
+    chan_t *child;
+    int32 w;
+
+    if (pls == NULL || !pls->pair)
+        return phone_loop_search_score(pls, hmm->ciphone);
+
+    phone_loop_search_succ_reset(pls);
+    for (child = hmm->next; child; child = child->alt)
+        phone_loop_search_succ_add(pls, child->ciphone);
+    for (w = hmm->info.penult_phn_wid; w >= 0; w = ngs->homophone_set[w])
+        phone_loop_search_succ_add(pls, dict_last_phone(ps_search_dict(ngs), w));
+    return phone_loop_search_pair_score(pls, hmm->ciphone, FALSE);
+}
+
+/*
+ * Lookahead score for entering the last phone of a word, or a
+ * single-phone word, where anything can follow.
+ */
+static int32
+final_lookahead(phone_loop_search_t *pls, int ci)
+{
+    if (pls == NULL || !pls->pair)
+        return phone_loop_search_score(pls, ci);
+    return phone_loop_search_pair_score(pls, ci, TRUE);
+}
+
+/*
+ * Lookahead score for entering a root channel, whose only successor
+ * is its second phone.
+ */
+static int32
+root_lookahead(phone_loop_search_t *pls, root_chan_t *rhmm)
+{
+    if (pls == NULL || !pls->pair)
+        return phone_loop_search_score(pls, rhmm->ciphone);
+    phone_loop_search_succ_reset(pls);
+    phone_loop_search_succ_add(pls, rhmm->ci2phone);
+    return phone_loop_search_pair_score(pls, rhmm->ciphone, FALSE);
+}
+
 /*
  * Prune currently active root channels for next frame.  Also, perform exit
  * transitions out of them and activate successors.
@@ -757,7 +957,7 @@ prune_root_chan(ngram_search_t *ngs, int frame_idx)
             if (pls != NULL || newphone_score BETTER_THAN newphone_thresh) {
                 for (hmm = rhmm->next; hmm; hmm = hmm->alt) {
                     int32 pl_newphone_score = newphone_score
-                        + phone_loop_search_score(pls, hmm->ciphone);
+                        + chan_lookahead(ngs, pls, hmm);
                     if (pl_newphone_score BETTER_THAN newphone_thresh) {
                         if ((hmm_frame(&hmm->hmm) < frame_idx)
                             || (pl_newphone_score BETTER_THAN hmm_in_score(&hmm->hmm))) {
@@ -778,7 +978,7 @@ prune_root_chan(ngram_search_t *ngs, int frame_idx)
                 for (w = rhmm->penult_phn_wid; w >= 0;
                      w = ngs->homophone_set[w]) {
                     int32 pl_newphone_score = newphone_score
-                        + phone_loop_search_score
+                        + final_lookahead
                         (pls, dict_last_phone(ps_search_dict(ngs),w));
                     E_DEBUG(3,("word %s newphone_score %d\n", dict_wordstr(ps_search_dict(ngs), w), newphone_score));
                     if (pl_newphone_score BETTER_THAN lastphn_thresh) {
@@ -836,7 +1036,7 @@ prune_nonroot_chan(ngram_search_t *ngs, int frame_idx)
             if (pls != NULL || newphone_score BETTER_THAN newphone_thresh) {
                 for (nexthmm = hmm->next; nexthmm; nexthmm = nexthmm->alt) {
                     int32 pl_newphone_score = newphone_score
-                        + phone_loop_search_score(pls, nexthmm->ciphone);
+                        + chan_lookahead(ngs, pls, nexthmm);
                     if ((pl_newphone_score BETTER_THAN newphone_thresh)
                         && ((hmm_frame(&nexthmm->hmm) < frame_idx)
                             || (pl_newphone_score
@@ -860,7 +1060,7 @@ prune_nonroot_chan(ngram_search_t *ngs, int frame_idx)
                 for (w = hmm->info.penult_phn_wid; w >= 0;
                      w = ngs->homophone_set[w]) {
                     int32 pl_newphone_score = newphone_score
-                        + phone_loop_search_score
+                        + final_lookahead
                         (pls, dict_last_phone(ps_search_dict(ngs),w));
                     if (pl_newphone_score BETTER_THAN lastphn_thresh) {
                         candp = ngs->lastphn_cand + ngs->n_lastphn_cand;
@@ -1055,6 +1255,10 @@ prune_word_chan(ngram_search_t *ngs, int frame_idx)
     nf = frame_idx + 1;
     newword_thresh = ngs->last_phone_best_score + ngs->wbeam;
     lastphn_thresh = ngs->last_phone_best_score + ngs->lponlybeam;
+    /* Absolute pruning applies to word channels too. */
+    if (ngs->dynamic_beam != ngs->beam
+        && ngs->best_score + ngs->dynamic_beam BETTER_THAN lastphn_thresh)
+        lastphn_thresh = ngs->best_score + ngs->dynamic_beam;
 
     awl = ngs->active_word_list[frame_idx & 0x1];
     nawl = ngs->active_word_list[nf & 0x1] + ngs->n_active_word[nf & 0x1];
@@ -1135,52 +1339,18 @@ prune_channels(ngram_search_t *ngs, int frame_idx)
 {
     /* Clear last phone candidate list. */
     ngs->n_lastphn_cand = 0;
-    /* Set the dynamic beam based on maxhmmpf here. */
+    /* Set the dynamic beam based on maxhmmpf here, from the
+     * histogram of scores collected in evaluate_channels(). */
     ngs->dynamic_beam = ngs->beam;
-    if (ngs->maxhmmpf != -1
-        && ngs->st.n_root_chan_eval + ngs->st.n_nonroot_chan_eval > ngs->maxhmmpf) {
-        /* Build a histogram to approximately prune them. */
-        int32 bins[256], bw, nhmms, i;
-        root_chan_t *rhmm;
-        chan_t **acl, *hmm;
-
-        /* Bins go from zero (best score) to edge of beam. */
-        bw = -ngs->beam / 256;
-        memset(bins, 0, sizeof(bins));
-        /* For each active root channel. */
-        for (i = 0, rhmm = ngs->root_chan; i < ngs->n_root_chan; i++, rhmm++) {
-            int32 b;
-
-            /* Put it in a bin according to its bestscore. */
-            b = (ngs->best_score - hmm_bestscore(&rhmm->hmm)) / bw;
-            if (b >= 256)
-                b = 255;
-            ++bins[b];
-        }
-        /* For each active non-root channel. */
-        acl = ngs->active_chan_list[frame_idx & 0x1];       /* currently active HMMs in tree */
-        for (i = ngs->n_active_chan[frame_idx & 0x1], hmm = *(acl++);
-             i > 0; --i, hmm = *(acl++)) {
-            int32 b;
-
-            /* Put it in a bin according to its bestscore. */
-            b = (ngs->best_score - hmm_bestscore(&hmm->hmm)) / bw;
-            if (b >= 256)
-                b = 255;
-            ++bins[b];
-        }
-        /* Walk down the bins to find the new beam. */
-        for (i = nhmms = 0; i < 256; ++i) {
-            nhmms += bins[i];
-            if (nhmms > ngs->maxhmmpf)
-                break;
-        }
-        ngs->dynamic_beam = -(i * bw);
-    }
+    if (ngs->maxhmmpf != -1)
+        ngs->dynamic_beam = ngram_search_hist_beam(ngs, ngs->maxhmmpf,
+                                                   ngs->beam);
 
     prune_root_chan(ngs, frame_idx);
     prune_nonroot_chan(ngs, frame_idx);
+    ngram_search_lm_lock(ngs);
     last_phone_transition(ngs, frame_idx);
+    ngram_search_lm_unlock(ngs);
     prune_word_chan(ngs, frame_idx);
 }
 
@@ -1188,10 +1358,18 @@ prune_channels(ngram_search_t *ngs, int frame_idx)
  * Limit the number of word exits in each frame to maxwpf.  And also limit the number of filler
  * words to 1.
  */
+static int32
+bp_bin(int32 bestscr, int32 score, int32 bw)
+{
+    int32 b = (bestscr - score) / bw;
+    return b < 256 ? b : 255;
+}
+
 static void
 bptable_maxwpf(ngram_search_t *ngs, int frame_idx)
 {
-    int32 bp, n;
+    int32 bp, n, b, k, bw;
+    int32 bins[256];
     int32 bestscr, worstscr;
     bptbl_t *bpe, *bestbpe, *worstbpe;
 
@@ -1223,7 +1401,40 @@ bptable_maxwpf(ngram_search_t *ngs, int frame_idx)
     /* Allow up to maxwpf best entries to survive; mark the remaining with valid = 0 */
     n = (ngs->bpidx
          - ngs->bp_table_idx[frame_idx]) - n;  /* No. of entries after limiting fillers */
-    for (; n > ngs->maxwpf; --n) {
+    if (n <= ngs->maxwpf)
+        return;
+
+    /* Bin the surviving entries by score below the best one, so the
+     * threshold can be found in linear time. */
+    bestscr = WORST_SCORE;
+    for (bp = ngs->bp_table_idx[frame_idx]; bp < ngs->bpidx; bp++) {
+        bpe = &(ngs->bp_table[bp]);
+        if (bpe->valid && bpe->score BETTER_THAN bestscr)
+            bestscr = bpe->score;
+    }
+    bw = -ngs->wbeam / 256;
+    if (bw < 1)
+        bw = 1;
+    memset(bins, 0, sizeof(bins));
+    for (bp = ngs->bp_table_idx[frame_idx]; bp < ngs->bpidx; bp++) {
+        bpe = &(ngs->bp_table[bp]);
+        if (bpe->valid)
+            ++bins[bp_bin(bestscr, bpe->score, bw)];
+    }
+    for (b = k = 0; b < 256; ++b) {
+        if (k + bins[b] > ngs->maxwpf)
+            break;
+        k += bins[b];
+    }
+
+    /* Entries below the boundary bin are dropped outright; within it,
+     * drop the worst ones until exactly maxwpf remain. */
+    for (bp = ngs->bp_table_idx[frame_idx]; bp < ngs->bpidx; bp++) {
+        bpe = &(ngs->bp_table[bp]);
+        if (bpe->valid && bp_bin(bestscr, bpe->score, bw) > b)
+            bpe->valid = FALSE;
+    }
+    for (n = k + bins[b]; n > ngs->maxwpf; --n) {
         /* Find worst BPTable entry */
         worstscr = (int32) 0x7fffffff;
         worstbpe = NULL;
@@ -1316,7 +1527,7 @@ word_transition(ngram_search_t *ngs, int frame_idx)
         bestbp_rc_ptr = &(ngs->bestbp_rc[rhmm->ciphone]);
 
         newscore = bestbp_rc_ptr->score + ngs->nwpen + ngs->pip
-            + phone_loop_search_score(pls, rhmm->ciphone);
+            + root_lookahead(pls, rhmm);
         if (newscore BETTER_THAN thresh) {
             if ((hmm_frame(&rhmm->hmm) < frame_idx)
                 || (newscore BETTER_THAN hmm_in_score(&rhmm->hmm))) {
@@ -1376,7 +1587,7 @@ word_transition(ngram_search_t *ngs, int frame_idx)
             continue;
         rhmm = (root_chan_t *) ngs->word_chan[w];
         newscore = ngs->last_ltrans[w].dscr + ngs->pip
-            + phone_loop_search_score(pls, rhmm->ciphone);
+            + final_lookahead(pls, rhmm->ciphone);
         if (newscore BETTER_THAN thresh) {
             bpe = ngs->bp_table + ngs->last_ltrans[w].bp;
             if ((hmm_frame(&rhmm->hmm) < frame_idx)
@@ -1398,7 +1609,7 @@ word_transition(ngram_search_t *ngs, int frame_idx)
     rhmm = (root_chan_t *) ngs->word_chan[w];
     bestbp_rc_ptr = &(ngs->bestbp_rc[ps_search_acmod(ngs)->mdef->sil]);
     newscore = bestbp_rc_ptr->score + ngs->silpen + ngs->pip
-        + phone_loop_search_score(pls, rhmm->ciphone);
+        + final_lookahead(pls, rhmm->ciphone);
     if (newscore BETTER_THAN thresh) {
         if ((hmm_frame(&rhmm->hmm) < frame_idx)
             || (newscore BETTER_THAN hmm_in_score(&rhmm->hmm))) {
@@ -1418,7 +1629,7 @@ word_transition(ngram_search_t *ngs, int frame_idx)
         if (rhmm == NULL)
             continue;
         newscore = bestbp_rc_ptr->score + ngs->fillpen + ngs->pip
-            + phone_loop_search_score(pls, rhmm->ciphone);
+            + final_lookahead(pls, rhmm->ciphone);
         if (newscore BETTER_THAN thresh) {
             if ((hmm_frame(&rhmm->hmm) < frame_idx)
                 || (newscore BETTER_THAN hmm_in_score(&rhmm->hmm))) {
@@ -1451,50 +1662,222 @@ deactivate_channels(ngram_search_t *ngs, int frame_idx)
     }
 }
 
-int
-ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx)
+/*
+ * Sum the senone scores pooled since the search last advanced into
+ * pool_senscr, and start a new group.
+ */
+static int16 const *
+flush_pool(ngram_search_t *ngs)
 {
-    int16 const *senscr;
+    acmod_t *acmod = ps_search_acmod(ngs);
+    int32 i, n;
+
+    n = acmod->compallsen ? bin_mdef_n_sen(acmod->mdef) : acmod->n_senone_active;
+    for (i = 0; i < n; ++i) {
+        int32 s = acmod->compallsen ? i : acmod->senone_active[i];
+        ngs->pool_senscr[s] = ngs->pool_acc[s] > 32767
+            ? 32767 : ngs->pool_acc[s];
+    }
+    ngs->n_pooled = 0;
+    return ngs->pool_senscr;
+}
 
-    /* Activate our HMMs for the current frame if need be. */
-    if (!ps_search_acmod(ngs)->compallsen)
-        compute_sen_active(ngs, frame_idx);
+/*
+ * Accumulate senone scores for frame skipping.  Returns NULL if the
+ * search should only carry its HMMs over to the next frame, or the
+ * summed scores over the last fwdskip frames if it should advance.
+ */
+static int16 const *
+pool_senscr(ngram_search_t *ngs, int16 const *senscr)
+{
+    acmod_t *acmod = ps_search_acmod(ngs);
+    int32 i, n;
+
+    n = acmod->compallsen ? bin_mdef_n_sen(acmod->mdef) : acmod->n_senone_active;
+    for (i = 0; i < n; ++i) {
+        int32 s = acmod->compallsen ? i : acmod->senone_active[i];
+        if (ngs->n_pooled == 0)
+            ngs->pool_acc[s] = senscr[s];
+        else
+            ngs->pool_acc[s] += senscr[s];
+    }
+    if (++ngs->n_pooled < ngs->fwdskip)
+        return NULL;
+    return flush_pool(ngs);
+}
 
-    /* Compute GMM scores for the current frame. */
-    if ((senscr = acmod_score(ps_search_acmod(ngs), &frame_idx)) == NULL)
-        return 0;
-    ngs->st.n_senone_active_utt += ps_search_acmod(ngs)->n_senone_active;
+/*
+ * Move all active HMMs unchanged from one frame to another, for
+ * frames which are pooled rather than searched.
+ */
+static void
+carry_channels(ngram_search_t *ngs, int frame_idx, int nf)
+{
+    root_chan_t *rhmm;
+    chan_t *hmm, **acl;
+    int32 i, w, *awl;
 
-    /* Mark backpointer table for current frame. */
-    ngram_search_mark_bptable(ngs, frame_idx);
+    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++) {
+        if (hmm_frame(&rhmm->hmm) == frame_idx)
+            hmm_frame(&rhmm->hmm) = nf;
+    }
+
+    i = ngs->n_active_chan[frame_idx & 0x1];
+    acl = ngs->active_chan_list[frame_idx & 0x1];
+    memcpy(ngs->active_chan_list[nf & 0x1], acl, i * sizeof(*acl));
+    ngs->n_active_chan[nf & 0x1] = i;
+    for (hmm = *(acl++); i > 0; --i, hmm = *(acl++))
+        hmm_frame(&hmm->hmm) = nf;
+
+    /* Word channels stay flagged in word_active. */
+    i = ngs->n_active_word[frame_idx & 0x1];
+    awl = ngs->active_word_list[frame_idx & 0x1];
+    memcpy(ngs->active_word_list[nf & 0x1], awl, i * sizeof(*awl));
+    ngs->n_active_word[nf & 0x1] = i;
+    for (w = *(awl++); i > 0; --i, w = *(awl++)) {
+        for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next)
+            hmm_frame(&hmm->hmm) = nf;
+    }
+
+    for (i = 0; i < ngs->n_1ph_words; i++) {
+        w = ngs->single_phone_wid[i];
+        rhmm = (root_chan_t *) ngs->word_chan[w];
+        if (hmm_frame(&rhmm->hmm) == frame_idx)
+            hmm_frame(&rhmm->hmm) = nf;
+    }
+}
+
+/*
+ * Advance the search by one step, ending at frame_idx.
+ */
+static int
+advance_search(ngram_search_t *ngs, int16 const *senscr, int frame_idx)
+{
+    int32 ref;
 
     /* If the best score is equal to or worse than WORST_SCORE,
      * recognition has failed, don't bother to keep trying. */
     if (ngs->best_score == WORST_SCORE || ngs->best_score WORSE_THAN WORST_SCORE)
         return 0;
     /* Renormalize if necessary */
+    ref = ngs->best_score;
     if (ngs->best_score + (2 * ngs->beam) WORSE_THAN WORST_SCORE) {
         E_INFO("Renormalizing Scores at frame %d, best score %d\n",
                frame_idx, ngs->best_score);
         renormalize_scores(ngs, frame_idx, ngs->best_score);
+        ref = 0;
     }
 
     /* Evaluate HMMs */
+    if (ngs->maxhmmpf != -1)
+        ngram_search_hist_start(ngs, ref, ngs->beam);
     evaluate_channels(ngs, senscr, frame_idx);
     /* Prune HMMs and do phone transitions. */
     prune_channels(ngs, frame_idx);
     /* Do absolute pruning on word exits. */
     bptable_maxwpf(ngs, frame_idx);
     /* Do word transitions. */
+    ngram_search_lm_lock(ngs);
     word_transition(ngs, frame_idx);
+    ngram_search_lm_unlock(ngs);
     /* Deactivate pruned HMMs. */
     deactivate_channels(ngs, frame_idx);
 
+    return 1;
+}
+
+int
+ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx)
+{
+    int16 const *senscr;
+
+    /* Activate our HMMs for the current frame if need be. */
+    if (!ps_search_acmod(ngs)->compallsen)
+        compute_sen_active(ngs, frame_idx);
+
+    /* Compute GMM scores for the current frame. */
+    if ((senscr = acmod_score(ps_search_acmod(ngs), &frame_idx)) == NULL)
+        return 0;
+    ngs->st.n_senone_active_utt += ps_search_acmod(ngs)->n_senone_active;
+
+    /* Mark backpointer table for current frame. */
+    ngram_search_mark_bptable(ngs, frame_idx);
+
+    /* With frame skipping, only advance the search on the last frame
+     * of each group, scoring it on the senone scores summed over the
+     * whole group. */
+    if (ngs->fwdskip > 1
+        && (senscr = pool_senscr(ngs, senscr)) == NULL) {
+        carry_channels(ngs, frame_idx, frame_idx + 1);
+        ++ngs->n_frame;
+        return 1;
+    }
+
+    if (!advance_search(ngs, senscr, frame_idx))
+        return 0;
+
     ++ngs->n_frame;
     /* Return the number of frames processed. */
     return 1;
 }
 
+/*
+ * Find the oldest word start in the live states of an HMM, as the
+ * backpointer it was entered from.
+ */
+static int32
+hmm_oldest_history(hmm_t *hmm, int32 bp)
+{
+    int32 i;
+
+    for (i = 0; i < hmm_n_emit_state(hmm); ++i)
+        if (hmm_score(hmm, i) BETTER_THAN WORST_SCORE
+            && hmm_history(hmm, i) < bp)
+            bp = hmm_history(hmm, i);
+    return bp;
+}
+
+int32
+ngram_fwdtree_final_sf(ngram_search_t *ngs, int frame_idx)
+{
+    root_chan_t *rhmm;
+    chan_t *hmm, **acl;
+    int32 i, w, *awl, nf, bp;
+
+    /* Words which exited in this frame may exit again in the next. */
+    nf = frame_idx + 1;
+    bp = ngs->bpidx;
+    for (i = ngs->bp_table_idx[frame_idx]; i < ngs->bpidx; ++i)
+        if (ngs->bp_table[i].bp < bp)
+            bp = ngs->bp_table[i].bp;
+
+    /* Every HMM which is still being searched. */
+    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++)
+        if (hmm_frame(&rhmm->hmm) == nf)
+            bp = hmm_oldest_history(&rhmm->hmm, bp);
+    i = ngs->n_active_chan[nf & 0x1];
+    acl = ngs->active_chan_list[nf & 0x1];
+    for (hmm = *(acl++); i > 0; --i, hmm = *(acl++))
+        bp = hmm_oldest_history(&hmm->hmm, bp);
+    i = ngs->n_active_word[nf & 0x1];
+    awl = ngs->active_word_list[nf & 0x1];
+    for (w = *(awl++); i > 0; --i, w = *(awl++))
+        for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next)
+            if (hmm_frame(&hmm->hmm) == nf)
+                bp = hmm_oldest_history(&hmm->hmm, bp);
+    for (i = 0; i < ngs->n_1ph_words; i++) {
+        rhmm = (root_chan_t *) ngs->word_chan[ngs->single_phone_wid[i]];
+        if (hmm_frame(&rhmm->hmm) == nf)
+            bp = hmm_oldest_history(&rhmm->hmm, bp);
+    }
+
+    if (bp == NO_BP)
+        return 0;
+    if (bp == ngs->bpidx)
+        return nf;
+    return ngs->bp_table[bp].frame + 1;
+}
+
 void
 ngram_fwdtree_finish(ngram_search_t *ngs)
 {
@@ -1504,6 +1887,16 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
 
     /* This is the number of frames processed. */
     cf = ps_search_acmod(ngs)->output_frame;
+
+    /* Search the frames pooled at the end of the utterance, which
+     * have been carried over to cf, as a shorter final group. */
+    if (ngs->n_pooled > 0) {
+        fill_pool_tp(ngs, ngs->n_pooled);
+        carry_channels(ngs, cf, cf - 1);
+        advance_search(ngs, flush_pool(ngs), cf - 1);
+    }
+    ngs->hmmctx->tp = ps_search_acmod(ngs)->tmat->tp;
+
     /* Add a mark in the backpointer table for one past the final frame. */
     ngram_search_mark_bptable(ngs, cf);
 
@@ -1550,6 +1943,7 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
                ngs->bpidx, (ngs->bpidx + (cf >> 1)) / (cf + 1));
         E_INFO("%8d senones evaluated (%d/fr)\n", ngs->st.n_senone_active_utt,
                (ngs->st.n_senone_active_utt + (cf >> 1)) / (cf + 1));
+        acmod_log_ssid_stats(ps_search_acmod(ngs));
         E_INFO("%8d channels searched (%d/fr), %d 1st, %d last\n",
                ngs->st.n_root_chan_eval + ngs->st.n_nonroot_chan_eval,
                (ngs->st.n_root_chan_eval + ngs->st.n_nonroot_chan_eval) / (cf + 1),
@@ -1568,3 +1962,327 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
     }
     /* dump_bptable(ngs); */
 }
+
+/*
+ * List the non-root channels under a node of the search tree, depth
+ * first, which numbers them the same way in any search built from
+ * the same dictionary and language model.
+ */
+static int32
+list_nonroot_chan(chan_t *hmm, chan_t **chans, int32 max, int32 n)
+{
+    for (; hmm; hmm = hmm->alt) {
+        if (n < max)
+            chans[n] = hmm;
+        n = list_nonroot_chan(hmm->next, chans, max, n + 1);
+    }
+    return n;
+}
+
+static chan_t **
+all_nonroot_chan(ngram_search_t *ngs)
+{
+    chan_t **chans;
+    int32 i, n;
+
+    chans = ckd_calloc(ngs->n_nonroot_chan + 1, sizeof(*chans));
+    for (i = n = 0; i < ngs->n_root_chan; ++i)
+        n = list_nonroot_chan(ngs->root_chan[i].next, chans,
+                              ngs->n_nonroot_chan, n);
+    if (n != ngs->n_nonroot_chan) {
+        E_ERROR("Search tree has %d non-root channels, expected %d\n",
+                n, ngs->n_nonroot_chan);
+        ckd_free(chans);
+        return NULL;
+    }
+    return chans;
+}
+
+typedef struct chan_idx_s {
+    chan_t *chan;
+    int32 idx;
+} chan_idx_t;
+
+static int
+chan_idx_cmp(const void *a, const void *b)
+{
+    chan_t *ca = ((chan_idx_t const *)a)->chan;
+    chan_t *cb = ((chan_idx_t const *)b)->chan;
+
+    return (ca < cb) ? -1 : (ca > cb) ? 1 : 0;
+}
+
+/*
+ * Write the index and state of each active HMM in an array of root
+ * channels.  The senone sequences of the inactive ones are written
+ * too, since they are still activated for scoring once re-entered.
+ */
+static int
+snapshot_root_chan(FILE *fh, root_chan_t **rhmms, int32 n, int32 nf)
+{
+    int32 i, n_active;
+
+    for (i = n_active = 0; i < n; ++i) {
+        if (snapshot_write(fh, rhmms[i]->hmm.senid, sizeof(uint16),
+                           hmm_n_emit_state(&rhmms[i]->hmm)) < 0)
+            return -1;
+        if (hmm_frame(&rhmms[i]->hmm) == nf)
+            ++n_active;
+    }
+    if (snapshot_write_int32(fh, n_active) < 0)
+        return -1;
+    for (i = 0; i < n; ++i) {
+        if (hmm_frame(&rhmms[i]->hmm) != nf)
+            continue;
+        if (snapshot_write_int32(fh, i) < 0
+            || snapshot_write_hmm(fh, &rhmms[i]->hmm) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int
+restore_root_chan(FILE *fh, root_chan_t **rhmms, int32 n)
+{
+    int32 i, j, n_active;
+
+    for (i = 0; i < n; ++i) {
+        hmm_clear(&rhmms[i]->hmm);
+        if (snapshot_read(fh, rhmms[i]->hmm.senid, sizeof(uint16),
+                          hmm_n_emit_state(&rhmms[i]->hmm)) < 0)
+            return -1;
+    }
+    if (snapshot_read_int32(fh, &n_active) < 0)
+        return -1;
+    for (i = 0; i < n_active; ++i) {
+        if (snapshot_read_int32(fh, &j) < 0)
+            return -1;
+        if (j < 0 || j >= n) {
+            E_ERROR("Corrupt snapshot: root channel %d of %d\n", j, n);
+            return -1;
+        }
+        if (snapshot_read_hmm(fh, &rhmms[j]->hmm) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Root channels of the tree and of single-phone words, as one array
+ * of pointers.
+ */
+static root_chan_t **
+all_root_chan(ngram_search_t *ngs)
+{
+    root_chan_t **rhmms;
+    int32 i;
+
+    rhmms = ckd_calloc(ngs->n_root_chan + ngs->n_1ph_words + 1,
+                       sizeof(*rhmms));
+    for (i = 0; i < ngs->n_root_chan; ++i)
+        rhmms[i] = &ngs->root_chan[i];
+    for (i = 0; i < ngs->n_1ph_words; ++i)
+        rhmms[ngs->n_root_chan + i]
+            = (root_chan_t *)ngs->word_chan[ngs->single_phone_wid[i]];
+    return rhmms;
+}
+
+int
+ngram_fwdtree_snapshot(ngram_search_t *ngs, FILE *fh)
+{
+    int32 n_sen = bin_mdef_n_sen(ps_search_acmod(ngs)->mdef);
+    int32 nf = ngs->n_frame;
+    root_chan_t **rhmms;
+    chan_t **chans, *hmm;
+    chan_idx_t *idx, key, *found;
+    int32 i, n, w, *awl;
+    int rv = -1;
+
+    if ((chans = all_nonroot_chan(ngs)) == NULL)
+        return -1;
+    rhmms = all_root_chan(ngs);
+    idx = ckd_calloc(ngs->n_nonroot_chan + 1, sizeof(*idx));
+    for (i = 0; i < ngs->n_nonroot_chan; ++i) {
+        idx[i].chan = chans[i];
+        idx[i].idx = i;
+    }
+    qsort(idx, ngs->n_nonroot_chan, sizeof(*idx), chan_idx_cmp);
+
+    if (snapshot_write_int32(fh, ngs->n_root_chan) < 0
+        || snapshot_write_int32(fh, ngs->n_1ph_words) < 0
+        || snapshot_write_int32(fh, ngs->n_nonroot_chan) < 0
+        || snapshot_root_chan(fh, rhmms, ngs->n_root_chan + ngs->n_1ph_words,
+                              nf) < 0)
+        goto error_out;
+
+    /* Active non-root channels, in the order they are searched. */
+    n = ngs->n_active_chan[nf & 0x1];
+    if (snapshot_write_int32(fh, n) < 0)
+        goto error_out;
+    for (i = 0; i < n; ++i) {
+        key.chan = ngs->active_chan_list[nf & 0x1][i];
+        found = bsearch(&key, idx, ngs->n_nonroot_chan, sizeof(*idx),
+                        chan_idx_cmp);
+        assert(found != NULL);
+        if (snapshot_write_int32(fh, found->idx) < 0
+            || snapshot_write_hmm(fh, &key.chan->hmm) < 0)
+            goto error_out;
+    }
+
+    /* Last phones of active words, one channel per right context. */
+    n = ngs->n_active_word[nf & 0x1];
+    awl = ngs->active_word_list[nf & 0x1];
+    if (snapshot_write_int32(fh, n) < 0)
+        goto error_out;
+    for (i = 0; i < n; ++i) {
+        int32 n_rc = 0;
+
+        w = awl[i];
+        for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next)
+            ++n_rc;
+        if (snapshot_write_int32(fh, w) < 0
+            || snapshot_write_int32(fh, n_rc) < 0)
+            goto error_out;
+        for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next)
+            if (snapshot_write_int32(fh, hmm->info.rc_id) < 0
+                || snapshot_write_hmm(fh, &hmm->hmm) < 0)
+                goto error_out;
+    }
+    if (snapshot_write(fh, ngs->word_active, sizeof(bitvec_t),
+                       bitvec_size(ps_search_n_words(ngs))) < 0)
+        goto error_out;
+
+    /* Senone scores pooled for frame skipping. */
+    if (snapshot_write_int32(fh, ngs->n_pooled) < 0
+        || (ngs->n_pooled > 0
+            && snapshot_write(fh, ngs->pool_acc, sizeof(*ngs->pool_acc),
+                              n_sen) < 0))
+        goto error_out;
+    rv = 0;
+
+error_out:
+    ckd_free(chans);
+    ckd_free(rhmms);
+    ckd_free(idx);
+    return rv;
+}
+
+int
+ngram_fwdtree_restore(ngram_search_t *ngs, FILE *fh)
+{
+    dict_t *dict = ps_search_dict(ngs);
+    int32 n_sen = bin_mdef_n_sen(ps_search_acmod(ngs)->mdef);
+    int32 nf = ngs->n_frame;
+    root_chan_t **rhmms;
+    chan_t **chans, *hmm, **phmmp;
+    int32 i, j, n, n_rc, w;
+    int rv = -1;
+
+    if (snapshot_check_int32(fh, ngs->n_root_chan, "number of root channels") < 0
+        || snapshot_check_int32(fh, ngs->n_1ph_words,
+                                "number of single-phone words") < 0
+        || snapshot_check_int32(fh, ngs->n_nonroot_chan,
+                                "number of non-root channels") < 0)
+        return -1;
+    if ((chans = all_nonroot_chan(ngs)) == NULL)
+        return -1;
+    rhmms = all_root_chan(ngs);
+    if (restore_root_chan(fh, rhmms, ngs->n_root_chan + ngs->n_1ph_words) < 0)
+        goto error_out;
+
+    /* Inactive channels are always cleared. */
+    for (i = 0; i < ngs->n_nonroot_chan; ++i)
+        hmm_clear(&chans[i]->hmm);
+    if (snapshot_read_int32(fh, &n) < 0)
+        goto error_out;
+    if (n < 0 || n > ngs->n_nonroot_chan) {
+        E_ERROR("Corrupt snapshot: %d active non-root channels\n", n);
+        goto error_out;
+    }
+    for (i = 0; i < n; ++i) {
+        if (snapshot_read_int32(fh, &j) < 0)
+            goto error_out;
+        if (j < 0 || j >= ngs->n_nonroot_chan) {
+            E_ERROR("Corrupt snapshot: non-root channel %d of %d\n",
+                    j, ngs->n_nonroot_chan);
+            goto error_out;
+        }
+        if (snapshot_read_hmm(fh, &chans[j]->hmm) < 0)
+            goto error_out;
+        ngs->active_chan_list[nf & 0x1][i] = chans[j];
+    }
+    ngs->n_active_chan[nf & 0x1] = n;
+    ngs->n_active_chan[!(nf & 0x1)] = 0;
+
+    /* Rebuild the right context channels of active words the same
+     * way ngram_search_alloc_all_rc() does. */
+    if (snapshot_read_int32(fh, &n) < 0)
+        goto error_out;
+    if (n < 0 || n > ps_search_n_words(ngs)) {
+        E_ERROR("Corrupt snapshot: %d active words\n", n);
+        goto error_out;
+    }
+    for (i = 0; i < n; ++i) {
+        xwdssid_t *rssid;
+        int32 ciphone, tmatid;
+
+        if (snapshot_read_int32(fh, &w) < 0
+            || snapshot_read_int32(fh, &n_rc) < 0)
+            goto error_out;
+        if (w < 0 || w >= ps_search_n_words(ngs)
+            || dict_is_single_phone(dict, w)) {
+            E_ERROR("Corrupt snapshot: active word %d\n", w);
+            goto error_out;
+        }
+        if (ngs->word_chan[w])
+            ngram_search_free_all_rc(ngs, w);
+        ciphone = dict_last_phone(dict, w);
+        rssid = dict2pid_rssid(ps_search_dict2pid(ngs), ciphone,
+                               dict_second_last_phone(dict, w));
+        tmatid = bin_mdef_pid2tmatid(ps_search_acmod(ngs)->mdef, ciphone);
+        phmmp = &ngs->word_chan[w];
+        for (j = 0; j < n_rc; ++j) {
+            int32 rc_id;
+
+            if (snapshot_read_int32(fh, &rc_id) < 0)
+                goto error_out;
+            if (rc_id < 0 || rc_id >= rssid->n_ssid) {
+                E_ERROR("Corrupt snapshot: right context %d of word %s\n",
+                        rc_id, dict_wordstr(dict, w));
+                goto error_out;
+            }
+            hmm = listelem_malloc(ngs->chan_alloc);
+            hmm->next = NULL;
+            hmm->info.rc_id = rc_id;
+            hmm->ciphone = ciphone;
+            hmm_init(ngs->hmmctx, &hmm->hmm, FALSE, rssid->ssid[rc_id], tmatid);
+            *phmmp = hmm;
+            phmmp = &hmm->next;
+            if (snapshot_read_hmm(fh, &hmm->hmm) < 0)
+                goto error_out;
+        }
+        ngs->active_word_list[nf & 0x1][i] = w;
+    }
+    ngs->n_active_word[nf & 0x1] = n;
+    ngs->n_active_word[!(nf & 0x1)] = 0;
+    if (snapshot_read(fh, ngs->word_active, sizeof(bitvec_t),
+                      bitvec_size(ps_search_n_words(ngs))) < 0)
+        goto error_out;
+
+    if (snapshot_read_int32(fh, &ngs->n_pooled) < 0)
+        goto error_out;
+    if (ngs->n_pooled < 0 || ngs->n_pooled >= ngs->fwdskip) {
+        E_ERROR("Snapshot has %d frames pooled, -fwdskip is %d\n",
+                ngs->n_pooled, ngs->fwdskip);
+        goto error_out;
+    }
+    if (ngs->n_pooled > 0
+        && snapshot_read(fh, ngs->pool_acc, sizeof(*ngs->pool_acc), n_sen) < 0)
+        goto error_out;
+    rv = 0;
+
+error_out:
+    ckd_free(chans);
+    ckd_free(rhmms);
+    return rv;
+}
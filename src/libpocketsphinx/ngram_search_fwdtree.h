@@ -62,6 +62,11 @@ void ngram_fwdtree_deinit(ngram_search_t *ngs);
  */
 int ngram_fwdtree_reinit(ngram_search_t *ngs);
 
+/**
+ * Add a newly appended dictionary word without a full rebuild.
+ */
+int ngram_fwdtree_add_word(ngram_search_t *ngs, int32 wid);
+
 /**
  * Start fwdtree decoding for an utterance.
  */
@@ -79,5 +84,32 @@ int ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx);
  */
 void ngram_fwdtree_finish(ngram_search_t *ngs);
 
+/**
+ * Find the earliest start frame of a word which the tree search may
+ * still add exits for, after searching a frame.
+ *
+ * All exits of words starting before this frame are in the
+ * backpointer table, so their part of the fwdflat word list is
+ * complete.
+ */
+int32 ngram_fwdtree_final_sf(ngram_search_t *ngs, int frame_idx);
+
+/**
+ * Write the HMMs and word channels active in the next frame of the
+ * utterance to a snapshot.
+ *
+ * Channels are identified by their place in the search tree, so the
+ * search they are restored into must have been built from the same
+ * dictionary and language model.
+ */
+int ngram_fwdtree_snapshot(ngram_search_t *ngs, FILE *fh);
+
+/**
+ * Restore the HMMs and word channels written by
+ * ngram_fwdtree_snapshot(), after ngram_fwdtree_start() and with
+ * ngs->n_frame already set.
+ */
+int ngram_fwdtree_restore(ngram_search_t *ngs, FILE *fh);
+
 
 #endif /* __NGRAM_SEARCH_FWDTREE_H__ */
@@ -39,9 +39,12 @@
  * @file phone_loop_search.h Fast and rough context-independent phoneme loop search.
  */
 
+#include <string.h>
+
 #include <sphinxbase/err.h>
 
 #include "phone_loop_search.h"
+#include "snapshot.h"
 
 static int phone_loop_search_start(ps_search_t *search);
 static int phone_loop_search_step(ps_search_t *search, int frame_idx);
@@ -51,6 +54,9 @@ static void phone_loop_search_free(ps_search_t *search);
 static char const *phone_loop_search_hyp(ps_search_t *search, int32 *out_score, int32 *out_is_final);
 static int32 phone_loop_search_prob(ps_search_t *search);
 static ps_seg_t *phone_loop_search_seg_iter(ps_search_t *search, int32 *out_score);
+static int phone_loop_search_scale_beams(ps_search_t *search, float32 scale);
+static int phone_loop_search_snapshot(ps_search_t *search, FILE *fh);
+static int phone_loop_search_restore(ps_search_t *search, FILE *fh);
 
 static ps_searchfuncs_t phone_loop_search_funcs = {
     /* name: */   "phone_loop",
@@ -58,11 +64,15 @@ static ps_searchfuncs_t phone_loop_search_funcs = {
     /* step: */   phone_loop_search_step,
     /* finish: */ phone_loop_search_finish,
     /* reinit: */ phone_loop_search_reinit,
+    /* add_word: */ NULL,
     /* free: */   phone_loop_search_free,
     /* lattice: */  NULL,
     /* hyp: */      phone_loop_search_hyp,
     /* prob: */     phone_loop_search_prob,
     /* seg_iter: */ phone_loop_search_seg_iter,
+    /* scale_beams: */ phone_loop_search_scale_beams,
+    /* snapshot: */ phone_loop_search_snapshot,
+    /* restore: */  phone_loop_search_restore,
 };
 
 static int
@@ -90,6 +100,9 @@ phone_loop_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
             hmm_deinit((hmm_t *)&pls->phones[i]);
         ckd_free(pls->phones);
     }
+    if (pls->hist)
+        ckd_free_2d(pls->hist);
+    ckd_free(pls->succ);
     pls->n_phones = bin_mdef_n_ciphone(acmod->mdef);
     pls->phones = ckd_calloc(pls->n_phones, sizeof(*pls->phones));
     for (i = 0; i < pls->n_phones; ++i) {
@@ -105,6 +118,33 @@ phone_loop_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     E_INFO("State beam %d Phone exit beam %d Insertion penalty %d\n",
            pls->beam, pls->pbeam, pls->pip);
 
+    /* Keep normalized phone scores for the whole lookahead window,
+     * for use in phone-pair bounds. */
+    pls->pair = cmd_ln_boolean_r(config, "-pl_pair");
+    pls->window = cmd_ln_int32_r(config, "-pl_window");
+    if (pls->window < 1)
+        pls->window = 1;
+    pls->hist = ckd_calloc_2d(pls->window, pls->n_phones,
+                              sizeof(**pls->hist));
+    pls->succ = ckd_calloc(pls->window, sizeof(*pls->succ));
+    pls->hist_idx = 0;
+
+    return 0;
+}
+
+static int
+phone_loop_search_scale_beams(ps_search_t *search, float32 scale)
+{
+    phone_loop_search_t *pls = (phone_loop_search_t *)search;
+    cmd_ln_t *config = ps_search_config(search);
+    acmod_t *acmod = ps_search_acmod(search);
+
+    pls->beam = (int32)(logmath_log(acmod->lmath,
+                                    cmd_ln_float64_r(config, "-pl_beam"))
+                        * scale);
+    pls->pbeam = (int32)(logmath_log(acmod->lmath,
+                                     cmd_ln_float64_r(config, "-pl_pbeam"))
+                         * scale);
     return 0;
 }
 
@@ -146,6 +186,8 @@ phone_loop_search_free(ps_search_t *search)
         hmm_deinit((hmm_t *)&pls->phones[i]);
     phone_loop_search_free_renorm(pls);
     ckd_free(pls->phones);
+    ckd_free_2d(pls->hist);
+    ckd_free(pls->succ);
     hmm_context_free(pls->hmmctx);
     ckd_free(pls);
 }
@@ -165,6 +207,11 @@ phone_loop_search_start(ps_search_t *search)
     phone_loop_search_free_renorm(pls);
     pls->best_score = 0;
 
+    /* All phones start out equally likely. */
+    for (i = 0; i < pls->window; ++i)
+        memset(pls->hist[i], 0, pls->n_phones * sizeof(**pls->hist));
+    pls->hist_idx = 0;
+
     return 0;
 }
 
@@ -205,6 +252,7 @@ evaluate_hmms(phone_loop_search_t *pls, int16 const *senscr, int frame_idx)
         }
     }
     pls->best_score = bs;
+    pls->best_ci = bi;
     return bs;
 }
 
@@ -234,34 +282,126 @@ static void
 phone_transition(phone_loop_search_t *pls, int frame_idx)
 {
     int32 thresh = pls->best_score + pls->pbeam;
+    int32 best_exit = WORST_SCORE;
+    int32 best_history = -1;
     int nf = frame_idx + 1;
     int i;
 
-    /* Now transition out of phones whose last states are inside the
-     * phone transition beam. */
+    /* Since every phone can follow every other one with the same
+     * insertion penalty, only the best exit matters to the Viterbi
+     * rule, so find it first... */
     for (i = 0; i < pls->n_phones; ++i) {
         hmm_t *hmm = (hmm_t *)&pls->phones[i];
         int32 newphone_score;
-        int j;
 
         if (hmm_frame(hmm) != nf)
             continue;
-
         newphone_score = hmm_out_score(hmm) + pls->pip;
-        if (newphone_score BETTER_THAN thresh) {
-            /* Transition into all phones using the usual Viterbi rule. */
-            for (j = 0; j < pls->n_phones; ++j) {
-                hmm_t *nhmm = (hmm_t *)&pls->phones[j];
-
-                if (hmm_frame(nhmm) < frame_idx
-                    || newphone_score BETTER_THAN hmm_in_score(nhmm)) {
-                    hmm_enter(nhmm, newphone_score, hmm_out_history(hmm), nf);
-                }
-            }
+        if (newphone_score BETTER_THAN thresh
+            && newphone_score BETTER_THAN best_exit) {
+            best_exit = newphone_score;
+            best_history = hmm_out_history(hmm);
+        }
+    }
+    if (best_exit == WORST_SCORE)
+        return;
+
+    /* ...then transition from it into all phones. */
+    for (i = 0; i < pls->n_phones; ++i) {
+        hmm_t *nhmm = (hmm_t *)&pls->phones[i];
+
+        if (hmm_frame(nhmm) < frame_idx
+            || best_exit BETTER_THAN hmm_in_score(nhmm)) {
+            hmm_enter(nhmm, best_exit, best_history, nf);
         }
     }
 }
 
+static void
+update_hist(phone_loop_search_t *pls)
+{
+    int32 *scores;
+    int i;
+
+    /* Overwrite the oldest frame with the current one.  Scores
+     * outside the beam are floored at the beam to avoid overflow
+     * when they are added together. */
+    scores = pls->hist[pls->hist_idx];
+    for (i = 0; i < pls->n_phones; ++i) {
+        int32 score = hmm_bestscore(&pls->phones[i].hmm) - pls->best_score;
+        scores[i] = (score BETTER_THAN pls->beam) ? score : pls->beam;
+    }
+    if (++pls->hist_idx == pls->window)
+        pls->hist_idx = 0;
+}
+
+void
+phone_loop_search_succ_reset(phone_loop_search_t *pls)
+{
+    int i;
+
+    for (i = 0; i < pls->window; ++i)
+        pls->succ[i] = WORST_SCORE;
+}
+
+void
+phone_loop_search_succ_add(phone_loop_search_t *pls, int ci)
+{
+    int i;
+
+    for (i = 0; i < pls->window; ++i)
+        if (pls->hist[i][ci] BETTER_THAN pls->succ[i])
+            pls->succ[i] = pls->hist[i][ci];
+}
+
+int32
+phone_loop_search_pair_score(phone_loop_search_t *pls, int ci, int any_succ)
+{
+    int32 run, best;
+    int i, k;
+
+    /* Best score for ci in any frame up to and including k, plus
+     * best successor score in frame k, maximized over k. */
+    run = best = WORST_SCORE;
+    for (i = 0, k = pls->hist_idx; i < pls->window; ++i) {
+        int32 succ;
+
+        if (pls->hist[k][ci] BETTER_THAN run)
+            run = pls->hist[k][ci];
+        /* The best phone in each frame has a normalized score of zero. */
+        succ = any_succ ? 0 : pls->succ[k];
+        if (succ != WORST_SCORE && run + succ BETTER_THAN best)
+            best = run + succ;
+        if (++k == pls->window)
+            k = 0;
+    }
+    /* If nothing can follow, this is as bad as it gets. */
+    if (best == WORST_SCORE)
+        best = 2 * pls->beam;
+    return best;
+}
+
+void
+phone_loop_search_rebase(phone_loop_search_t *pls, int n_frames)
+{
+    gnode_t *gn;
+    int i;
+
+    for (i = 0; i < pls->n_phones; ++i) {
+        hmm_t *hmm = (hmm_t *)&pls->phones[i];
+
+        /* Inactive phones stay inactive. */
+        if (hmm_frame(hmm) < n_frames)
+            hmm_frame(hmm) = -1;
+        else
+            hmm_frame(hmm) -= n_frames;
+    }
+    for (gn = pls->renorm; gn; gn = gnode_next(gn)) {
+        phone_loop_renorm_t *rn = gnode_ptr(gn);
+        rn->frame_idx -= n_frames;
+    }
+}
+
 static int
 phone_loop_search_step(ps_search_t *search, int frame_idx)
 {
@@ -291,6 +431,9 @@ phone_loop_search_step(ps_search_t *search, int frame_idx)
     /* Prune phone HMMs. */
     prune_hmms(pls, frame_idx);
 
+    /* Remember normalized phone scores for pair bounds. */
+    update_hist(pls);
+
     /* Do phone transitions. */
     phone_transition(pls, frame_idx);
 
@@ -304,6 +447,90 @@ phone_loop_search_finish(ps_search_t *search)
     return 0;
 }
 
+static int
+phone_loop_search_snapshot(ps_search_t *search, FILE *fh)
+{
+    phone_loop_search_t *pls = (phone_loop_search_t *)search;
+    gnode_t *gn;
+    int i;
+
+    if (snapshot_write_int32(fh, pls->n_phones) < 0)
+        return -1;
+    for (i = 0; i < pls->n_phones; ++i)
+        if (snapshot_write_hmm(fh, &pls->phones[i].hmm) < 0)
+            return -1;
+    if (snapshot_write_int32(fh, pls->best_score) < 0
+        || snapshot_write_int32(fh, pls->best_ci) < 0
+        || snapshot_write_int32(fh, glist_count(pls->renorm)) < 0)
+        return -1;
+    for (gn = pls->renorm; gn; gn = gnode_next(gn)) {
+        phone_loop_renorm_t *rn = gnode_ptr(gn);
+        if (snapshot_write_int32(fh, rn->frame_idx) < 0
+            || snapshot_write_int32(fh, rn->norm) < 0)
+            return -1;
+    }
+    if (snapshot_write_int32(fh, pls->window) < 0
+        || snapshot_write_int32(fh, pls->hist_idx) < 0
+        || snapshot_write(fh, pls->hist[0], sizeof(**pls->hist),
+                          pls->window * pls->n_phones) < 0)
+        return -1;
+    return 0;
+}
+
+static int
+phone_loop_search_restore(ps_search_t *search, FILE *fh)
+{
+    phone_loop_search_t *pls = (phone_loop_search_t *)search;
+    phone_loop_renorm_t *renorm;
+    int32 val, n_renorm;
+    int i;
+
+    if (snapshot_check_int32(fh, pls->n_phones, "number of phones") < 0)
+        return -1;
+    for (i = 0; i < pls->n_phones; ++i)
+        if (snapshot_read_hmm(fh, &pls->phones[i].hmm) < 0)
+            return -1;
+    if (snapshot_read_int32(fh, &pls->best_score) < 0
+        || snapshot_read_int32(fh, &val) < 0
+        || snapshot_read_int32(fh, &n_renorm) < 0)
+        return -1;
+    pls->best_ci = val;
+    if (n_renorm < 0) {
+        E_ERROR("Corrupt snapshot: %d renormalizations\n", n_renorm);
+        return -1;
+    }
+
+    /* The list is newest first, so rebuild it from the end. */
+    phone_loop_search_free_renorm(pls);
+    renorm = ckd_calloc(n_renorm + 1, sizeof(*renorm));
+    for (i = 0; i < n_renorm; ++i) {
+        if (snapshot_read_int32(fh, &renorm[i].frame_idx) < 0
+            || snapshot_read_int32(fh, &renorm[i].norm) < 0) {
+            ckd_free(renorm);
+            return -1;
+        }
+    }
+    for (i = n_renorm - 1; i >= 0; --i) {
+        phone_loop_renorm_t *rn = ckd_calloc(1, sizeof(*rn));
+        *rn = renorm[i];
+        pls->renorm = glist_add_ptr(pls->renorm, rn);
+    }
+    ckd_free(renorm);
+
+    if (snapshot_check_int32(fh, pls->window, "-pl_window") < 0
+        || snapshot_read_int32(fh, &val) < 0)
+        return -1;
+    if (val < 0 || val >= pls->window) {
+        E_ERROR("Corrupt snapshot: phone score history index %d\n", val);
+        return -1;
+    }
+    pls->hist_idx = val;
+    if (snapshot_read(fh, pls->hist[0], sizeof(**pls->hist),
+                      pls->window * pls->n_phones) < 0)
+        return -1;
+    return 0;
+}
+
 static char const *
 phone_loop_search_hyp(ps_search_t *search, int32 *out_score, int32 *out_is_final)
 {
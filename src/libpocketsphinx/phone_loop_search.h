@@ -87,10 +87,17 @@ struct phone_loop_search_s {
     phone_loop_t *phones;   /**< Array of phone arcs. */
 
     int32 best_score;       /**< Best Viterbi score in current frame. */
+    int16 best_ci;          /**< Best phone in current frame. */
     int32 beam;             /**< HMM pruning beam width. */
     int32 pbeam;            /**< Phone exit pruning beam width. */
     int32 pip;              /**< Phone insertion penalty ("language score"). */
     glist_t renorm;         /**< List of renormalizations. */
+
+    int16 window;           /**< Number of frames of phone scores kept. */
+    int16 hist_idx;         /**< Ring index of the oldest frame in hist. */
+    int32 **hist;           /**< Ring of normalized phone scores (window x n_phones). */
+    int32 *succ;            /**< Best successor score in each frame of hist. */
+    uint8 pair;             /**< Use phone-pair lookahead bounds (-pl_pair). */
 };
 typedef struct phone_loop_search_s phone_loop_search_t;
 
@@ -105,4 +112,32 @@ ps_search_t *phone_loop_search_init(cmd_ln_t *config,
     ((pls == NULL) ? 0                                          \
      : (hmm_bestscore(&pls->phones[ci].hmm) - (pls)->best_score))
 
+/**
+ * Clear the set of successor phones used by phone_loop_search_pair_score().
+ */
+void phone_loop_search_succ_reset(phone_loop_search_t *pls);
+
+/**
+ * Add a phone to the set of successor phones.
+ */
+void phone_loop_search_succ_add(phone_loop_search_t *pls, int ci);
+
+/**
+ * Return phone-pair lookahead bound for a specific phone.
+ *
+ * This is the best score, over the lookahead window, of phone @a ci
+ * followed (in the same or a later frame) by any of the phones added
+ * with phone_loop_search_succ_add().  If @a any_succ is TRUE, the
+ * successor set is ignored and the bound is simply the best score
+ * for @a ci over the window.
+ */
+int32 phone_loop_search_pair_score(phone_loop_search_t *pls, int ci,
+                                   int any_succ);
+
+/**
+ * Renumber frames after acmod_rebase() has dropped n_frames frames
+ * from the start of the utterance.
+ */
+void phone_loop_search_rebase(phone_loop_search_t *pls, int n_frames);
+
 #endif /* __PHONE_LOOP_SEARCH_H__ */
@@ -37,6 +37,7 @@
 
 /* System headers. */
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 /* SphinxBase headers. */
@@ -54,6 +55,7 @@
 #include "ngram_search.h"
 #include "ngram_search_fwdtree.h"
 #include "ngram_search_fwdflat.h"
+#include "snapshot.h"
 
 static const arg_t ps_args_def[] = {
     POCKETSPHINX_OPTIONS,
@@ -189,6 +191,14 @@ ps_find_search(ps_decoder_t *ps, char const *name)
     return NULL;
 }
 
+/* The phone loop is only used by the main search for lookahead if a
+ * window is configured; otherwise it is just there for the endpointer. */
+static ps_search_t *
+ps_lookahead(ps_decoder_t *ps)
+{
+    return ps->pl_window ? ps->phone_loop : NULL;
+}
+
 int
 ps_reinit(ps_decoder_t *ps, cmd_ln_t *config)
 {
@@ -238,7 +248,9 @@ ps_reinit(ps_decoder_t *ps, cmd_ln_t *config)
     if ((ps->acmod = acmod_init(ps->config, ps->lmath, NULL, NULL)) == NULL)
         return -1;
 
-    if ((ps->pl_window = cmd_ln_int32_r(ps->config, "-pl_window"))) {
+    ps->pl_window = cmd_ln_int32_r(ps->config, "-pl_window");
+    ps->vad = cmd_ln_boolean_r(ps->config, "-vad");
+    if (ps->pl_window || ps->vad) {
         /* Initialize an auxiliary phone loop search, which will run in
          * "parallel" with FSG or N-Gram search. */
         if ((ps->phone_loop = phone_loop_search_init(ps->config,
@@ -260,7 +272,7 @@ ps_reinit(ps_decoder_t *ps, cmd_ln_t *config)
             return -1;
         if ((fsgs = fsg_search_init(ps->config, ps->acmod, ps->dict, ps->d2p)) == NULL)
             return -1;
-        fsgs->pls = ps->phone_loop;
+        fsgs->pls = ps_lookahead(ps);
         ps->searches = glist_add_ptr(ps->searches, fsgs);
         ps->search = fsgs;
     }
@@ -277,7 +289,7 @@ ps_reinit(ps_decoder_t *ps, cmd_ln_t *config)
             return -1;
         if ((ngs = ngram_search_init(ps->config, ps->acmod, ps->dict, ps->d2p)) == NULL)
             return -1;
-        ngs->pls = ps->phone_loop;
+        ngs->pls = ps_lookahead(ps);
         ps->searches = glist_add_ptr(ps->searches, ngs);
         ps->search = ngs;
     }
@@ -292,6 +304,23 @@ ps_reinit(ps_decoder_t *ps, cmd_ln_t *config)
     ps->perf.name = "decode";
     ptmr_init(&ps->perf);
 
+    /* Initialize real-time governor. */
+    ps->rtf_target = cmd_ln_float32_r(ps->config, "-rtf");
+    ps->beam_scale = 1.0f;
+    ps->rtf_perf.name = "governor";
+    ptmr_init(&ps->rtf_perf);
+
+    /* Initialize endpointer. */
+    ps->vad_autoend = cmd_ln_boolean_r(ps->config, "-vad_autoend");
+    ps->vad_prespeech = cmd_ln_int32_r(ps->config, "-vad_prespeech");
+    if (ps->vad_prespeech < 1)
+        ps->vad_prespeech = 1;
+    ps->vad_postspeech = cmd_ln_int32_r(ps->config, "-vad_postspeech");
+    if (ps->vad_postspeech < 1)
+        ps->vad_postspeech = 1;
+    ps->vad_threshold = cmd_ln_float32_r(ps->config, "-vad_threshold");
+    ps->vad_state = ps->vad ? PS_VAD_SILENCE : PS_VAD_SPEECH;
+
     return 0;
 }
 
@@ -398,7 +427,7 @@ ps_update_lmset(ps_decoder_t *ps, ngram_model_t *lmset)
         search = ngram_search_init(ps->config, ps->acmod, ps->dict, ps->d2p);
         if (search == NULL)
             return NULL;
-        search->pls = ps->phone_loop;
+        search->pls = ps_lookahead(ps);
         ps->searches = glist_add_ptr(ps->searches, search);
         ngs = (ngram_search_t *)search;
     }
@@ -441,7 +470,7 @@ ps_update_fsgset(ps_decoder_t *ps)
                                  ps->acmod, ps->dict, ps->d2p)) == NULL) {
             return NULL;
         }
-        search->pls = ps->phone_loop;
+        search->pls = ps_lookahead(ps);
         ps->searches = glist_add_ptr(ps->searches, search);
     }
     else {
@@ -568,10 +597,14 @@ ps_add_word(ps_decoder_t *ps,
             return -1;
     }
  
-    /* Rebuild the widmap and search tree if requested. */
+    /* Update the widmap and search tree if requested, adding just
+     * this word where the search knows how, otherwise rebuilding. */
     if (update) {
-        if ((rv = ps_search_reinit(ps->search, ps->dict, ps->d2p) < 0))
-            return rv;
+        if (ps->search->vt->add_word == NULL
+            || ps_search_add_word(ps->search, wid) < 0) {
+            if ((rv = ps_search_reinit(ps->search, ps->dict, ps->d2p)) < 0)
+                return rv;
+        }
     }
     return wid;
 }
@@ -616,6 +649,59 @@ ps_decode_raw(ps_decoder_t *ps, FILE *rawfh,
     return total;
 }
 
+/* Number of frames between real-time governor decisions. */
+#define RTF_WINDOW 25
+/* Factor by which beams are narrowed when falling behind. */
+#define RTF_TIGHTEN 0.8f
+/* Beams are only widened again below this fraction of the target. */
+#define RTF_HYSTERESIS 0.7f
+/* Narrowest beams allowed, relative to the configured ones. */
+#define RTF_MIN_SCALE 0.25f
+
+static void
+ps_scale_beams(ps_decoder_t *ps)
+{
+    if (ps->search && ps->search->vt->scale_beams)
+        ps_search_scale_beams(ps->search, ps->beam_scale);
+    if (ps->phone_loop && ps->phone_loop->vt->scale_beams)
+        ps_search_scale_beams(ps->phone_loop, ps->beam_scale);
+}
+
+/*
+ * Compare the time spent searching over the last window of frames to
+ * the target real-time factor, and narrow or widen the beams to suit.
+ */
+static void
+ps_governor_update(ps_decoder_t *ps)
+{
+    float32 rtf, scale;
+
+    if (++ps->rtf_nfr < RTF_WINDOW)
+        return;
+    rtf = ps->rtf_perf.t_tot_elapsed
+        * cmd_ln_int32_r(ps->config, "-frate") / ps->rtf_nfr;
+    scale = ps->beam_scale;
+    if (rtf > ps->rtf_target) {
+        scale *= RTF_TIGHTEN;
+        if (scale < RTF_MIN_SCALE)
+            scale = RTF_MIN_SCALE;
+    }
+    else if (rtf < ps->rtf_target * RTF_HYSTERESIS) {
+        scale /= RTF_TIGHTEN;
+        if (scale > 1.0f)
+            scale = 1.0f;
+    }
+    if (scale != ps->beam_scale) {
+        E_INFO("Search at %.2f xRT (target %.2f), %d senones/frame: "
+               "beam scale %.2f -> %.2f\n", rtf, ps->rtf_target,
+               ps->rtf_nsen / ps->rtf_nfr, ps->beam_scale, scale);
+        ps->beam_scale = scale;
+        ps_scale_beams(ps);
+    }
+    ptmr_reset(&ps->rtf_perf);
+    ps->rtf_nfr = ps->rtf_nsen = 0;
+}
+
 int
 ps_start_utt(ps_decoder_t *ps, char const *uttid)
 {
@@ -630,6 +716,14 @@ ps_start_utt(ps_decoder_t *ps, char const *uttid)
     ptmr_reset(&ps->perf);
     ptmr_start(&ps->perf);
 
+    /* Keep the governor's beams across utterances, but start a new
+     * measurement window. */
+    if (ps->rtf_target > 0) {
+        ptmr_reset(&ps->rtf_perf);
+        ps->rtf_nfr = ps->rtf_nsen = 0;
+        ps_scale_beams(ps);
+    }
+
     if (uttid) {
         ckd_free(ps->uttid);
         ps->uttid = ckd_salloc(uttid);
@@ -697,9 +791,101 @@ ps_start_utt(ps_decoder_t *ps, char const *uttid)
     if (ps->phone_loop)
         ps_search_start(ps->phone_loop);
 
+    /* Wait for speech if the endpointer is enabled. */
+    ps->vad_state = ps->vad ? PS_VAD_SILENCE : PS_VAD_SPEECH;
+    ps->vad_count = 0;
+    ps->vad_floor_set = FALSE;
+    ps->vad_ended_utt = FALSE;
+    ps->search_frame = 0;
+
     return ps_search_start(ps->search);
 }
 
+/* Fraction by which the noise floor follows the energy of frames
+ * above it which are not speech. */
+#define VAD_FLOOR_RATE 0.01f
+
+/*
+ * Drop frames before frame_idx from the utterance, as they are
+ * silence which the main search will never see.
+ */
+static void
+ps_vad_rebase(ps_decoder_t *ps, int frame_idx)
+{
+    if (frame_idx <= 0)
+        return;
+    if (acmod_rebase(ps->acmod, frame_idx) < 0)
+        return;
+    phone_loop_search_rebase((phone_loop_search_t *)ps->phone_loop,
+                             frame_idx);
+}
+
+/*
+ * Classify the frame the phone loop has just searched as speech or
+ * not, and update the endpointer state.  It is speech if the best
+ * phone is not silence or noise, and its energy (if known) is far
+ * enough above the noise floor.
+ */
+static void
+ps_vad_update(ps_decoder_t *ps)
+{
+    phone_loop_search_t *pls = (phone_loop_search_t *)ps->phone_loop;
+    bin_mdef_t *mdef = ps->acmod->mdef;
+    int frame_idx = ps->acmod->output_frame;
+    float32 energy;
+    int speech;
+
+    speech = (pls->best_ci != bin_mdef_silphone(mdef)
+              && bin_mdef_ciphone_str(mdef, pls->best_ci)[0] != '+');
+    if (acmod_frame_energy(ps->acmod, frame_idx, &energy) == 0) {
+        /* The floor drops straight down to quieter frames, and rises
+         * slowly with louder ones that are not speech. */
+        if (!ps->vad_floor_set || energy < ps->vad_floor) {
+            ps->vad_floor = energy;
+            ps->vad_floor_set = TRUE;
+        }
+        else if (!speech)
+            ps->vad_floor += (energy - ps->vad_floor) * VAD_FLOOR_RATE;
+        if (energy < ps->vad_floor + ps->vad_threshold)
+            speech = FALSE;
+    }
+
+    switch (ps->vad_state) {
+    case PS_VAD_SILENCE:
+        ps->vad_count = speech ? ps->vad_count + 1 : 0;
+        /* Nothing before the frame where speech might be starting is
+         * needed, but keep the current frame so the utterance is never
+         * empty. */
+        ps_vad_rebase(ps, frame_idx + 1
+                      - (ps->vad_count ? ps->vad_count : 1));
+        if (ps->vad_count >= ps->vad_prespeech) {
+            E_INFO("Speech starts at frame %d\n", ps->acmod->frame_offset);
+            ps->vad_state = PS_VAD_SPEECH;
+            ps->vad_count = 0;
+        }
+        break;
+    case PS_VAD_SPEECH:
+        ps->vad_count = speech ? 0 : ps->vad_count + 1;
+        if (ps->vad_count >= ps->vad_postspeech) {
+            E_INFO("Speech ends at frame %d\n", ps->acmod->frame_offset
+                   + ps->acmod->output_frame + 1 - ps->vad_count);
+            ps->vad_state = PS_VAD_ENDED;
+            ps->vad_count = 0;
+        }
+        break;
+    case PS_VAD_ENDED:
+        ps->vad_count = speech ? ps->vad_count + 1 : 0;
+        if (ps->vad_count >= ps->vad_prespeech) {
+            E_INFO("Speech starts again at frame %d\n",
+                   ps->acmod->frame_offset + ps->acmod->output_frame
+                   + 1 - ps->vad_count);
+            ps->vad_state = PS_VAD_SPEECH;
+            ps->vad_count = 0;
+        }
+        break;
+    }
+}
+
 static int
 ps_search_forward(ps_decoder_t *ps)
 {
@@ -708,13 +894,29 @@ ps_search_forward(ps_decoder_t *ps)
     nfr = 0;
     while (ps->acmod->n_feat_frame > 0) {
         int k;
+        /* Anything after the end of speech is not part of the
+         * utterance if it is to end there. */
+        if (ps->vad_autoend && ps->vad_state == PS_VAD_ENDED)
+            break;
+        if (ps->rtf_target > 0)
+            ptmr_start(&ps->rtf_perf);
         if (ps->phone_loop)
             if ((k = ps_search_step(ps->phone_loop, ps->acmod->output_frame)) < 0)
                 return k;
-        if (ps->acmod->output_frame >= ps->pl_window)
-            if ((k = ps_search_step(ps->search,
-                                    ps->acmod->output_frame - ps->pl_window)) < 0)
-                return k;
+        if (ps->vad)
+            ps_vad_update(ps);
+        /* The main search does not start until there is speech, then
+         * catches up to the lookahead window. */
+        if (ps->vad_state != PS_VAD_SILENCE) {
+            while (ps->search_frame <= ps->acmod->output_frame - ps->pl_window)
+                if ((k = ps_search_step(ps->search, ps->search_frame++)) < 0)
+                    return k;
+        }
+        if (ps->rtf_target > 0) {
+            ptmr_stop(&ps->rtf_perf);
+            ps->rtf_nsen += ps->acmod->n_senone_active;
+            ps_governor_update(ps);
+        }
         acmod_advance(ps->acmod);
         ++ps->n_frame;
         ++nfr;
@@ -722,6 +924,24 @@ ps_search_forward(ps_decoder_t *ps)
     return nfr;
 }
 
+/*
+ * End the utterance if the endpointer has found the end of speech and
+ * is configured to do so.  Returns 1 if it did, 0 if not.
+ */
+static int
+ps_vad_check_end(ps_decoder_t *ps)
+{
+    int rv;
+
+    if (!ps->vad_autoend || ps->vad_state != PS_VAD_ENDED
+        || ps->vad_ended_utt)
+        return 0;
+    if ((rv = ps_end_utt(ps)) < 0)
+        return rv;
+    ps->vad_ended_utt = TRUE;
+    return 1;
+}
+
 int
 ps_decode_senscr(ps_decoder_t *ps, FILE *senfh,
                  char const *uttid)
@@ -737,6 +957,11 @@ ps_decode_senscr(ps_decoder_t *ps, FILE *senfh,
             return nfr;
         }
         n_searchfr += nfr;
+        if ((nfr = ps_vad_check_end(ps)) != 0) {
+            if (nfr < 0)
+                return nfr;
+            break;
+        }
     }
     ps_end_utt(ps);
     acmod_set_insenfh(ps->acmod, NULL);
@@ -753,6 +978,9 @@ ps_process_raw(ps_decoder_t *ps,
 {
     int n_searchfr = 0;
 
+    /* Ignore data after the endpointer has ended the utterance. */
+    if (ps->vad_ended_utt)
+        return 0;
     if (no_search)
         acmod_set_grow(ps->acmod, TRUE);
 
@@ -770,6 +998,8 @@ ps_process_raw(ps_decoder_t *ps,
         if ((nfr = ps_search_forward(ps)) < 0)
             return nfr;
         n_searchfr += nfr;
+        if ((nfr = ps_vad_check_end(ps)) != 0)
+            return (nfr < 0) ? nfr : n_searchfr;
     }
 
     return n_searchfr;
@@ -784,6 +1014,9 @@ ps_process_cep(ps_decoder_t *ps,
 {
     int n_searchfr = 0;
 
+    /* Ignore data after the endpointer has ended the utterance. */
+    if (ps->vad_ended_utt)
+        return 0;
     if (no_search)
         acmod_set_grow(ps->acmod, TRUE);
 
@@ -801,6 +1034,8 @@ ps_process_cep(ps_decoder_t *ps,
         if ((nfr = ps_search_forward(ps)) < 0)
             return nfr;
         n_searchfr += nfr;
+        if ((nfr = ps_vad_check_end(ps)) != 0)
+            return (nfr < 0) ? nfr : n_searchfr;
     }
 
     return n_searchfr;
@@ -809,9 +1044,16 @@ ps_process_cep(ps_decoder_t *ps,
 int
 ps_end_utt(ps_decoder_t *ps)
 {
-    int rv, i;
+    int rv;
+
+    /* The endpointer may have done this already. */
+    if (ps->vad_ended_utt)
+        return 0;
 
     acmod_end_utt(ps->acmod);
+    /* Drop anything after the end of speech. */
+    if (ps->vad_autoend && ps->vad_state == PS_VAD_ENDED)
+        acmod_truncate(ps->acmod);
 
     /* Search any remaining frames. */
     if ((rv = ps_search_forward(ps)) < 0) {
@@ -825,10 +1067,10 @@ ps_end_utt(ps_decoder_t *ps)
             return rv;
         }
     }
-    /* Search any frames remaining in the lookahead window. */
-    for (i = ps->acmod->output_frame - ps->pl_window;
-         i < ps->acmod->output_frame; ++i)
-        ps_search_step(ps->search, i);
+    /* Search any frames remaining in the lookahead window (or those
+     * kept by the endpointer, if speech never started). */
+    for (; ps->search_frame < ps->acmod->output_frame; ++ps->search_frame)
+        ps_search_step(ps->search, ps->search_frame);
     /* Finish main search. */
     if ((rv = ps_search_finish(ps->search)) < 0) {
         ptmr_stop(&ps->perf);
@@ -862,6 +1104,184 @@ ps_end_utt(ps_decoder_t *ps)
     return rv;
 }
 
+/* Snapshots are written in native byte order, which is checked on
+ * reading. */
+#define PS_SNAPSHOT_MAGIC "PSSNAP2"
+
+int
+ps_snapshot(ps_decoder_t *ps, FILE *fh)
+{
+    acmod_t *acmod = ps->acmod;
+    cmn_t *cmn = acmod->fcb->cmn_struct;
+    int32 cepsize, veclen, in_utt;
+
+    cepsize = feat_cepsize(acmod->fcb);
+    veclen = cmn ? cmn->veclen : 0;
+    in_utt = (acmod->state == ACMOD_STARTED
+              || acmod->state == ACMOD_PROCESSING);
+    if (in_utt) {
+        if (acmod->insenfh) {
+            E_ERROR("Cannot take a snapshot when decoding senone scores\n");
+            return -1;
+        }
+        if (ps->search->vt->snapshot == NULL
+            || (ps->phone_loop && ps->phone_loop->vt->snapshot == NULL)) {
+            E_ERROR("Search %s cannot take a snapshot during an utterance\n",
+                    ps_search_name(ps->search));
+            return -1;
+        }
+    }
+
+    if (snapshot_write(fh, PS_SNAPSHOT_MAGIC, 1, sizeof(PS_SNAPSHOT_MAGIC)) < 0
+        || snapshot_write_int32(fh, BYTE_ORDER_MAGIC) < 0
+        || snapshot_write_int32(fh, cepsize) < 0
+        || snapshot_write_int32(fh, sizeof(mfcc_t)) < 0
+        || snapshot_write_int32(fh, veclen) < 0
+        || snapshot_write_int32(fh, ps->uttno) < 0
+        || snapshot_write_int32(fh, in_utt) < 0)
+        return -1;
+    /* Current CMN state. */
+    if (veclen) {
+        if (snapshot_write(fh, cmn->cmn_mean, sizeof(mfcc_t), veclen) < 0
+            || snapshot_write(fh, cmn->sum, sizeof(mfcc_t), veclen) < 0
+            || snapshot_write_int32(fh, cmn->nframe) < 0)
+            return -1;
+    }
+    if (!in_utt)
+        return 0;
+
+    /* Utterance ID and the decoder's own state, followed by that of
+     * the acoustic model and the searches. */
+    if (snapshot_write_int32(fh, strlen(ps->uttid)) < 0
+        || snapshot_write(fh, ps->uttid, 1, strlen(ps->uttid)) < 0
+        || snapshot_write_int32(fh, ps->n_frame) < 0
+        || snapshot_write_int32(fh, ps->search_frame) < 0
+        || snapshot_write_int32(fh, ps->vad_state) < 0
+        || snapshot_write_int32(fh, ps->vad_count) < 0
+        || snapshot_write_int32(fh, ps->vad_floor_set) < 0
+        || snapshot_write_int32(fh, ps->vad_ended_utt) < 0
+        || snapshot_write(fh, &ps->vad_floor, sizeof(ps->vad_floor), 1) < 0
+        || snapshot_write(fh, &ps->beam_scale, sizeof(ps->beam_scale), 1) < 0
+        || acmod_snapshot(acmod, fh) < 0
+        || snapshot_write_int32(fh, ps->phone_loop != NULL) < 0)
+        return -1;
+    if (ps->phone_loop && ps_search_snapshot(ps->phone_loop, fh) < 0)
+        return -1;
+    return ps_search_snapshot(ps->search, fh);
+}
+
+static void
+ps_restore_cmn(ps_decoder_t *ps, mfcc_t const *cmnbuf, int32 nframe)
+{
+    cmn_t *cmn = ps->acmod->fcb->cmn_struct;
+
+    memcpy(cmn->cmn_mean, cmnbuf, cmn->veclen * sizeof(mfcc_t));
+    memcpy(cmn->sum, cmnbuf + cmn->veclen, cmn->veclen * sizeof(mfcc_t));
+    cmn->nframe = nframe;
+}
+
+int
+ps_restore(ps_decoder_t *ps, FILE *fh)
+{
+    acmod_t *acmod = ps->acmod;
+    cmn_t *cmn = acmod->fcb->cmn_struct;
+    char magic[sizeof(PS_SNAPSHOT_MAGIC)];
+    int32 byteorder, cepsize, mfcsize, veclen, uttno, in_utt, nframe;
+    int32 len, n_frame, vad_state, vad_floor_set, vad_ended_utt, has_pl;
+    mfcc_t *cmnbuf = NULL;
+    char *uttid = NULL;
+    int rv = -1;
+
+    if (snapshot_read(fh, magic, 1, sizeof(magic)) < 0
+        || snapshot_read_int32(fh, &byteorder) < 0
+        || snapshot_read_int32(fh, &cepsize) < 0
+        || snapshot_read_int32(fh, &mfcsize) < 0
+        || snapshot_read_int32(fh, &veclen) < 0
+        || snapshot_read_int32(fh, &uttno) < 0
+        || snapshot_read_int32(fh, &in_utt) < 0)
+        return -1;
+    if (memcmp(magic, PS_SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+        E_ERROR("Not a decoder snapshot\n");
+        return -1;
+    }
+    if (byteorder != BYTE_ORDER_MAGIC) {
+        E_ERROR("Snapshot was written with a different byte order\n");
+        return -1;
+    }
+    if (cepsize != feat_cepsize(acmod->fcb) || mfcsize != sizeof(mfcc_t)
+        || veclen != (cmn ? cmn->veclen : 0)) {
+        E_ERROR("Snapshot does not match the decoder's feature parameters\n");
+        return -1;
+    }
+
+    if (veclen) {
+        cmnbuf = ckd_calloc(2 * veclen, sizeof(*cmnbuf));
+        if (snapshot_read(fh, cmnbuf, sizeof(*cmnbuf), 2 * veclen) < 0
+            || snapshot_read_int32(fh, &nframe) < 0)
+            goto error_out;
+    }
+    if (!in_utt) {
+        if (veclen)
+            ps_restore_cmn(ps, cmnbuf, nframe);
+        ps->uttno = uttno;
+        ckd_free(cmnbuf);
+        return 0;
+    }
+
+    if (snapshot_read_int32(fh, &len) < 0 || len < 0)
+        goto error_out;
+    uttid = ckd_calloc(len + 1, 1);
+    if (snapshot_read(fh, uttid, 1, len) < 0)
+        goto error_out;
+    if (ps->search->vt->restore == NULL
+        || (ps->phone_loop && ps->phone_loop->vt->restore == NULL)) {
+        E_ERROR("Search %s cannot restore a snapshot during an utterance\n",
+                ps_search_name(ps->search));
+        goto error_out;
+    }
+
+    /* Start an utterance to reset everything that is not saved, then
+     * overwrite the rest with the snapshot. */
+    if (ps_start_utt(ps, uttid) < 0)
+        goto error_out;
+    ps->uttno = uttno;
+    if (veclen)
+        ps_restore_cmn(ps, cmnbuf, nframe);
+    if (snapshot_read_int32(fh, &n_frame) < 0
+        || snapshot_read_int32(fh, &ps->search_frame) < 0
+        || snapshot_read_int32(fh, &vad_state) < 0
+        || snapshot_read_int32(fh, &ps->vad_count) < 0
+        || snapshot_read_int32(fh, &vad_floor_set) < 0
+        || snapshot_read_int32(fh, &vad_ended_utt) < 0
+        || snapshot_read(fh, &ps->vad_floor, sizeof(ps->vad_floor), 1) < 0
+        || snapshot_read(fh, &ps->beam_scale, sizeof(ps->beam_scale), 1) < 0
+        || acmod_restore(acmod, fh) < 0
+        || snapshot_read_int32(fh, &has_pl) < 0)
+        goto error_out;
+    ps->n_frame = n_frame;
+    ps->vad_state = vad_state;
+    ps->vad_floor_set = vad_floor_set;
+    ps->vad_ended_utt = vad_ended_utt;
+    if (has_pl != (ps->phone_loop != NULL)) {
+        E_ERROR("Snapshot does not match the decoder's phone loop search\n");
+        goto error_out;
+    }
+    if (ps->phone_loop && ps_search_restore(ps->phone_loop, fh) < 0)
+        goto error_out;
+    if (ps_search_restore(ps->search, fh) < 0)
+        goto error_out;
+    /* Apply the governor's beams as they were when the snapshot was
+     * taken. */
+    if (ps->rtf_target > 0)
+        ps_scale_beams(ps);
+    rv = 0;
+
+error_out:
+    ckd_free(cmnbuf);
+    ckd_free(uttid);
+    return rv;
+}
+
 char const *
 ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score, char const **out_uttid)
 {
@@ -1030,6 +1450,18 @@ ps_get_n_frames(ps_decoder_t *ps)
     return ps->acmod->output_frame + 1;
 }
 
+ps_vad_state_t
+ps_get_vad_state(ps_decoder_t *ps)
+{
+    return ps->vad_state;
+}
+
+int
+ps_get_vad_offset(ps_decoder_t *ps)
+{
+    return ps->acmod->frame_offset;
+}
+
 void
 ps_get_utt_time(ps_decoder_t *ps, double *out_nspeech,
                 double *out_ncpu, double *out_nwall)
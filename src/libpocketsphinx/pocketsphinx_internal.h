@@ -72,12 +72,30 @@ typedef struct ps_searchfuncs_s {
     int (*step)(ps_search_t *search, int frame_idx);
     int (*finish)(ps_search_t *search);
     int (*reinit)(ps_search_t *search, dict_t *dict, dict2pid_t *d2p);
+    /**
+     * Add a single word (already in the dictionary and dict2pid) to
+     * the search structures without rebuilding them.  May be NULL,
+     * or may return <0 to ask for a full reinit instead.
+     */
+    int (*add_word)(ps_search_t *search, int32 wid);
     void (*free)(ps_search_t *search);
 
     ps_lattice_t *(*lattice)(ps_search_t *search);
     char const *(*hyp)(ps_search_t *search, int32 *out_score, int32 *out_is_final);
     int32 (*prob)(ps_search_t *search);
     ps_seg_t *(*seg_iter)(ps_search_t *search, int32 *out_score);
+    /**
+     * Scale all pruning beams by a factor in (0,1] relative to their
+     * configured widths.  May be NULL if the search has no beams.
+     */
+    int (*scale_beams)(ps_search_t *search, float32 scale);
+    /**
+     * Write the state of the search in the middle of an utterance to
+     * a file, or read it back into a search which has just been
+     * started.  May be NULL if the search cannot save its state.
+     */
+    int (*snapshot)(ps_search_t *search, FILE *fh);
+    int (*restore)(ps_search_t *search, FILE *fh);
 } ps_searchfuncs_t;
 
 /**
@@ -119,11 +137,15 @@ struct ps_search_s {
 #define ps_search_step(s,i) (*(ps_search_base(s)->vt->step))(s,i)
 #define ps_search_finish(s) (*(ps_search_base(s)->vt->finish))(s)
 #define ps_search_reinit(s,d,d2p) (*(ps_search_base(s)->vt->reinit))(s,d,d2p)
+#define ps_search_add_word(s,w) (*(ps_search_base(s)->vt->add_word))(s,w)
 #define ps_search_free(s) (*(ps_search_base(s)->vt->free))(s)
 #define ps_search_lattice(s) (*(ps_search_base(s)->vt->lattice))(s)
 #define ps_search_hyp(s,sc,final) (*(ps_search_base(s)->vt->hyp))(s,sc,final)
 #define ps_search_prob(s) (*(ps_search_base(s)->vt->prob))(s)
 #define ps_search_seg_iter(s,sc) (*(ps_search_base(s)->vt->seg_iter))(s,sc)
+#define ps_search_scale_beams(s,f) (*(ps_search_base(s)->vt->scale_beams))(s,f)
+#define ps_search_snapshot(s,fh) (*(ps_search_base(s)->vt->snapshot))(s,fh)
+#define ps_search_restore(s,fh) (*(ps_search_base(s)->vt->restore))(s,fh)
 
 /* For convenience... */
 #define ps_search_silence_wid(s) ps_search_base(s)->silence_wid
@@ -195,7 +217,7 @@ struct ps_decoder_s {
     /* TODO: Convert this to a stack of searches each with their own
      * lookahead value. */
     ps_search_t *search;     /**< Currently active search module. */
-    ps_search_t *phone_loop; /**< Phone loop search for lookahead. */
+    ps_search_t *phone_loop; /**< Phone loop search for lookahead or endpointing. */
     int pl_window;           /**< Window size for phoneme lookahead. */
 
     /* Utterance-processing related stuff. */
@@ -203,6 +225,27 @@ struct ps_decoder_s {
     char *uttid;        /**< Utterance ID for current utterance. */
     ptmr_t perf;        /**< Performance counter for all of decoding. */
     uint32 n_frame;     /**< Total number of frames processed. */
+    int32 search_frame; /**< Next frame to be searched by the main search. */
+
+    /* Real-time governor. */
+    float32 rtf_target; /**< Target real-time factor, or 0 if disabled. */
+    float32 beam_scale; /**< Scale currently applied to search beams. */
+    ptmr_t rtf_perf;    /**< Search time over the current window. */
+    int32 rtf_nfr;      /**< Frames searched in the current window. */
+    int32 rtf_nsen;     /**< Senones scored in the current window. */
+
+    /* Endpointer. */
+    uint8 vad;               /**< Detect the start and end of speech? */
+    uint8 vad_autoend;       /**< End the utterance at the end of speech? */
+    uint8 vad_ended_utt;     /**< Utterance was ended by the endpointer. */
+    uint8 vad_floor_set;     /**< Has the noise floor been estimated yet? */
+    ps_vad_state_t vad_state; /**< Current endpointer state. */
+    int32 vad_count;         /**< Frames counted towards a change of state. */
+    int32 vad_prespeech;     /**< Frames of speech needed to start speech. */
+    int32 vad_postspeech;    /**< Frames of silence needed to end speech. */
+    float32 vad_threshold;   /**< Energy above the noise floor for speech. */
+    float32 vad_floor;       /**< Noise floor estimate (C0). */
+
     char const *mfclogdir; /**< Log directory for MFCC files. */
     char const *rawlogdir; /**< Log directory for audio files. */
     char const *senlogdir; /**< Log directory for senone score files. */
@@ -50,6 +50,7 @@
 #include <sphinxbase/strfuncs.h>
 #include <sphinxbase/err.h>
 #include <sphinxbase/pio.h>
+#include <sphinxbase/mmio.h>
 
 /* Local headers. */
 #include "pocketsphinx_internal.h"
@@ -67,6 +68,8 @@ ps_lattice_link(ps_lattice_t *dag, ps_latnode_t *from, ps_latnode_t *to,
 {
     latlink_list_t *fwdlink;
 
+    ps_lattice_invalidate(dag);
+
     /* Look for an existing link between "from" and "to" nodes */
     for (fwdlink = from->exits; fwdlink; fwdlink = fwdlink->next)
         if (fwdlink->link->to == to)
@@ -102,6 +105,66 @@ ps_lattice_link(ps_lattice_t *dag, ps_latnode_t *from, ps_latnode_t *to,
     }           
 }
 
+void
+ps_lattice_invalidate(ps_lattice_t *dag)
+{
+    ckd_free(dag->link_order);
+    dag->link_order = NULL;
+    dag->n_link_order = 0;
+    dag->post_valid = FALSE;
+}
+
+int32
+ps_lattice_sort_links(ps_lattice_t *dag)
+{
+    ps_latnode_t *node;
+    latlink_list_t *x;
+    int32 n_links, head, tail;
+
+    if (dag->link_order)
+        return dag->n_link_order;
+
+    /* Initialize node fanin counts. */
+    n_links = 0;
+    for (node = dag->nodes; node; node = node->next)
+        node->info.fanin = 0;
+    for (node = dag->nodes; node; node = node->next) {
+        for (x = node->exits; x; x = x->next) {
+            (x->link->to->info.fanin)++;
+            ++n_links;
+        }
+    }
+    dag->link_order = ckd_calloc(n_links + 1, sizeof(*dag->link_order));
+
+    /* Seed the queue with all exits from start, then (for robustness)
+     * exits from any other nodes without predecessors. */
+    tail = 0;
+    for (x = dag->start->exits; x; x = x->next)
+        dag->link_order[tail++] = x->link;
+    for (node = dag->nodes; node; node = node->next) {
+        if (node == dag->start || node->info.fanin != 0)
+            continue;
+        for (x = node->exits; x; x = x->next)
+            dag->link_order[tail++] = x->link;
+    }
+
+    /* The array itself is the queue: extend a node's exits once all
+     * of its entries have been seen. */
+    for (head = 0; head < tail; ++head) {
+        ps_latnode_t *to = dag->link_order[head]->to;
+        if (--to->info.fanin == 0) {
+            for (x = to->exits; x; x = x->next)
+                dag->link_order[tail++] = x->link;
+        }
+    }
+    if (tail < n_links)
+        E_WARN("%d of %d lattice links are in cycles, ignoring them\n",
+               n_links - tail, n_links);
+    dag->n_link_order = tail;
+
+    return tail;
+}
+
 void
 ps_lattice_bypass_fillers(ps_lattice_t *dag, int32 silpen, int32 fillpen)
 {
@@ -199,6 +262,8 @@ ps_lattice_delete_unreachable(ps_lattice_t *dag)
     ps_latnode_t *node, *prev_node, *next_node;
     int i;
 
+    ps_lattice_invalidate(dag);
+
     /* Remove unreachable nodes from the list of nodes. */
     prev_node = NULL;
     for (node = dag->nodes; node; node = next_node) {
@@ -369,6 +434,147 @@ ps_lattice_write_htk(ps_lattice_t *dag, char const *filename)
     return 0;
 }
 
+/*
+ * Binary lattice format.
+ *
+ * All integers are stored as variable-length (LEB128) unsigned
+ * quantities, with signed ones zig-zag encoded first, so the file is
+ * independent of byte order and word size.  The layout is:
+ *
+ *   "PSLATBIN"                          magic (8 bytes)
+ *   version
+ *   logbase                             IEEE double, little-endian (8 bytes)
+ *   n_frames
+ *   n_words { length, bytes }           string table of word strings
+ *   n_nodes { word, sf, fef-sf, lef-fef, node_id }
+ *   start, end                          node indices
+ *   n_links { from-prev_from, to-from, ascr, ef-(to->sf-1) }
+ *
+ * Links are written in order of their source node, so the source
+ * index is stored as a (non-negative) delta.
+ */
+#define LATBIN_MAGIC "PSLATBIN"
+#define LATBIN_MAGIC_LEN 8
+#define LATBIN_VERSION 1
+
+#define ZIGZAG_ENC(x) (((uint32)(x) << 1) ^ (uint32)((int32)(x) >> 31))
+#define ZIGZAG_DEC(x) ((int32)(((x) >> 1) ^ -(int32)((x) & 1)))
+
+static void
+latbin_put_uint(FILE *fp, uint32 val)
+{
+    while (val >= 0x80) {
+        putc((val & 0x7f) | 0x80, fp);
+        val >>= 7;
+    }
+    putc(val, fp);
+}
+
+static void
+latbin_put_int(FILE *fp, int32 val)
+{
+    latbin_put_uint(fp, ZIGZAG_ENC(val));
+}
+
+static int
+latbin_link_valid(ps_latlink_t *link)
+{
+    return !(link->ascr WORSE_THAN WORST_SCORE || link->ascr BETTER_THAN 0);
+}
+
+int32
+ps_lattice_write_bin(ps_lattice_t *dag, char const *filename)
+{
+    FILE *fp;
+    ps_latnode_t *d;
+    hash_table_t *wordidx;
+    char const **words;
+    int32 i, n_nodes, n_words, n_links, prev_from;
+    union {
+        float64 f;
+        uint64 u;
+    } lb;
+
+    E_INFO("Writing binary lattice file: %s\n", filename);
+    if ((fp = fopen(filename, "wb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open lattice file '%s' for writing", filename);
+        return -1;
+    }
+
+    /* Number the nodes, build the string table and count links. */
+    for (n_nodes = n_links = 0, d = dag->nodes; d; d = d->next)
+        ++n_nodes;
+    wordidx = hash_table_new(n_nodes, HASH_CASE_YES);
+    words = ckd_calloc(n_nodes, sizeof(*words));
+    for (n_words = 0, i = 0, d = dag->nodes; d; d = d->next, i++) {
+        latlink_list_t *l;
+        char const *wstr = dict_wordstr(dag->dict, d->wid);
+        int32 widx;
+
+        d->id = i;
+        if (hash_table_lookup_int32(wordidx, wstr, &widx) < 0) {
+            hash_table_enter_int32(wordidx, wstr, n_words);
+            words[n_words++] = wstr;
+        }
+        for (l = d->exits; l; l = l->next)
+            if (latbin_link_valid(l->link))
+                ++n_links;
+    }
+
+    fwrite(LATBIN_MAGIC, 1, LATBIN_MAGIC_LEN, fp);
+    latbin_put_uint(fp, LATBIN_VERSION);
+    lb.f = logmath_get_base(dag->lmath);
+    for (i = 0; i < 8; ++i)
+        putc((int)((lb.u >> (i * 8)) & 0xff), fp);
+    latbin_put_uint(fp, dag->n_frames);
+
+    latbin_put_uint(fp, n_words);
+    for (i = 0; i < n_words; ++i) {
+        size_t len = strlen(words[i]);
+        latbin_put_uint(fp, len);
+        fwrite(words[i], 1, len, fp);
+    }
+
+    latbin_put_uint(fp, n_nodes);
+    for (d = dag->nodes; d; d = d->next) {
+        int32 widx;
+
+        hash_table_lookup_int32(wordidx, dict_wordstr(dag->dict, d->wid), &widx);
+        latbin_put_uint(fp, widx);
+        latbin_put_int(fp, d->sf);
+        latbin_put_int(fp, d->fef - d->sf);
+        latbin_put_int(fp, d->lef - d->fef);
+        latbin_put_int(fp, d->node_id);
+    }
+    latbin_put_uint(fp, dag->start->id);
+    latbin_put_uint(fp, dag->end->id);
+
+    latbin_put_uint(fp, n_links);
+    prev_from = 0;
+    for (d = dag->nodes; d; d = d->next) {
+        latlink_list_t *l;
+        for (l = d->exits; l; l = l->next) {
+            ps_latlink_t *link = l->link;
+            if (!latbin_link_valid(link))
+                continue;
+            latbin_put_uint(fp, d->id - prev_from);
+            latbin_put_int(fp, link->to->id - d->id);
+            latbin_put_int(fp, link->ascr);
+            latbin_put_int(fp, link->ef - (link->to->sf - 1));
+            prev_from = d->id;
+        }
+    }
+
+    hash_table_free(wordidx);
+    ckd_free(words);
+    if (fclose(fp) != 0) {
+        E_ERROR_SYSTEM("Failed to write lattice file '%s'", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
 /* Read parameter from a lattice file*/
 static int
 dag_param_read(lineiter_t *li, char *param)
@@ -406,6 +612,302 @@ dag_mark_reachable(ps_latnode_t * d)
             dag_mark_reachable(l->link->from);
 }
 
+/* Find (or, for standalone lattices, create) the word ID for a word string. */
+static int32
+dag_word_id(ps_lattice_t *dag, char const *wd)
+{
+    int32 w;
+
+    w = dict_wordid(dag->dict, wd);
+    if (w < 0 && dag->search == NULL) {
+        char *ww = ckd_salloc(wd);
+        if (dict_word2basestr(ww) != -1) {
+            if (dict_wordid(dag->dict, ww) == BAD_S3WID)
+                dict_add_word(dag->dict, ww, NULL, 0);
+        }
+        ckd_free(ww);
+        w = dict_add_word(dag->dict, wd, NULL, 0);
+    }
+    return w;
+}
+
+/* Common post-processing for lattices read from disk. */
+static ps_lattice_t *
+dag_read_finish(ps_lattice_t *dag, ps_decoder_t *ps)
+{
+    int32 pip, silpen, fillpen;
+
+    /* Minor hack: If the final node is a filler word and not </s>,
+     * then set its base word ID to </s>, so that the language model
+     * scores won't be screwed up. */
+    if (dict_filler_word(dag->dict, dag->end->wid))
+        dag->end->basewid = dag->search
+            ? ps_search_finish_wid(dag->search)
+            : dict_wordid(dag->dict, S3_FINISH_WORD);
+
+    /* Mark reachable from dag->end */
+    dag_mark_reachable(dag->end);
+
+    /* Free nodes unreachable from dag->end and their links */
+    ps_lattice_delete_unreachable(dag);
+
+    if (ps) {
+        /* Build links around silence and filler words, since they do
+         * not exist in the language model.  FIXME: This is
+         * potentially buggy, as we already do this before outputing
+         * lattices. */
+        pip = logmath_log(dag->lmath, cmd_ln_float32_r(ps->config, "-pip"));
+        silpen = pip + logmath_log(dag->lmath,
+                                   cmd_ln_float32_r(ps->config, "-silprob"));
+        fillpen = pip + logmath_log(dag->lmath,
+                                    cmd_ln_float32_r(ps->config, "-fillprob"));
+        ps_lattice_bypass_fillers(dag, silpen, fillpen);
+    }
+
+    return dag;
+}
+
+/* Cursor over an in-memory binary lattice. */
+typedef struct latbin_reader_s {
+    uint8 const *ptr;
+    uint8 const *end;
+    int err;
+} latbin_reader_t;
+
+static uint32
+latbin_get_uint(latbin_reader_t *r)
+{
+    uint32 val = 0;
+    int shift = 0;
+
+    while (r->ptr < r->end && shift <= 28) {
+        uint8 b = *r->ptr++;
+        val |= (uint32)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return val;
+        shift += 7;
+    }
+    r->err = TRUE;
+    return 0;
+}
+
+static int32
+latbin_get_int(latbin_reader_t *r)
+{
+    uint32 val = latbin_get_uint(r);
+    return ZIGZAG_DEC(val);
+}
+
+static int
+latbin_is_binary(char const *file)
+{
+    FILE *fp;
+    char magic[LATBIN_MAGIC_LEN];
+    int rv;
+
+    if ((fp = fopen(file, "rb")) == NULL)
+        return FALSE;
+    rv = (fread(magic, 1, LATBIN_MAGIC_LEN, fp) == LATBIN_MAGIC_LEN
+          && 0 == memcmp(magic, LATBIN_MAGIC, LATBIN_MAGIC_LEN));
+    fclose(fp);
+    return rv;
+}
+
+static ps_lattice_t *
+ps_lattice_read_bin(ps_lattice_t *dag, ps_decoder_t *ps, char const *file)
+{
+    FILE *fp;
+    mmio_file_t *filemap;
+    uint8 *data;
+    latbin_reader_t r;
+    long len;
+    int do_mmap;
+    float32 logratio;
+    int32 *wids;
+    ps_latnode_t **darray;
+    ps_latnode_t *tail;
+    uint32 i, n_words, n_nodes, n_links, k;
+    int32 from;
+    union {
+        float64 f;
+        uint64 u;
+    } lb;
+
+    E_INFO("Reading binary DAG file: %s\n", file);
+    filemap = NULL;
+    data = NULL;
+    wids = NULL;
+    darray = NULL;
+    if ((fp = fopen(file, "rb")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open DAG file '%s' for reading", file);
+        goto load_error;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    /* Decide whether to read in the whole file or mmap it. */
+    do_mmap = ps ? cmd_ln_boolean_r(ps->config, "-mmap") : TRUE;
+    if (do_mmap) {
+        filemap = mmio_file_read(file);
+        if (filemap == NULL)
+            do_mmap = FALSE;
+    }
+    if (do_mmap) {
+        r.ptr = mmio_file_ptr(filemap);
+    }
+    else {
+        data = ckd_malloc(len);
+        if (fread(data, 1, len, fp) != (size_t)len) {
+            E_ERROR_SYSTEM("Failed to read %ld bytes from %s", len, file);
+            fclose(fp);
+            goto load_error;
+        }
+        r.ptr = data;
+    }
+    fclose(fp);
+    r.end = r.ptr + len;
+    r.err = FALSE;
+
+    /* Header. */
+    r.ptr += LATBIN_MAGIC_LEN;
+    if ((k = latbin_get_uint(&r)) > LATBIN_VERSION) {
+        E_ERROR("Binary lattice version %d for %s is newer than library\n",
+                k, file);
+        goto load_error;
+    }
+    if (r.end - r.ptr < 8) {
+        E_ERROR("Premature EOF(%s)\n", file);
+        goto load_error;
+    }
+    for (lb.u = 0, i = 0; i < 8; ++i)
+        lb.u |= (uint64)*r.ptr++ << (i * 8);
+    logratio = 1.0f;
+    if (fabs(lb.f - logmath_get_base(dag->lmath)) >= 0.0001) {
+        float32 pb = logmath_get_base(dag->lmath);
+        E_WARN("Inconsistent logbases: %f vs %f: will compensate\n", lb.f, pb);
+        logratio = (float32)(log(lb.f) / log(pb));
+        E_INFO("Lattice log ratio: %f\n", logratio);
+    }
+    dag->n_frames = latbin_get_uint(&r);
+    if (r.err || dag->n_frames <= 0) {
+        E_ERROR("Frames parameter missing or invalid\n");
+        goto load_error;
+    }
+
+    /* String table. */
+    n_words = latbin_get_uint(&r);
+    if (r.err || n_words == 0) {
+        E_ERROR("Word table missing or invalid\n");
+        goto load_error;
+    }
+    wids = ckd_calloc(n_words, sizeof(*wids));
+    for (i = 0; i < n_words; ++i) {
+        char *wd;
+
+        k = latbin_get_uint(&r);
+        if (r.err || k > (uint32)(r.end - r.ptr)) {
+            E_ERROR("Premature EOF while loading words(%s)\n", file);
+            goto load_error;
+        }
+        wd = ckd_malloc(k + 1);
+        memcpy(wd, r.ptr, k);
+        wd[k] = '\0';
+        r.ptr += k;
+        if ((wids[i] = dag_word_id(dag, wd)) < 0) {
+            E_ERROR("Unknown word: %s\n", wd);
+            ckd_free(wd);
+            goto load_error;
+        }
+        ckd_free(wd);
+    }
+
+    /* Nodes. */
+    n_nodes = latbin_get_uint(&r);
+    if (r.err || n_nodes == 0) {
+        E_ERROR("Nodes parameter missing or invalid\n");
+        goto load_error;
+    }
+    darray = ckd_calloc(n_nodes, sizeof(*darray));
+    tail = NULL;
+    for (i = 0; i < n_nodes; ++i) {
+        ps_latnode_t *d;
+
+        if ((k = latbin_get_uint(&r)) >= n_words) {
+            E_ERROR("Invalid word index %d for node %d\n", k, i);
+            goto load_error;
+        }
+        d = listelem_malloc(dag->latnode_alloc);
+        memset(d, 0, sizeof(*d));
+        darray[i] = d;
+        d->id = i;
+        d->wid = wids[k];
+        d->basewid = dict_basewid(dag->dict, d->wid);
+        d->sf = latbin_get_int(&r);
+        d->fef = d->sf + latbin_get_int(&r);
+        d->lef = d->fef + latbin_get_int(&r);
+        d->node_id = latbin_get_int(&r);
+
+        if (!dag->nodes)
+            dag->nodes = d;
+        else
+            tail->next = d;
+        tail = d;
+    }
+    if ((k = latbin_get_uint(&r)) >= n_nodes) {
+        E_ERROR("Initial node parameter missing or invalid\n");
+        goto load_error;
+    }
+    dag->start = darray[k];
+    if ((k = latbin_get_uint(&r)) >= n_nodes) {
+        E_ERROR("Final node parameter missing or invalid\n");
+        goto load_error;
+    }
+    dag->end = darray[k];
+
+    /* Links. */
+    n_links = latbin_get_uint(&r);
+    from = 0;
+    for (i = 0; i < n_links && !r.err; ++i) {
+        int32 to, ascr, ef;
+
+        from += latbin_get_uint(&r);
+        to = from + latbin_get_int(&r);
+        ascr = latbin_get_int(&r);
+        ef = latbin_get_int(&r);
+        if (from < 0 || (uint32)from >= n_nodes
+            || to < 0 || (uint32)to >= n_nodes) {
+            E_ERROR("Invalid edge %d -> %d\n", from, to);
+            goto load_error;
+        }
+        if (logratio != 1.0f)
+            ascr = (int32)(ascr * logratio);
+        ps_lattice_link(dag, darray[from], darray[to], ascr,
+                        darray[to]->sf - 1 + ef);
+    }
+    if (r.err) {
+        E_ERROR("Premature EOF while loading edges(%s)\n", file);
+        goto load_error;
+    }
+
+    if (filemap)
+        mmio_file_unmap(filemap);
+    ckd_free(data);
+    ckd_free(wids);
+    ckd_free(darray);
+    return dag_read_finish(dag, ps);
+
+  load_error:
+    E_ERROR("Failed to load %s\n", file);
+    if (filemap)
+        mmio_file_unmap(filemap);
+    ckd_free(data);
+    ckd_free(wids);
+    ckd_free(darray);
+    ps_lattice_free(dag);
+    return NULL;
+}
+
 ps_lattice_t *
 ps_lattice_read(ps_decoder_t *ps,
                 char const *file)
@@ -419,7 +921,6 @@ ps_lattice_read(ps_decoder_t *ps,
     ps_latnode_t **darray;
     ps_lattice_t *dag;
     int i, k, n_nodes;
-    int32 pip, silpen, fillpen;
 
     dag = ckd_calloc(1, sizeof(*dag));
 
@@ -443,6 +944,9 @@ ps_lattice_read(ps_decoder_t *ps,
     tail = NULL;
     darray = NULL;
 
+    if (latbin_is_binary(file))
+        return ps_lattice_read_bin(dag, ps, file);
+
     E_INFO("Reading DAG file: %s\n", file);
     if ((fp = fopen_compchk(file, &ispipe)) == NULL) {
         E_ERROR_SYSTEM("Failed to open DAG file '%s' for reading", file);
@@ -512,21 +1016,9 @@ ps_lattice_read(ps_decoder_t *ps,
             goto load_error;
         }
 
-        w = dict_wordid(dag->dict, wd);
-        if (w < 0) {
-            if (dag->search == NULL) {
-                char *ww = ckd_salloc(wd);
-                if (dict_word2basestr(ww) != -1) {
-                    if (dict_wordid(dag->dict, ww) == BAD_S3WID)
-                        dict_add_word(dag->dict, ww, NULL, 0);
-                }
-                ckd_free(ww);
-                w = dict_add_word(dag->dict, wd, NULL, 0);
-            }
-            if (w < 0) {
-                E_ERROR("Unknown word in line: %s\n", line->buf);
-                goto load_error;
-            }
+        if ((w = dag_word_id(dag, wd)) < 0) {
+            E_ERROR("Unknown word in line: %s\n", line->buf);
+            goto load_error;
         }
 
         if (seqid != i) {
@@ -615,34 +1107,7 @@ ps_lattice_read(ps_decoder_t *ps,
     fclose_comp(fp, ispipe);
     ckd_free(darray);
 
-    /* Minor hack: If the final node is a filler word and not </s>,
-     * then set its base word ID to </s>, so that the language model
-     * scores won't be screwed up. */
-    if (dict_filler_word(dag->dict, dag->end->wid))
-        dag->end->basewid = dag->search
-            ? ps_search_finish_wid(dag->search)
-            : dict_wordid(dag->dict, S3_FINISH_WORD);
-
-    /* Mark reachable from dag->end */
-    dag_mark_reachable(dag->end);
-
-    /* Free nodes unreachable from dag->end and their links */
-    ps_lattice_delete_unreachable(dag);
-
-    if (ps) {
-        /* Build links around silence and filler words, since they do
-         * not exist in the language model.  FIXME: This is
-         * potentially buggy, as we already do this before outputing
-         * lattices. */
-        pip = logmath_log(dag->lmath, cmd_ln_float32_r(ps->config, "-pip"));
-        silpen = pip + logmath_log(dag->lmath,
-                                   cmd_ln_float32_r(ps->config, "-silprob"));
-        fillpen = pip + logmath_log(dag->lmath,
-                                    cmd_ln_float32_r(ps->config, "-fillprob"));
-        ps_lattice_bypass_fillers(dag, silpen, fillpen);
-    }
-
-    return dag;
+    return dag_read_finish(dag, ps);
 
   load_error:
     E_ERROR("Failed to load %s\n", file);
@@ -696,6 +1161,7 @@ ps_lattice_free(ps_lattice_t *dag)
     listelem_alloc_free(dag->latnode_alloc);
     listelem_alloc_free(dag->latlink_alloc);
     listelem_alloc_free(dag->latlink_list_alloc);    
+    ckd_free(dag->link_order);
     ckd_free(dag->hyp_str);
     ckd_free(dag);
     return 0;
@@ -1244,10 +1710,12 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
     ps_latlink_t *bestend;
     latlink_list_t *x;
     logmath_t *lmath;
-    int32 bestescr;
+    int32 bestescr, i;
 
     search = dag->search;
     lmath = dag->lmath;
+    /* Alphas are about to change. */
+    dag->post_valid = FALSE;
 
     /* Initialize path scores for all links exiting dag->start, and
      * set all other scores to the minimum.  Also initialize alphas to
@@ -1281,19 +1749,21 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
     }
 
     /* Traverse the edges in the graph, updating path scores. */
-    for (link = ps_lattice_traverse_edges(dag, NULL, NULL);
-         link; link = ps_lattice_traverse_next(dag, NULL)) {
+    ps_lattice_sort_links(dag);
+    for (i = 0; i < dag->n_link_order; ++i) {
         int32 bprob, n_used;
 
+        link = dag->link_order[i];
         /* Skip filler nodes in traversal. */
         if (dict_filler_word(ps_search_dict(search), link->from->basewid) && link->from != dag->start)
             continue;
         if (dict_filler_word(ps_search_dict(search), link->to->basewid) && link->to != dag->end)
             continue;
 
-        /* Sanity check, we should not be traversing edges that
-         * weren't previously updated, otherwise nasty overflows will result. */
-        assert(link->path_scr != MAX_NEG_INT32);
+        /* Skip edges that were never updated (not reachable from
+         * dag->start), otherwise nasty overflows will result. */
+        if (link->path_scr == MAX_NEG_INT32)
+            continue;
 
         /* Calculate common bigram probability for all alphas. */
         if (lmset)
@@ -1414,11 +1884,17 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
     ps_latlink_t *link;
     latlink_list_t *x;
     ps_latlink_t *bestend;
-    int32 bestescr;
+    int32 bestescr, i;
 
     search = dag->search;
     lmath = dag->lmath;
 
+    /* Betas only depend on the lattice, the language model and the
+     * acoustic scale, so reuse them if nothing has changed. */
+    if (dag->post_valid && dag->post_lmset == lmset
+        && dag->post_ascale == ascale)
+        return dag->post;
+
     /* Reset all betas to zero. */
     for (node = dag->nodes; node; node = node->next) {
         for (x = node->exits; x; x = x->next) {
@@ -1426,13 +1902,27 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
         }
     }
 
+    /* Track the best path - we will backtrace in order to calculate
+       the unscaled joint probability for sentence posterior. */
     bestend = NULL;
     bestescr = MAX_NEG_INT32;
-    /* Accumulate backward probabilities for all links. */
-    for (link = ps_lattice_reverse_edges(dag, NULL, NULL);
-         link; link = ps_lattice_reverse_next(dag, NULL)) {
+    for (x = dag->end->entries; x; x = x->next) {
+        if (dict_filler_word(ps_search_dict(search), x->link->from->basewid)
+            && x->link->from != dag->start)
+            continue;
+        if (x->link->path_scr BETTER_THAN bestescr) {
+            bestescr = x->link->path_scr;
+            bestend = x->link;
+        }
+    }
+
+    /* Accumulate backward probabilities for all links, visiting each
+     * link after all of its successors. */
+    ps_lattice_sort_links(dag);
+    for (i = dag->n_link_order - 1; i >= 0; --i) {
         int32 bprob, n_used;
 
+        link = dag->link_order[i];
         /* Skip filler nodes in traversal. */
         if (dict_filler_word(ps_search_dict(search), link->from->basewid) && link->from != dag->start)
             continue;
@@ -1447,13 +1937,6 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
             bprob = 0;
 
         if (link->to == dag->end) {
-            /* Track the best path - we will backtrace in order to
-               calculate the unscaled joint probability for sentence
-               posterior. */
-            if (link->path_scr BETTER_THAN bestescr) {
-                bestescr = link->path_scr;
-                bestend = link;
-            }
             /* Imaginary exit link from final node has beta = 1.0 */
             link->beta = bprob + (dag->final_node_ascr << SENSCR_SHIFT) * ascale;
         }
@@ -1470,17 +1953,25 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
     }
 
     /* Return P(S|O) = P(O,S)/P(O) */
-    return ps_lattice_joint(dag, bestend, ascale) - dag->norm;
+    dag->post = ps_lattice_joint(dag, bestend, ascale) - dag->norm;
+    dag->post_lmset = lmset;
+    dag->post_ascale = ascale;
+    dag->post_valid = TRUE;
+    return dag->post;
 }
 
 int32
 ps_lattice_posterior_prune(ps_lattice_t *dag, int32 beam)
 {
     ps_latlink_t *link;
+    int32 i;
     int npruned = 0;
 
-    for (link = ps_lattice_traverse_edges(dag, dag->start, dag->end);
-         link; link = ps_lattice_traverse_next(dag, dag->end)) {
+    /* Use the link ordering and alphas and betas left over from
+     * ps_lattice_bestpath() and ps_lattice_posterior(). */
+    ps_lattice_sort_links(dag);
+    for (i = 0; i < dag->n_link_order; ++i) {
+        link = dag->link_order[i];
         link->from->reachable = FALSE;
         if (link->alpha + link->beta - dag->norm < beam) {
             latlink_list_t *x, *tmp, *next;
@@ -1518,10 +2009,6 @@ ps_lattice_posterior_prune(ps_lattice_t *dag, int32 beam)
 }
 
 
-/* Parameters to prune n-best alternatives search */
-#define MAX_PATHS	500     /* Max allowed active paths at any time */
-#define MAX_HYP_TRIES	10000
-
 /*
  * For each node in any path between from and end of utt, find the
  * best score from "from".sf to end of utt.  (NOTE: Uses bigram probs;
@@ -1558,55 +2045,134 @@ best_rem_score(ps_astar_t *nbest, ps_latnode_t * from)
     return bestscore;
 }
 
+/* Order paths by decreasing total score. */
+static int
+path_cmp(const void *a, const void *b)
+{
+    ps_latpath_t * const *pa = a;
+    ps_latpath_t * const *pb = b;
+
+    if ((*pa)->total_score BETTER_THAN (*pb)->total_score)
+        return -1;
+    else if ((*pb)->total_score BETTER_THAN (*pa)->total_score)
+        return 1;
+    return 0;
+}
+
 /*
- * Insert newpath in sorted (by path score) list of paths.  But if newpath is
- * too far down the list, drop it (FIXME: necessary?)
- * total_score = path score (newpath) + rem_score to end of utt.
+ * Enforce the bound on the open list by discarding its worse half.
+ * The remaining paths are left sorted, which is also a valid heap.
+ * Paths in the open list have not been extended yet, so nothing else
+ * points to them.
  */
 static void
-path_insert(ps_astar_t *nbest, ps_latpath_t *newpath, int32 total_score)
+path_heap_prune(ps_astar_t *nbest)
+{
+    int32 i, n_keep;
+
+    n_keep = nbest->n_path / 2;
+    qsort(nbest->heap, nbest->n_path, sizeof(*nbest->heap), path_cmp);
+    for (i = n_keep; i < nbest->n_path; ++i) {
+        listelem_free(nbest->latpath_alloc, nbest->heap[i]);
+        nbest->n_hyp_reject++;
+    }
+    nbest->n_path = n_keep;
+}
+
+/*
+ * Insert newpath into the open list, keyed on total_score (the exact
+ * path score plus the best score from the end of the path to the end
+ * of the utterance).
+ */
+static void
+path_insert(ps_astar_t *nbest, ps_latpath_t *newpath)
 {
-    ps_lattice_t *dag;
-    ps_latpath_t *prev, *p;
     int32 i;
 
-    dag = nbest->dag;
-    prev = NULL;
-    for (i = 0, p = nbest->path_list; (i < MAX_PATHS) && p; p = p->next, i++) {
-        if ((p->score + p->node->info.rem_score) < total_score)
+    if (nbest->max_path > 0 && nbest->n_path >= nbest->max_path)
+        path_heap_prune(nbest);
+    if (nbest->n_path == nbest->n_path_alloc) {
+        nbest->n_path_alloc *= 2;
+        nbest->heap = ckd_realloc(nbest->heap,
+                                  nbest->n_path_alloc * sizeof(*nbest->heap));
+    }
+
+    /* Sift up. */
+    i = nbest->n_path++;
+    while (i > 0) {
+        int32 parent = (i - 1) / 2;
+        if (!(newpath->total_score BETTER_THAN nbest->heap[parent]->total_score))
             break;
-        prev = p;
+        nbest->heap[i] = nbest->heap[parent];
+        i = parent;
     }
+    nbest->heap[i] = newpath;
+    nbest->n_hyp_insert++;
+}
 
-    /* newpath should be inserted between prev and p */
-    if (i < MAX_PATHS) {
-        /* Insert new partial hyp */
-        newpath->next = p;
-        if (!prev)
-            nbest->path_list = newpath;
-        else
-            prev->next = newpath;
-        if (!p)
-            nbest->path_tail = newpath;
+/* Remove the best path from the open list. */
+static ps_latpath_t *
+path_pop(ps_astar_t *nbest)
+{
+    ps_latpath_t *top, *last;
+    int32 i, n;
 
-        nbest->n_path++;
-        nbest->n_hyp_insert++;
-        nbest->insert_depth += i;
-    }
-    else {
-        /* newpath score too low; reject it and also prune paths beyond MAX_PATHS */
-        nbest->path_tail = prev;
-        prev->next = NULL;
-        nbest->n_path = MAX_PATHS;
-        listelem_free(nbest->latpath_alloc, newpath);
+    if (nbest->n_path == 0)
+        return NULL;
+    top = nbest->heap[0];
+    last = nbest->heap[--nbest->n_path];
+    n = nbest->n_path;
 
-        nbest->n_hyp_reject++;
-        for (; p; p = newpath) {
-            newpath = p->next;
-            listelem_free(nbest->latpath_alloc, p);
-            nbest->n_hyp_reject++;
-        }
+    /* Sift down. */
+    i = 0;
+    while (2 * i + 1 < n) {
+        int32 child = 2 * i + 1;
+        if (child + 1 < n
+            && nbest->heap[child + 1]->total_score
+            BETTER_THAN nbest->heap[child]->total_score)
+            ++child;
+        if (!(nbest->heap[child]->total_score BETTER_THAN last->total_score))
+            break;
+        nbest->heap[i] = nbest->heap[child];
+        i = child;
     }
+    if (n > 0)
+        nbest->heap[i] = last;
+
+    return top;
+}
+
+/*
+ * Check whether the word sequence of a complete path has not been
+ * output before, and remember it if so.
+ */
+static int
+path_is_new(ps_astar_t *nbest, ps_latpath_t *path)
+{
+    dict_t *dict;
+    ps_latpath_t *p;
+    int32 *key;
+    size_t len;
+    void *val;
+
+    dict = nbest->dag->dict;
+    for (len = 0, p = path; p; p = p->parent)
+        if (dict_real_word(dict, p->node->basewid))
+            ++len;
+    key = ckd_calloc(len + 1, sizeof(*key));
+    for (len = 0, p = path; p; p = p->parent)
+        if (dict_real_word(dict, p->node->basewid))
+            key[len++] = p->node->basewid;
+
+    if (hash_table_lookup_bkey(nbest->uniq, (char const *)key,
+                               len * sizeof(*key), &val) == 0) {
+        ckd_free(key);
+        return FALSE;
+    }
+    hash_table_enter_bkey(nbest->uniq, (char const *)key,
+                          len * sizeof(*key), NULL);
+    nbest->uniq_keys = glist_add_ptr(nbest->uniq_keys, key);
+    return TRUE;
 }
 
 /* Find all possible extensions to given partial path */
@@ -1615,10 +2181,6 @@ path_extend(ps_astar_t *nbest, ps_latpath_t * path)
 {
     latlink_list_t *x;
     ps_latpath_t *newpath;
-    int32 total_score, tail_score;
-    ps_lattice_t *dag;
-
-    dag = nbest->dag;
 
     /* Consider all successors of path->node */
     for (x = path->node->exits; x; x = x->next) {
@@ -1648,23 +2210,10 @@ path_extend(ps_astar_t *nbest, ps_latpath_t * path)
                        >> SENSCR_SHIFT);
         }
 
-        /* Insert new partial path hypothesis into sorted path_list */
+        /* Insert new partial path hypothesis into the open list */
         nbest->n_hyp_tried++;
-        total_score = newpath->score + newpath->node->info.rem_score;
-
-        /* First see if hyp would be worse than the worst */
-        if (nbest->n_path >= MAX_PATHS) {
-            tail_score =
-                nbest->path_tail->score
-                + nbest->path_tail->node->info.rem_score;
-            if (total_score < tail_score) {
-                listelem_free(nbest->latpath_alloc, newpath);
-                nbest->n_hyp_reject++;
-                continue;
-            }
-        }
-
-        path_insert(nbest, newpath, total_score);
+        newpath->total_score = newpath->score + newpath->node->info.rem_score;
+        path_insert(nbest, newpath);
     }
 }
 
@@ -1690,6 +2239,19 @@ ps_astar_start(ps_lattice_t *dag,
     nbest->w1 = w1;
     nbest->w2 = w2;
     nbest->latpath_alloc = listelem_alloc_init(sizeof(ps_latpath_t));
+    if (dag->search) {
+        cmd_ln_t *config = ps_search_config(dag->search);
+        nbest->max_path = cmd_ln_int32_r(config, "-nbestmaxpath");
+        nbest->max_pop = cmd_ln_int32_r(config, "-nbestmaxpop");
+        if (cmd_ln_boolean_r(config, "-nbestuniq"))
+            nbest->uniq = hash_table_new(256, HASH_CASE_YES);
+    }
+    else {
+        nbest->max_path = 500;
+        nbest->max_pop = 10000;
+    }
+    nbest->n_path_alloc = nbest->max_path > 0 ? nbest->max_path : 256;
+    nbest->heap = ckd_calloc(nbest->n_path_alloc, sizeof(*nbest->heap));
 
     /* Initialize rem_score (A* heuristic) to default values */
     for (node = dag->nodes; node; node = node->next) {
@@ -1702,7 +2264,6 @@ ps_astar_start(ps_lattice_t *dag,
     }
 
     /* Create initial partial hypotheses list consisting of nodes starting at sf */
-    nbest->path_list = nbest->path_tail = NULL;
     for (node = dag->nodes; node; node = node->next) {
         if (node->sf == sf) {
             ps_latpath_t *path;
@@ -1720,7 +2281,8 @@ ps_astar_start(ps_lattice_t *dag,
             else
                 path->score = 0;
             path->score >>= SENSCR_SHIFT;
-            path_insert(nbest, path, path->score + node->info.rem_score);
+            path->total_score = path->score + node->info.rem_score;
+            path_insert(nbest, path);
         }
     }
 
@@ -1735,28 +2297,33 @@ ps_astar_next(ps_astar_t *nbest)
     dag = nbest->dag;
 
     /* Pop the top (best) partial hypothesis */
-    while ((nbest->top = nbest->path_list) != NULL) {
-        nbest->path_list = nbest->path_list->next;
-        if (nbest->top == nbest->path_tail)
-            nbest->path_tail = NULL;
-        nbest->n_path--;
-
+    while ((nbest->top = path_pop(nbest)) != NULL) {
         /* Complete hypothesis? */
         if ((nbest->top->node->sf >= nbest->ef)
             || ((nbest->top->node == dag->end) &&
                 (nbest->ef > dag->end->sf))) {
-            /* FIXME: Verify that it is non-empty.  Also we may want
-             * to verify that it is actually distinct from other
-             * paths, since often this is not the case*/
+            /* FIXME: Verify that it is non-empty. */
+            if (nbest->uniq && !path_is_new(nbest, nbest->top)) {
+                nbest->n_hyp_dup++;
+                continue;
+            }
             return nbest->top;
         }
         else {
+            /* Stop if the expansion budget is exhausted. */
+            if (nbest->max_pop > 0 && nbest->n_pop >= nbest->max_pop) {
+                E_INFO("N-best search stopped after %d expansions\n",
+                       nbest->n_pop);
+                break;
+            }
+            ++nbest->n_pop;
             if (nbest->top->node->fef < nbest->ef)
                 path_extend(nbest, nbest->top);
         }
     }
 
     /* Did not find any more paths to extend. */
+    nbest->top = NULL;
     return NULL;
 }
 
@@ -1891,7 +2458,15 @@ ps_astar_finish(ps_astar_t *nbest)
         ckd_free(gnode_ptr(gn));
     }
     glist_free(nbest->hyps);
+    /* Free duplicate-suppression table. */
+    if (nbest->uniq)
+        hash_table_free(nbest->uniq);
+    for (gn = nbest->uniq_keys; gn; gn = gnode_next(gn)) {
+        ckd_free(gnode_ptr(gn));
+    }
+    glist_free(nbest->uniq_keys);
     /* Free all paths. */
+    ckd_free(nbest->heap);
     listelem_alloc_free(nbest->latpath_alloc);
     /* Free the Henge. */
     ckd_free(nbest);
@@ -84,6 +84,14 @@ struct ps_lattice_s {
     /* This will probably be replaced with a heap. */
     latlink_list_t *q_head; /**< Queue of links for traversal. */
     latlink_list_t *q_tail; /**< Queue of links for traversal. */
+
+    ps_latlink_t **link_order; /**< Links in topological order, built on demand. */
+    int32 n_link_order;        /**< Number of links in link_order. */
+
+    int post_valid;            /**< Are betas and post up to date? */
+    ngram_model_t *post_lmset; /**< Language model used for cached posteriors. */
+    float32 post_ascale;       /**< Acoustic scale used for cached posteriors. */
+    int32 post;                /**< Cached result of ps_lattice_posterior(). */
 };
 
 /**
@@ -153,8 +161,8 @@ typedef struct dag_seg_s {
 typedef struct ps_latpath_s {
     ps_latnode_t *node;            /**< Node ending this path. */
     struct ps_latpath_s *parent;   /**< Previous element in this path. */
-    struct ps_latpath_s *next;     /**< Pointer to next path in list of paths. */
     int32 score;                  /**< Exact score from start node up to node->sf. */
+    int32 total_score;            /**< score plus heuristic score to end of utterance. */
 } ps_latpath_t;
 
 /**
@@ -173,13 +181,19 @@ typedef struct ps_astar_s {
     int32 n_hyp_tried;
     int32 n_hyp_insert;
     int32 n_hyp_reject;
-    int32 insert_depth;
-    int32 n_path;
+    int32 n_hyp_dup;   /**< Number of complete hypotheses suppressed as duplicates. */
+    int32 n_pop;       /**< Number of partial paths expanded so far. */
+
+    int32 max_path;    /**< Maximum size of open list (or <= 0 for no limit). */
+    int32 max_pop;     /**< Maximum number of path expansions (or <= 0 for no limit). */
 
-    ps_latpath_t *path_list;
-    ps_latpath_t *path_tail;
+    ps_latpath_t **heap; /**< Open list of partial paths, a binary heap on total_score. */
+    int32 n_path;        /**< Number of paths in heap. */
+    int32 n_path_alloc;  /**< Allocated size of heap. */
     ps_latpath_t *top;
 
+    hash_table_t *uniq;  /**< Word sequences output so far (if suppressing duplicates). */
+    glist_t uniq_keys;   /**< Storage for keys in uniq. */
     glist_t hyps;	             /**< List of hypothesis strings. */
     listelem_alloc_t *latpath_alloc; /**< Path allocator for N-best search. */
 } ps_astar_t;
@@ -204,6 +218,24 @@ ps_lattice_t *ps_lattice_init_search(ps_search_t *search, int n_frame);
  */
 void ps_lattice_bypass_fillers(ps_lattice_t *dag, int32 silpen, int32 fillpen);
 
+/**
+ * Discard cached link ordering and posteriors after modifying a lattice.
+ */
+void ps_lattice_invalidate(ps_lattice_t *dag);
+
+/**
+ * Sort links in topological order (if not already done).
+ *
+ * The result is cached in dag->link_order until the lattice is
+ * modified.  Each link comes after every link entering its source
+ * node.  This is the breadth-first order ps_lattice_traverse_edges()
+ * starts with, except that links from other nodes without
+ * predecessors are included and nothing is cut off at dag->end.
+ *
+ * @return Number of links in dag->link_order.
+ */
+int32 ps_lattice_sort_links(ps_lattice_t *dag);
+
 /**
  * Remove nodes marked as unreachable.
  */
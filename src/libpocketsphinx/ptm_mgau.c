@@ -63,13 +63,16 @@
 /* Local headers */
 #include "tied_mgau_common.h"
 #include "ptm_mgau.h"
+#include "snapshot.h"
 #include "posixwin32.h"
 
 static ps_mgaufuncs_t ptm_mgau_funcs = {
     "ptm",
     ptm_mgau_frame_eval,      /* frame_eval */
     ptm_mgau_mllr_transform,  /* transform */
-    ptm_mgau_free             /* free */
+    ptm_mgau_free,            /* free */
+    ptm_mgau_snapshot,        /* snapshot */
+    ptm_mgau_restore          /* restore */
 };
 
 #define COMPUTE_GMM_MAP(_idx)                           \
@@ -291,21 +294,19 @@ ptm_mgau_codebook_eval(ptm_mgau_t *s, mfcc_t **z, int frame)
 }
 
 static int
-ptm_mgau_calc_cb_active(ptm_mgau_t *s, uint8 *senone_active,
+ptm_mgau_calc_cb_active(ptm_mgau_t *s, uint16 *senone_active,
                         int32 n_senone_active, int compallsen)
 {
-    int i, lastsen;
+    int i;
 
     if (compallsen) {
         bitvec_set_all(s->f->mgau_active, s->g->n_mgau);
         return 0;
     }
     bitvec_clear_all(s->f->mgau_active, s->g->n_mgau);
-    for (lastsen = i = 0; i < n_senone_active; ++i) {
-        int sen = senone_active[i] + lastsen;
-        int cb = s->sen2cb[sen];
+    for (i = 0; i < n_senone_active; ++i) {
+        int cb = s->sen2cb[senone_active[i]];
         bitvec_set(s->f->mgau_active, cb);
-        lastsen = sen;
     }
     E_DEBUG(1, ("Active codebooks:"));
     for (i = 0; i < s->g->n_mgau; ++i) {
@@ -322,10 +323,10 @@ ptm_mgau_calc_cb_active(ptm_mgau_t *s, uint8 *senone_active,
  */
 static int
 ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
-                     uint8 *senone_active, int32 n_senone_active,
+                     uint16 *senone_active, int32 n_senone_active,
                      int compall)
 {
-    int i, lastsen, bestscore;
+    int i, bestscore;
 
     memset(senone_scores, 0, s->n_sen * sizeof(*senone_scores));
     /* FIXME: This is the non-cache-efficient way to do this.  We want
@@ -336,23 +337,21 @@ ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
     if (compall)
         n_senone_active = s->n_sen;
     bestscore = 0x7fffffff;
-    for (lastsen = i = 0; i < n_senone_active; ++i) {
+    for (i = 0; i < n_senone_active; ++i) {
         int sen, f, cb;
         int ascore;
 
         if (compall)
             sen = i;
         else
-            sen = senone_active[i] + lastsen;
-        lastsen = sen;
+            sen = senone_active[i];
         cb = s->sen2cb[sen];
 
         if (bitvec_is_clear(s->f->mgau_active, cb)) {
             int j;
-            /* Because senone_active is deltas we can't really "knock
-             * out" senones from pruned codebooks, and in any case,
-             * it wouldn't make any difference to the search code,
-             * which doesn't expect senone_active to change. */
+            /* We don't "knock out" senones from pruned codebooks,
+             * since it wouldn't make any difference to the search
+             * code, which doesn't expect senone_active to change. */
             for (f = 0; f < s->g->n_feat; ++f) {
                 for (j = 0; j < s->max_topn; ++j) {
                     s->f->topn[cb][f][j].score = MAX_NEG_ASCR;
@@ -405,7 +404,7 @@ ptm_mgau_senone_eval(ptm_mgau_t *s, int16 *senone_scores,
 int32
 ptm_mgau_frame_eval(ps_mgau_t *ps,
                     int16 *senone_scores,
-                    uint8 *senone_active,
+                    uint16 *senone_active,
                     int32 n_senone_active,
                     mfcc_t ** featbuf, int32 frame,
                     int32 compallsen)
@@ -901,3 +900,46 @@ ptm_mgau_free(ps_mgau_t *ps)
     gauden_free(s->g);
     ckd_free(s);
 }
+
+int
+ptm_mgau_snapshot(ps_mgau_t *ps, FILE *fh)
+{
+    ptm_mgau_t *s = (ptm_mgau_t *)ps;
+    int32 n_topn = s->g->n_mgau * s->g->n_feat * s->max_topn;
+    int i;
+
+    /* The top-N codewords of each frame are the starting point for
+     * the next one, and the previous frames' ones are kept for the
+     * phone loop lookahead, so all of them carry over. */
+    if (snapshot_write_int32(fh, s->n_fast_hist) < 0
+        || snapshot_write_int32(fh, n_topn) < 0)
+        return -1;
+    for (i = 0; i < s->n_fast_hist; ++i) {
+        if (snapshot_write(fh, s->hist[i].topn[0][0],
+                           sizeof(ptm_topn_t), n_topn) < 0
+            || snapshot_write(fh, s->hist[i].mgau_active, sizeof(bitvec_t),
+                              bitvec_size(s->g->n_mgau)) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int
+ptm_mgau_restore(ps_mgau_t *ps, FILE *fh)
+{
+    ptm_mgau_t *s = (ptm_mgau_t *)ps;
+    int32 n_topn = s->g->n_mgau * s->g->n_feat * s->max_topn;
+    int i;
+
+    if (snapshot_check_int32(fh, s->n_fast_hist, "-pl_window") < 0
+        || snapshot_check_int32(fh, n_topn, "number of top-N codewords") < 0)
+        return -1;
+    for (i = 0; i < s->n_fast_hist; ++i) {
+        if (snapshot_read(fh, s->hist[i].topn[0][0],
+                          sizeof(ptm_topn_t), n_topn) < 0
+            || snapshot_read(fh, s->hist[i].mgau_active, sizeof(bitvec_t),
+                             bitvec_size(s->g->n_mgau)) < 0)
+            return -1;
+    }
+    return 0;
+}
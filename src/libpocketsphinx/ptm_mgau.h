@@ -91,13 +91,15 @@ ps_mgau_t *ptm_mgau_init(acmod_t *acmod, bin_mdef_t *mdef);
 void ptm_mgau_free(ps_mgau_t *s);
 int ptm_mgau_frame_eval(ps_mgau_t *s,
                         int16 *senone_scores,
-                        uint8 *senone_active,
+                        uint16 *senone_active,
                         int32 n_senone_active,
                         mfcc_t **featbuf,
                         int32 frame,
                         int32 compallsen);
 int ptm_mgau_mllr_transform(ps_mgau_t *s,
                             ps_mllr_t *mllr);
+int ptm_mgau_snapshot(ps_mgau_t *s, FILE *fh);
+int ptm_mgau_restore(ps_mgau_t *s, FILE *fh);
 
 
 #endif /*  __PTM_MGAU_H__ */
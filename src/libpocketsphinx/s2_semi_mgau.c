@@ -62,6 +62,7 @@
 
 /* Local headers */
 #include "s2_semi_mgau.h"
+#include "snapshot.h"
 #include "tied_mgau_common.h"
 #include "posixwin32.h"
 
@@ -69,7 +70,9 @@ static ps_mgaufuncs_t s2_semi_mgau_funcs = {
     "s2_semi",
     s2_semi_mgau_frame_eval,      /* frame_eval */
     s2_semi_mgau_mllr_transform,  /* transform */
-    s2_semi_mgau_free             /* free */
+    s2_semi_mgau_free,            /* free */
+    s2_semi_mgau_snapshot,        /* snapshot */
+    s2_semi_mgau_restore          /* restore */
 };
 
 struct vqFeature_s {
@@ -208,10 +211,10 @@ mgau_norm(s2_semi_mgau_t *s, int feat)
 
 static int32
 get_scores_8b_feat_6(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2, *pid_cw3, *pid_cw4, *pid_cw5;
 
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
@@ -221,8 +224,8 @@ get_scores_8b_feat_6(s2_semi_mgau_t * s, int i,
     pid_cw4 = s->mixw[i][s->f[i][4].codeword];
     pid_cw5 = s->mixw[i][s->f[i][5].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int sen = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int sen = senone_active[j];
         int32 tmp = pid_cw0[sen] + s->f[i][0].score;
 
         tmp = fast_logmath_add(s->lmath_8b, tmp,
@@ -237,17 +240,16 @@ get_scores_8b_feat_6(s2_semi_mgau_t * s, int i,
                                pid_cw5[sen] + s->f[i][5].score);
 
         senone_scores[sen] += tmp;
-        l = sen;
     }
     return 0;
 }
 
 static int32
 get_scores_8b_feat_5(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2, *pid_cw3, *pid_cw4;
 
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
@@ -256,8 +258,8 @@ get_scores_8b_feat_5(s2_semi_mgau_t * s, int i,
     pid_cw3 = s->mixw[i][s->f[i][3].codeword];
     pid_cw4 = s->mixw[i][s->f[i][4].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int sen = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int sen = senone_active[j];
         int32 tmp = pid_cw0[sen] + s->f[i][0].score;
 
         tmp = fast_logmath_add(s->lmath_8b, tmp,
@@ -270,17 +272,16 @@ get_scores_8b_feat_5(s2_semi_mgau_t * s, int i,
                                pid_cw4[sen] + s->f[i][4].score);
 
         senone_scores[sen] += tmp;
-        l = sen;
     }
     return 0;
 }
 
 static int32
 get_scores_8b_feat_4(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2, *pid_cw3;
 
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
@@ -288,8 +289,8 @@ get_scores_8b_feat_4(s2_semi_mgau_t * s, int i,
     pid_cw2 = s->mixw[i][s->f[i][2].codeword];
     pid_cw3 = s->mixw[i][s->f[i][3].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int sen = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int sen = senone_active[j];
         int32 tmp = pid_cw0[sen] + s->f[i][0].score;
 
         tmp = fast_logmath_add(s->lmath_8b, tmp,
@@ -300,25 +301,24 @@ get_scores_8b_feat_4(s2_semi_mgau_t * s, int i,
                                pid_cw3[sen] + s->f[i][3].score);
 
         senone_scores[sen] += tmp;
-        l = sen;
     }
     return 0;
 }
 
 static int32
 get_scores_8b_feat_3(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2;
 
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
     pid_cw1 = s->mixw[i][s->f[i][1].codeword];
     pid_cw2 = s->mixw[i][s->f[i][2].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int sen = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int sen = senone_active[j];
         int32 tmp = pid_cw0[sen] + s->f[i][0].score;
 
         tmp = fast_logmath_add(s->lmath_8b, tmp,
@@ -327,62 +327,59 @@ get_scores_8b_feat_3(s2_semi_mgau_t * s, int i,
                                pid_cw2[sen] + s->f[i][2].score);
 
         senone_scores[sen] += tmp;
-        l = sen;
     }
     return 0;
 }
 
 static int32
 get_scores_8b_feat_2(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1;
 
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
     pid_cw1 = s->mixw[i][s->f[i][1].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int sen = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int sen = senone_active[j];
         int32 tmp = pid_cw0[sen] + s->f[i][0].score;
 
         tmp = fast_logmath_add(s->lmath_8b, tmp,
                                pid_cw1[sen] + s->f[i][1].score);
 
         senone_scores[sen] += tmp;
-        l = sen;
     }
     return 0;
 }
 
 static int32
 get_scores_8b_feat_1(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0;
 
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
-    for (l = j = 0; j < n_senone_active; j++) {
-        int sen = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int sen = senone_active[j];
         int32 tmp = pid_cw0[sen] + s->f[i][0].score;
         senone_scores[sen] += tmp;
-        l = sen;
     }
     return 0;
 }
 
 static int32
 get_scores_8b_feat_any(s2_semi_mgau_t * s, int i, int topn,
-                       int16 *senone_scores, uint8 *senone_active,
+                       int16 *senone_scores, uint16 *senone_active,
                        int32 n_senone_active)
 {
-    int32 j, k, l;
+    int32 j, k;
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int sen = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int sen = senone_active[j];
         uint8 *pid_cw;
         int32 tmp;
         pid_cw = s->mixw[i][s->f[i][0].codeword];
@@ -393,14 +390,13 @@ get_scores_8b_feat_any(s2_semi_mgau_t * s, int i, int topn,
                                    pid_cw[sen] + s->f[i][k].score);
         }
         senone_scores[sen] += tmp;
-        l = sen;
     }
     return 0;
 }
 
 static int32
 get_scores_8b_feat(s2_semi_mgau_t * s, int i, int topn,
-                   int16 *senone_scores, uint8 *senone_active, int32 n_senone_active)
+                   int16 *senone_scores, uint16 *senone_active, int32 n_senone_active)
 {
     switch (topn) {
     case 6:
@@ -449,10 +445,10 @@ get_scores_8b_feat_all(s2_semi_mgau_t * s, int i, int topn, int16 *senone_scores
 
 static int32
 get_scores_4b_feat_6(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2, *pid_cw3, *pid_cw4, *pid_cw5;
     uint8 w_den[6][16];
 
@@ -473,8 +469,8 @@ get_scores_4b_feat_6(s2_semi_mgau_t * s, int i,
     pid_cw4 = s->mixw[i][s->f[i][4].codeword];
     pid_cw5 = s->mixw[i][s->f[i][5].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int n = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int n = senone_active[j];
         int tmp, cw;
 
         if (n & 1) {
@@ -506,17 +502,16 @@ get_scores_4b_feat_6(s2_semi_mgau_t * s, int i,
             tmp = fast_logmath_add(s->lmath_8b, tmp, w_den[5][cw]);
         }
         senone_scores[n] += tmp;
-        l = n;
     }
     return 0;
 }
 
 static int32
 get_scores_4b_feat_5(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2, *pid_cw3, *pid_cw4;
     uint8 w_den[5][16];
 
@@ -535,8 +530,8 @@ get_scores_4b_feat_5(s2_semi_mgau_t * s, int i,
     pid_cw3 = s->mixw[i][s->f[i][3].codeword];
     pid_cw4 = s->mixw[i][s->f[i][4].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int n = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int n = senone_active[j];
         int tmp, cw;
 
         if (n & 1) {
@@ -564,17 +559,16 @@ get_scores_4b_feat_5(s2_semi_mgau_t * s, int i,
             tmp = fast_logmath_add(s->lmath_8b, tmp, w_den[4][cw]);
         }
         senone_scores[n] += tmp;
-        l = n;
     }
     return 0;
 }
 
 static int32
 get_scores_4b_feat_4(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2, *pid_cw3;
     uint8 w_den[4][16];
 
@@ -591,8 +585,8 @@ get_scores_4b_feat_4(s2_semi_mgau_t * s, int i,
     pid_cw2 = s->mixw[i][s->f[i][2].codeword];
     pid_cw3 = s->mixw[i][s->f[i][3].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int n = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int n = senone_active[j];
         int tmp, cw;
 
         if (n & 1) {
@@ -616,17 +610,16 @@ get_scores_4b_feat_4(s2_semi_mgau_t * s, int i,
             tmp = fast_logmath_add(s->lmath_8b, tmp, w_den[3][cw]);
         }
         senone_scores[n] += tmp;
-        l = n;
     }
     return 0;
 }
 
 static int32
 get_scores_4b_feat_3(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1, *pid_cw2;
     uint8 w_den[3][16];
 
@@ -641,8 +634,8 @@ get_scores_4b_feat_3(s2_semi_mgau_t * s, int i,
     pid_cw1 = s->mixw[i][s->f[i][1].codeword];
     pid_cw2 = s->mixw[i][s->f[i][2].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int n = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int n = senone_active[j];
         int tmp, cw;
 
         if (n & 1) {
@@ -662,17 +655,16 @@ get_scores_4b_feat_3(s2_semi_mgau_t * s, int i,
             tmp = fast_logmath_add(s->lmath_8b, tmp, w_den[2][cw]);
         }
         senone_scores[n] += tmp;
-        l = n;
     }
     return 0;
 }
 
 static int32
 get_scores_4b_feat_2(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0, *pid_cw1;
     uint8 w_den[2][16];
 
@@ -685,8 +677,8 @@ get_scores_4b_feat_2(s2_semi_mgau_t * s, int i,
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
     pid_cw1 = s->mixw[i][s->f[i][1].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int n = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int n = senone_active[j];
         int tmp, cw;
 
         if (n & 1) {
@@ -702,17 +694,16 @@ get_scores_4b_feat_2(s2_semi_mgau_t * s, int i,
             tmp = fast_logmath_add(s->lmath_8b, tmp, w_den[1][cw]);
         }
         senone_scores[n] += tmp;
-        l = n;
     }
     return 0;
 }
 
 static int32
 get_scores_4b_feat_1(s2_semi_mgau_t * s, int i,
-                     int16 *senone_scores, uint8 *senone_active,
+                     int16 *senone_scores, uint16 *senone_active,
                      int32 n_senone_active)
 {
-    int32 j, l;
+    int32 j;
     uint8 *pid_cw0;
     uint8 w_den[16];
 
@@ -723,8 +714,8 @@ get_scores_4b_feat_1(s2_semi_mgau_t * s, int i,
 
     pid_cw0 = s->mixw[i][s->f[i][0].codeword];
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int n = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int n = senone_active[j];
         int tmp, cw;
 
         if (n & 1) {
@@ -736,20 +727,19 @@ get_scores_4b_feat_1(s2_semi_mgau_t * s, int i,
             tmp = w_den[cw];
         }
         senone_scores[n] += tmp;
-        l = n;
     }
     return 0;
 }
 
 static int32
 get_scores_4b_feat_any(s2_semi_mgau_t * s, int i, int topn,
-                       int16 *senone_scores, uint8 *senone_active,
+                       int16 *senone_scores, uint16 *senone_active,
                        int32 n_senone_active)
 {
-    int32 j, k, l;
+    int32 j, k;
 
-    for (l = j = 0; j < n_senone_active; j++) {
-        int n = senone_active[j] + l;
+    for (j = 0; j < n_senone_active; j++) {
+        int n = senone_active[j];
         int tmp, cw;
         uint8 *pid_cw;
     
@@ -769,14 +759,13 @@ get_scores_4b_feat_any(s2_semi_mgau_t * s, int i, int topn,
                                    s->mixw_cb[cw] + s->f[i][k].score);
         }
         senone_scores[n] += tmp;
-        l = n;
     }
     return 0;
 }
 
 static int32
 get_scores_4b_feat(s2_semi_mgau_t * s, int i, int topn,
-                   int16 *senone_scores, uint8 *senone_active, int32 n_senone_active)
+                   int16 *senone_scores, uint16 *senone_active, int32 n_senone_active)
 {
     switch (topn) {
     case 6:
@@ -840,7 +829,7 @@ get_scores_4b_feat_all(s2_semi_mgau_t * s, int i, int topn, int16 *senone_scores
 int32
 s2_semi_mgau_frame_eval(ps_mgau_t *ps,
                         int16 *senone_scores,
-                        uint8 *senone_active,
+                        uint16 *senone_active,
                         int32 n_senone_active,
 			mfcc_t ** featbuf, int32 frame,
 			int32 compallsen)
@@ -1364,3 +1353,36 @@ s2_semi_mgau_free(ps_mgau_t *ps)
     ckd_free_3d((void **)s->topn_hist);
     ckd_free(s);
 }
+
+int
+s2_semi_mgau_snapshot(ps_mgau_t *ps, FILE *fh)
+{
+    s2_semi_mgau_t *s = (s2_semi_mgau_t *)ps;
+    int32 n_topn = s->n_feat * s->max_topn;
+
+    /* Each frame's top-N codewords start from the previous one's. */
+    if (snapshot_write_int32(fh, s->n_topn_hist) < 0
+        || snapshot_write_int32(fh, n_topn) < 0
+        || snapshot_write(fh, s->topn_hist[0][0], sizeof(vqFeature_t),
+                          s->n_topn_hist * n_topn) < 0
+        || snapshot_write(fh, s->topn_hist_n[0], sizeof(uint8),
+                          s->n_topn_hist * s->n_feat) < 0)
+        return -1;
+    return 0;
+}
+
+int
+s2_semi_mgau_restore(ps_mgau_t *ps, FILE *fh)
+{
+    s2_semi_mgau_t *s = (s2_semi_mgau_t *)ps;
+    int32 n_topn = s->n_feat * s->max_topn;
+
+    if (snapshot_check_int32(fh, s->n_topn_hist, "-pl_window") < 0
+        || snapshot_check_int32(fh, n_topn, "number of top-N codewords") < 0
+        || snapshot_read(fh, s->topn_hist[0][0], sizeof(vqFeature_t),
+                         s->n_topn_hist * n_topn) < 0
+        || snapshot_read(fh, s->topn_hist_n[0], sizeof(uint8),
+                         s->n_topn_hist * s->n_feat) < 0)
+        return -1;
+    return 0;
+}
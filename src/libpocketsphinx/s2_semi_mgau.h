@@ -92,13 +92,15 @@ ps_mgau_t *s2_semi_mgau_init(acmod_t *acmod);
 void s2_semi_mgau_free(ps_mgau_t *s);
 int s2_semi_mgau_frame_eval(ps_mgau_t *s,
                             int16 *senone_scores,
-                            uint8 *senone_active,
+                            uint16 *senone_active,
                             int32 n_senone_active,
                             mfcc_t **featbuf,
                             int32 frame,
                             int32 compallsen);
 int s2_semi_mgau_mllr_transform(ps_mgau_t *s,
                                 ps_mllr_t *mllr);
+int s2_semi_mgau_snapshot(ps_mgau_t *s, FILE *fh);
+int s2_semi_mgau_restore(ps_mgau_t *s, FILE *fh);
 
 
 #endif /*  __S2_SEMI_MGAU_H__ */
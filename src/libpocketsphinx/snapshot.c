@@ -0,0 +1,136 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2010 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+
+/**
+ * @file snapshot.c Reading and writing the pieces of a decoder snapshot.
+ */
+
+/* System headers. */
+#include <stdio.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/err.h>
+
+/* Local headers. */
+#include "snapshot.h"
+
+int
+snapshot_write(FILE *fh, void const *buf, size_t size, size_t n)
+{
+    if (n > 0 && fwrite(buf, size, n, fh) != n) {
+        E_ERROR_SYSTEM("Failed to write snapshot");
+        return -1;
+    }
+    return 0;
+}
+
+int
+snapshot_write_int32(FILE *fh, int32 val)
+{
+    return snapshot_write(fh, &val, sizeof(val), 1);
+}
+
+int
+snapshot_read(FILE *fh, void *buf, size_t size, size_t n)
+{
+    if (n > 0 && fread(buf, size, n, fh) != n) {
+        E_ERROR("Failed to read snapshot: truncated or unreadable\n");
+        return -1;
+    }
+    return 0;
+}
+
+int
+snapshot_read_int32(FILE *fh, int32 *val)
+{
+    return snapshot_read(fh, val, sizeof(*val), 1);
+}
+
+int
+snapshot_check_int32(FILE *fh, int32 expected, char const *what)
+{
+    int32 val;
+
+    if (snapshot_read_int32(fh, &val) < 0)
+        return -1;
+    if (val != expected) {
+        E_ERROR("Snapshot does not match the decoder's %s: %d != %d\n",
+                what, val, expected);
+        return -1;
+    }
+    return 0;
+}
+
+int
+snapshot_write_hmm(FILE *fh, hmm_t const *hmm)
+{
+    int n = hmm_n_emit_state(hmm);
+
+    if (snapshot_write(fh, hmm->score, sizeof(int32), n) < 0
+        || snapshot_write(fh, hmm->history, sizeof(int32), n) < 0
+        || snapshot_write_int32(fh, hmm->out_score) < 0
+        || snapshot_write_int32(fh, hmm->out_history) < 0
+        || snapshot_write_int32(fh, hmm->bestscore) < 0
+        || snapshot_write_int32(fh, hmm->frame) < 0)
+        return -1;
+    /* The senone sequences of a multiplex HMM change as it is entered
+     * from different predecessors. */
+    if (hmm_is_mpx(hmm)
+        && snapshot_write(fh, hmm->senid, sizeof(uint16), n) < 0)
+        return -1;
+    return 0;
+}
+
+int
+snapshot_read_hmm(FILE *fh, hmm_t *hmm)
+{
+    int n = hmm_n_emit_state(hmm);
+    int32 frame;
+
+    if (snapshot_read(fh, hmm->score, sizeof(int32), n) < 0
+        || snapshot_read(fh, hmm->history, sizeof(int32), n) < 0
+        || snapshot_read_int32(fh, &hmm->out_score) < 0
+        || snapshot_read_int32(fh, &hmm->out_history) < 0
+        || snapshot_read_int32(fh, &hmm->bestscore) < 0
+        || snapshot_read_int32(fh, &frame) < 0)
+        return -1;
+    hmm->frame = frame;
+    if (hmm_is_mpx(hmm)
+        && snapshot_read(fh, hmm->senid, sizeof(uint16), n) < 0)
+        return -1;
+    return 0;
+}
@@ -0,0 +1,101 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2010 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+
+/**
+ * @file snapshot.h Reading and writing the pieces of a decoder snapshot.
+ *
+ * Snapshots are written in the native byte order and word size, so
+ * these are just thin wrappers around fread() and fwrite() which
+ * report errors.  All of them return 0 on success and <0 on failure.
+ */
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+/* System headers. */
+#include <stdio.h>
+
+/* SphinxBase headers. */
+#include <sphinxbase/prim_type.h>
+
+/* Local headers. */
+#include "hmm.h"
+
+/**
+ * Write an array of n objects of the given size.
+ */
+int snapshot_write(FILE *fh, void const *buf, size_t size, size_t n);
+
+/**
+ * Write a single integer.
+ */
+int snapshot_write_int32(FILE *fh, int32 val);
+
+/**
+ * Read an array of n objects of the given size.
+ */
+int snapshot_read(FILE *fh, void *buf, size_t size, size_t n);
+
+/**
+ * Read a single integer.
+ */
+int snapshot_read_int32(FILE *fh, int32 *val);
+
+/**
+ * Read an integer and check that it is the expected one.
+ *
+ * This is used for the sizes of things which are fixed by the
+ * configuration of the decoder, to catch snapshots taken with a
+ * different one.
+ *
+ * @param what Description of the value for the error message.
+ */
+int snapshot_check_int32(FILE *fh, int32 expected, char const *what);
+
+/**
+ * Write the scores, histories and frame of an HMM, and its senone
+ * sequence if it has several.
+ */
+int snapshot_write_hmm(FILE *fh, hmm_t const *hmm);
+
+/**
+ * Read an HMM written by snapshot_write_hmm() into one which has
+ * already been initialized with the same topology.
+ */
+int snapshot_read_hmm(FILE *fh, hmm_t *hmm);
+
+#endif /* __SNAPSHOT_H__ */
@@ -49,6 +49,15 @@ state_align_search_start(ps_search_t *search)
     /* Activate the initial state. */
     hmm_enter(sas->hmms, 0, 0, 0);
 
+    /* Rewind the senone score spool file for checkpointed mode. */
+    if (sas->ckpt_interval > 0) {
+        if (sas->senfh == NULL && (sas->senfh = tmpfile()) == NULL) {
+            E_ERROR_SYSTEM("Failed to create senone score spool file");
+            return -1;
+        }
+        rewind(sas->senfh);
+    }
+
     return 0;
 }
 
@@ -138,15 +147,10 @@ extend_tokenstack(state_align_search_t *sas, int frame_idx)
 }
 
 static void
-record_transitions(state_align_search_t *sas, int frame_idx)
+record_transitions(state_align_search_t *sas, int frame_idx, uint16 *tokens)
 {
-    uint16 *tokens;
     int i;
 
-    /* Push another frame of tokens on the stack. */
-    extend_tokenstack(sas, frame_idx);
-    tokens = sas->tokens + frame_idx * sas->n_emit_state;
-
     /* Scan all active HMMs */
     for (i = 0; i < sas->n_phones; ++i) {
         hmm_t *hmm = sas->hmms + i;
@@ -157,26 +161,21 @@ record_transitions(state_align_search_t *sas, int frame_idx)
         for (j = 0; j < sas->hmmctx->n_emit_state; ++j) {
             int state_idx = i * sas->hmmctx->n_emit_state + j;
             /* Record their backpointers on the token stack. */
-            tokens[state_idx] = hmm_history(hmm, j);
+            if (tokens)
+                tokens[state_idx] = hmm_history(hmm, j);
             /* Update backpointer fields with state index. */
             hmm_history(hmm, j) = state_idx;
         }
     }
 }
 
-static int
-state_align_search_step(ps_search_t *search, int frame_idx)
+/**
+ * Run one frame of Viterbi, storing backpointers in tokens (if not NULL).
+ */
+static void
+viterbi_frame(state_align_search_t *sas, int16 const *senscr,
+              int frame_idx, uint16 *tokens)
 {
-    state_align_search_t *sas = (state_align_search_t *)search;
-    acmod_t *acmod = ps_search_acmod(search);
-    int16 const *senscr;
-    int i;
-
-    /* Calculate senone scores. */
-    for (i = 0; i < sas->n_phones; ++i)
-        acmod_activate_hmm(acmod, sas->hmms + i);
-    senscr = acmod_score(acmod, &frame_idx);
-
     /* Renormalize here if needed. */
     /* FIXME: Make sure to (unit-)test this!!! */
     if ((sas->best_score - 0x300000) WORSE_THAN WORST_SCORE) {
@@ -193,7 +192,92 @@ state_align_search_step(ps_search_t *search, int frame_idx)
     phone_transition(sas, frame_idx);
 
     /* Generate new tokens from best path results. */
-    record_transitions(sas, frame_idx);
+    record_transitions(sas, frame_idx, tokens);
+}
+
+static void
+save_checkpoint(state_align_search_t *sas, int frame_idx)
+{
+    int ckpt = frame_idx / sas->ckpt_interval;
+
+    if (ckpt >= sas->n_ckpt_alloc) {
+        sas->n_ckpt_alloc = ckpt + TOKEN_STEP;
+        sas->ckpt_hmms = ckd_realloc(sas->ckpt_hmms,
+                                     sas->n_phones * sas->n_ckpt_alloc
+                                     * sizeof(*sas->ckpt_hmms));
+        sas->ckpt_best = ckd_realloc(sas->ckpt_best,
+                                     sas->n_ckpt_alloc
+                                     * sizeof(*sas->ckpt_best));
+    }
+    memcpy(sas->ckpt_hmms + ckpt * sas->n_phones, sas->hmms,
+           sas->n_phones * sizeof(*sas->hmms));
+    sas->ckpt_best[ckpt] = sas->best_score;
+}
+
+static int
+write_senscr(state_align_search_t *sas, int16 const *senscr)
+{
+    int i;
+
+    for (i = 0; i < sas->n_sen_ids; ++i)
+        sas->senscr[i] = senscr[sas->sen_ids[i]];
+    if (fwrite(sas->senscr, sizeof(*sas->senscr), sas->n_sen_ids,
+               sas->senfh) != (size_t)sas->n_sen_ids) {
+        E_ERROR_SYSTEM("Failed to write senone scores to spool file");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+read_senscr(state_align_search_t *sas)
+{
+    int i;
+
+    if (fread(sas->senscr, sizeof(*sas->senscr), sas->n_sen_ids,
+              sas->senfh) != (size_t)sas->n_sen_ids) {
+        E_ERROR_SYSTEM("Failed to read senone scores from spool file");
+        return -1;
+    }
+    /* Scatter them back to their senone IDs.  Since sen_ids is
+     * sorted, sen_ids[i] >= i, so this can be done in place going
+     * backwards. */
+    for (i = sas->n_sen_ids - 1; i >= 0; --i)
+        sas->senscr[sas->sen_ids[i]] = sas->senscr[i];
+    return 0;
+}
+
+static int
+state_align_search_step(ps_search_t *search, int frame_idx)
+{
+    state_align_search_t *sas = (state_align_search_t *)search;
+    acmod_t *acmod = ps_search_acmod(search);
+    int16 const *senscr;
+    uint16 *tokens;
+    int i;
+
+    /* Calculate senone scores. */
+    for (i = 0; i < sas->n_phones; ++i)
+        acmod_activate_hmm(acmod, sas->hmms + i);
+    senscr = acmod_score(acmod, &frame_idx);
+
+    if (sas->ckpt_interval > 0) {
+        /* Save the search state at the start of each segment, and
+         * the scores needed to recompute it. */
+        if (frame_idx % sas->ckpt_interval == 0)
+            save_checkpoint(sas, frame_idx);
+        if (write_senscr(sas, senscr) < 0)
+            return -1;
+        tokens = NULL;
+    }
+    else {
+        /* Push another frame of tokens on the stack. */
+        extend_tokenstack(sas, frame_idx);
+        tokens = sas->tokens + frame_idx * sas->n_emit_state;
+    }
+
+    /* Viterbi step. */
+    viterbi_frame(sas, senscr, frame_idx, tokens);
 
     /* Update frame counter */
     sas->frame = frame_idx;
@@ -201,6 +285,58 @@ state_align_search_step(ps_search_t *search, int frame_idx)
     return 0;
 }
 
+/**
+ * Re-run the search from the checkpoint at first_frame up to
+ * last_frame, leaving their backpointers in sas->tokens.
+ */
+static int
+recompute_segment(state_align_search_t *sas, int first_frame, int last_frame)
+{
+    int ckpt = first_frame / sas->ckpt_interval;
+    int frame_idx;
+
+    memcpy(sas->hmms, sas->ckpt_hmms + ckpt * sas->n_phones,
+           sas->n_phones * sizeof(*sas->hmms));
+    sas->best_score = sas->ckpt_best[ckpt];
+    if (fseek(sas->senfh, (long)first_frame * sas->n_sen_ids
+              * sizeof(*sas->senscr), SEEK_SET) < 0) {
+        E_ERROR_SYSTEM("Failed to seek to frame %d in spool file",
+                       first_frame);
+        return -1;
+    }
+    for (frame_idx = first_frame; frame_idx <= last_frame; ++frame_idx) {
+        if (read_senscr(sas) < 0)
+            return -1;
+        viterbi_frame(sas, sas->senscr, frame_idx,
+                      sas->tokens
+                      + (frame_idx - first_frame) * sas->n_emit_state);
+    }
+    return 0;
+}
+
+/**
+ * Update alignment entry for next_state if state differs from it.
+ */
+static ps_alignment_iter_t *
+backtrace_state(ps_alignment_iter_t *itor, int frame, int state,
+                int *inout_next_state, int *inout_next_start)
+{
+    ps_alignment_entry_t *ent;
+
+    if (state == *inout_next_state)
+        return itor;
+    itor = ps_alignment_iter_goto(itor, *inout_next_state);
+    assert(itor != NULL);
+    ent = ps_alignment_iter_get(itor);
+    ent->start = frame + 1;
+    ent->duration = *inout_next_start - ent->start;
+    E_DEBUG(1,("state %d start %d end %d\n", *inout_next_state,
+               ent->start, *inout_next_start));
+    *inout_next_state = state;
+    *inout_next_start = frame + 1;
+    return itor;
+}
+
 static int
 state_align_search_finish(ps_search_t *search)
 {
@@ -209,6 +345,7 @@ state_align_search_finish(ps_search_t *search)
     ps_alignment_iter_t *itor;
     ps_alignment_entry_t *ent;
     int next_state, next_start, state, frame;
+    int rv = 0;
 
     /* Best state exiting the last frame. */
     next_state = state = hmm_out_history(final_phone);
@@ -218,19 +355,43 @@ state_align_search_finish(ps_search_t *search)
     }
     itor = ps_alignment_states(sas->al);
     next_start = sas->frame + 1;
-    for (frame = sas->frame - 1; frame >= 0; --frame) {
-        state = sas->tokens[frame * sas->n_emit_state + state];
-        /* State boundary, update alignment entry for next state. */
-        if (state != next_state) {
-            itor = ps_alignment_iter_goto(itor, next_state);
-            assert(itor != NULL);
-            ent = ps_alignment_iter_get(itor);
-            ent->start = frame + 1;
-            ent->duration = next_start - ent->start;
-            E_DEBUG(1,("state %d start %d end %d\n", next_state,
-                       ent->start, next_start));
-            next_state = state;
-            next_start = frame + 1;
+    if (sas->ckpt_interval > 0) {
+        hmm_t *final_hmms;
+        int32 final_best;
+        int first, last;
+
+        /* Recompute backpointers one segment at a time, last one
+         * first, then put back the final state of the search. */
+        final_hmms = ckd_malloc(sas->n_phones * sizeof(*final_hmms));
+        memcpy(final_hmms, sas->hmms, sas->n_phones * sizeof(*final_hmms));
+        final_best = sas->best_score;
+        for (last = sas->frame - 1; last >= 0; last = first - 1) {
+            first = last / sas->ckpt_interval * sas->ckpt_interval;
+            if (recompute_segment(sas, first, last) < 0) {
+                rv = -1;
+                break;
+            }
+            for (frame = last; frame >= first; --frame) {
+                state = sas->tokens[(frame - first) * sas->n_emit_state
+                                    + state];
+                itor = backtrace_state(itor, frame, state,
+                                       &next_state, &next_start);
+            }
+        }
+        memcpy(sas->hmms, final_hmms, sas->n_phones * sizeof(*final_hmms));
+        sas->best_score = final_best;
+        ckd_free(final_hmms);
+        if (rv < 0) {
+            ps_alignment_iter_free(itor);
+            return rv;
+        }
+    }
+    else {
+        for (frame = sas->frame - 1; frame >= 0; --frame) {
+            state = sas->tokens[frame * sas->n_emit_state + state];
+            /* State boundary, update alignment entry for next state. */
+            itor = backtrace_state(itor, frame, state,
+                                   &next_state, &next_start);
         }
     }
     /* Update alignment entry for initial state. */
@@ -261,6 +422,12 @@ state_align_search_free(ps_search_t *search)
     ps_search_deinit(search);
     ckd_free(sas->hmms);
     ckd_free(sas->tokens);
+    ckd_free(sas->ckpt_hmms);
+    ckd_free(sas->ckpt_best);
+    ckd_free(sas->sen_ids);
+    ckd_free(sas->senscr);
+    if (sas->senfh)
+        fclose(sas->senfh);
     hmm_context_free(sas->hmmctx);
     ckd_free(sas);
 }
@@ -271,11 +438,15 @@ static ps_searchfuncs_t state_align_search_funcs = {
     /* step: */   state_align_search_step,
     /* finish: */ state_align_search_finish,
     /* reinit: */ state_align_search_reinit,
+    /* add_word: */ NULL,
     /* free: */   state_align_search_free,
     /* lattice: */  NULL,
     /* hyp: */      NULL,
     /* prob: */     NULL,
     /* seg_iter: */ NULL,
+    /* scale_beams: */ NULL,
+    /* snapshot: */ NULL,
+    /* restore: */  NULL,
 };
 
 ps_search_t *
@@ -308,5 +479,35 @@ state_align_search_init(cmd_ln_t *config,
         hmm_init(sas->hmmctx, hmm, FALSE,
                  ent->id.pid.ssid, ent->id.pid.tmatid);
     }
+
+    /* Set up checkpointed mode. */
+    sas->ckpt_interval = cmd_ln_int32_r(config, "-aligncheckpoint");
+    if (sas->ckpt_interval > 0) {
+        int n_sen = bin_mdef_n_sen(acmod->mdef);
+        bitvec_t *sen_used;
+        int i, j;
+
+        /* Only the scores for senones in the alignment get spooled. */
+        sen_used = bitvec_alloc(n_sen);
+        for (i = 0; i < sas->n_phones; ++i)
+            for (j = 0; j < sas->hmmctx->n_emit_state; ++j)
+                if (hmm_senid(sas->hmms + i, j) != BAD_SENID)
+                    bitvec_set(sen_used, hmm_senid(sas->hmms + i, j));
+        sas->n_sen_ids = bitvec_count_set(sen_used, n_sen);
+        sas->sen_ids = ckd_calloc(sas->n_sen_ids, sizeof(*sas->sen_ids));
+        for (i = j = 0; i < n_sen; ++i)
+            if (bitvec_is_set(sen_used, i))
+                sas->sen_ids[j++] = i;
+        bitvec_free(sen_used);
+        sas->senscr = ckd_calloc(n_sen, sizeof(*sas->senscr));
+
+        /* One segment worth of tokens. */
+        sas->n_fr_alloc = sas->ckpt_interval;
+        sas->tokens = ckd_calloc(sas->n_emit_state * sas->n_fr_alloc,
+                                 sizeof(*sas->tokens));
+        E_INFO("Checkpointing state alignment every %d frames, "
+               "spooling %d senone scores per frame\n",
+               sas->ckpt_interval, sas->n_sen_ids);
+    }
     return ps_search_base(sas);
 }
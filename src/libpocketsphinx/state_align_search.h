@@ -66,6 +66,21 @@ struct state_align_search_s {
     int n_emit_state;       /**< Number of emitting states (tokens per frame) */
     uint16 *tokens;         /**< Tokens (backpointers) for state alignment. */
     int n_fr_alloc;         /**< Number of frames of tokens allocated. */
+
+    /* Checkpointed mode, used when -aligncheckpoint is non-zero.
+     * Instead of one vector of tokens per frame, a copy of the HMM
+     * vector is saved every ckpt_interval frames, and the senone
+     * scores used by the alignment are spooled to a temporary file,
+     * so that each segment can be re-run in finish() to recover its
+     * backpointers. */
+    int ckpt_interval;      /**< Frames between checkpoints (0 for none). */
+    hmm_t *ckpt_hmms;       /**< Saved HMM vectors, n_phones per checkpoint. */
+    int32 *ckpt_best;       /**< Saved best score for each checkpoint. */
+    int n_ckpt_alloc;       /**< Number of checkpoints allocated. */
+    uint16 *sen_ids;        /**< Senones used by the alignment. */
+    int n_sen_ids;          /**< Number of entries in sen_ids. */
+    int16 *senscr;          /**< Senone score buffer for recomputation. */
+    FILE *senfh;            /**< Spool file for senone scores. */
 };
 typedef struct state_align_search_s state_align_search_t;
 
@@ -0,0 +1,680 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2010 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced
+ * Research Projects Agency and the National Science Foundation of the
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+
+/**
+ * @file align.c Batch-mode forced alignment.
+ *
+ * Utterances are divided among a pool of worker processes, which are
+ * forked after the models are loaded so that they share them.  Each
+ * worker writes its results and a one-line report per utterance to
+ * temporary files, which the parent then merges in control file
+ * order.
+ */
+
+/* System headers. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_FORK) && !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define ALIGN_USE_FORK
+#endif
+
+/* SphinxBase headers. */
+#include <sphinxbase/pio.h>
+#include <sphinxbase/err.h>
+#include <sphinxbase/strfuncs.h>
+#include <sphinxbase/profile.h>
+#include <sphinxbase/byteorder.h>
+
+/* PocketSphinx headers. */
+#include <pocketsphinx.h>
+
+/* S3kr3t headerz. */
+#include "pocketsphinx_internal.h"
+#include "ps_alignment.h"
+#include "state_align_search.h"
+
+static const arg_t align_args_def[] = {
+    POCKETSPHINX_OPTIONS,
+    /* Argument file. */
+    { "-argfile",
+      ARG_STRING,
+      NULL,
+      "Argument file giving extra arguments." },
+    /* Control and transcription files. */
+    { "-ctl",
+      ARG_STRING,
+      NULL,
+      "Control file listing utterances to be aligned (file [uttid])" },
+    { "-ctloffset",
+      ARG_INT32,
+      "0",
+      "No. of utterances at the beginning of -ctl file to be skipped" },
+    { "-ctlcount",
+      ARG_INT32,
+      "-1",
+      "No. of utterances to be processed (after skipping -ctloffset entries)" },
+    { "-insent",
+      ARG_STRING,
+      NULL,
+      "Transcription file, one line per entry in -ctl" },
+    { "-nworker",
+      ARG_INT32,
+      "1",
+      "Number of worker processes" },
+
+    /* Input file types and locations. */
+    { "-adcin",
+      ARG_BOOLEAN,
+      "no",
+      "Input is raw audio data" },
+    { "-adchdr",
+      ARG_INT32,
+      "0",
+      "Size of audio file header in bytes (headers are ignored)" },
+    { "-cepdir",
+      ARG_STRING,
+      NULL,
+      "Input files directory (prefixed to filespecs in control file)" },
+    { "-cepext",
+      ARG_STRING,
+      ".mfc",
+      "Input files extension (suffixed to filespecs in control file)" },
+
+    /* Output files. */
+    { "-wordseg",
+      ARG_STRING,
+      NULL,
+      "Output file for word segmentations" },
+    { "-phseg",
+      ARG_STRING,
+      NULL,
+      "Output file for phone segmentations" },
+    { "-stseg",
+      ARG_STRING,
+      NULL,
+      "Output file for state (senone) segmentations" },
+
+    CMDLN_EMPTY_OPTION
+};
+
+/** Segmentation output levels. */
+enum align_level_e {
+    ALIGN_WORD,
+    ALIGN_PHONE,
+    ALIGN_STATE,
+    ALIGN_N_LEVEL
+};
+static char const *align_level_args[ALIGN_N_LEVEL] = {
+    "-wordseg", "-phseg", "-stseg"
+};
+
+/** Utterances to align. */
+typedef struct align_ctl_s {
+    char **files;
+    char **uttids;
+    char **texts;
+    int n_utt;
+} align_ctl_t;
+
+/** Per-worker temporary output. */
+typedef struct align_worker_s {
+    FILE *repfh;                 /**< One report line per utterance. */
+    FILE *segfh[ALIGN_N_LEVEL];  /**< One line per aligned utterance. */
+} align_worker_t;
+
+static mfcc_t **
+read_mfc_file(FILE *infh, int *out_nfr, int ceplen)
+{
+    long flen;
+    int32 nmfc, nfr;
+    float32 *floats;
+    mfcc_t **mfcs;
+    int swap, i;
+
+    fseek(infh, 0, SEEK_END);
+    flen = ftell(infh);
+    fseek(infh, 0, SEEK_SET);
+    if (fread(&nmfc, 4, 1, infh) != 1) {
+        E_ERROR_SYSTEM("Failed to read 4 bytes from MFCC file");
+        return NULL;
+    }
+    swap = 0;
+    if (nmfc != flen / 4 - 1) {
+        SWAP_INT32(&nmfc);
+        swap = 1;
+        if (nmfc != flen / 4 - 1) {
+            E_ERROR("File length mismatch: 0x%x != 0x%lx, maybe it's not MFCC file\n",
+                    nmfc, flen / 4 - 1);
+            return NULL;
+        }
+    }
+
+    nfr = nmfc / ceplen;
+    mfcs = ckd_calloc_2d(nfr, ceplen, sizeof(**mfcs));
+    floats = (float32 *)mfcs[0];
+    if (fread(floats, 4, nfr * ceplen, infh) != nfr * ceplen) {
+        E_ERROR_SYSTEM("Failed to read %d items from mfcfile", nfr * ceplen);
+        ckd_free_2d(mfcs);
+        return NULL;
+    }
+    if (swap) {
+        for (i = 0; i < nfr * ceplen; ++i)
+            SWAP_FLOAT32(&floats[i]);
+    }
+#ifdef FIXED_POINT
+    for (i = 0; i < nfr * ceplen; ++i)
+        mfcs[0][i] = FLOAT2MFCC(floats[i]);
+#endif
+    *out_nfr = nfr;
+    return mfcs;
+}
+
+/**
+ * Step the search over all frames currently available in acmod.
+ */
+static int
+align_frames(acmod_t *acmod, ps_search_t *search)
+{
+    while (acmod->n_feat_frame > 0) {
+        if (ps_search_step(search, acmod->output_frame) < 0)
+            return -1;
+        acmod_advance(acmod);
+    }
+    return 0;
+}
+
+/**
+ * Run the alignment search over an input file.
+ *
+ * @return Number of frames aligned, or <0 on error.
+ */
+static int
+align_input(cmd_ln_t *config, acmod_t *acmod, ps_search_t *search,
+            FILE *infh)
+{
+    if (acmod_start_utt(acmod) < 0)
+        return -1;
+    if (ps_search_start(search) < 0)
+        goto error_out;
+
+    if (cmd_ln_boolean_r(config, "-adcin")) {
+        int16 buf[2048];
+        size_t nread;
+
+        fseek(infh, cmd_ln_int32_r(config, "-adchdr"), SEEK_SET);
+        while ((nread = fread(buf, sizeof(*buf), 2048, infh)) > 0) {
+            int16 const *bptr = buf;
+            while (nread > 0) {
+                if (acmod_process_raw(acmod, &bptr, &nread, FALSE) < 0)
+                    goto error_out;
+                if (align_frames(acmod, search) < 0)
+                    goto error_out;
+            }
+        }
+    }
+    else {
+        mfcc_t **mfcs, **cptr;
+        int nfr, n_left;
+
+        if ((mfcs = read_mfc_file(infh, &nfr,
+                                  cmd_ln_int32_r(config, "-ceplen"))) == NULL)
+            goto error_out;
+        cptr = mfcs;
+        n_left = nfr;
+        while (n_left > 0) {
+            if (acmod_process_cep(acmod, &cptr, &n_left, FALSE) < 0) {
+                ckd_free_2d(mfcs);
+                goto error_out;
+            }
+            if (align_frames(acmod, search) < 0) {
+                ckd_free_2d(mfcs);
+                goto error_out;
+            }
+        }
+        ckd_free_2d(mfcs);
+    }
+
+    /* Flush out any remaining frames and backtrace. */
+    acmod_end_utt(acmod);
+    if (align_frames(acmod, search) < 0)
+        return -1;
+    if (ps_search_finish(search) < 0)
+        return -1;
+    return acmod->output_frame;
+
+error_out:
+    acmod_end_utt(acmod);
+    return -1;
+}
+
+static void
+write_seg(FILE *fh, ps_decoder_t *ps, ps_alignment_iter_t *itor,
+          int level, char const *uttid)
+{
+    fprintf(fh, "%s", uttid);
+    for (; itor; itor = ps_alignment_iter_next(itor)) {
+        ps_alignment_entry_t *ent = ps_alignment_iter_get(itor);
+
+        fprintf(fh, " %d %d ", ent->start, ent->duration);
+        switch (level) {
+        case ALIGN_WORD:
+            fputs(dict_wordstr(ps->dict, ent->id.wid), fh);
+            break;
+        case ALIGN_PHONE:
+            fputs(bin_mdef_ciphone_str(ps->acmod->mdef, ent->id.pid.cipid), fh);
+            break;
+        case ALIGN_STATE:
+            fprintf(fh, "%d", ent->id.senid);
+            break;
+        }
+    }
+    fputc('\n', fh);
+}
+
+/**
+ * Align one utterance and write its segmentations.
+ *
+ * @return Number of frames aligned, or <0 on error.
+ */
+static int
+align_utt(ps_decoder_t *ps, cmd_ln_t *config, align_worker_t *w,
+          char const *file, char const *uttid, char *text)
+{
+    ps_alignment_t *al;
+    ps_search_t *search = NULL;
+    char const *cepdir, *cepext;
+    char *infile = NULL;
+    char **words = NULL;
+    FILE *infh = NULL;
+    int nwords, i, nfr = -1;
+
+    /* Build the word sequence, ignoring a trailing (uttid). */
+    al = ps_alignment_init(ps->d2p);
+    ps_alignment_add_word(al, dict_startwid(ps->dict), 0);
+    nwords = str2words(text, NULL, 0);
+    words = ckd_calloc(nwords, sizeof(*words));
+    str2words(text, words, nwords);
+    if (nwords > 0 && words[nwords - 1][0] == '(')
+        --nwords;
+    for (i = 0; i < nwords; ++i) {
+        s3wid_t wid = dict_wordid(ps->dict, words[i]);
+        if (wid == BAD_S3WID) {
+            E_ERROR("%s: Unknown word %s in transcription\n", uttid, words[i]);
+            goto error_out;
+        }
+        ps_alignment_add_word(al, wid, 0);
+    }
+    ps_alignment_add_word(al, dict_finishwid(ps->dict), 0);
+    if (ps_alignment_populate(al) < 0) {
+        E_ERROR("%s: Failed to populate alignment\n", uttid);
+        goto error_out;
+    }
+    if ((search = state_align_search_init(config, ps->acmod, al)) == NULL)
+        goto error_out;
+
+    /* Open the input and align it. */
+    cepdir = cmd_ln_str_r(config, "-cepdir");
+    cepext = cmd_ln_str_r(config, "-cepext");
+    infile = string_join(cepdir ? cepdir : "",
+                         cepdir ? "/" : "", file,
+                         cepext ? cepext : "", NULL);
+    if ((infh = fopen(infile, "rb")) == NULL) {
+        E_ERROR_SYSTEM("%s: Failed to open %s", uttid, infile);
+        goto error_out;
+    }
+    if ((nfr = align_input(config, ps->acmod, search, infh)) < 0) {
+        E_ERROR("%s: Alignment failed\n", uttid);
+        goto error_out;
+    }
+
+    if (w->segfh[ALIGN_WORD])
+        write_seg(w->segfh[ALIGN_WORD], ps, ps_alignment_words(al),
+                  ALIGN_WORD, uttid);
+    if (w->segfh[ALIGN_PHONE])
+        write_seg(w->segfh[ALIGN_PHONE], ps, ps_alignment_phones(al),
+                  ALIGN_PHONE, uttid);
+    if (w->segfh[ALIGN_STATE])
+        write_seg(w->segfh[ALIGN_STATE], ps, ps_alignment_states(al),
+                  ALIGN_STATE, uttid);
+
+error_out:
+    if (infh)
+        fclose(infh);
+    ckd_free(infile);
+    ckd_free(words);
+    if (search)
+        ps_search_free(search);
+    ps_alignment_free(al);
+    return nfr;
+}
+
+/**
+ * Align every nworker'th utterance starting at worker_id.
+ */
+static void
+align_worker(ps_decoder_t *ps, cmd_ln_t *config, align_ctl_t *ctl,
+             align_worker_t *w, int worker_id, int nworker)
+{
+    ptmr_t tm;
+    int frate, i;
+
+    frate = cmd_ln_int32_r(config, "-frate");
+    ptmr_init(&tm);
+    for (i = worker_id; i < ctl->n_utt; i += nworker) {
+        int nfr;
+
+        ptmr_reset(&tm);
+        ptmr_start(&tm);
+        nfr = align_utt(ps, config, w, ctl->files[i],
+                        ctl->uttids[i], ctl->texts[i]);
+        ptmr_stop(&tm);
+        fprintf(w->repfh, "%s %d %.3f %.3f\n", ctl->uttids[i],
+                nfr, tm.t_cpu, tm.t_elapsed);
+        if (nfr > 0)
+            E_INFO("%s: %.2f seconds speech, %.2f seconds CPU, %.2f xRT\n",
+                   ctl->uttids[i], (double)nfr / frate, tm.t_cpu,
+                   tm.t_cpu * frate / nfr);
+    }
+}
+
+static int
+read_ctl(cmd_ln_t *config, align_ctl_t *ctl)
+{
+    FILE *ctlfh, *sentfh;
+    int32 ctloffset, ctlcount;
+    int n_alloc, i;
+    char *line;
+    size_t len;
+
+    if ((ctlfh = fopen(cmd_ln_str_r(config, "-ctl"), "r")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open control file '%s'",
+                       cmd_ln_str_r(config, "-ctl"));
+        return -1;
+    }
+    if ((sentfh = fopen(cmd_ln_str_r(config, "-insent"), "r")) == NULL) {
+        E_ERROR_SYSTEM("Failed to open transcription file '%s'",
+                       cmd_ln_str_r(config, "-insent"));
+        fclose(ctlfh);
+        return -1;
+    }
+    ctloffset = cmd_ln_int32_r(config, "-ctloffset");
+    ctlcount = cmd_ln_int32_r(config, "-ctlcount");
+
+    n_alloc = 0;
+    for (i = 0; (line = fread_line(ctlfh, &len)); ++i) {
+        char *sent, *wptr[2];
+        int nf;
+
+        if ((sent = fread_line(sentfh, &len)) == NULL) {
+            E_ERROR("File size mismatch between control and transcription\n");
+            ckd_free(line);
+            break;
+        }
+        if (i < ctloffset
+            || (ctlcount != -1 && i >= ctloffset + ctlcount)) {
+            ckd_free(line);
+            ckd_free(sent);
+            continue;
+        }
+        if ((nf = str2words(line, wptr, 2)) <= 0) {
+            if (nf < 0)
+                E_ERROR("Unexpected extra data in control file at line %d\n", i);
+            ckd_free(line);
+            ckd_free(sent);
+            continue;
+        }
+        if (ctl->n_utt == n_alloc) {
+            n_alloc += 128;
+            ctl->files = ckd_realloc(ctl->files, n_alloc * sizeof(*ctl->files));
+            ctl->uttids = ckd_realloc(ctl->uttids, n_alloc * sizeof(*ctl->uttids));
+            ctl->texts = ckd_realloc(ctl->texts, n_alloc * sizeof(*ctl->texts));
+        }
+        ctl->files[ctl->n_utt] = ckd_salloc(wptr[0]);
+        ctl->uttids[ctl->n_utt] = ckd_salloc(nf > 1 ? wptr[1] : wptr[0]);
+        ctl->texts[ctl->n_utt] = sent;
+        ++ctl->n_utt;
+        ckd_free(line);
+    }
+    fclose(ctlfh);
+    fclose(sentfh);
+    return ctl->n_utt;
+}
+
+static void
+free_ctl(align_ctl_t *ctl)
+{
+    int i;
+
+    for (i = 0; i < ctl->n_utt; ++i) {
+        ckd_free(ctl->files[i]);
+        ckd_free(ctl->uttids[i]);
+        ckd_free(ctl->texts[i]);
+    }
+    ckd_free(ctl->files);
+    ckd_free(ctl->uttids);
+    ckd_free(ctl->texts);
+}
+
+/**
+ * Merge worker output back into control file order and report.
+ *
+ * @return Number of failed utterances.
+ */
+static int
+merge_results(cmd_ln_t *config, align_ctl_t *ctl,
+              align_worker_t *workers, int nworker, ptmr_t *tm)
+{
+    FILE *outfh[ALIGN_N_LEVEL];
+    double n_speech, n_cpu;
+    int frate, n_failed, i, j;
+
+    for (j = 0; j < ALIGN_N_LEVEL; ++j) {
+        char const *outfile;
+
+        outfh[j] = NULL;
+        if ((outfile = cmd_ln_str_r(config, align_level_args[j])) == NULL)
+            continue;
+        if ((outfh[j] = fopen(outfile, "w")) == NULL)
+            E_ERROR_SYSTEM("Failed to open %s for writing", outfile);
+    }
+    for (i = 0; i < nworker; ++i) {
+        rewind(workers[i].repfh);
+        for (j = 0; j < ALIGN_N_LEVEL; ++j)
+            if (workers[i].segfh[j])
+                rewind(workers[i].segfh[j]);
+    }
+
+    frate = cmd_ln_int32_r(config, "-frate");
+    n_speech = n_cpu = 0.0;
+    n_failed = 0;
+    for (i = 0; i < ctl->n_utt; ++i) {
+        align_worker_t *w = workers + i % nworker;
+        char *line, *wptr[4];
+        size_t len;
+        int nfr = -1;
+
+        /* A missing report line means the worker died. */
+        if ((line = fread_line(w->repfh, &len)) != NULL
+            && str2words(line, wptr, 4) == 4) {
+            nfr = atoi(wptr[1]);
+            n_cpu += atof_c(wptr[2]);
+        }
+        ckd_free(line);
+        if (nfr < 0) {
+            E_ERROR("%s: FAILED\n", ctl->uttids[i]);
+            ++n_failed;
+            continue;
+        }
+        n_speech += (double)nfr / frate;
+        for (j = 0; j < ALIGN_N_LEVEL; ++j) {
+            if (w->segfh[j] == NULL)
+                continue;
+            line = fread_line(w->segfh[j], &len);
+            if (line && outfh[j])
+                fputs(line, outfh[j]);
+            ckd_free(line);
+        }
+    }
+
+    E_INFO("TOTAL %d utterances, %d failed, %.2f seconds speech, "
+           "%.2f seconds CPU, %.2f seconds wall\n",
+           ctl->n_utt, n_failed, n_speech, n_cpu, tm->t_elapsed);
+    if (n_speech > 0)
+        E_INFO("AVERAGE %.2f xRT (CPU), %.2f xRT (elapsed) with %d workers\n",
+               n_cpu / n_speech, tm->t_elapsed / n_speech, nworker);
+
+    for (j = 0; j < ALIGN_N_LEVEL; ++j)
+        if (outfh[j])
+            fclose(outfh[j]);
+    return n_failed;
+}
+
+int
+main(int32 argc, char *argv[])
+{
+    ps_decoder_t *ps;
+    cmd_ln_t *config;
+    char const *str;
+    align_ctl_t ctl;
+    align_worker_t *workers;
+    ptmr_t tm;
+    int nworker, n_failed, i, j;
+
+    /* Handle argument file as only argument. */
+    if (argc == 2) {
+        config = cmd_ln_parse_file_r(NULL, align_args_def, argv[1], TRUE);
+    }
+    else {
+        config = cmd_ln_parse_r(NULL, align_args_def, argc, argv, TRUE);
+    }
+    /* Handle argument file as -argfile. */
+    if (config && (str = cmd_ln_str_r(config, "-argfile")) != NULL) {
+        config = cmd_ln_parse_file_r(config, align_args_def, str, FALSE);
+    }
+    if (config == NULL) {
+        /* This probably just means that we got no arguments. */
+        return 2;
+    }
+    if (cmd_ln_str_r(config, "-ctl") == NULL
+        || cmd_ln_str_r(config, "-insent") == NULL) {
+        E_FATAL("-ctl and -insent arguments are required for alignment\n");
+    }
+
+    memset(&ctl, 0, sizeof(ctl));
+    if (read_ctl(config, &ctl) < 0)
+        return 1;
+    ps = ps_init(config);
+    if (ps == NULL) {
+        E_FATAL("PocketSphinx decoder init failed\n");
+    }
+
+    nworker = cmd_ln_int32_r(config, "-nworker");
+#ifndef ALIGN_USE_FORK
+    if (nworker > 1) {
+        E_WARN("Worker processes are not supported on this platform\n");
+        nworker = 1;
+    }
+#endif
+    if (nworker > ctl.n_utt)
+        nworker = ctl.n_utt;
+    if (nworker < 1)
+        nworker = 1;
+
+    /* Worker output goes to anonymous temporary files, which are
+     * inherited by the worker processes. */
+    workers = ckd_calloc(nworker, sizeof(*workers));
+    for (i = 0; i < nworker; ++i) {
+        if ((workers[i].repfh = tmpfile()) == NULL)
+            E_FATAL_SYSTEM("Failed to create temporary file");
+        for (j = 0; j < ALIGN_N_LEVEL; ++j) {
+            if (cmd_ln_str_r(config, align_level_args[j]) == NULL)
+                continue;
+            if ((workers[i].segfh[j] = tmpfile()) == NULL)
+                E_FATAL_SYSTEM("Failed to create temporary file");
+        }
+    }
+
+    ptmr_init(&tm);
+    ptmr_start(&tm);
+#ifdef ALIGN_USE_FORK
+    if (nworker > 1) {
+        pid_t *pids = ckd_calloc(nworker, sizeof(*pids));
+
+        fflush(NULL);
+        for (i = 0; i < nworker; ++i) {
+            if ((pids[i] = fork()) < 0) {
+                E_ERROR_SYSTEM("Failed to start worker %d", i);
+            }
+            else if (pids[i] == 0) {
+                align_worker(ps, config, &ctl, workers + i, i, nworker);
+                fflush(NULL);
+                _exit(0);
+            }
+        }
+        for (i = 0; i < nworker; ++i) {
+            int status;
+            if (pids[i] <= 0)
+                continue;
+            if (waitpid(pids[i], &status, 0) < 0
+                || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                E_ERROR("Worker %d exited abnormally\n", i);
+        }
+        ckd_free(pids);
+    }
+    else
+#endif
+        align_worker(ps, config, &ctl, workers, 0, 1);
+    ptmr_stop(&tm);
+
+    n_failed = merge_results(config, &ctl, workers, nworker, &tm);
+
+    for (i = 0; i < nworker; ++i) {
+        fclose(workers[i].repfh);
+        for (j = 0; j < ALIGN_N_LEVEL; ++j)
+            if (workers[i].segfh[j])
+                fclose(workers[i].segfh[j]);
+    }
+    ckd_free(workers);
+    free_ctl(&ctl);
+    ps_free(ps);
+    cmd_ln_free_r(config);
+    return n_failed ? 1 : 0;
+}
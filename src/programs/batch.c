@@ -153,7 +153,7 @@ static const arg_t ps_args_def[] = {
     { "-outlatfmt",
       ARG_STRING,
       "s3",
-      "Format for dumping word lattices (s3 or htk)" },
+      "Format for dumping word lattices (s3, htk or bin)" },
     { "-outlatext",
       ARG_STRING,
       ".lat",
@@ -461,6 +461,12 @@ write_lattice(ps_decoder_t *ps, char const *latdir, char const *uttid)
             return -1;
         }
     }
+    else if (0 == strcmp("bin", cmd_ln_str_r(config, "-outlatfmt"))) {
+        if (ps_lattice_write_bin(lat, outfile) < 0) {
+            E_ERROR("Failed to write lattice to %s\n", outfile);
+            return -1;
+        }
+    }
     else {
         if (ps_lattice_write(lat, outfile) < 0) {
             E_ERROR("Failed to write lattice to %s\n", outfile);
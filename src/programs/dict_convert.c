@@ -0,0 +1,117 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2010 Carnegie Mellon University.  All rights
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced
+ * Research Projects Agency and the National Science Foundation of the
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * @file dict_convert.c Compile pronunciation dictionaries to binary form.
+ *
+ * The binary form can be memory-mapped by the decoder, which avoids
+ * parsing the dictionary and building its hash table at startup.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/err.h>
+
+#include "bin_mdef.h"
+#include "dict.h"
+
+static const arg_t dict_convert_args_def[] = {
+    { "-mdef",
+      REQARG_STRING,
+      NULL,
+      "Model definition input file (phone IDs are checked against it)" },
+    { "-dict",
+      REQARG_STRING,
+      NULL,
+      "Main pronunciation dictionary (lexicon) input file" },
+    { "-fdict",
+      ARG_STRING,
+      NULL,
+      "Noise word pronunciation dictionary input file" },
+    { "-dictcase",
+      ARG_BOOLEAN,
+      "no",
+      "Dictionary is case sensitive (NOTE: case insensitivity applies to ASCII characters only)" },
+    { "-outdict",
+      REQARG_STRING,
+      NULL,
+      "Output dictionary file" },
+    { "-outformat",
+      ARG_STRING,
+      "bin",
+      "Output format, one of bin or text (text drops filler words)" },
+    CMDLN_EMPTY_OPTION
+};
+
+int
+main(int argc, char *argv[])
+{
+    cmd_ln_t *config;
+    bin_mdef_t *mdef;
+    dict_t *dict;
+    char const *outfile;
+    int rv;
+
+    if ((config = cmd_ln_parse_r(NULL, dict_convert_args_def,
+                                 argc, argv, TRUE)) == NULL)
+        return 1;
+
+    if ((mdef = bin_mdef_read(NULL, cmd_ln_str_r(config, "-mdef"))) == NULL) {
+        E_ERROR("Failed to read model definition from %s\n",
+                cmd_ln_str_r(config, "-mdef"));
+        return 1;
+    }
+    if ((dict = dict_init(config, mdef)) == NULL) {
+        E_ERROR("Failed to read dictionary from %s\n",
+                cmd_ln_str_r(config, "-dict"));
+        return 1;
+    }
+
+    outfile = cmd_ln_str_r(config, "-outdict");
+    rv = dict_write(dict, outfile, cmd_ln_str_r(config, "-outformat"));
+    if (rv < 0)
+        E_ERROR("Failed to write dictionary to %s\n", outfile);
+    else
+        E_INFO("Wrote %d words to %s\n", dict_size(dict), outfile);
+
+    dict_free(dict);
+    bin_mdef_free(mdef);
+    cmd_ln_free_r(config);
+
+    return rv < 0;
+}
@@ -120,6 +120,7 @@ LOCAL_SRC_FILES := \
 	dict2pid.c    \
 	fsg_history.c   \
 	fsg_lextree.c   \
+	fsg_optimize.c   \
 	fsg_search.c   \
 	hmm.c.arm     \
 	mdef.c     \
@@ -135,6 +136,7 @@ LOCAL_SRC_FILES := \
 	ps_mllr.c    \
 	ptm_mgau.c.arm    \
 	s2_semi_mgau.c.arm   \
+	snapshot.c   \
 	tmat.c     \
 	vector.c
 
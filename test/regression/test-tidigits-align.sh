@@ -0,0 +1,38 @@
+#!/bin/sh
+
+. ../testfuncs.sh
+
+bn=`basename $0 .sh`
+
+echo "Test: $bn"
+run_program pocketsphinx_align \
+    -hmm $model/hmm/en/tidigits \
+    -dict $model/lm/en/tidigits.dic \
+    -ctl $data/tidigits/tidigits.ctl \
+    -insent $data/tidigits/tidigits.lsn \
+    -cepdir $data/tidigits \
+    -nworker 2 \
+    -wordseg $bn.wdseg \
+    -phseg $bn.phseg \
+    > $bn.log 2>&1
+
+# Test whether it actually completed
+if [ $? = 0 ]; then
+    pass "run"
+else
+    fail "run"
+fi
+
+# Every utterance should be aligned, in control file order
+nutt=`wc -l < $data/tidigits/tidigits.ctl`
+if [ `wc -l < $bn.wdseg` = $nutt ] \
+    && cut -d' ' -f1 $bn.wdseg | cmp -s - $data/tidigits/tidigits.ctl; then
+    pass "wordseg"
+else
+    fail "wordseg"
+fi
+if [ `wc -l < $bn.phseg` = $nutt ]; then
+    pass "phseg"
+else
+    fail "phseg"
+fi
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <pocketsphinx.h>
+
+#include <sphinxbase/logmath.h>
+#include <sphinxbase/bitvec.h>
+
+#include "acmod.h"
+#include "test_macros.h"
+
+#define LAG 2
+
+static void
+activate_every(acmod_t *acmod, int n)
+{
+	int i;
+
+	acmod_clear_active(acmod);
+	for (i = 0; i < bin_mdef_n_sen(acmod->mdef); i += n)
+		bitvec_set(acmod->senone_active_vec, i);
+}
+
+static int
+start_whole_utt(acmod_t *acmod, int16 const *buf, size_t nsamps)
+{
+	int16 const *bptr = buf;
+
+	TEST_EQUAL(0, acmod_start_utt(acmod));
+	acmod_process_raw(acmod, &bptr, &nsamps, TRUE);
+	TEST_EQUAL(0, acmod_end_utt(acmod));
+	return acmod->n_feat_frame;
+}
+
+int
+main(int argc, char *argv[])
+{
+	acmod_t *acmod;
+	logmath_t *lmath;
+	cmd_ln_t *config;
+	FILE *rawfh;
+	int16 *buf;
+	int16 **refscr;
+	size_t nsamps;
+	int i, nfr, n_sen;
+
+	lmath = logmath_init(1.0001, 0, 0);
+	config = cmd_ln_init(NULL, ps_args(), TRUE,
+			     "-featparams", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/feat.params",
+			     "-mdef", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/mdef",
+			     "-mean", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/means",
+			     "-var", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/variances",
+			     "-tmat", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/transition_matrices",
+			     "-sendump", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/sendump",
+			     "-pl_window", "2",
+			     "-cmn", "current",
+			     "-mmap", "no",
+			     "-input_endian", "little",
+			     "-samprate", "16000", NULL);
+	TEST_ASSERT(config);
+	TEST_ASSERT(acmod = acmod_init(config, lmath, NULL, NULL));
+	TEST_EQUAL(LAG + 1, acmod->n_senscr_hist);
+	n_sen = bin_mdef_n_sen(acmod->mdef);
+
+	/* Active senones are listed exactly, even across large gaps. */
+	acmod_clear_active(acmod);
+	acmod_activate_sen(acmod, 3);
+	acmod_activate_sen(acmod, 1000);
+	acmod_activate_sen(acmod, n_sen - 1);
+	TEST_EQUAL(3, acmod_flags2list(acmod));
+	TEST_EQUAL(3, acmod->senone_active[0]);
+	TEST_EQUAL(1000, acmod->senone_active[1]);
+	TEST_EQUAL(n_sen - 1, acmod->senone_active[2]);
+
+	/* HMMs sharing a senone sequence only expand it once. */
+	{
+		hmm_context_t *ctx;
+		hmm_t hmm1, hmm2;
+		int j;
+
+		TEST_ASSERT(ctx = hmm_context_init(bin_mdef_n_emit_state(acmod->mdef),
+						   acmod->tmat->tp, NULL,
+						   acmod->mdef->sseq));
+		hmm_init(ctx, &hmm1, FALSE, 42, 0);
+		hmm_init(ctx, &hmm2, FALSE, 42, 0);
+		acmod_clear_active(acmod);
+		acmod_activate_hmm(acmod, &hmm1);
+		acmod_activate_hmm(acmod, &hmm2);
+		TEST_ASSERT(acmod_flags2list(acmod) > 0);
+		TEST_EQUAL(2, acmod->n_ssid_hmm);
+		TEST_EQUAL(1, acmod->n_ssid_expand);
+		for (j = 0; j < bin_mdef_n_emit_state(acmod->mdef); ++j)
+			TEST_ASSERT(bitvec_is_set(acmod->senone_active_vec,
+						  bin_mdef_sseq2sen(acmod->mdef, 42, j)));
+		hmm_deinit(&hmm1);
+		hmm_deinit(&hmm2);
+		hmm_context_free(ctx);
+	}
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	nsamps = ftell(rawfh) / sizeof(*buf);
+	fseek(rawfh, 0, SEEK_SET);
+	buf = ckd_calloc(nsamps, sizeof(*buf));
+	TEST_EQUAL(nsamps, fread(buf, sizeof(*buf), nsamps, rawfh));
+	fclose(rawfh);
+
+	/* Reference: score every third senone in each frame directly. */
+	nfr = start_whole_utt(acmod, buf, nsamps);
+	refscr = (int16 **)ckd_calloc_2d(nfr, n_sen, sizeof(**refscr));
+	for (i = 0; i < nfr; ++i) {
+		int frame_idx = i;
+		int16 const *senscr;
+
+		activate_every(acmod, 3);
+		TEST_ASSERT(senscr = acmod_score(acmod, &frame_idx));
+		memcpy(refscr[i], senscr, n_sen * sizeof(*senscr));
+		acmod_advance(acmod);
+	}
+
+	/* Now score every second senone in each frame, and every third
+	 * one LAG frames behind, as the phone loop and main search do.
+	 * The lagged scores should be reused where possible but come
+	 * out the same. */
+	TEST_EQUAL(nfr, start_whole_utt(acmod, buf, nsamps));
+	for (i = 0; i < nfr; ++i) {
+		int frame_idx = i;
+		int16 const *senscr;
+
+		activate_every(acmod, 2);
+		TEST_ASSERT(acmod_score(acmod, &frame_idx));
+		if (i >= LAG) {
+			int j;
+
+			frame_idx = i - LAG;
+			activate_every(acmod, 3);
+			TEST_ASSERT(senscr = acmod_score(acmod, &frame_idx));
+			TEST_EQUAL(i - LAG, frame_idx);
+			for (j = 0; j < n_sen; j += 3)
+				TEST_EQUAL(refscr[i - LAG][j], senscr[j]);
+		}
+		acmod_advance(acmod);
+	}
+
+	ckd_free_2d((void **)refscr);
+	ckd_free(buf);
+	acmod_free(acmod);
+	logmath_free(lmath);
+	cmd_ln_free_r(config);
+	return 0;
+}
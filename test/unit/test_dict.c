@@ -11,7 +11,7 @@ int
 main(int argc, char *argv[])
 {
 	bin_mdef_t *mdef;
-	dict_t *dict;
+	dict_t *dict, *dict2;
 	cmd_ln_t *config;
 
 	int i;
@@ -34,6 +34,36 @@ main(int argc, char *argv[])
 	TEST_EQUAL(0, dict_write(dict, "_cmu07a.dic", NULL));
 	TEST_EQUAL(0, system("diff -uw " MODELDIR "/lm/en_US/cmu07a.dic _cmu07a.dic"));
 
+	/* Compile it to binary and read that back. */
+	TEST_EQUAL(0, dict_write(dict, "_cmu07a.bdic", "bin"));
+	cmd_ln_set_str_r(config, "-dict", "_cmu07a.bdic");
+	TEST_ASSERT(dict2 = dict_init(config, mdef));
+	TEST_EQUAL(dict_size(dict), dict_size(dict2));
+	TEST_EQUAL(dict_filler_start(dict), dict_filler_start(dict2));
+	TEST_EQUAL(dict_filler_end(dict), dict_filler_end(dict2));
+	TEST_EQUAL(dict_silwid(dict), dict_silwid(dict2));
+	for (i = 0; i < dict_size(dict); ++i) {
+		int j;
+
+		TEST_EQUAL(i, dict_wordid(dict2, dict_wordstr(dict, i)));
+		TEST_EQUAL(dict_basewid(dict, i), dict_basewid(dict2, i));
+		TEST_EQUAL(dict_pronlen(dict, i), dict_pronlen(dict2, i));
+		for (j = 0; j < dict_pronlen(dict, i); ++j)
+			TEST_EQUAL(dict_pron(dict, i, j), dict_pron(dict2, i, j));
+	}
+	TEST_EQUAL(BAD_S3WID, dict_wordid(dict2, "ASDFASFASSD"));
+	/* Runtime additions go on top of it. */
+	TEST_EQUAL(BAD_S3WID, dict_add_word(dict2, "CARNEGIE", NULL, 0));
+	TEST_EQUAL(dict_size(dict), dict_add_word(dict2, "ASDFASFASSD", NULL, 0));
+	TEST_EQUAL(BAD_S3WID, dict_add_word(dict2, "ASDFASFASSD", NULL, 0));
+	TEST_EQUAL(dict_size(dict), dict_wordid(dict2, "ASDFASFASSD"));
+	TEST_EQUAL(dict_size(dict) + 1,
+		   dict_add_word(dict2, "CARNEGIE(9)", NULL, 0));
+	TEST_EQUAL(dict_wordid(dict2, "CARNEGIE"),
+		   dict_basewid(dict2, dict_wordid(dict2, "CARNEGIE(9)")));
+	dict_free(dict2);
+	cmd_ln_set_str_r(config, "-dict", MODELDIR "/lm/en_US/cmu07a.dic");
+
 	dict_free(dict);
 	bin_mdef_free(mdef);
 
@@ -15,14 +15,41 @@ main(int argc, char *argv[])
 	dict_t *dict;
 	dict2pid_t *d2p;
 	cmd_ln_t *config;
+	int p;
 
 	TEST_ASSERT(config = cmd_ln_init(NULL, NULL, FALSE,
 						   "-dict", MODELDIR "/lm/en_US/cmu07a.dic",
 						   "-fdict", MODELDIR "/hmm/en_US/hub4wsj_sc_8k/noisedict",
 						   NULL));
 	TEST_ASSERT(mdef = bin_mdef_read(NULL, MODELDIR "/hmm/en_US/hub4wsj_sc_8k/mdef"));
+	/* Every triphone should be found from its own contexts. */
+	for (p = bin_mdef_n_ciphone(mdef); p < bin_mdef_n_phone(mdef); ++p) {
+		mdef_entry_t *e = &mdef->phone[p];
+
+		if (bin_mdef_is_fillerphone(mdef, e->info.cd.ctx[1])
+		    || bin_mdef_is_fillerphone(mdef, e->info.cd.ctx[2]))
+			continue;
+		TEST_EQUAL(p, bin_mdef_phone_id(mdef, e->info.cd.ctx[0],
+						e->info.cd.ctx[1],
+						e->info.cd.ctx[2],
+						e->info.cd.wpos));
+	}
 	TEST_ASSERT(dict = dict_init(config, mdef));
 	TEST_ASSERT(d2p = dict2pid_build(mdef, dict));
+	/* Cross-word tables are only filled in for diphones in the
+	 * dictionary, but lookups work for all of them. */
+	for (p = 0; p < dict_size(dict); ++p) {
+		if (dict_pronlen(dict, p) < 2)
+			continue;
+		TEST_ASSERT(IS_S3SSID(dict2pid_ldiph_lc(d2p, dict_first_phone(dict, p),
+							dict_second_phone(dict, p),
+							bin_mdef_silphone(mdef))));
+		TEST_ASSERT(dict2pid_rssid(d2p, dict_last_phone(dict, p),
+					   dict_second_last_phone(dict, p))->n_ssid > 0);
+	}
+	TEST_ASSERT(d2p->alloc < 2 * bin_mdef_n_ciphone(mdef)
+		    * bin_mdef_n_ciphone(mdef) * bin_mdef_n_ciphone(mdef)
+		    * sizeof(s3ssid_t));
 
 	dict_free(dict);
 	dict2pid_free(d2p);
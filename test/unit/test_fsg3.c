@@ -81,6 +81,26 @@ main(int argc, char *argv[])
 	printf("BESTPATH: %s\n",
 	       ps_lattice_hyp(dag, ps_lattice_bestpath(dag, NULL, 1.0, 15.0)));
 	ps_lattice_posterior(dag, NULL, 15.0);
+
+	/* An alternate pronunciation with the same first and last
+	 * phones goes straight into the lextree.  A rebuild would
+	 * reinitialize its nodes, so mark one and check that it
+	 * survives. */
+	{
+		fsg_lextree_t *lextree = fsgs->lextree;
+		fsg_pnode_t *root;
+		int32 n_pnode = fsg_lextree_n_pnode(lextree);
+
+		TEST_ASSERT(root = fsg_lextree_root(lextree,
+						    fsg_model_start_state(fsgs->fsg)));
+		root->hmm.bestscore = 42;
+		TEST_ASSERT(ps_add_word(ps, "ONE(2)",
+					"W_one AX_one AX_one N_one", TRUE) > 0);
+		TEST_ASSERT(fsgs->lextree == lextree);
+		TEST_EQUAL(42, root->hmm.bestscore);
+		TEST_ASSERT(fsg_lextree_n_pnode(lextree) > n_pnode);
+		root->hmm.bestscore = WORST_SCORE;
+	}
 	ps_free(ps);
 	cmd_ln_free_r(config);
 
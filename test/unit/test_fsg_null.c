@@ -0,0 +1,118 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sphinxbase/fsg_model.h>
+
+#include "pocketsphinx_internal.h"
+#include "fsg_search_internal.h"
+#include "test_macros.h"
+
+/* States in each null transition chain of the synthetic grammar. */
+#define SEG_LEN 250
+
+/*
+ * Build a grammar for "go forward ten meters" made of four chains of
+ * SEG_LEN states joined by null transitions.  Every state in a chain
+ * can leave it with that chain's word, so each word exit is followed
+ * by a walk down the whole next chain.
+ */
+static fsg_model_t *
+build_chain_fsg(logmath_t *lmath, int32 null_lp)
+{
+	static char const *words[] = { "go", "forward", "ten", "meters" };
+	fsg_model_t *fsg;
+	int32 i, j;
+
+	fsg = fsg_model_init("chain", lmath, 1.0, 4 * SEG_LEN + 1);
+	fsg->start_state = 0;
+	fsg->final_state = 4 * SEG_LEN;
+	for (i = 0; i < 4; ++i) {
+		int32 wid = fsg_model_word_add(fsg, words[i]);
+
+		for (j = 0; j < SEG_LEN; ++j) {
+			int32 s = i * SEG_LEN + j;
+
+			if (j < SEG_LEN - 1)
+				fsg_model_null_trans_add(fsg, s, s + 1, null_lp);
+			fsg_model_trans_add(fsg, s, (i + 1) * SEG_LEN, 0, wid);
+		}
+	}
+	return fsg;
+}
+
+static void
+time_decode(ps_decoder_t *ps, char const *name)
+{
+	FILE *rawfh;
+	char const *hyp, *uttid;
+	int32 score;
+	clock_t c;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+	c = clock();
+	TEST_ASSERT(ps_decode_raw(ps, rawfh, name, -1) > 0);
+	c = clock() - c;
+	fclose(rawfh);
+	hyp = ps_get_hyp(ps, &score, &uttid);
+	printf("%s: %s (%d)\n", uttid, hyp, score);
+	printf("%s: %.3f msec/frame\n", name,
+	       (double)c * 1000 / CLOCKS_PER_SEC / ps_get_n_frames(ps));
+	TEST_EQUAL(0, strcmp("go forward ten meters", hyp));
+}
+
+int
+main(int argc, char *argv[])
+{
+	ps_decoder_t *ps;
+	cmd_ln_t *config;
+	fsg_set_t *fsgset;
+	fsg_search_t *fsgs;
+	fsg_model_t *fsg;
+	fsg_lextree_t *lextree;
+	fsg_link_t *link;
+	int32 null_lp;
+	int i, n_null;
+
+	/* Leave the null transitions in, so the search has to follow
+	 * them. */
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en_US/hub4wsj_sc_8k",
+				"-dict", MODELDIR "/lm/en/turtle.dic",
+				"-jsgf", DATADIR "/goforward.gram",
+				"-fsgopt", "no",
+				"-input_endian", "little",
+				"-samprate", "16000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+	setbuf(stdout, NULL);
+	time_decode(ps, "goforward.gram");
+
+	/* Deep null chains. */
+	null_lp = logmath_log(ps_get_logmath(ps), 0.99);
+	TEST_ASSERT(fsgset = ps_get_fsgset(ps));
+	fsg = build_chain_fsg(ps_get_logmath(ps), null_lp);
+	TEST_ASSERT(fsg_set_add(fsgset, "chain", fsg) == fsg);
+	TEST_ASSERT(fsg_set_select(fsgset, "chain") == fsg);
+	TEST_ASSERT(ps_update_fsgset(ps));
+	fsgs = (fsg_search_t *)ps->search;
+	TEST_ASSERT(lextree = fsgs->lextree);
+
+	/* The closure of the first state is the rest of its chain, with
+	 * the score of every null transition on the way. */
+	n_null = fsg_lextree_n_null(lextree, 0);
+	TEST_EQUAL(SEG_LEN - 1, n_null);
+	link = fsg_lextree_null(lextree, 0);
+	for (i = 0; i < n_null; ++i, ++link) {
+		int32 d = fsg_link_to_state(link);
+
+		TEST_ASSERT(d > 0 && d < SEG_LEN);
+		TEST_EQUAL(d * null_lp, fsg_link_logs2prob(link));
+	}
+	time_decode(ps, "chain");
+
+	ps_free(ps);
+	cmd_ln_free_r(config);
+	return 0;
+}
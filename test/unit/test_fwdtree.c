@@ -66,6 +66,139 @@ main(int argc, char *argv[])
 	c = clock() - c;
 	printf("5 * fwdtree search in %.2f sec\n",
 	       (double)c / CLOCKS_PER_SEC);
+
+	/* Frame skipping should evaluate fewer HMMs and still get the
+	 * right answer, including the frames left over at the end.  The
+	 * tradeoff is printed for each setting. */
+	{
+		FILE *rawfh;
+		char const *hyp;
+		int32 score, n_eval, n_eval1 = 0;
+		double nspeech, ncpu, nwall;
+		int skip;
+
+		for (skip = 1; skip <= 3; ++skip) {
+			cmd_ln_set_int32_r(config, "-fwdskip", skip);
+			TEST_EQUAL(0, ps_reinit(ps, config));
+			TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+			TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1) > 0);
+			fclose(rawfh);
+			ngs = (ngram_search_t *)ps->search;
+			TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+			ps_get_utt_time(ps, &nspeech, &ncpu, &nwall);
+			n_eval = ngs->st.n_root_chan_eval
+				+ ngs->st.n_nonroot_chan_eval;
+			printf("fwdskip %d: %s (%d), %d HMM evaluations, "
+			       "%.3f xRT\n", skip, hyp, score, n_eval,
+			       ncpu / nspeech);
+			TEST_EQUAL(0, ngs->n_pooled);
+			TEST_ASSERT(ngs->hmmctx->tp == ps->acmod->tmat->tp);
+			if (skip == 1)
+				n_eval1 = n_eval;
+			else
+				TEST_ASSERT(n_eval < n_eval1);
+			if (skip <= 2)
+				TEST_EQUAL(0, strcmp("go forward ten years", hyp));
+		}
+	}
+
+	/* An unreachable real-time target should narrow the beams. */
+	{
+		FILE *rawfh;
+		int32 beam;
+
+		cmd_ln_set_int32_r(config, "-fwdskip", 1);
+		cmd_ln_set_float32_r(config, "-rtf", 0.0001);
+		TEST_EQUAL(0, ps_reinit(ps, config));
+		beam = ((ngram_search_t *)ps->search)->beam;
+		TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+		TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1) > 0);
+		fclose(rawfh);
+		TEST_ASSERT(ps->beam_scale < 1.0f);
+		TEST_ASSERT(((ngram_search_t *)ps->search)->beam > beam);
+		/* Scaling starts from the configured beams every time. */
+		TEST_EQUAL(beam, ((ngram_search_t *)ps->search)->beam_orig);
+	}
+
+	/* Absolute pruning should hold in every frame, and still produce
+	 * a result. */
+	{
+		FILE *rawfh;
+		int16 buf[2048];
+		size_t nread;
+		int16 const *bptr;
+		uint8 *root_active;
+		char const *hyp;
+		int32 max_kept, max_exits;
+
+		cmd_ln_set_float32_r(config, "-rtf", 0);
+		cmd_ln_set_int32_r(config, "-maxhmmpf", 1000);
+		cmd_ln_set_int32_r(config, "-maxwpf", 5);
+		TEST_EQUAL(0, ps_reinit(ps, config));
+		ngs = (ngram_search_t *)ps->search;
+		acmod = ps->acmod;
+		root_active = ckd_calloc(ngs->n_root_chan, 1);
+		max_kept = max_exits = 0;
+
+		TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+		TEST_EQUAL(0, acmod_start_utt(acmod));
+		ngram_fwdtree_start(ngs);
+		while (!feof(rawfh)) {
+			nread = fread(buf, sizeof(*buf), 2048, rawfh);
+			bptr = buf;
+			while (acmod_process_raw(acmod, &bptr, &nread, FALSE) > 0) {
+				while (acmod->n_feat_frame > 0) {
+					int frame_idx = acmod->output_frame;
+					int32 thresh, n, bp;
+
+					/* Remember which root channels are
+					 * evaluated in this frame, since word
+					 * transitions enter new ones. */
+					for (i = 0; i < ngs->n_root_chan; ++i)
+						root_active[i] = (hmm_frame(&ngs->root_chan[i].hmm)
+								  == frame_idx);
+					ngram_fwdtree_search(ngs, frame_idx);
+					acmod_advance(acmod);
+
+					/* Count the tree HMMs kept for the
+					 * next frame by pruning. */
+					thresh = ngs->best_score + ngs->dynamic_beam;
+					n = 0;
+					for (i = 0; i < ngs->n_root_chan; ++i)
+						if (root_active[i]
+						    && hmm_bestscore(&ngs->root_chan[i].hmm)
+						    BETTER_THAN thresh)
+							++n;
+					for (i = 0; i < ngs->n_active_chan[frame_idx & 0x1]; ++i)
+						if (hmm_bestscore(&ngs->active_chan_list
+								  [frame_idx & 0x1][i]->hmm)
+						    BETTER_THAN thresh)
+							++n;
+					TEST_ASSERT(n <= 1000);
+					if (n > max_kept)
+						max_kept = n;
+
+					/* Count the word exits which survived. */
+					n = 0;
+					for (bp = ngs->bp_table_idx[frame_idx];
+					     bp < ngs->bpidx; ++bp)
+						if (ngs->bp_table[bp].valid)
+							++n;
+					TEST_ASSERT(n <= 5);
+					if (n > max_exits)
+						max_exits = n;
+				}
+			}
+		}
+		ngram_fwdtree_finish(ngs);
+		TEST_ASSERT(acmod_end_utt(acmod) >= 0);
+		fclose(rawfh);
+		hyp = ngram_search_bp_hyp(ngs, ngram_search_find_exit(ngs, -1, NULL, NULL));
+		TEST_ASSERT(hyp);
+		printf("maxhmmpf 1000 maxwpf 5: %s (at most %d HMMs, %d words/frame)\n",
+		       hyp, max_kept, max_exits);
+		ckd_free(root_active);
+	}
 	ps_free(ps);
 	cmd_ln_free_r(config);
 
@@ -3,6 +3,8 @@
 #include <string.h>
 #include <time.h>
 
+#include <sphinxbase/profile.h>
+
 #include "pocketsphinx_internal.h"
 #include "ngram_search_fwdtree.h"
 #include "ngram_search_fwdflat.h"
@@ -88,6 +90,104 @@ main(int argc, char *argv[])
 	c = clock() - c;
 	printf("5 * fwdtree + fwdflat search in %.2f sec\n",
 	       (double)c / CLOCKS_PER_SEC);
+
+	/* Running fwdflat behind fwdtree should give the same result as
+	 * running it after the utterance, as long as no word is active
+	 * for longer than the lag. */
+	{
+		FILE *rawfh;
+		char const *hyp;
+		char *hyp1;
+		int32 score, score1;
+
+		TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+		TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1) > 0);
+		fclose(rawfh);
+		TEST_ASSERT(hyp = ps_get_hyp(ps, &score1, NULL));
+		hyp1 = ckd_salloc(hyp);
+
+		cmd_ln_set_int32_r(config, "-fwdflatlag", 200);
+		TEST_EQUAL(0, ps_reinit(ps, config));
+		TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+		TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1) > 0);
+		fclose(rawfh);
+		TEST_ASSERT(((ngram_search_t *)ps->search)->flat != NULL);
+		TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+		printf("FWDFLAT (lag 200): %s (%d, batch %d)\n", hyp, score, score1);
+		TEST_EQUAL(0, strcmp(hyp1, hyp));
+		TEST_EQUAL(score1, score);
+		ckd_free(hyp1);
+	}
+
+	/* Live input only keeps the features for the lag, which have to
+	 * be enough for fwdflat to score its frames. */
+	{
+		FILE *rawfh;
+		int16 *buf;
+		size_t nsamps, j;
+		char const *hyp;
+		int32 score;
+
+		cmd_ln_set_int32_r(config, "-fwdflatlag", 40);
+		TEST_EQUAL(0, ps_reinit(ps, config));
+		TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+		fseek(rawfh, 0, SEEK_END);
+		nsamps = ftell(rawfh) / sizeof(*buf);
+		fseek(rawfh, 0, SEEK_SET);
+		buf = ckd_calloc(nsamps, sizeof(*buf));
+		TEST_EQUAL(nsamps, fread(buf, sizeof(*buf), nsamps, rawfh));
+		fclose(rawfh);
+		TEST_EQUAL(0, ps_start_utt(ps, "goforward"));
+		for (j = 0; j < nsamps; j += 256)
+			TEST_ASSERT(ps_process_raw(ps, buf + j,
+						   (nsamps - j < 256) ? nsamps - j : 256,
+						   FALSE, FALSE) >= 0);
+		TEST_EQUAL(0, ps_end_utt(ps));
+		TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+		printf("FWDFLAT (lag 40, live): %s\n", hyp);
+		TEST_EQUAL(0, strcmp("go forward ten years", hyp));
+		ckd_free(buf);
+	}
+
+	/* And so should running it on its own thread. */
+	{
+		FILE *rawfh;
+		char const *hyp;
+		int32 score;
+
+		cmd_ln_set_boolean_r(config, "-fwdflatthread", TRUE);
+		TEST_EQUAL(0, ps_reinit(ps, config));
+		TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+		TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1) > 0);
+		fclose(rawfh);
+		TEST_ASSERT(((ngram_search_t *)ps->search)->flat_thread != NULL);
+		TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+		printf("FWDFLAT (lag 40, thread): %s\n", hyp);
+		TEST_EQUAL(0, strcmp("go forward ten years", hyp));
+	}
+	/* Compare wall-clock and CPU time for fwdflat after the
+	 * utterance, behind fwdtree, and behind it on a thread. */
+	for (i = 0; i < 3; ++i) {
+		static char const *names[] = { "batch", "lag 40", "lag 40, thread" };
+		ptmr_t tm;
+		int j;
+
+		cmd_ln_set_int32_r(config, "-fwdflatlag", i ? 40 : 0);
+		cmd_ln_set_boolean_r(config, "-fwdflatthread", i == 2);
+		TEST_EQUAL(0, ps_reinit(ps, config));
+		ptmr_init(&tm);
+		ptmr_start(&tm);
+		for (j = 0; j < 5; ++j) {
+			FILE *rawfh;
+
+			TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+			TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1) > 0);
+			fclose(rawfh);
+		}
+		ptmr_stop(&tm);
+		printf("5 * fwdtree + fwdflat (%s): %.2f sec wall, %.2f sec CPU\n",
+		       names[i], tm.t_elapsed, tm.t_cpu);
+	}
 	ps_free(ps);
 	cmd_ln_free_r(config);
 
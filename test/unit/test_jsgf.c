@@ -19,14 +19,15 @@ main(int argc, char *argv[])
 	fsg_search_t *fsgs;
 	jsgf_t *jsgf;
 	jsgf_rule_t *rule;
-	fsg_model_t *fsg;
+	fsg_model_t *fsg, *fsg2;
+	fsg_lextree_t *lextree;
 	ps_seg_t *seg;
 	ps_lattice_t *dag;
 	FILE *rawfh;
 	char const *hyp, *uttid;
 	int32 score, prob;
 	clock_t c;
-	int i;
+	int i, n_state;
 
 	TEST_ASSERT(config =
 		    cmd_ln_init(NULL, ps_args(), TRUE,
@@ -45,9 +46,49 @@ main(int argc, char *argv[])
 	fsg = jsgf_build_fsg(jsgf, rule, ps->lmath, 7.5);
 	TEST_ASSERT(fsg);
 	fsg_model_write(fsg, stdout);
+	n_state = fsg_model_n_state(fsg);
 	TEST_ASSERT(fsg_set_add(fsgs, "<goforward.move2>", fsg));
+	/* Null transitions are removed, except into the final state. */
+	TEST_ASSERT(fsg_model_n_state(fsg) < n_state);
+	for (i = 0; i < fsg_model_n_state(fsg); ++i) {
+		fsg_arciter_t *itor;
+		for (itor = fsg_model_arcs(fsg, i); itor;
+		     itor = fsg_arciter_next(itor)) {
+			fsg_link_t *link = fsg_arciter_get(itor);
+			if (fsg_link_wid(link) < 0)
+				TEST_EQUAL(fsg_model_final_state(fsg),
+					   fsg_link_to_state(link));
+		}
+	}
+	TEST_ASSERT(fsg_set_select(fsgs, "<goforward.move2>"));
+	fsg_search_reinit(ps_search_base(fsgs), ps->dict, ps->d2p);
+
+	/* Switching to another grammar and back reuses the lextree. */
+	lextree = fsgs->lextree;
+	TEST_ASSERT(lextree);
+	/* Null closure only holds real null paths out of each state. */
+	for (i = 0; i < fsg_model_n_state(fsg); ++i) {
+		fsg_link_t *link = fsg_lextree_null(lextree, i);
+		int j;
+		for (j = 0; j < fsg_lextree_n_null(lextree, i); ++j, ++link) {
+			TEST_EQUAL(-1, fsg_link_wid(link));
+			TEST_EQUAL(i, fsg_link_from_state(link));
+			TEST_ASSERT(fsg_link_to_state(link) != i);
+		}
+	}
+	rule = jsgf_get_rule(jsgf, "<goforward.move>");
+	TEST_ASSERT(rule);
+	fsg2 = jsgf_build_fsg(jsgf, rule, ps->lmath, 7.5);
+	TEST_ASSERT(fsg_set_add(fsgs, "<goforward.move>", fsg2));
+	TEST_ASSERT(fsg_set_select(fsgs, "<goforward.move>"));
+	fsg_search_reinit(ps_search_base(fsgs), ps->dict, ps->d2p);
+	TEST_ASSERT(fsgs->lextree != lextree);
 	TEST_ASSERT(fsg_set_select(fsgs, "<goforward.move2>"));
 	fsg_search_reinit(ps_search_base(fsgs), ps->dict, ps->d2p);
+	TEST_ASSERT(fsgs->lextree == lextree);
+	TEST_ASSERT(fsg2 == fsg_set_remove_byname(fsgs, "<goforward.move>"));
+	fsg_model_free(fsg2);
+	TEST_ASSERT(fsgs->lextree == lextree);
 
 	setbuf(stdout, NULL);
 	c = clock();
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "pocketsphinx_internal.h"
+#include "ngram_search.h"
 #include "test_macros.h"
 
 int
@@ -67,6 +69,24 @@ main(int argc, char *argv[])
 	/* Bingo! */
 	TEST_EQUAL(0, strcmp(hyp, "go forward ten meters"));
 
+	/* A word added on its own goes straight into the existing
+	 * search tree.  A rebuild would reinitialize the root channels,
+	 * so mark one and check that it survives. */
+	{
+		ngram_search_t *ngs = (ngram_search_t *)ps->search;
+
+		ngs->root_chan[0].hmm.bestscore = 42;
+		TEST_ASSERT(ps_add_word(ps, "snoofy", "S N UW F IY", TRUE) > 0);
+		TEST_EQUAL(42, ngs->root_chan[0].hmm.bestscore);
+		ngs->root_chan[0].hmm.bestscore = WORST_SCORE;
+	}
+	clearerr(rawfh);
+	fseek(rawfh, 0, SEEK_SET);
+	TEST_ASSERT(ps_decode_raw(ps, rawfh, "goforward", -1));
+	hyp = ps_get_hyp(ps, &score, &uttid);
+	printf("%s: %s (%d)\n", uttid, hyp, score);
+	TEST_EQUAL(0, strcmp(hyp, "go forward ten meters"));
+
 	/* Now let's test dictionary switching. */
 	TEST_EQUAL(-1, ps_load_dict(ps, MODELDIR "/lm/en/turtle_missing_file.dic",
 				   NULL, NULL));
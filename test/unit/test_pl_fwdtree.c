@@ -4,8 +4,52 @@
 #include <time.h>
 
 #include "pocketsphinx_internal.h"
+#include "phone_loop_search.h"
+#include "ngram_search.h"
 #include "test_macros.h"
 
+/* Returns the number of HMMs evaluated by the tree search. */
+static int32
+decode_utt(acmod_t *acmod, ps_search_t *ngs, ps_search_t *pls)
+{
+	FILE *rawfh;
+	int16 buf[2048];
+	size_t nread;
+	int16 const *bptr;
+	int nfr, n_searchfr;
+	int32 score;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+	TEST_EQUAL(0, acmod_start_utt(acmod));
+	ps_search_start(ngs);
+	ps_search_start(pls);
+	n_searchfr = 0;
+	while (!feof(rawfh)) {
+		nread = fread(buf, sizeof(*buf), 2048, rawfh);
+		bptr = buf;
+		while ((nfr = acmod_process_raw(acmod, &bptr, &nread, FALSE)) > 0) {
+			while (acmod->n_feat_frame > 0) {
+				ps_search_step(pls, n_searchfr);
+				if (n_searchfr >= 6)
+					ps_search_step(ngs, n_searchfr - 6);
+				acmod_advance(acmod);
+				++n_searchfr;
+			}
+		}
+	}
+	for (nfr = n_searchfr - 6; nfr < n_searchfr; ++nfr) {
+		ps_search_step(ngs, nfr);
+	}
+	ps_search_finish(pls);
+	ps_search_finish(ngs);
+	printf("%s\n", ps_search_hyp(ngs, &score, NULL));
+
+	TEST_ASSERT(acmod_end_utt(acmod) >= 0);
+	fclose(rawfh);
+	return ((ngram_search_t *)ngs)->st.n_root_chan_eval
+		+ ((ngram_search_t *)ngs)->st.n_nonroot_chan_eval;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -14,7 +58,7 @@ main(int argc, char *argv[])
 	acmod_t *acmod;
 	ps_search_t *ngs, *pls;
 	clock_t c;
-	int32 score;
+	int32 score, n_eval, n_pair_eval;
 	int i;
 
 	TEST_ASSERT(config =
@@ -36,46 +80,21 @@ main(int argc, char *argv[])
 
 	setbuf(stdout, NULL);
 	c = clock();
-	for (i = 0; i < 5; ++i) {
-		FILE *rawfh;
-		int16 buf[2048];
-		size_t nread;
-		int16 const *bptr;
-		int nfr, n_searchfr;
-
-		TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
-		TEST_EQUAL(0, acmod_start_utt(acmod));
-		ps_search_start(ngs);
-		ps_search_start(pls);
-		n_searchfr = 0;
-		while (!feof(rawfh)) {
-			nread = fread(buf, sizeof(*buf), 2048, rawfh);
-			bptr = buf;
-			while ((nfr = acmod_process_raw(acmod, &bptr, &nread, FALSE)) > 0) {
-				while (acmod->n_feat_frame > 0) {
-					ps_search_step(pls, n_searchfr);
-					if (n_searchfr >= 6)
-						ps_search_step(ngs, n_searchfr - 6);
-					acmod_advance(acmod);
-					++n_searchfr;
-				}
-			}
-		}
-		for (nfr = n_searchfr - 6; nfr < n_searchfr; ++nfr) {
-			ps_search_step(ngs, nfr);
-		}
-		ps_search_finish(pls);
-		ps_search_finish(ngs);
-		printf("%s\n", ps_search_hyp(ngs, &score, NULL));
-
-		TEST_ASSERT(acmod_end_utt(acmod) >= 0);
-		fclose(rawfh);
-	}
+	for (i = 0; i < 5; ++i)
+		n_eval = decode_utt(acmod, ngs, pls);
 	printf("%s\n", ps_search_hyp(ngs, &score, NULL));
 	TEST_EQUAL(0, strcmp("go forward ten years", ps_search_hyp(ngs, &score, NULL)));
 	c = clock() - c;
 	printf("5 * fwdtree search in %.2f sec\n",
 	       (double)c / CLOCKS_PER_SEC);
+
+	/* Phone-pair bounds should not change the result, but should
+	 * let fewer HMMs through. */
+	((phone_loop_search_t *)pls)->pair = TRUE;
+	n_pair_eval = decode_utt(acmod, ngs, pls);
+	TEST_EQUAL(0, strcmp("go forward ten years", ps_search_hyp(ngs, &score, NULL)));
+	printf("%d HMMs evaluated, %d with -pl_pair\n", n_eval, n_pair_eval);
+	TEST_ASSERT(n_pair_eval < n_eval);
 	ps_free(ps);
 	cmd_ln_free_r(config);
 
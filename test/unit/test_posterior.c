@@ -110,6 +110,17 @@ test_decode(ps_decoder_t *ps)
 	printf("Best path score: %d\n",
 	       link->path_scr + dag->final_node_ascr);
 	printf("P(S|O) = %d\n", post);
+	/* A second call should reuse the cached betas. */
+	TEST_ASSERT(dag->post_valid);
+	TEST_EQUAL(post, ps_lattice_posterior(dag, ngs->lmset, 1.0/20.0));
+	/* Verify that the cached link ordering is topological. */
+	TEST_ASSERT(dag->link_order);
+	for (i = 0; i < dag->n_link_order; ++i)
+		dag->link_order[i]->path_scr = i;
+	for (i = 0; i < dag->n_link_order; ++i) {
+		for (x = dag->link_order[i]->from->entries; x; x = x->next)
+			TEST_ASSERT(x->link->path_scr < i);
+	}
 
 	/* Verify that sum of final alphas and initial alphas+betas is
 	 * sufficiently similar. */
@@ -92,6 +92,25 @@ test_remaining_nodes(ps_lattice_t *dag) {
 }
 
 
+static int
+count_nodes_and_links(ps_lattice_t *dag, int *out_n_links)
+{
+	ps_latnode_iter_t *itor;
+	ps_latlink_iter_t *litor;
+	int count, lcount;
+
+	count = lcount = 0;
+	for (itor = ps_latnode_iter(dag); itor; itor = ps_latnode_iter_next(itor)) {
+		ps_latnode_t *node = ps_latnode_iter_node(itor);
+		for (litor = ps_latnode_exits(node);
+		     litor; litor = ps_latlink_iter_next(litor))
+			lcount++;
+		count++;
+	}
+	*out_n_links = lcount;
+	return count;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -102,6 +121,7 @@ main(int argc, char *argv[])
 	char const *hyp;
 	char const *uttid;
 	int32 score;
+	int n_nodes, n_links, bin_n_links;
 
 	TEST_ASSERT(config =
 		    cmd_ln_init(NULL, ps_args(), TRUE,
@@ -128,6 +148,7 @@ main(int argc, char *argv[])
 	test_nodes_and_stuff(dag);
 
 	TEST_EQUAL(0, ps_lattice_write(dag, "goforward.lat"));
+	TEST_EQUAL(0, ps_lattice_write_bin(dag, "goforward.latbin"));
 
 	dag = ps_lattice_read(ps, "goforward.lat");
 	TEST_ASSERT(dag);
@@ -136,6 +157,14 @@ main(int argc, char *argv[])
 	printf("P(S|O) = %d\n", score);
 	test_nodes_and_stuff(dag);
 	ps_lattice_free(dag);
+
+	dag = ps_lattice_read(ps, "goforward.latbin");
+	TEST_ASSERT(dag);
+	TEST_ASSERT(ps_lattice_bestpath(dag, ps_get_lmset(ps), 1.0, 1.0/15.0));
+	score = ps_lattice_posterior(dag, ps_get_lmset(ps), 1.0/15.0);
+	printf("P(S|O) = %d\n", score);
+	test_nodes_and_stuff(dag);
+	ps_lattice_free(dag);
 	ps_free(ps);
 	cmd_ln_free_r(config);
 
@@ -144,6 +173,18 @@ main(int argc, char *argv[])
 	TEST_ASSERT(dag);
 	test_nodes_and_stuff(dag);
 	ps_lattice_free(dag);
+	dag = ps_lattice_read(NULL, "goforward.latbin");
+	TEST_ASSERT(dag);
+	test_nodes_and_stuff(dag);
+	n_nodes = count_nodes_and_links(dag, &n_links);
+	/* Binary lattices should survive a round trip unchanged. */
+	TEST_EQUAL(0, ps_lattice_write_bin(dag, "goforward2.latbin"));
+	ps_lattice_free(dag);
+	dag = ps_lattice_read(NULL, "goforward2.latbin");
+	TEST_ASSERT(dag);
+	TEST_EQUAL(n_nodes, count_nodes_and_links(dag, &bin_n_links));
+	TEST_EQUAL(n_links, bin_n_links);
+	ps_lattice_free(dag);
 
 	/* Test stripping the unreachable nodes. */
 	dag = ps_lattice_read(NULL, DATADIR "/unreachable.lat");
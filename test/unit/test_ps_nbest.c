@@ -16,6 +16,7 @@ main(int argc, char *argv[])
 	char const *hyp;
 	char const *uttid;
 	int32 score, n;
+	char const *hyps[10];
 
 	TEST_ASSERT(config =
 		    cmd_ln_init(NULL, ps_args(), TRUE,
@@ -52,6 +53,26 @@ main(int argc, char *argv[])
 			break;
 		++n;
 	}
+	if (nbest)
+	    ps_nbest_free(nbest);
+
+	/* Now with duplicate suppression and a small open list. */
+	cmd_ln_set_boolean_r(config, "-nbestuniq", TRUE);
+	cmd_ln_set_int32_r(config, "-nbestmaxpath", 50);
+	TEST_ASSERT(nbest = ps_nbest(ps, 0, -1, NULL, NULL));
+	n = 0;
+	while (nbest && (nbest = ps_nbest_next(nbest))) {
+		int i;
+		hyp = ps_nbest_hyp(nbest, &score);
+		printf("UNIQ NBEST %d: %s (%d)\n", n + 1, hyp, score);
+		for (i = 0; i < n; ++i)
+			TEST_ASSERT(hyp != hyps[i]
+				    && (hyp == NULL || hyps[i] == NULL
+					|| 0 != strcmp(hyps[i], hyp)));
+		hyps[n] = hyp;
+		if (++n == 10)
+			break;
+	}
 	if (nbest)
 	    ps_nbest_free(nbest);
 	ps_free(ps);
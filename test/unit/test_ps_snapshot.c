@@ -0,0 +1,127 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "test_macros.h"
+
+#define CHUNK 10
+
+int
+main(int argc, char *argv[])
+{
+	ps_decoder_t *ps, *ps2;
+	cmd_ln_t *config;
+	mfcc_t **cepbuf;
+	FILE *rawfh, *snapfh;
+	int16 *buf;
+	int16 const *bptr;
+	size_t nsamps;
+	int32 nfr, i, half, score, score2;
+	char const *hyp;
+	char *hyp1;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en_US/hub4wsj_sc_8k",
+				"-lm", MODELDIR "/lm/en_US/wsj0vp.5000.DMP",
+				"-dict", MODELDIR "/lm/en_US/cmu07a.dic",
+				"-fwdtree", "yes",
+				"-fwdflat", "yes",
+				"-bestpath", "no",
+				"-input_endian", "little",
+				"-samprate", "16000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+
+	/* Compute cepstra for the whole file. */
+	TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	nsamps = ftell(rawfh) / sizeof(*buf);
+	fseek(rawfh, 0, SEEK_SET);
+	bptr = buf = ckd_calloc(nsamps, sizeof(*buf));
+	TEST_EQUAL(nsamps, fread(buf, sizeof(*buf), nsamps, rawfh));
+	fclose(rawfh);
+	fe_process_frames(ps->acmod->fe, &bptr, &nsamps, NULL, &nfr);
+	cepbuf = ckd_calloc_2d(nfr + 1,
+			       fe_get_output_size(ps->acmod->fe),
+			       sizeof(**cepbuf));
+	fe_start_utt(ps->acmod->fe);
+	fe_process_frames(ps->acmod->fe, &bptr, &nsamps, cepbuf, &nfr);
+	fe_end_utt(ps->acmod->fe, cepbuf[nfr], &i);
+	nfr += i;
+
+	/* Decode it, taking a snapshot half way through. */
+	TEST_ASSERT(snapfh = tmpfile());
+	half = nfr / 2 / CHUNK * CHUNK;
+	TEST_EQUAL(0, ps_start_utt(ps, "snapshot"));
+	for (i = 0; i < nfr; i += CHUNK) {
+		if (i == half)
+			TEST_EQUAL(0, ps_snapshot(ps, snapfh));
+		ps_process_cep(ps, cepbuf + i,
+			       (nfr - i < CHUNK) ? nfr - i : CHUNK,
+			       FALSE, FALSE);
+	}
+	TEST_EQUAL(0, ps_end_utt(ps));
+	TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+	printf("uninterrupted: %s (%d)\n", hyp, score);
+	hyp1 = ckd_salloc(hyp);
+
+	/* Restoring it into a new decoder and decoding the rest should
+	 * give the same result. */
+	TEST_ASSERT(ps2 = ps_init(config));
+	rewind(snapfh);
+	TEST_EQUAL(0, ps_restore(ps2, snapfh));
+	TEST_EQUAL(0, strcmp("snapshot", ps_get_uttid(ps2)));
+	for (i = half; i < nfr; i += CHUNK)
+		ps_process_cep(ps2, cepbuf + i,
+			       (nfr - i < CHUNK) ? nfr - i : CHUNK,
+			       FALSE, FALSE);
+	TEST_EQUAL(0, ps_end_utt(ps2));
+	TEST_ASSERT(hyp = ps_get_hyp(ps2, &score2, NULL));
+	printf("restored: %s (%d)\n", hyp, score2);
+	TEST_EQUAL(0, strcmp(hyp1, hyp));
+	TEST_EQUAL(score, score2);
+	fclose(snapfh);
+	ckd_free(hyp1);
+
+	/* The same goes for an utterance processed all at once. */
+	TEST_ASSERT(snapfh = tmpfile());
+	TEST_EQUAL(0, ps_start_utt(ps, "full"));
+	TEST_ASSERT(ps_process_cep(ps, cepbuf, nfr, FALSE, TRUE) > 0);
+	TEST_EQUAL(0, ps_snapshot(ps, snapfh));
+	TEST_EQUAL(0, ps_end_utt(ps));
+	TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+	printf("full: %s (%d)\n", hyp, score);
+	hyp1 = ckd_salloc(hyp);
+	rewind(snapfh);
+	TEST_EQUAL(0, ps_restore(ps2, snapfh));
+	TEST_EQUAL(0, ps_end_utt(ps2));
+	TEST_ASSERT(hyp = ps_get_hyp(ps2, &score2, NULL));
+	printf("full, restored: %s (%d)\n", hyp, score2);
+	TEST_EQUAL(0, strcmp(hyp1, hyp));
+	TEST_EQUAL(score, score2);
+	fclose(snapfh);
+	ps_free(ps2);
+
+	/* Between utterances, the CMN estimate is carried over. */
+	{
+		mfcc_t mean[13];
+
+		TEST_ASSERT(snapfh = tmpfile());
+		TEST_EQUAL(0, ps_snapshot(ps, snapfh));
+		memcpy(mean, ps->acmod->fcb->cmn_struct->cmn_mean, sizeof(mean));
+		memset(ps->acmod->fcb->cmn_struct->cmn_mean, 0, sizeof(mean));
+		rewind(snapfh);
+		TEST_EQUAL(0, ps_restore(ps, snapfh));
+		TEST_EQUAL(0, memcmp(mean, ps->acmod->fcb->cmn_struct->cmn_mean,
+				     sizeof(mean)));
+		fclose(snapfh);
+	}
+
+	ckd_free(hyp1);
+	ckd_free_2d(cepbuf);
+	ckd_free(buf);
+	ps_free(ps);
+	cmd_ln_free_r(config);
+	return 0;
+}
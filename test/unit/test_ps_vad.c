@@ -0,0 +1,138 @@
+#include <pocketsphinx.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocketsphinx_internal.h"
+#include "test_macros.h"
+
+/* One second of quiet noise at 16kHz. */
+#define NSIL 16000
+
+static int16 *
+read_padded(size_t *out_nsamps)
+{
+	FILE *rawfh;
+	int16 *buf;
+	size_t nsamps;
+	uint32 seed = 1;
+	size_t i;
+
+	TEST_ASSERT(rawfh = fopen(DATADIR "/goforward.raw", "rb"));
+	fseek(rawfh, 0, SEEK_END);
+	nsamps = ftell(rawfh) / sizeof(*buf);
+	fseek(rawfh, 0, SEEK_SET);
+	buf = ckd_calloc(nsamps + 2 * NSIL, sizeof(*buf));
+	TEST_EQUAL(nsamps, fread(buf + NSIL, sizeof(*buf), nsamps, rawfh));
+	fclose(rawfh);
+	*out_nsamps = nsamps + 2 * NSIL;
+	for (i = 0; i < *out_nsamps; ++i) {
+		if (i >= NSIL && i < NSIL + nsamps)
+			continue;
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (int16)((seed >> 16) % 17) - 8;
+	}
+	return buf;
+}
+
+int
+main(int argc, char *argv[])
+{
+	ps_decoder_t *ps;
+	cmd_ln_t *config;
+	int16 *buf;
+	size_t nsamps, i;
+	int j;
+	char const *hyp;
+	int32 score;
+	ps_seg_t *seg;
+
+	TEST_ASSERT(config =
+		    cmd_ln_init(NULL, ps_args(), TRUE,
+				"-hmm", MODELDIR "/hmm/en_US/hub4wsj_sc_8k",
+				"-lm", MODELDIR "/lm/en_US/wsj0vp.5000.DMP",
+				"-dict", MODELDIR "/lm/en_US/cmu07a.dic",
+				"-fwdtree", "yes",
+				"-fwdflat", "yes",
+				"-bestpath", "no",
+				"-vad", "yes",
+				"-input_endian", "little",
+				"-samprate", "16000", NULL));
+	TEST_ASSERT(ps = ps_init(config));
+	buf = read_padded(&nsamps);
+
+	/* The endpointer should follow the speech, and the main search
+	 * should only see the frames from its start.  Five seconds of
+	 * silence are dropped as they come, so buffers stay small while
+	 * waiting for speech, and fwdflat has to rewind to the frame
+	 * where speech starts. */
+	TEST_EQUAL(0, ps_start_utt(ps, "vad"));
+	for (j = 0; j < 5; ++j)
+		for (i = 0; i < NSIL; i += 256)
+			TEST_ASSERT(ps_process_raw(ps, buf + i,
+						   (NSIL - i < 256) ? NSIL - i : 256,
+						   FALSE, FALSE) >= 0);
+	TEST_EQUAL(PS_VAD_SILENCE, ps_get_vad_state(ps));
+	TEST_ASSERT(ps_get_vad_offset(ps) > 450);
+	TEST_ASSERT(ps->acmod->n_feat_alloc < ps_get_vad_offset(ps));
+	TEST_ASSERT(ps->acmod->n_energy_alloc < ps_get_vad_offset(ps));
+	for (i = NSIL; i + 256 <= nsamps - NSIL; i += 256)
+		TEST_ASSERT(ps_process_raw(ps, buf + i, 256, FALSE, FALSE) >= 0);
+	TEST_ASSERT(ps_get_vad_state(ps) != PS_VAD_SILENCE);
+	for (; i < nsamps; i += 256)
+		TEST_ASSERT(ps_process_raw(ps, buf + i,
+					   (nsamps - i < 256) ? nsamps - i : 256,
+					   FALSE, FALSE) >= 0);
+	TEST_EQUAL(PS_VAD_ENDED, ps_get_vad_state(ps));
+	TEST_EQUAL(0, ps_end_utt(ps));
+	TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+	printf("vad: %s (%d, %d frames)\n", hyp, score, ps_get_n_frames(ps));
+	TEST_EQUAL(0, strcmp("go forward ten years", hyp));
+
+	/* With the offset added back, the words are where they are in the
+	 * audio, after five seconds (500 frames) of silence. */
+	for (seg = ps_seg_iter(ps, &score); seg; seg = ps_seg_next(seg)) {
+		int sf, ef;
+
+		ps_seg_frames(seg, &sf, &ef);
+		printf("%s %d %d\n", ps_seg_word(seg),
+		       sf + ps_get_vad_offset(ps), ef + ps_get_vad_offset(ps));
+		if (!strcmp(ps_seg_word(seg), "go"))
+			TEST_ASSERT(sf + ps_get_vad_offset(ps) >= 500);
+	}
+
+	/* The same goes for a whole utterance processed at once. */
+	TEST_EQUAL(0, ps_start_utt(ps, "vad_full"));
+	TEST_ASSERT(ps_process_raw(ps, buf, nsamps, FALSE, TRUE) > 0);
+	TEST_EQUAL(PS_VAD_ENDED, ps_get_vad_state(ps));
+	TEST_ASSERT(ps_get_vad_offset(ps) > 50);
+	TEST_EQUAL(0, ps_end_utt(ps));
+	TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+	printf("vad_full: %s (%d, %d frames)\n", hyp, score,
+	       ps_get_n_frames(ps));
+	TEST_EQUAL(0, strcmp("go forward ten years", hyp));
+
+	/* With -vad_autoend, the utterance ends by itself, and the rest
+	 * of the data is ignored. */
+	cmd_ln_set_boolean_r(config, "-vad_autoend", TRUE);
+	TEST_EQUAL(0, ps_reinit(ps, config));
+	TEST_EQUAL(0, ps_start_utt(ps, "vad_autoend"));
+	for (i = 0; i < nsamps; i += 256) {
+		TEST_ASSERT(ps_process_raw(ps, buf + i,
+					   (nsamps - i < 256) ? nsamps - i : 256,
+					   FALSE, FALSE) >= 0);
+		if (ps_get_vad_state(ps) == PS_VAD_ENDED)
+			break;
+	}
+	TEST_ASSERT(i < nsamps);
+	TEST_EQUAL(0, ps_process_raw(ps, buf + i, nsamps - i, FALSE, FALSE));
+	TEST_EQUAL(0, ps_end_utt(ps));
+	TEST_ASSERT(hyp = ps_get_hyp(ps, &score, NULL));
+	printf("vad_autoend: %s (%d, %d frames)\n", hyp, score,
+	       ps_get_n_frames(ps));
+	TEST_EQUAL(0, strcmp("go forward ten years", hyp));
+
+	ckd_free(buf);
+	ps_free(ps);
+	cmd_ln_free_r(config);
+	return 0;
+}
@@ -47,7 +47,8 @@ main(int argc, char *argv[])
 	ps_search_t *search;
 	state_align_search_t *sas;
 	cmd_ln_t *config;
-	int i;
+	int *starts, *durations;
+	int i, n_states;
 
 	config = cmd_ln_init(NULL, ps_args(), FALSE,
 			     "-hmm", MODELDIR "/hmm/en_US/hub4wsj_sc_8k",
@@ -96,6 +97,32 @@ main(int argc, char *argv[])
 	itor = ps_alignment_iter_next(itor);
 	TEST_EQUAL(itor, NULL);
 
+	/* Save the state alignment. */
+	n_states = ps_alignment_n_states(al);
+	starts = ckd_calloc(n_states, sizeof(*starts));
+	durations = ckd_calloc(n_states, sizeof(*durations));
+	for (i = 0, itor = ps_alignment_states(al); itor;
+	     ++i, itor = ps_alignment_iter_next(itor)) {
+		starts[i] = ps_alignment_iter_get(itor)->start;
+		durations[i] = ps_alignment_iter_get(itor)->duration;
+		ps_alignment_iter_get(itor)->start = -1;
+	}
+	ps_search_free(search);
+
+	/* Checkpointed alignment should give exactly the same result. */
+	cmd_ln_set_int32_r(config, "-aligncheckpoint", 16);
+	TEST_ASSERT(search = state_align_search_init(config, acmod, al));
+	for (i = 0; i < 5; ++i)
+		do_search(search, acmod);
+	for (i = 0, itor = ps_alignment_states(al); itor;
+	     ++i, itor = ps_alignment_iter_next(itor)) {
+		TEST_EQUAL(starts[i], ps_alignment_iter_get(itor)->start);
+		TEST_EQUAL(durations[i], ps_alignment_iter_get(itor)->duration);
+	}
+	TEST_EQUAL(i, n_states);
+	ckd_free(starts);
+	ckd_free(durations);
+
 	ps_search_free(search);
 	ps_alignment_free(al);
 	ps_free(ps);